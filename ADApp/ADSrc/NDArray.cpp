@@ -36,7 +36,8 @@ NDArray::NDArray()
   this->epicsTS.nsec = 0;
   memset(this->dims, 0, sizeof(this->dims));
   memset(&this->node, 0, sizeof(this->node));
-  this->pAttributeList = new NDAttributeList();
+  /* Arrays only hold passive copies of attributes so their lists can be shared copy-on-write */
+  this->pAttributeList = new NDAttributeList(true);
 }
 
 /** NDArray destructor 
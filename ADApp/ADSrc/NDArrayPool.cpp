@@ -204,8 +204,8 @@ NDArray* NDArrayPool::copy(NDArray *pIn, NDArray *pOut, int copyData)
     if (pOut->dataSize < numCopy) numCopy = pOut->dataSize;
     memcpy(pOut->pData, pIn->pData, numCopy);
   }
-  pOut->pAttributeList->clear();
-  pIn->pAttributeList->copy(pOut->pAttributeList);
+  /* The attributes of the output array are replaced, the ones it already has are reused */
+  pIn->pAttributeList->copy(pOut->pAttributeList, true);
   return(pOut);
 }
 
@@ -259,7 +259,10 @@ int NDArrayPool::release(NDArray *pArray)
   epicsMutexLock(listLock_);
   pArray->referenceCount--;
   if (pArray->referenceCount == 0) {
-    /* The last user has released this image, add it back to the free list */
+    /* The last user has released this image, add it back to the free list.
+     * Attributes shared with the copies of this array stay with the copies, so that
+     * the attributes of arrays on the free list are never shared. */
+    pArray->pAttributeList->dropShared();
     ellAdd(&freeList_, &pArray->node);
     numFree_++;
   }
@@ -588,13 +591,13 @@ int NDArrayPool::convert(NDArray *pIn,
 
   /* If the frame is an RGBx frame and we have collapsed that dimension then change the colorMode */
   pAttribute = pOut->pAttributeList->find("ColorMode");
+  /* The list may be shared with the input array, so the value is changed with add() rather
+   * than through the attribute itself */
   if (pAttribute && pAttribute->getValue(NDAttrInt32, &colorMode)) {
-    if      ((colorMode == NDColorModeRGB1) && (pOut->dims[0].size != 3)) 
-      pAttribute->setValue(&colorModeMono);
-    else if ((colorMode == NDColorModeRGB2) && (pOut->dims[1].size != 3)) 
-      pAttribute->setValue(&colorModeMono);
-    else if ((colorMode == NDColorModeRGB3) && (pOut->dims[2].size != 3))
-      pAttribute->setValue(&colorModeMono);
+    if (((colorMode == NDColorModeRGB1) && (pOut->dims[0].size != 3)) ||
+        ((colorMode == NDColorModeRGB2) && (pOut->dims[1].size != 3)) ||
+        ((colorMode == NDColorModeRGB3) && (pOut->dims[2].size != 3)))
+      pOut->pAttributeList->add("ColorMode", pAttribute->getDescription(), NDAttrInt32, &colorModeMono);
   }
   return ND_SUCCESS;
 }
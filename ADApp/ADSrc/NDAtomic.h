@@ -0,0 +1,99 @@
+/** NDAtomic.h
+ *
+ * Atomic integer operations and memory barriers used by the lock-free code in ADCore.
+ * With EPICS base 3.15 and later these are the functions in epicsAtomic.h, with
+ * EPICS base 3.14 they are the compiler intrinsics.
+ *
+ */
+
+#ifndef NDAtomic_H
+#define NDAtomic_H
+
+#include <stddef.h>
+
+#include <epicsVersion.h>
+
+#if (EPICS_VERSION > 3) || ((EPICS_VERSION == 3) && (EPICS_REVISION >= 15))
+  #define ND_EPICS_ATOMIC
+  #include <epicsAtomic.h>
+#elif defined(_MSC_VER)
+  #include <intrin.h>
+#elif !defined(__GNUC__)
+  #error "NDAtomic.h needs EPICS base 3.15 or later with this compiler"
+#endif
+
+/** Memory barrier; loads after the barrier are not done before loads before it */
+inline void ndReadBarrier()
+{
+#if defined(ND_EPICS_ATOMIC)
+  epicsAtomicReadMemoryBarrier();
+#elif defined(_MSC_VER)
+  /* x86 and x64 do not reorder loads with other loads, so only the compiler must be stopped */
+  _ReadWriteBarrier();
+#else
+  __sync_synchronize();
+#endif
+}
+
+/** Memory barrier; stores after the barrier are not done before stores before it */
+inline void ndWriteBarrier()
+{
+#if defined(ND_EPICS_ATOMIC)
+  epicsAtomicWriteMemoryBarrier();
+#elif defined(_MSC_VER)
+  _ReadWriteBarrier();
+#else
+  __sync_synchronize();
+#endif
+}
+
+/** Atomically adds to an integer.
+  * \param[in] pTarget The integer.
+  * \param[in] delta The value to add.
+  * \return The new value. */
+inline int ndAtomicAdd(int *pTarget, int delta)
+{
+#if defined(ND_EPICS_ATOMIC)
+  return epicsAtomicAddIntT(pTarget, delta);
+#elif defined(_MSC_VER)
+  return _InterlockedExchangeAdd((volatile long *)pTarget, delta) + delta;
+#else
+  return __sync_add_and_fetch(pTarget, delta);
+#endif
+}
+
+/** Atomically replaces an integer if it has the expected value.
+  * \param[in] pTarget The integer.
+  * \param[in] oldValue The expected value.
+  * \param[in] newValue The new value.
+  * \return The value before the operation; the integer was replaced if this is oldValue. */
+inline int ndAtomicCmpAndSwap(int *pTarget, int oldValue, int newValue)
+{
+#if defined(ND_EPICS_ATOMIC)
+  return epicsAtomicCmpAndSwapIntT(pTarget, oldValue, newValue);
+#elif defined(_MSC_VER)
+  return _InterlockedCompareExchange((volatile long *)pTarget, newValue, oldValue);
+#else
+  return __sync_val_compare_and_swap(pTarget, oldValue, newValue);
+#endif
+}
+
+/** Reads an integer written by another thread; later loads are not done before this one.
+  * \param[in] pTarget The integer. */
+inline int ndAtomicGet(const int *pTarget)
+{
+  int value = *(const volatile int *)pTarget;
+  ndReadBarrier();
+  return value;
+}
+
+/** Writes an integer read by another thread; earlier stores are done before this one.
+  * \param[in] pTarget The integer.
+  * \param[in] value The new value. */
+inline void ndAtomicSet(int *pTarget, int value)
+{
+  ndWriteBarrier();
+  *(volatile int *)pTarget = value;
+}
+
+#endif
@@ -40,10 +40,12 @@ const char *NDAttribute::attrSourceString(NDAttrSource_t type)
                            NDAttrSource_t sourceType, const char *pSource, 
                            NDAttrDataType_t dataType, void *pValue)
                            
-  : dataType_(NDAttrUndefined)
+  : pValue_(&value_), pString_(&string_)
                            
 {
 
+  this->value_.dataType = NDAttrUndefined;
+
   this->name_ = pName ? pName : "";
   this->description_ = pDescription ? pDescription : "";
   this->sourceType_ = sourceType;
@@ -77,6 +79,7 @@ const char *NDAttribute::attrSourceString(NDAttrSource_t type)
   * \param[in] attribute The attribute to copy from
   */
 NDAttribute::NDAttribute(NDAttribute& attribute)
+  : pValue_(&value_), pString_(&string_)
 {
   void *pValue;
   this->name_ = attribute.name_;
@@ -85,9 +88,9 @@ NDAttribute::NDAttribute(NDAttribute& attribute)
   this->sourceType_ = attribute.sourceType_;
   this->sourceTypeString_ = attribute.sourceTypeString_;
   this->string_ = "";
-  this->dataType_ = attribute.dataType_;
-  if (attribute.dataType_ == NDAttrString) pValue = (void *)attribute.string_.c_str();
-  else pValue = &attribute.value_;
+  this->value_.dataType = attribute.pValue_->dataType;
+  if (attribute.pValue_->dataType == NDAttrString) pValue = (void *)attribute.pString_->c_str();
+  else pValue = &attribute.pValue_->value;
   this->setValue(pValue);
   this->listNode_.pNDAttribute = this;
 }
@@ -101,7 +104,8 @@ NDAttribute::~NDAttribute()
 /** Copies properties from <b>this</b> to pOut.
   * \param[in] pOut A pointer to the output attribute
   *         If NULL the output attribute will be created using the copy constructor
-  * Only the value is copied, all other fields are assumed to already be the same in pOut
+  * Only the value is copied, all other fields are assumed to already be the same in pOut,
+  * except that the data type is set if it is undefined in pOut
   * \return  Returns a pointer to the copy
   */
 NDAttribute* NDAttribute::copy(NDAttribute *pOut)
@@ -111,13 +115,34 @@ NDAttribute* NDAttribute::copy(NDAttribute *pOut)
   if (!pOut) 
     pOut = new NDAttribute(*this);
   else {
-    if (this->dataType_ == NDAttrString) pValue = (void *)this->string_.c_str();
-    else pValue = &this->value_;
+    if (pOut->pValue_->dataType == NDAttrUndefined) pOut->setDataType(this->pValue_->dataType);
+    if (this->pValue_->dataType == NDAttrString) pValue = (void *)this->pString_->c_str();
+    else pValue = &this->pValue_->value;
     pOut->setValue(pValue);
   }
   return pOut;
 }
 
+/** Moves the data type and value of this attribute to new storage.
+  * This is used by NDAttributeList to keep the values of its attributes in a contiguous block.
+  * \param[in] pValue Location for the data type and value; if NULL the attribute's own storage is used.
+  * \param[in] pString Location for the value of strings; if NULL the attribute's own storage is used.
+  */
+void NDAttribute::setStorage(NDAttributeValue *pValue, std::string *pString)
+{
+  if (!pValue) pValue = &this->value_;
+  if (!pString) pString = &this->string_;
+  if (pValue != this->pValue_) {
+    *pValue = *this->pValue_;
+    this->pValue_ = pValue;
+  }
+  if (pString != this->pString_) {
+    pString->swap(*this->pString_);
+    this->pString_->clear();
+    this->pString_ = pString;
+  }
+}
+
 /** Returns the name of this attribute.
   */
 const char *NDAttribute::getName()
@@ -132,16 +157,16 @@ int NDAttribute::setDataType(NDAttrDataType_t type)
   // It is OK to set the data type to the same type as the existing type.
   // This will happen on channel access reconnects and if drivers create a parameter
   // and call this function every time.
-  if (type == this->dataType_) return ND_SUCCESS;
-  if (this->dataType_ != NDAttrUndefined) {
-    fprintf(stderr, "NDAttribute::setDataType, data type already defined = %d\n", this->dataType_);
+  if (type == this->pValue_->dataType) return ND_SUCCESS;
+  if (this->pValue_->dataType != NDAttrUndefined) {
+    fprintf(stderr, "NDAttribute::setDataType, data type already defined = %d\n", this->pValue_->dataType);
     return ND_ERROR;
   }
   if ((type < NDAttrInt8) || (type > NDAttrString)) {
     fprintf(stderr, "NDAttribute::setDataType, invalid data type = %d\n", type);
     return ND_ERROR;
   }
-  this->dataType_ = type;
+  this->pValue_->dataType = type;
   return ND_SUCCESS;
 }
 
@@ -149,7 +174,7 @@ int NDAttribute::setDataType(NDAttrDataType_t type)
   */
 NDAttrDataType_t NDAttribute::getDataType()
 {
-  return dataType_;
+  return pValue_->dataType;
 }
 
 /** Returns the description of this attribute.
@@ -181,41 +206,41 @@ const char *NDAttribute::getSourceInfo(NDAttrSource_t *pSourceType)
 int NDAttribute::setValue(const void *pValue)
 {
   /* If any data type but undefined then pointer must be valid */
-  if ((dataType_ != NDAttrUndefined) && !pValue) return ND_ERROR;
+  if ((pValue_->dataType != NDAttrUndefined) && !pValue) return ND_ERROR;
 
   /* Treat strings specially */
-  if (dataType_ == NDAttrString) {
+  if (pValue_->dataType == NDAttrString) {
     /* If the previous value was the same string don't do anything, 
      * saves freeing and allocating memory.  
      * If not the same free the old string and copy new one. */
-    if (this->string_ == (char *)pValue) return ND_SUCCESS;
-    this->string_ = (char *)pValue;
+    if (*this->pString_ == (char *)pValue) return ND_SUCCESS;
+    *this->pString_ = (char *)pValue;
     return ND_SUCCESS;
   }
-  switch (dataType_) {
+  switch (pValue_->dataType) {
     case NDAttrInt8:
-      this->value_.i8 = *(epicsInt8 *)pValue;
+      this->pValue_->value.i8 = *(epicsInt8 *)pValue;
       break;
     case NDAttrUInt8:
-      this->value_.ui8 = *(epicsUInt8 *)pValue;
+      this->pValue_->value.ui8 = *(epicsUInt8 *)pValue;
       break;
     case NDAttrInt16:
-      this->value_.i16 = *(epicsInt16 *)pValue;
+      this->pValue_->value.i16 = *(epicsInt16 *)pValue;
       break;
     case NDAttrUInt16:
-      this->value_.ui16 = *(epicsUInt16 *)pValue;
+      this->pValue_->value.ui16 = *(epicsUInt16 *)pValue;
       break;
     case NDAttrInt32:
-      this->value_.i32 = *(epicsInt32*)pValue;
+      this->pValue_->value.i32 = *(epicsInt32*)pValue;
       break;
     case NDAttrUInt32:
-      this->value_.ui32 = *(epicsUInt32 *)pValue;
+      this->pValue_->value.ui32 = *(epicsUInt32 *)pValue;
       break;
     case NDAttrFloat32:
-      this->value_.f32 = *(epicsFloat32 *)pValue;
+      this->pValue_->value.f32 = *(epicsFloat32 *)pValue;
       break;
     case NDAttrFloat64:
-      this->value_.f64 = *(epicsFloat64 *)pValue;
+      this->pValue_->value.f64 = *(epicsFloat64 *)pValue;
       break;
     case NDAttrUndefined:
       break;
@@ -231,8 +256,8 @@ int NDAttribute::setValue(const void *pValue)
 int NDAttribute::setValue(const std::string& value)
 {
   /* Data type must be string */
-  if (dataType_ == NDAttrString) {
-    this->string_ = value;
+  if (pValue_->dataType == NDAttrString) {
+    *this->pString_ = value;
     return ND_SUCCESS;
   }
   return ND_ERROR;
@@ -245,34 +270,34 @@ int NDAttribute::setValue(const std::string& value)
   * string including 0 terminator. */
 int NDAttribute::getValueInfo(NDAttrDataType_t *pDataType, size_t *pSize)
 {
-  *pDataType = this->dataType_;
-  switch (this->dataType_) {
+  *pDataType = this->pValue_->dataType;
+  switch (this->pValue_->dataType) {
     case NDAttrInt8:
-      *pSize = sizeof(this->value_.i8);
+      *pSize = sizeof(this->pValue_->value.i8);
       break;
     case NDAttrUInt8:
-      *pSize = sizeof(this->value_.ui8);
+      *pSize = sizeof(this->pValue_->value.ui8);
       break;
     case NDAttrInt16:
-      *pSize = sizeof(this->value_.i16);
+      *pSize = sizeof(this->pValue_->value.i16);
       break;
     case NDAttrUInt16:
-      *pSize = sizeof(this->value_.ui16);
+      *pSize = sizeof(this->pValue_->value.ui16);
       break;
     case NDAttrInt32:
-      *pSize = sizeof(this->value_.i32);
+      *pSize = sizeof(this->pValue_->value.i32);
       break;
     case NDAttrUInt32:
-      *pSize = sizeof(this->value_.ui32);
+      *pSize = sizeof(this->pValue_->value.ui32);
       break;
     case NDAttrFloat32:
-      *pSize = sizeof(this->value_.f32);
+      *pSize = sizeof(this->pValue_->value.f32);
       break;
     case NDAttrFloat64:
-      *pSize = sizeof(this->value_.f64);
+      *pSize = sizeof(this->pValue_->value.f64);
       break;
     case NDAttrString:
-      *pSize = this->string_.size()+1;
+      *pSize = this->pString_->size()+1;
       break;
     case NDAttrUndefined:
       *pSize = 0;
@@ -289,30 +314,30 @@ int NDAttribute::getValueT(void *pValueIn, size_t dataSize)
 {
   epicsType *pValue = (epicsType *)pValueIn;
 
-  switch (this->dataType_) {
+  switch (this->pValue_->dataType) {
     case NDAttrInt8:
-      *pValue = (epicsType) this->value_.i8;
+      *pValue = (epicsType) this->pValue_->value.i8;
       break;
     case NDAttrUInt8:
-       *pValue = (epicsType) this->value_.ui8;
+       *pValue = (epicsType) this->pValue_->value.ui8;
       break;
     case NDAttrInt16:
-      *pValue = (epicsType) this->value_.i16;
+      *pValue = (epicsType) this->pValue_->value.i16;
       break;
     case NDAttrUInt16:
-      *pValue = (epicsType) this->value_.ui16;
+      *pValue = (epicsType) this->pValue_->value.ui16;
       break;
     case NDAttrInt32:
-      *pValue = (epicsType) this->value_.i32;
+      *pValue = (epicsType) this->pValue_->value.i32;
       break;
     case NDAttrUInt32:
-      *pValue = (epicsType) this->value_.ui32;
+      *pValue = (epicsType) this->pValue_->value.ui32;
       break;
     case NDAttrFloat32:
-      *pValue = (epicsType) this->value_.f32;
+      *pValue = (epicsType) this->pValue_->value.f32;
       break;
     case NDAttrFloat64:
-      *pValue = (epicsType) this->value_.f64;
+      *pValue = (epicsType) this->pValue_->value.f64;
       break;
     default:
       return ND_ERROR;
@@ -329,11 +354,11 @@ int NDAttribute::getValueT(void *pValueIn, size_t dataSize)
   * Does data type conversions between numeric data types */
 int NDAttribute::getValue(NDAttrDataType_t dataType, void *pValue, size_t dataSize)
 {
-  switch (this->dataType_) {
+  switch (this->pValue_->dataType) {
     case NDAttrString:
       if (dataType != NDAttrString) return ND_ERROR;
-      if (dataSize == 0) dataSize = this->string_.size()+1;
-      strncpy((char *)pValue, this->string_.c_str(), dataSize);
+      if (dataSize == 0) dataSize = this->pString_->size()+1;
+      strncpy((char *)pValue, this->pString_->c_str(), dataSize);
       return ND_SUCCESS;
     case NDAttrUndefined:
       return ND_ERROR;
@@ -371,15 +396,25 @@ int NDAttribute::getValue(NDAttrDataType_t dataType, void *pValue, size_t dataSi
   * Does data type conversions between numeric data types */
 int NDAttribute::getValue(std::string& value)
 {
-  switch (this->dataType_) {
+  switch (this->pValue_->dataType) {
     case NDAttrString:
-      value = this->string_;
+      value = *this->pString_;
       return ND_SUCCESS;
     default:
       return ND_ERROR;
   }
 }
 
+/** Reads the current value of the source of this attribute, to be set by the next updateValue().
+  * NDAttributeList::snapshotValues() calls this for all of the attributes of a list in one pass,
+  * so that the sources that need a lock can all be read while it is held once.
+  * The base class does nothing, derived classes that read such sources override it.
+ */
+int NDAttribute::snapshotValue()
+{
+  return ND_SUCCESS;
+}
+
 /** Updates the current value of this attribute.
   * The base class does nothing, but derived classes may fetch the current value of the attribute,
   * for example from an EPICS PV or driver parameter library.
@@ -403,42 +438,42 @@ int NDAttribute::report(FILE *fp, int details)
   fprintf(fp, "  source type=%d\n", this->sourceType_);
   fprintf(fp, "  source type string=%s\n", this->sourceTypeString_.c_str());
   fprintf(fp, "  source=%s\n", this->source_.c_str());
-  switch (this->dataType_) {
+  switch (this->pValue_->dataType) {
     case NDAttrInt8:
       fprintf(fp, "  dataType=NDAttrInt8\n");
-      fprintf(fp, "  value=%d\n", this->value_.i8);
+      fprintf(fp, "  value=%d\n", this->pValue_->value.i8);
       break;
     case NDAttrUInt8:
       fprintf(fp, "  dataType=NDAttrUInt8\n"); 
-      fprintf(fp, "  value=%u\n", this->value_.ui8);
+      fprintf(fp, "  value=%u\n", this->pValue_->value.ui8);
       break;
     case NDAttrInt16:
       fprintf(fp, "  dataType=NDAttrInt16\n"); 
-      fprintf(fp, "  value=%d\n", this->value_.i16);
+      fprintf(fp, "  value=%d\n", this->pValue_->value.i16);
       break;
     case NDAttrUInt16:
       fprintf(fp, "  dataType=NDAttrUInt16\n"); 
-      fprintf(fp, "  value=%d\n", this->value_.ui16);
+      fprintf(fp, "  value=%d\n", this->pValue_->value.ui16);
       break;
     case NDAttrInt32:
       fprintf(fp, "  dataType=NDAttrInt32\n"); 
-      fprintf(fp, "  value=%d\n", this->value_.i32);
+      fprintf(fp, "  value=%d\n", this->pValue_->value.i32);
       break;
     case NDAttrUInt32:
       fprintf(fp, "  dataType=NDAttrUInt32\n"); 
-      fprintf(fp, "  value=%d\n", this->value_.ui32);
+      fprintf(fp, "  value=%d\n", this->pValue_->value.ui32);
       break;
     case NDAttrFloat32:
       fprintf(fp, "  dataType=NDAttrFloat32\n"); 
-      fprintf(fp, "  value=%f\n", this->value_.f32);
+      fprintf(fp, "  value=%f\n", this->pValue_->value.f32);
       break;
     case NDAttrFloat64:
       fprintf(fp, "  dataType=NDAttrFloat64\n"); 
-      fprintf(fp, "  value=%f\n", this->value_.f64);
+      fprintf(fp, "  value=%f\n", this->pValue_->value.f64);
       break;
     case NDAttrString:
       fprintf(fp, "  dataType=NDAttrString\n"); 
-      fprintf(fp, "  value=%s\n", this->string_.c_str());
+      fprintf(fp, "  value=%s\n", this->pString_->c_str());
       break;
     case NDAttrUndefined:
       fprintf(fp, "  dataType=NDAttrUndefined\n");
@@ -73,6 +73,15 @@ typedef union {
     epicsFloat64 f64;   /**< 64-bit float */
 } NDAttrValue;
 
+/** Data type and value of an attribute.
+  * An attribute normally stores these itself, but the attributes of a compact NDAttributeList
+  * store them in a contiguous block owned by the list, so that the values of all of the
+  * attributes can be copied at once. */
+typedef struct NDAttributeValue {
+    NDAttrDataType_t dataType;  /**< Data type of attribute */
+    NDAttrValue value;          /**< Value of attribute except for strings */
+} NDAttributeValue;
+
 /** Structure used by the EPICS ellLib library for linked lists of C++ objects.
   * This is needed for ellLists of C++ objects, for which making the first data element the ELLNODE 
   * does not work if the class has virtual functions or derived classes. */
@@ -104,6 +113,7 @@ public:
     virtual int setDataType(NDAttrDataType_t dataType);
     virtual int setValue(const void *pValue);
     virtual int setValue(const std::string&);
+    virtual int snapshotValue();
     virtual int updateValue();
     virtual int report(FILE *fp, int details);
     friend class NDArray;
@@ -112,10 +122,12 @@ public:
 
 private:
     template <typename epicsType> int getValueT(void *pValue, size_t dataSize);
+    void setStorage(NDAttributeValue *pValue, std::string *pString);
     std::string name_;              /**< Name string */
     std::string description_;       /**< Description string */
-    NDAttrDataType_t dataType_;     /**< Data type of attribute */
-    NDAttrValue value_;             /**< Value of attribute except for strings */
+    NDAttributeValue *pValue_;      /**< Data type and value, either value_ or in the value block of a list */
+    std::string *pString_;          /**< Value for strings, either string_ or in the value block of a list */
+    NDAttributeValue value_;        /**< Data type and value of attribute except for strings */
     std::string string_;            /**< Value of attribute for strings */
     std::string source_;            /**< Source string - EPICS PV name or DRV_INFO string */
     NDAttrSource_t sourceType_;     /**< Source type */
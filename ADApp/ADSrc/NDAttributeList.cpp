@@ -7,16 +7,35 @@
  */
  
 #include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#include <epicsThread.h>
 
 #include <epicsExport.h>
 
 #include "NDAttributeList.h"
 
+/* Mutex for the reference counts of shared attributes */
+static epicsMutexId refCountLock;
+static epicsThreadOnceId refCountOnceId = EPICS_THREAD_ONCE_INIT;
+
+static void refCountOnce(void *)
+{
+  refCountLock = epicsMutexMustCreate();
+}
+
 /** NDAttributeList constructor
+  * \param[in] shareable If true the attributes of this list can be shared by the lists that
+  * copy it rather than being copied.  This is used for the lists of NDArrays, which only
+  * contain copies of the driver attributes; it must be false for lists whose attributes
+  * have their own sources, such as the attribute list of a driver.
   */
-NDAttributeList::NDAttributeList()
+NDAttributeList::NDAttributeList(bool shareable)
+  : shareable_(shareable)
 {
-  ellInit(&this->list_);
+  epicsThreadOnce(&refCountOnceId, refCountOnce, NULL);
+  this->pData_ = createData(shareable);
   this->lock_ = epicsMutexCreate();
 }
 
@@ -24,8 +43,7 @@ NDAttributeList::NDAttributeList()
   */
 NDAttributeList::~NDAttributeList()
 {
-  this->clear();
-  ellFree(&this->list_);
+  releaseData(this->pData_);
   epicsMutexDestroy(this->lock_);
 }
 
@@ -39,9 +57,11 @@ int NDAttributeList::add(NDAttribute *pAttribute)
   //const char *functionName = "NDAttributeList::add";
 
   epicsMutexLock(this->lock_);
+  this->detach();
   /* Remove any existing attribute with this name */
   this->remove(pAttribute->name_.c_str());
-  ellAdd(&this->list_, &pAttribute->listNode_.node);
+  ellAdd(&this->pData_->list, &pAttribute->listNode_.node);
+  this->indexAdd(pAttribute);
   epicsMutexUnlock(this->lock_);
   return(ND_SUCCESS);
 }
@@ -68,12 +88,14 @@ NDAttribute* NDAttributeList::add(const char *pName, const char *pDescription, N
   NDAttribute *pAttribute;
 
   epicsMutexLock(this->lock_);
+  this->detach();
   pAttribute = this->find(pName);
   if (pAttribute) {
     pAttribute->setValue(pValue);
   } else {
     pAttribute = new NDAttribute(pName, pDescription, NDAttrSourceDriver, "Driver", dataType, pValue);
-    ellAdd(&this->list_, &pAttribute->listNode_.node);
+    ellAdd(&this->pData_->list, &pAttribute->listNode_.node);
+    this->indexAdd(pAttribute);
   }
   epicsMutexUnlock(this->lock_);
   return(pAttribute);
@@ -82,25 +104,28 @@ NDAttribute* NDAttributeList::add(const char *pName, const char *pDescription, N
 
 
 /** Finds an attribute by name; the search is now case sensitive (R1-10)
+  * The attribute may be shared with other lists, see the class description.
   * \param[in] pName The name of the attribute to be found.
   * \return Returns a pointer to the attribute if found, NULL if not found. 
   */
 NDAttribute* NDAttributeList::find(const char *pName)
 {
-  NDAttribute *pAttribute;
-  NDAttributeListNode *pListNode;
+  NDAttribute *pAttribute=NULL;
+  epicsUInt32 hash;
+  size_t i, mask;
   //const char *functionName = "NDAttributeList::find";
 
   epicsMutexLock(this->lock_);
-  pListNode = (NDAttributeListNode *)ellFirst(&this->list_);
-  while (pListNode) {
-    pAttribute = pListNode->pNDAttribute;
-    if (pAttribute->name_ == pName) goto done;
-    pListNode = (NDAttributeListNode *)ellNext(&pListNode->node);
+  if (this->pData_->index.size() > 0) {
+    hash = hashName(pName);
+    mask = this->pData_->index.size() - 1;
+    for (i=hash & mask; this->pData_->index[i].pAttribute; i=(i+1) & mask) {
+      if ((this->pData_->index[i].hash == hash) && (this->pData_->index[i].pAttribute->name_ == pName)) {
+        pAttribute = this->pData_->index[i].pAttribute;
+        break;
+      }
+    }
   }
-  pAttribute = NULL;
-
-  done:
   epicsMutexUnlock(this->lock_);
   return(pAttribute);
 }
@@ -118,7 +143,7 @@ NDAttribute* NDAttributeList::next(NDAttribute *pAttributeIn)
 
   epicsMutexLock(this->lock_);
   if (!pAttributeIn) {
-    pListNode = (NDAttributeListNode *)ellFirst(&this->list_);
+    pListNode = (NDAttributeListNode *)ellFirst(&this->pData_->list);
    }
   else {
     pListNode = (NDAttributeListNode *)ellNext(&pAttributeIn->listNode_.node);
@@ -132,9 +157,13 @@ NDAttribute* NDAttributeList::next(NDAttribute *pAttributeIn)
   * \return Returns the number of attributes. */
 int NDAttributeList::count()
 {
+  int count;
   //const char *functionName = "NDAttributeList::count";
 
-  return ellCount(&this->list_);
+  epicsMutexLock(this->lock_);
+  count = ellCount(&this->pData_->list);
+  epicsMutexUnlock(this->lock_);
+  return count;
 }
 
 /** Removes an attribute from the list.
@@ -150,7 +179,14 @@ int NDAttributeList::remove(const char *pName)
   epicsMutexLock(this->lock_);
   pAttribute = this->find(pName);
   if (!pAttribute) goto done;
-  ellDelete(&this->list_, &pAttribute->listNode_.node);
+  if (this->isShared()) {
+    this->detach();
+    pAttribute = this->find(pName);
+  }
+  /* The schema attributes must stay together, so removing one of them expands the list */
+  if (pAttribute->pValue_ != &pAttribute->value_) this->expand();
+  this->indexRemove(pAttribute);
+  ellDelete(&this->pData_->list, &pAttribute->listNode_.node);
   delete pAttribute;
   status = ND_SUCCESS;
 
@@ -167,12 +203,29 @@ int NDAttributeList::clear()
   //const char *functionName = "NDAttributeList::clear";
 
   epicsMutexLock(this->lock_);
-  pListNode = (NDAttributeListNode *)ellFirst(&this->list_);
+  if (this->isShared()) {
+    /* Leave the shared attributes to the other lists */
+    releaseData(this->pData_);
+    this->pData_ = createData(this->shareable_);
+    epicsMutexUnlock(this->lock_);
+    return(ND_SUCCESS);
+  }
+  pListNode = (NDAttributeListNode *)ellFirst(&this->pData_->list);
   while (pListNode) {
     pAttribute = pListNode->pNDAttribute;
-    ellDelete(&this->list_, &pListNode->node);
+    ellDelete(&this->pData_->list, &pListNode->node);
     delete pAttribute;
-    pListNode = (NDAttributeListNode *)ellFirst(&this->list_);
+    pListNode = (NDAttributeListNode *)ellFirst(&this->pData_->list);
+  }
+  /* Keep the size of the index, the list is usually refilled with the same attributes */
+  for (size_t i=0; i<this->pData_->index.size(); i++) {
+    this->pData_->index[i].pAttribute = NULL;
+  }
+  if (this->pData_->pSchema) {
+    this->pData_->pSchema->release();
+    this->pData_->pSchema = NULL;
+    this->pData_->values.clear();
+    this->pData_->strings.clear();
   }
   epicsMutexUnlock(this->lock_);
   return(ND_SUCCESS);
@@ -182,24 +235,132 @@ int NDAttributeList::clear()
   * It is efficient so that if the attribute already exists in the output
   * list it just copies the properties, and memory allocation is minimized.
   * The attributes are added to any existing attributes already present in the output list.
+  * The output list usually has the same attributes in the same order, e.g. when an array
+  * from the NDArrayPool free list is reused for the next array from the same driver,
+  * so the attributes are first matched by position and only searched for by name
+  * when the names differ.  Copying a list is thus O(N) in the number of attributes.
+  * If this list is shareable and the output list is empty then the output list just
+  * shares the attributes of this list, and copying is O(1).  If the output list is shared
+  * and only contains attributes that are in this list then its shared attributes are
+  * replaced rather than first being copied.
+  * If this list is compact then an output list that is empty, or only contains attributes
+  * that are in the schema of this list, is made compact with the same schema, and the
+  * schema attributes are copied with a single memcpy of the value block.
   * \param[out] pListOut A pointer to the output attribute list to copy to.
+  * \param[in] exact If true the attributes of the output list that are not in this list are
+  * removed, so the output list has the same attributes as this list.
   */
-int NDAttributeList::copy(NDAttributeList *pListOut)
+int NDAttributeList::copy(NDAttributeList *pListOut, bool exact)
 {
   NDAttribute *pAttrIn, *pAttrOut, *pFound;
-  NDAttributeListNode *pListNode;
+  NDAttributeListNode *pListNode, *pListNodeOut;
+  NDAttributeSchema *pSchema;
+  int i, numSlots;
   //const char *functionName = "NDAttributeList::copy";
 
+  if (pListOut == this) return(ND_SUCCESS);
   epicsMutexLock(this->lock_);
-  pListNode = (NDAttributeListNode *)ellFirst(&this->list_);
+  epicsMutexLock(pListOut->lock_);
+  if (pListOut->pData_ == this->pData_) goto done;
+  if (exact && !pListOut->isSubsetOf(this)) pListOut->clear();
+  if (ellCount(&this->pData_->list) == 0) goto done;
+  if ((ellCount(&pListOut->pData_->list) == 0) ||
+      (pListOut->isShared() && pListOut->isSubsetOf(this))) {
+    /* All of the attributes of the output list are replaced */
+    if (this->pData_->shareable) {
+      epicsMutexLock(refCountLock);
+      this->pData_->refCount++;
+      epicsMutexUnlock(refCountLock);
+      releaseData(pListOut->pData_);
+      pListOut->pData_ = this->pData_;
+      goto done;
+    }
+    if (pListOut->isShared()) {
+      releaseData(pListOut->pData_);
+      pListOut->pData_ = createData(pListOut->shareable_);
+    }
+  }
+  pListOut->detach();
+  pListNode = (NDAttributeListNode *)ellFirst(&this->pData_->list);
+  pListNodeOut = (NDAttributeListNode *)ellFirst(&pListOut->pData_->list);
+  pSchema = this->pData_->pSchema;
+  if (pSchema && (pListOut->pData_->pSchema != pSchema) && pListOut->canAdopt(pSchema)) {
+    pListOut->clear();
+    pListOut->adoptSchema(pSchema);
+    pListNodeOut = (NDAttributeListNode *)ellFirst(&pListOut->pData_->list);
+  }
+  if (pSchema && (pListOut->pData_->pSchema == pSchema)) {
+    /* Same schema, copy the value block and then any attributes after the schema attributes */
+    numSlots = pSchema->numSlots();
+    memcpy(&pListOut->pData_->values[0], &this->pData_->values[0], numSlots * sizeof(NDAttributeValue));
+    for (i=0; i<numSlots; i++) {
+      if (this->pData_->values[i].dataType == NDAttrString) {
+        pListOut->pData_->strings[i] = this->pData_->strings[i];
+      }
+    }
+    if (ellCount(&this->pData_->list) == numSlots) goto done;
+    for (i=0; i<numSlots; i++) {
+      pListNode = (NDAttributeListNode *)ellNext(&pListNode->node);
+      pListNodeOut = (NDAttributeListNode *)ellNext(&pListNodeOut->node);
+    }
+  }
   while (pListNode) {
     pAttrIn = pListNode->pNDAttribute;
-    /* See if there is already an attribute of this name in the output list */
-    pFound = pListOut->find(pAttrIn->name_.c_str());
-    /* The copy function will copy the properties, and will create the attribute if pFound is NULL */
-    pAttrOut = pAttrIn->copy(pFound);
-    /* If pFound is NULL, then a copy created a new attribute, need to add it to the list */
-    if (!pFound) pListOut->add(pAttrOut);
+    if (pListNodeOut && (pListNodeOut->pNDAttribute->name_ == pAttrIn->name_)) {
+      /* Same attribute at the same position */
+      pAttrIn->copy(pListNodeOut->pNDAttribute);
+      pListNodeOut = (NDAttributeListNode *)ellNext(&pListNodeOut->node);
+    } else {
+      /* See if there is already an attribute of this name in the output list */
+      pFound = pListOut->find(pAttrIn->name_.c_str());
+      /* The copy function will copy the properties, and will create the attribute if pFound is NULL */
+      pAttrOut = pAttrIn->copy(pFound);
+      if (pFound) {
+        /* Continue matching by position after the attribute that was found */
+        pListNodeOut = (NDAttributeListNode *)ellNext(&pFound->listNode_.node);
+      } else {
+        /* A copy created a new attribute, need to add it to the list */
+        ellAdd(&pListOut->pData_->list, &pAttrOut->listNode_.node);
+        pListOut->indexAdd(pAttrOut);
+      }
+    }
+    pListNode = (NDAttributeListNode *)ellNext(&pListNode->node);
+  }
+
+  done:
+  epicsMutexUnlock(pListOut->lock_);
+  epicsMutexUnlock(this->lock_);
+  return(ND_SUCCESS);
+}
+
+/** Drops the attributes of the list if they are shared with other lists, leaving the list empty.
+  * Attributes that are not shared are kept, so that they can be reused by the next copy into the list.
+  * NDArrayPool::release() calls this when an array returns to the free list.
+  */
+int NDAttributeList::dropShared()
+{
+  epicsMutexLock(this->lock_);
+  if (this->isShared()) {
+    releaseData(this->pData_);
+    this->pData_ = createData(this->shareable_);
+  }
+  epicsMutexUnlock(this->lock_);
+  return(ND_SUCCESS);
+}
+
+/** Reads the values of the sources of all of the attributes in the list, to be set by the next
+  * updateValues(); calls NDAttribute::snapshotValue() for each attribute in the list.
+  */
+int NDAttributeList::snapshotValues()
+{
+  NDAttributeListNode *pListNode;
+  //const char *functionName = "NDAttributeList::snapshotValues";
+
+  epicsMutexLock(this->lock_);
+  this->detach();
+  pListNode = (NDAttributeListNode *)ellFirst(&this->pData_->list);
+  while (pListNode) {
+    pListNode->pNDAttribute->snapshotValue();
     pListNode = (NDAttributeListNode *)ellNext(&pListNode->node);
   }
   epicsMutexUnlock(this->lock_);
@@ -215,7 +376,8 @@ int NDAttributeList::updateValues()
   //const char *functionName = "NDAttributeList::updateValues";
 
   epicsMutexLock(this->lock_);
-  pListNode = (NDAttributeListNode *)ellFirst(&this->list_);
+  this->detach();
+  pListNode = (NDAttributeListNode *)ellFirst(&this->pData_->list);
   while (pListNode) {
     pAttribute = pListNode->pNDAttribute;
     pAttribute->updateValue();
@@ -225,6 +387,131 @@ int NDAttributeList::updateValues()
   return(ND_SUCCESS);
 }
 
+/** Makes the list compact, moving the data types and values of all of its attributes into
+  * a contiguous value block described by a new NDAttributeSchema.
+  * This does nothing if the list is already compact and has no attributes that were added
+  * after it was made compact, so it can be called before each copy.
+  */
+int NDAttributeList::compact()
+{
+  NDAttributeSchema *pSchema;
+  NDAttribute *pAttribute;
+  NDAttributeListNode *pListNode;
+  int i, count;
+  //const char *functionName = "NDAttributeList::compact";
+
+  epicsMutexLock(this->lock_);
+  count = ellCount(&this->pData_->list);
+  if ((count == 0) ||
+      (this->pData_->pSchema && (this->pData_->pSchema->numSlots() == count))) goto done;
+  this->detach();
+  this->expand();
+  pSchema = new NDAttributeSchema();
+  pListNode = (NDAttributeListNode *)ellFirst(&this->pData_->list);
+  while (pListNode) {
+    pAttribute = pListNode->pNDAttribute;
+    pSchema->addSlot(pAttribute->name_.c_str(), pAttribute->description_.c_str(),
+                     pAttribute->sourceType_, pAttribute->source_.c_str());
+    pListNode = (NDAttributeListNode *)ellNext(&pListNode->node);
+  }
+  this->pData_->pSchema = pSchema;
+  this->pData_->values.resize(count);
+  this->pData_->strings.resize(count);
+  pListNode = (NDAttributeListNode *)ellFirst(&this->pData_->list);
+  for (i=0; i<count; i++) {
+    pListNode->pNDAttribute->setStorage(&this->pData_->values[i], &this->pData_->strings[i]);
+    pListNode = (NDAttributeListNode *)ellNext(&pListNode->node);
+  }
+
+  done:
+  epicsMutexUnlock(this->lock_);
+  return(ND_SUCCESS);
+}
+
+/** Returns the schema of a compact list, or NULL if the list is not compact.
+  * The schema is only valid while the list is not changed; NDAttributeSchema::reserve()
+  * must be called to keep it for longer.
+  */
+NDAttributeSchema* NDAttributeList::getSchema()
+{
+  NDAttributeSchema *pSchema;
+
+  epicsMutexLock(this->lock_);
+  pSchema = this->pData_->pSchema;
+  epicsMutexUnlock(this->lock_);
+  return pSchema;
+}
+
+/** Converts a numeric attribute value to a double.
+  * \return true if the data type is numeric. */
+static bool slotValueAsDouble(NDAttrDataType_t dataType, const NDAttrValue& value, double *pValue)
+{
+  switch (dataType) {
+    case NDAttrInt8:    *pValue = value.i8;   break;
+    case NDAttrUInt8:   *pValue = value.ui8;  break;
+    case NDAttrInt16:   *pValue = value.i16;  break;
+    case NDAttrUInt16:  *pValue = value.ui16; break;
+    case NDAttrInt32:   *pValue = value.i32;  break;
+    case NDAttrUInt32:  *pValue = value.ui32; break;
+    case NDAttrFloat32: *pValue = value.f32;  break;
+    case NDAttrFloat64: *pValue = value.f64;  break;
+    default:            return false;
+  }
+  return true;
+}
+
+/** Returns the value of a schema attribute of a compact list as a double, without looking up
+  * the attribute by name.  The slot is found once with NDAttributeSchema::findSlot() on the schema
+  * returned by getSchema(), and can be used for all lists with that schema.
+  * \param[in] slot The slot number of the attribute in the schema of this list.
+  * \param[out] pValue The value.
+  * \return ND_SUCCESS, or ND_ERROR if the list is not compact, the slot is not in its schema
+  * or the value is not numeric.
+  */
+int NDAttributeList::getSlotValue(int slot, double *pValue)
+{
+  int status = ND_SUCCESS;
+
+  epicsMutexLock(this->lock_);
+  if (!this->pData_->pSchema || (slot < 0) || (slot >= this->pData_->pSchema->numSlots())) {
+    epicsMutexUnlock(this->lock_);
+    return ND_ERROR;
+  }
+  if (!slotValueAsDouble(this->pData_->values[slot].dataType, this->pData_->values[slot].value, pValue)) {
+    status = ND_ERROR;
+  }
+  epicsMutexUnlock(this->lock_);
+  return status;
+}
+
+/** Returns the values of several schema attributes of a compact list as doubles, like getSlotValue()
+  * but locking the list only once.
+  * \param[in] numValues The number of values to return.
+  * \param[in] pSlots The slot numbers of the attributes in the schema of this list.
+  * \param[out] pValues The values.  Values whose slot is not in the schema of this list, or which are
+  * not numeric, are not changed.
+  * \return The number of values returned, 0 if the list is not compact.
+  */
+int NDAttributeList::getSlotValues(int numValues, const int *pSlots, double *pValues)
+{
+  int i, slot, numSlots;
+  int count = 0;
+
+  epicsMutexLock(this->lock_);
+  if (this->pData_->pSchema) {
+    numSlots = this->pData_->pSchema->numSlots();
+    for (i=0; i<numValues; i++) {
+      slot = pSlots[i];
+      if ((slot < 0) || (slot >= numSlots)) continue;
+      if (slotValueAsDouble(this->pData_->values[slot].dataType, this->pData_->values[slot].value, &pValues[i])) {
+        count++;
+      }
+    }
+  }
+  epicsMutexUnlock(this->lock_);
+  return count;
+}
+
 /** Reports on the properties of the attribute list.
   * \param[in] fp File pointer for the report output.
   * \param[in] details Level of report details desired; if >10 calls NDAttribute::report() for each attribute.
@@ -238,8 +525,10 @@ int NDAttributeList::report(FILE *fp, int details)
   fprintf(fp, "\n");
   fprintf(fp, "NDAttributeList: address=%p:\n", this);
   fprintf(fp, "  number of attributes=%d\n", this->count());
+  fprintf(fp, "  shared=%d\n", this->isShared());
+  fprintf(fp, "  compact attributes=%d\n", this->pData_->pSchema ? this->pData_->pSchema->numSlots() : 0);
   if (details > 10) {
-    pListNode = (NDAttributeListNode *) ellFirst(&this->list_);
+    pListNode = (NDAttributeListNode *) ellFirst(&this->pData_->list);
     while (pListNode) {
       pAttribute = (NDAttribute *)pListNode->pNDAttribute;
       pAttribute->report(fp, details);
@@ -251,3 +540,242 @@ int NDAttributeList::report(FILE *fp, int details)
 }
 
 
+/** Creates an empty set of attributes with a reference count of 1.
+  * \param[in] shareable Whether the attributes can be shared.
+  */
+NDAttributeListData *NDAttributeList::createData(bool shareable)
+{
+  NDAttributeListData *pData = new NDAttributeListData;
+
+  ellInit(&pData->list);
+  pData->refCount = 1;
+  pData->shareable = shareable;
+  pData->pSchema = NULL;
+  return pData;
+}
+
+/** Releases a reference to a set of attributes, deleting them if it was the last one.
+  * \param[in] pData The attributes.
+  */
+void NDAttributeList::releaseData(NDAttributeListData *pData)
+{
+  NDAttributeListNode *pListNode;
+  int refCount;
+
+  epicsMutexLock(refCountLock);
+  refCount = --pData->refCount;
+  epicsMutexUnlock(refCountLock);
+  if (refCount > 0) return;
+  pListNode = (NDAttributeListNode *)ellFirst(&pData->list);
+  while (pListNode) {
+    ellDelete(&pData->list, &pListNode->node);
+    delete pListNode->pNDAttribute;
+    pListNode = (NDAttributeListNode *)ellFirst(&pData->list);
+  }
+  if (pData->pSchema) pData->pSchema->release();
+  delete pData;
+}
+
+/** Returns true if the attributes of this list are shared with other lists.
+  * The reference count can only drop to 1 while they are shared,
+  * so false means that no other list can be using them.
+  */
+bool NDAttributeList::isShared()
+{
+  bool shared;
+
+  epicsMutexLock(refCountLock);
+  shared = (this->pData_->refCount > 1);
+  epicsMutexUnlock(refCountLock);
+  return shared;
+}
+
+/** Returns true if all of the attributes of this list are also in another list.
+  * Must be called with the locks of both lists held.
+  * \param[in] pList The other list.
+  */
+bool NDAttributeList::isSubsetOf(NDAttributeList *pList)
+{
+  NDAttributeListNode *pListNode;
+
+  if (ellCount(&this->pData_->list) > ellCount(&pList->pData_->list)) return false;
+  pListNode = (NDAttributeListNode *)ellFirst(&this->pData_->list);
+  while (pListNode) {
+    if (!pList->find(pListNode->pNDAttribute->name_.c_str())) return false;
+    pListNode = (NDAttributeListNode *)ellNext(&pListNode->node);
+  }
+  return true;
+}
+
+/** Makes a private copy of the attributes if they are shared with other lists.
+  * Must be called with the lock held before changing the attributes.
+  */
+void NDAttributeList::detach()
+{
+  NDAttributeListData *pShared = this->pData_;
+  NDAttributeListNode *pListNode;
+  NDAttribute *pAttribute;
+
+  if (!this->isShared()) return;
+  this->pData_ = createData(this->shareable_);
+  pListNode = (NDAttributeListNode *)ellFirst(&pShared->list);
+  if (pShared->pSchema) {
+    /* The copy is compact with the same schema */
+    this->adoptSchema(pShared->pSchema);
+    std::copy(pShared->values.begin(), pShared->values.end(), this->pData_->values.begin());
+    std::copy(pShared->strings.begin(), pShared->strings.end(), this->pData_->strings.begin());
+    for (int i=0; i<pShared->pSchema->numSlots(); i++) {
+      pListNode = (NDAttributeListNode *)ellNext(&pListNode->node);
+    }
+  }
+  while (pListNode) {
+    pAttribute = pListNode->pNDAttribute->copy(NULL);
+    ellAdd(&this->pData_->list, &pAttribute->listNode_.node);
+    pListNode = (NDAttributeListNode *)ellNext(&pListNode->node);
+  }
+  if (pShared->index.size() > 0) this->indexRebuild(pShared->index.size());
+  releaseData(pShared);
+}
+
+/** Returns the data types and values of the schema attributes to the attributes themselves,
+  * so the list is no longer compact.  Must be called with the lock held on a list that is not shared.
+  */
+void NDAttributeList::expand()
+{
+  NDAttributeListNode *pListNode;
+
+  if (!this->pData_->pSchema) return;
+  pListNode = (NDAttributeListNode *)ellFirst(&this->pData_->list);
+  for (int i=0; i<this->pData_->pSchema->numSlots(); i++) {
+    pListNode->pNDAttribute->setStorage(NULL, NULL);
+    pListNode = (NDAttributeListNode *)ellNext(&pListNode->node);
+  }
+  this->pData_->pSchema->release();
+  this->pData_->pSchema = NULL;
+  this->pData_->values.clear();
+  this->pData_->strings.clear();
+}
+
+/** Returns true if the list can be changed to a compact list with a schema when it is copied to,
+  * i.e. if it is empty or it is compact and all of its attributes are in the schema.
+  * Must be called with the lock held.
+  * \param[in] pSchema The schema of the list being copied.
+  */
+bool NDAttributeList::canAdopt(NDAttributeSchema *pSchema)
+{
+  NDAttributeSchema *pOwn = this->pData_->pSchema;
+  int count = ellCount(&this->pData_->list);
+
+  if (count == 0) return true;
+  if (!pOwn || (pOwn->numSlots() != count)) return false;
+  for (int i=0; i<count; i++) {
+    if (pSchema->findSlot(pOwn->getSlot(i).name.c_str()) < 0) return false;
+  }
+  return true;
+}
+
+/** Makes an empty list compact with a schema, creating an attribute for each slot of the schema.
+  * The attributes have an undefined data type until a value is copied to them.
+  * Must be called with the lock held on a list that is empty and not shared.
+  * \param[in] pSchema The schema.
+  */
+void NDAttributeList::adoptSchema(NDAttributeSchema *pSchema)
+{
+  NDAttribute *pAttribute;
+  NDAttributeValue undefined;
+  int i, numSlots = pSchema->numSlots();
+
+  pSchema->reserve();
+  this->pData_->pSchema = pSchema;
+  memset(&undefined, 0, sizeof(undefined));
+  undefined.dataType = NDAttrUndefined;
+  this->pData_->values.assign(numSlots, undefined);
+  this->pData_->strings.assign(numSlots, std::string());
+  for (i=0; i<numSlots; i++) {
+    const NDAttributeSlot& slot = pSchema->getSlot(i);
+    pAttribute = new NDAttribute(slot.name.c_str(), slot.description.c_str(), slot.sourceType,
+                                 slot.source.c_str(), NDAttrUndefined, NULL);
+    pAttribute->setStorage(&this->pData_->values[i], &this->pData_->strings[i]);
+    ellAdd(&this->pData_->list, &pAttribute->listNode_.node);
+    this->indexAdd(pAttribute);
+  }
+}
+
+/** Computes the hash of an attribute name (32-bit FNV-1a).
+  * \param[in] pName The name of the attribute.
+  */
+epicsUInt32 NDAttributeList::hashName(const char *pName)
+{
+  epicsUInt32 hash = 2166136261u;
+
+  for (; *pName; pName++) {
+    hash ^= (unsigned char)*pName;
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+/** Adds an attribute to the hash index; the attribute must already be in the list
+  * and must not already be in the index.  Must be called with the lock held.
+  * \param[in] pAttribute A pointer to the attribute.
+  */
+void NDAttributeList::indexAdd(NDAttribute *pAttribute)
+{
+  epicsUInt32 hash = hashName(pAttribute->name_.c_str());
+  size_t i, mask;
+
+  if (2 * (size_t)ellCount(&this->pData_->list) > this->pData_->index.size()) {
+    /* indexRebuild() also adds pAttribute, which is already in the list */
+    this->indexRebuild(this->pData_->index.size() ? 2 * this->pData_->index.size() : 16);
+    return;
+  }
+  mask = this->pData_->index.size() - 1;
+  for (i=hash & mask; this->pData_->index[i].pAttribute; i=(i+1) & mask);
+  this->pData_->index[i].hash = hash;
+  this->pData_->index[i].pAttribute = pAttribute;
+}
+
+/** Removes an attribute from the hash index.  Must be called with the lock held.
+  * The following entries are shifted back so that no tombstones are needed.
+  * \param[in] pAttribute A pointer to the attribute.
+  */
+void NDAttributeList::indexRemove(NDAttribute *pAttribute)
+{
+  size_t i, j, home, mask;
+
+  if (this->pData_->index.size() == 0) return;
+  mask = this->pData_->index.size() - 1;
+  for (i=hashName(pAttribute->name_.c_str()) & mask; this->pData_->index[i].pAttribute != pAttribute; i=(i+1) & mask) {
+    if (!this->pData_->index[i].pAttribute) return;
+  }
+  for (j=(i+1) & mask; this->pData_->index[j].pAttribute; j=(j+1) & mask) {
+    home = this->pData_->index[j].hash & mask;
+    /* The entry at j can move to i unless its home position is cyclically in (i, j] */
+    if ((i <= j) ? ((i < home) && (home <= j)) : ((i < home) || (home <= j))) continue;
+    this->pData_->index[i] = this->pData_->index[j];
+    i = j;
+  }
+  this->pData_->index[i].pAttribute = NULL;
+}
+
+/** Rebuilds the hash index from the list with a new size.  Must be called with the lock held.
+  * \param[in] size The new size of the index, a power of 2.
+  */
+void NDAttributeList::indexRebuild(size_t size)
+{
+  NDAttributeListNode *pListNode;
+  NDAttribute *pAttribute;
+  size_t i, mask = size - 1;
+  epicsUInt32 hash;
+
+  this->pData_->index.assign(size, NDAttributeIndexEntry());
+  pListNode = (NDAttributeListNode *)ellFirst(&this->pData_->list);
+  while (pListNode) {
+    pAttribute = pListNode->pNDAttribute;
+    hash = hashName(pAttribute->name_.c_str());
+    for (i=hash & mask; this->pData_->index[i].pAttribute; i=(i+1) & mask);
+    this->pData_->index[i].hash = hash;
+    this->pData_->index[i].pAttribute = pAttribute;
+    pListNode = (NDAttributeListNode *)ellNext(&pListNode->node);
+  }
+}
@@ -10,17 +10,64 @@
 #define NDAttributeList_H
 
 #include <stdio.h>
+#include <vector>
 #include <ellLib.h>
 #include <epicsMutex.h>
  
 #include "NDAttribute.h"
+#include "NDAttributeSchema.h"
 
 
+/** Entry in the hash index of an NDAttributeList */
+typedef struct NDAttributeIndexEntry {
+    epicsUInt32 hash;           /**< Hash of the attribute name */
+    NDAttribute *pAttribute;    /**< The attribute, NULL if the entry is empty */
+} NDAttributeIndexEntry;
+
+/** The attributes of an NDAttributeList, which can be shared by several lists */
+typedef struct NDAttributeListData {
+    ELLLIST list;               /**< The EPICS ELLLIST of the attributes in the order they were added */
+    /** Open addressing hash index of the attributes by name, with linear probing.
+      * The size is a power of 2 and at least twice the number of attributes. */
+    std::vector<NDAttributeIndexEntry> index;
+    int refCount;               /**< Number of lists using these attributes */
+    bool shareable;             /**< The attributes can be shared by lists that copy them */
+    /** Schema of the first attributes in the list, NULL if the list is not compact */
+    NDAttributeSchema *pSchema;
+    /** Value block; the data types and values of the schema attributes, indexed by slot */
+    std::vector<NDAttributeValue> values;
+    /** The string values of the schema attributes, indexed by slot */
+    std::vector<std::string> strings;
+} NDAttributeListData;
+
 /** NDAttributeList class; this is a linked list of attributes.
+  * The linked list keeps the attributes in the order they were added, and a hash index
+  * of the attribute names makes find(), add() and remove() independent of the number
+  * of attributes in the list.
+  *
+  * The attributes of the lists of NDArrays are shared copy-on-write: copying such a list
+  * into an empty list, which is what NDArrayPool::copy() does, only adds a reference to
+  * the same attributes.  The methods that change the list (add(), remove(), updateValues()
+  * and copying into a list that is not empty) first make a private copy of the attributes
+  * if they are shared.  A list is only shared after it has been copied to or from, and
+  * NDArrayPool::release() drops the shared attributes of an array when it returns to the
+  * free list, so the list of an array returned by NDArrayPool::alloc() is never shared and
+  * drivers can change the attributes that find() and next() return.  The list of an array
+  * made by NDArrayPool::copy(), and the list of the array that was copied, may be shared,
+  * and add() must be used to change the value of their attributes.
+  *
+  * A list can also be compact, in which case the data types and values of its first
+  * attributes are kept in a contiguous value block described by an NDAttributeSchema.
+  * compact() makes the attributes of a list, such as the attribute list of a driver, compact.
+  * Copying a compact list into an empty list, or into a list with the same schema, makes
+  * the output list compact with the same schema, so that afterwards the copy is just a
+  * memcpy of the value block.  The attributes of the output list are then a view of its
+  * value block, and are otherwise used in the same way as any other attribute.
+  * Removing one of the schema attributes returns the values to the attributes.
   */
 class epicsShareClass NDAttributeList {
 public:
-    NDAttributeList();
+    NDAttributeList(bool shareable=false);
     ~NDAttributeList();
     int          add(NDAttribute *pAttribute);
     NDAttribute* add(const char *pName, const char *pDescription="", 
@@ -30,13 +77,32 @@ public:
     int          count();
     int          remove(const char *pName);
     int          clear();
-    int          copy(NDAttributeList *pOut);
+    int          copy(NDAttributeList *pOut, bool exact=false);
+    int          dropShared();
+    int          snapshotValues();
     int          updateValues();
+    int          compact();
+    NDAttributeSchema* getSchema();
+    int          getSlotValue(int slot, double *pValue);
+    int          getSlotValues(int numValues, const int *pSlots, double *pValues);
     int          report(FILE *fp, int details);
     
 private:
-    ELLLIST      list_;   /**< The EPICS ELLLIST  */
+    static epicsUInt32 hashName(const char *pName);
+    static NDAttributeListData *createData(bool shareable);
+    static void releaseData(NDAttributeListData *pData);
+    bool isShared();
+    bool isSubsetOf(NDAttributeList *pList);
+    void detach();
+    void expand();
+    bool canAdopt(NDAttributeSchema *pSchema);
+    void adoptSchema(NDAttributeSchema *pSchema);
+    void indexAdd(NDAttribute *pAttribute);
+    void indexRemove(NDAttribute *pAttribute);
+    void indexRebuild(size_t size);
+    NDAttributeListData *pData_;  /**< The attributes, possibly shared with other lists */
     epicsMutexId lock_;  /**< Mutex to protect the ELLLIST */
+    bool shareable_;     /**< Attributes created by this list can be shared */
 };
 
 #endif
@@ -0,0 +1,74 @@
+/** NDAttributeSchema.cpp
+ *
+ * The names, descriptions and sources of a set of attributes, defined once and shared
+ * by all of the compact attribute lists that contain those attributes.
+ *
+ */
+
+#include <epicsExport.h>
+
+#include "NDAttributeSchema.h"
+
+/** NDAttributeSchema constructor; creates an empty schema with a reference count of 1.
+  * The slots are added with addSlot() before the schema is used by any list.
+  */
+NDAttributeSchema::NDAttributeSchema()
+  : refCount_(1)
+{
+  this->lock_ = epicsMutexMustCreate();
+}
+
+/** NDAttributeSchema destructor, only called by release() */
+NDAttributeSchema::~NDAttributeSchema()
+{
+  epicsMutexDestroy(this->lock_);
+}
+
+/** Adds an attribute to the schema; the slot number is the number of attributes already added.
+  * \param[in] pName The name of the attribute.
+  * \param[in] pDescription The description of the attribute.
+  * \param[in] sourceType The source type of the attribute (NDAttrSource_t).
+  * \param[in] pSource The source string for the attribute.
+  */
+void NDAttributeSchema::addSlot(const char *pName, const char *pDescription, NDAttrSource_t sourceType, const char *pSource)
+{
+  NDAttributeSlot slot;
+
+  slot.name = pName ? pName : "";
+  slot.description = pDescription ? pDescription : "";
+  slot.source = pSource ? pSource : "";
+  slot.sourceType = sourceType;
+  this->slots_.push_back(slot);
+}
+
+/** Adds a reference to the schema */
+void NDAttributeSchema::reserve()
+{
+  epicsMutexLock(this->lock_);
+  this->refCount_++;
+  epicsMutexUnlock(this->lock_);
+}
+
+/** Releases a reference to the schema, deleting it if it was the last one */
+void NDAttributeSchema::release()
+{
+  int refCount;
+
+  epicsMutexLock(this->lock_);
+  refCount = --this->refCount_;
+  epicsMutexUnlock(this->lock_);
+  if (refCount == 0) delete this;
+}
+
+/** Finds an attribute in the schema by name.
+  * This is a linear search; it is only used when a list changes to a different schema.
+  * \param[in] pName The name of the attribute.
+  * \return Returns the slot number, or -1 if there is no attribute of that name.
+  */
+int NDAttributeSchema::findSlot(const char *pName) const
+{
+  for (size_t i=0; i<this->slots_.size(); i++) {
+    if (this->slots_[i].name == pName) return (int)i;
+  }
+  return -1;
+}
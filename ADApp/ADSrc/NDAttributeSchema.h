@@ -0,0 +1,54 @@
+/** NDAttributeSchema.h
+ *
+ * The names, descriptions and sources of a set of attributes, defined once and shared
+ * by all of the compact attribute lists that contain those attributes.
+ *
+ */
+
+#ifndef NDAttributeSchema_H
+#define NDAttributeSchema_H
+
+#include <string>
+#include <vector>
+
+#include <epicsMutex.h>
+
+#include "NDAttribute.h"
+
+/** Description of one attribute in an NDAttributeSchema */
+typedef struct NDAttributeSlot {
+    std::string name;           /**< Name of the attribute */
+    std::string description;    /**< Description of the attribute */
+    std::string source;         /**< Source string - EPICS PV name or DRV_INFO string */
+    NDAttrSource_t sourceType;  /**< Source type */
+} NDAttributeSlot;
+
+/** NDAttributeSchema class; the fixed part of a set of attributes.
+  * A compact NDAttributeList keeps the data types and values of the attributes in its schema
+  * in a flat block indexed by slot number, so copying between two lists with the same schema
+  * only copies the value block.  The data types are part of the values rather than the schema
+  * because some attributes, such as PVAttributes, only know their data type once they are connected.
+  * A schema cannot be changed once it is created; it is reference counted and deleted when
+  * the last list using it releases it.
+  */
+class epicsShareClass NDAttributeSchema {
+public:
+    NDAttributeSchema();
+    void addSlot(const char *pName, const char *pDescription, NDAttrSource_t sourceType, const char *pSource);
+    void reserve();
+    void release();
+    /** Returns the number of attributes in the schema */
+    int numSlots() const { return (int)slots_.size(); }
+    /** Returns the description of an attribute.
+      * \param[in] slot The slot number, 0 to numSlots()-1 */
+    const NDAttributeSlot& getSlot(int slot) const { return slots_[slot]; }
+    int findSlot(const char *pName) const;
+
+private:
+    ~NDAttributeSchema();
+    std::vector<NDAttributeSlot> slots_;
+    int refCount_;          /**< Number of users of the schema */
+    epicsMutexId lock_;     /**< Mutex to protect the reference count */
+};
+
+#endif
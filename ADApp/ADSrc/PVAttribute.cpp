@@ -22,6 +22,7 @@
 
 #define epicsExportSharedSymbols
 #include <shareLib.h>
+#include "NDAtomic.h"
 #include "PVAttribute.h"
 
 static const char *driverName = "PVAttribute";
@@ -45,7 +46,7 @@ static asynUser *pasynUserSelf = NULL;
 PVAttribute::PVAttribute(const char *pName, const char *pDescription,
                          const char *pSource, chtype dbrType)
     : NDAttribute(pName, pDescription, NDAttrSourceEPICSPV, pSource, NDAttrUndefined, 0),
-    dbrType(dbrType), callbackString(0), connectedOnce(false)
+    dbrType(dbrType), callbackString(0), callbackStringSize(0), callbackSequence(0), connectedOnce(false)
 {
     static const char *functionName = "PVAttribute";
     
@@ -85,6 +86,10 @@ PVAttribute::PVAttribute(PVAttribute& attribute)
     dbrType = attribute.dbrType;
     eventId = 0;
     chanId = 0;
+    callbackString = 0;
+    callbackStringSize = 0;
+    callbackSequence = 0;
+    connectedOnce = false;
     lock = 0;
 }
 
@@ -93,6 +98,7 @@ PVAttribute::~PVAttribute()
 {
     if (this->chanId) SEVCHK(ca_clear_channel(this->chanId),"ca_clear_channel");
     if (this->lock) epicsMutexDestroy(this->lock);
+    free(this->callbackString);
 }
 
 
@@ -117,7 +123,7 @@ static void monitorCallbackC(struct event_handler_args cha)
 }
 
 /** Monitor callback called whenever an EPICS PV changes value.
-  * Calls NDAttribute::setValue to store the new value.
+  * Stores the new value, which is copied to the attribute by updateValue().
   * \param[in] eha Event handler argument structure passed by channel access. 
   */
 void PVAttribute::monitorCallback(struct event_handler_args eha)
@@ -137,11 +143,16 @@ void PVAttribute::monitorCallback(struct event_handler_args eha)
         driverName, functionName, eha.status);
         goto done;
     }
-    /* Treat strings specially */
+    /* The lock serializes the callbacks, updateValue() uses the sequence number instead */
+    ndAtomicAdd(&this->callbackSequence, 1);
+    ndWriteBarrier();
+    /* Treat strings specially.  The last character of callbackString is always 0, and DBR_CHAR
+     * arrays read as strings are not necessarily terminated */
     if (dataType == NDAttrString) {
-      if (this->callbackString) free(this->callbackString);
-      this->callbackString = epicsStrDup((char *)eha.dbr);
-      goto done;
+      if (this->callbackString) {
+        strncpy(this->callbackString, (char *)eha.dbr, this->callbackStringSize - 1);
+      }
+      goto written;
     }
     switch (dataType) {
       case NDAttrInt8:
@@ -173,24 +184,38 @@ void PVAttribute::monitorCallback(struct event_handler_args eha)
       default:
         break;
     }
+    written:
+    ndWriteBarrier();
+    ndAtomicAdd(&this->callbackSequence, 1);
     done:
     epicsMutexUnlock(this->lock);
 }
 
+/** Updates the value of the attribute with the last value received from the PV.
+  * This does not take the lock, so it is never blocked by channel access callbacks;
+  * it reads the value again if a callback changed it while it was being read.
+  */
 int PVAttribute::updateValue()
 {
     //static const char *functionName = "updateValue"
     
-    void *pValue;
+    NDAttrValue value;
     NDAttrDataType_t dataType = this->getDataType();
-    
-    epicsMutexLock(this->lock);
+    int sequence;
+
+    if ((dataType == NDAttrString) && !this->callbackString) return asynSuccess;
+    do {
+        sequence = ndAtomicGet(&this->callbackSequence);
+        if (dataType == NDAttrString)
+            this->updateString.assign(this->callbackString);
+        else
+            value = this->callbackValue;
+        ndReadBarrier();
+    } while ((sequence & 1) || (sequence != ndAtomicGet(&this->callbackSequence)));
     if (dataType == NDAttrString)
-        pValue = callbackString;
+        this->setValue(this->updateString);
     else
-        pValue = &callbackValue;
-    this->setValue(pValue);
-    epicsMutexUnlock(this->lock);
+        this->setValue(&value);
     return asynSuccess;
 }
 
@@ -296,6 +321,12 @@ void PVAttribute::connectCallback(struct connection_handler_args cha)
         asynPrint(pasynUserSelf, ASYN_TRACE_FLOW, 
             "%s:%s: Connect event, PV=%s, chanId=%p, type=%d\n", 
             driverName, functionName, this->getSource(), chanId, dataType);
+        if (dataType == NDAttrString) {
+            /* The string must be allocated before updateValue() sees the data type */
+            this->callbackStringSize = (nRequest > MAX_STRING_SIZE ? nRequest : MAX_STRING_SIZE) + 1;
+            this->callbackString = (char *)calloc(this->callbackStringSize, 1);
+            ndWriteBarrier();
+        }
         this->setDataType(dataType);
             
         /* Set value change callback on this PV */
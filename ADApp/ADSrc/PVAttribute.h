@@ -39,7 +39,12 @@ private:
     evid        eventId;
     chtype      dbrType;
     NDAttrValue callbackValue;
-    char        *callbackString;
+    char        *callbackString;     /**< Allocated when the PV connects with room for the longest string */
+    size_t      callbackStringSize;
+    /** Sequence number of callbackValue and callbackString, odd while monitorCallback is changing them.
+      * updateValue() reads them without the lock and tries again if this changed while it was reading. */
+    int         callbackSequence;
+    std::string updateString;       /**< Used by updateValue() to read callbackString */
     bool        connectedOnce;
     epicsMutexId lock;
 };
@@ -472,6 +472,12 @@ done_macros:
   * Calls NDAttributeList::updateValues for this driver's attribute list, 
   * and then NDAttributeList::copy, to copy this driver's attribute 
   * list to pList, appending the values to that output attribute list.
+  * The driver's attribute list is kept compact, so copying it to the attribute list of an
+  * NDArray that was last used by this driver is a copy of its value block.
+  * The parameter values of all of the attributes are first read in a single pass with the
+  * driver locked (NDAttributeList::snapshotValues), so they are a consistent snapshot of the
+  * parameter library, and the attributes are then updated without the driver lock.
+  * PVAttribute values are read without locking.
   * \param[out] pList  The NDAttributeList to copy the attributes to.
   *
   * NOTE: Plugins must never call this function with a pointer to the attribute
@@ -483,7 +489,11 @@ asynStatus asynNDArrayDriver::getAttributes(NDAttributeList *pList)
     //const char *functionName = "getAttributes";
     int status = asynSuccess;
     
+    this->lock();
+    this->pAttributeList->snapshotValues();
+    this->unlock();
     status = this->pAttributeList->updateValues();
+    this->pAttributeList->compact();
     status = this->pAttributeList->copy(pList);
     return (asynStatus) status;
 }
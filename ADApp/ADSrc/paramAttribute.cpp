@@ -44,7 +44,8 @@ static asynUser *pasynUserSelf = NULL;
 paramAttribute::paramAttribute(const char *pName, const char *pDescription, const char *pSource, int addr, 
                                class asynNDArrayDriver *pDriver, const char *dataType)
     : NDAttribute(pName, pDescription, NDAttrSourceParam, pSource, NDAttrUndefined, 0),
-    paramAddr(addr), paramType(paramAttrTypeUnknown), pDriver(pDriver)
+    paramAddr(addr), paramType(paramAttrTypeUnknown), pDriver(pDriver),
+    haveSnapshot(false), snapshotStatus(asynSuccess), i32Value(0), f64Value(0.)
 {
     static const char *functionName = "paramAttribute";
     asynUser *pasynUser=NULL;
@@ -108,6 +109,10 @@ paramAttribute::paramAttribute(paramAttribute& attribute)
     paramAddr = attribute.paramAddr;
     pDriver = attribute.pDriver;
     paramId = attribute.paramId;
+    haveSnapshot = false;
+    snapshotStatus = asynSuccess;
+    i32Value = 0;
+    f64Value = 0.;
 }
 
 /** Destructor for driver/plugin attribute
@@ -116,32 +121,59 @@ paramAttribute::~paramAttribute()
 {
 }
 
+/** Reads the current value of the driver/plugin parameter from the parameter library, to be
+  * set by the next updateValue().
+  * asynNDArrayDriver::getAttributes() calls this for all of its attributes while it holds the
+  * driver lock, so the values of all of the parameter attributes are from the same point in time,
+  * and then updates the attributes after releasing the lock.
+  */
+int paramAttribute::snapshotValue()
+{
+    int status = asynSuccess;
+
+    switch (this->paramType) {
+        case paramAttrTypeInt:
+            status = this->pDriver->getIntegerParam(this->paramAddr, this->paramId, 
+                                                 &this->i32Value);
+            break;
+        case paramAttrTypeDouble:
+            status = this->pDriver->getDoubleParam(this->paramAddr, this->paramId,
+                                                &this->f64Value);
+            break;
+        case paramAttrTypeString:
+            status = this->pDriver->getStringParam(this->paramAddr, this->paramId,
+                                                this->stringValue);
+            break;
+        default:
+            break;
+    }
+    this->snapshotStatus = status;
+    this->haveSnapshot = true;
+    return(status);
+}
+
 /** Updates the current value of this attribute; sets the attribute value to the current value of the
   * driver/plugin parameter in the parameter library.
+  * If snapshotValue() was called since the last update the value it read is used, otherwise
+  * the parameter is read now.
   */
 int paramAttribute::updateValue()
 {
-    int status = asynSuccess;
-    std::string stringValue = "";
-    epicsInt32 i32Value=0;
-    epicsFloat64 f64Value=0.;
+    int status;
     static const char *functionName = "updateValue";
     
+    if (!this->haveSnapshot) this->snapshotValue();
+    this->haveSnapshot = false;
+    status = this->snapshotStatus;
     switch (this->paramType) {
         case paramAttrTypeInt:
-            status = this->pDriver->getIntegerParam(this->paramAddr, this->paramId, 
-                                                 &i32Value);
-            this->setValue(&i32Value);
+            this->setValue(&this->i32Value);
             break;
         case paramAttrTypeDouble:
-            status = this->pDriver->getDoubleParam(this->paramAddr, this->paramId,
-                                                &f64Value);
-            this->setValue(&f64Value);
+            this->setValue(&this->f64Value);
             break;
         case paramAttrTypeString:
-            status = this->pDriver->getStringParam(this->paramAddr, this->paramId,
-                                                stringValue);
-            this->setValue(stringValue);
+            this->setValue(this->stringValue);
             break;
         default:
             break;
@@ -33,6 +33,7 @@ public:
     paramAttribute(paramAttribute& attribute);
     ~paramAttribute();
     paramAttribute* copy(NDAttribute *pAttribute);
+    int snapshotValue();
     int updateValue();
     int report(FILE *fp, int details);
 
@@ -41,6 +42,11 @@ private:
     int         paramAddr;
     paramAttrType_t paramType;
     class asynNDArrayDriver *pDriver;
+    bool        haveSnapshot;   /**< snapshotValue() has read a value that updateValue() has not set yet */
+    int         snapshotStatus; /**< Status of reading the parameter in snapshotValue() */
+    epicsInt32  i32Value;
+    epicsFloat64 f64Value;
+    std::string stringValue;    /**< Kept between updates so that reading strings does not allocate memory */
 };
 
 #endif /*INCparamAttributeH*/
@@ -1,5 +1,9 @@
 #include <math.h>
 
+#ifdef HAVE_BLOSC
+#include <blosc.h>
+#endif
+
 #include <epicsExport.h>
 #include "ntndArrayConverter.h"
 
@@ -40,6 +44,18 @@ static const NDAttrDataType_t scalarToNDAttrDataType[pvString+1] = {
         NDAttrString,   // 11: pvString
 };
 
+// Maps NDDataType_t to ScalarType, for the data type in the codec parameters
+static const ScalarType NDDataTypeToScalar[NDFloat64+1] = {
+        pvByte,     // NDInt8
+        pvUByte,    // NDUInt8
+        pvShort,    // NDInt16
+        pvUShort,   // NDUInt16
+        pvInt,      // NDInt32
+        pvUInt,     // NDUInt32
+        pvFloat,    // NDFloat32
+        pvDouble,   // NDFloat64
+};
+
 static const PVDataCreatePtr PVDC = getPVDataCreate();
 
 template <typename dataType>
@@ -49,10 +65,24 @@ struct freeNDArray {
     void operator()(dataType *data) { array->release(); }
 };
 
-NTNDArrayConverter::NTNDArrayConverter (NTNDArrayPtr array) : m_array(array) {}
+NTNDArrayConverter::NTNDArrayConverter (NTNDArrayPtr array) :
+    m_array(array),
+    m_attributeStructure(array->getAttribute()->getStructureArray()->getStructure()),
+    m_attributeSet(0),
+    m_attributesPrepared(false)
+{}
 
 ScalarType NTNDArrayConverter::getValueType (void)
 {
+    // The value of a compressed array is bytes, the codec parameters have the data type
+    if(!m_array->getCodec()->getSubField<PVString>("name")->get().empty())
+    {
+        PVIntPtr dataType(m_array->getCodec()->getSubField<PVUnion>("parameters")->get<PVInt>());
+        if(!dataType || dataType->get() < NDInt8 || dataType->get() > NDFloat64)
+            throw std::runtime_error("invalid codec parameters");
+        return NDDataTypeToScalar[dataType->get()];
+    }
+
     string fieldName(m_array->getValue()->getSelectedFieldName());
 
     /*
@@ -204,15 +234,24 @@ void NTNDArrayConverter::toArray (NDArray *dest)
     dest->uniqueId = uniqueId->get();
 }
 
-void NTNDArrayConverter::fromArray (NDArray *src)
+/** Copies an NDArray to the NTNDArray.
+  * The attributes are those built by prepareAttributes() if it was called for this array.
+  * \param[in] src The array.
+  * \param[in] compressed If not NULL, an NDUInt8 array with the data of src compressed with
+  *            the codec, which is published as the value instead of the data of src.
+  * \param[in] codec The name of the codec, for example "blosc".
+  */
+void NTNDArrayConverter::fromArray (NDArray *src, NDArray *compressed, const string& codec)
 {
-    fromValue(src);
+    if(compressed)
+        fromCompressedValue(src, compressed);
+    else
+        fromValue(src);
     fromDimensions(src);
     fromTimeStamp(src);
     fromDataTimeStamp(src);
     fromAttributes(src);
-
-    m_array->getCodec()->getSubField<PVString>("name")->put("");
+    fromCodec(src, compressed ? codec : string());
 
     // getUniqueId not implemented yet
     // m_array->getUniqueId()->put(src->uniqueId);
@@ -233,6 +272,14 @@ void NTNDArrayConverter::toValue (NDArray *dest)
 
 void NTNDArrayConverter::toValue (NDArray *dest)
 {
+    string codec(m_array->getCodec()->getSubField<PVString>("name")->get());
+
+    if(!codec.empty())
+    {
+        toDecompressedValue(dest, codec);
+        return;
+    }
+
     switch(getValueType())
     {
     case pvByte:    toValue<PVByteArray>  (dest); break;
@@ -253,6 +300,38 @@ void NTNDArrayConverter::toValue (NDArray *dest)
     }
 }
 
+void NTNDArrayConverter::toDecompressedValue (NDArray *dest, const string& codec)
+{
+    NTNDArrayInfo_t info(getInfo());
+    PVUByteArrayPtr src(m_array->getValue()->get<PVUByteArray>());
+
+    if(!src)
+        throw std::runtime_error("compressed value is not ubyteValue");
+
+    PVUByteArray::const_svector srcVec(src->view());
+
+#ifdef HAVE_BLOSC
+    if(codec == "blosc")
+    {
+        // Check the header before decompressing, so a short or corrupt buffer
+        // cannot make blosc read past the source or write past the destination
+        size_t nbytes, cbytes, blocksize;
+        if(srcVec.size() < BLOSC_MIN_HEADER_LENGTH)
+            throw std::runtime_error("blosc buffer is too short");
+        blosc_cbuffer_sizes(srcVec.data(), &nbytes, &cbytes, &blocksize);
+        if(cbytes > srcVec.size() || nbytes != info.totalBytes)
+            throw std::runtime_error("blosc buffer does not match the array");
+
+        int size = blosc_decompress_ctx(srcVec.data(), dest->pData, info.totalBytes, 1);
+        if(size < 0 || (size_t)size != info.totalBytes)
+            throw std::runtime_error("blosc decompression failed");
+        return;
+    }
+#endif
+
+    throw std::runtime_error("unsupported codec " + codec);
+}
+
 void NTNDArrayConverter::toDimensions (NDArray *dest)
 {
     PVStructureArrayPtr src(m_array->getDimension());
@@ -413,6 +492,53 @@ void NTNDArrayConverter::fromValue (NDArray *src)
     }
 }
 
+void NTNDArrayConverter::fromCompressedValue (NDArray *src, NDArray *compressed)
+{
+    typedef PVUByteArray::value_type arrayValType;
+
+    NDArrayInfo_t arrayInfo;
+    size_t count = compressed->dims[0].size;
+
+    src->getInfo(&arrayInfo);
+
+    m_array->getCompressedDataSize()->put(static_cast<int64>(count));
+    m_array->getUncompressedDataSize()->put(static_cast<int64>(arrayInfo.totalBytes));
+
+    compressed->reserve();
+    shared_vector<arrayValType> temp((arrayValType*)compressed->pData,
+            freeNDArray<arrayValType>(compressed), 0, count);
+
+    PVUnionPtr dest = m_array->getValue();
+    dest->select<PVUByteArray>("ubyteValue")->replace(freeze(temp));
+    dest->postPut();
+}
+
+/** Sets the codec name, and for compressed arrays the data type of the uncompressed data
+  * in the codec parameters. */
+void NTNDArrayConverter::fromCodec (NDArray *src, const string& codec)
+{
+    PVStructurePtr dest(m_array->getCodec());
+    PVUnionPtr parameters(dest->getSubField<PVUnion>("parameters"));
+
+    dest->getSubField<PVString>("name")->put(codec);
+
+    if(codec.empty())
+    {
+        if(parameters->get())
+            parameters->set(PVFieldPtr());
+        return;
+    }
+
+    PVIntPtr dataType(parameters->get<PVInt>());
+    if(!dataType)
+    {
+        dataType = PVDC->createPVScalar<PVInt>();
+        parameters->set(dataType);
+    }
+    dataType->put(src->dataType);
+    parameters->postPut();
+}
+
 void NTNDArrayConverter::fromDimensions (NDArray *src)
 {
     PVStructureArrayPtr dest(m_array->getDimension());
@@ -460,20 +586,15 @@ void NTNDArrayConverter::fromTimeStamp (NDArray *src)
 }
 
 template <typename pvAttrType, typename valueType>
-void NTNDArrayConverter::fromAttribute (PVStructurePtr dest, NDAttribute *src)
+void NTNDArrayConverter::fromAttribute (PVUnionPtr dest, NDAttribute *src)
 {
     valueType value;
     src->getValue(src->getDataType(), (void*)&value);
 
-    PVUnionPtr destUnion(dest->getSubField<PVUnion>("value"));
-
-    if(!destUnion->get())
-        destUnion->set(PVDC->createPVScalar<pvAttrType>());
-
-    static_pointer_cast<pvAttrType>(destUnion->get())->put(value);
+    static_pointer_cast<pvAttrType>(dest->get())->put(value);
 }
 
-void NTNDArrayConverter::fromStringAttribute (PVStructurePtr dest, NDAttribute *src)
+void NTNDArrayConverter::fromStringAttribute (PVUnionPtr dest, NDAttribute *src)
 {
     NDAttrDataType_t attrDataType;
     size_t attrDataSize;
@@ -483,67 +604,121 @@ void NTNDArrayConverter::fromStringAttribute (PVStructurePtr dest, NDAttribute *
     char *value = (char *)malloc(sizeof(char) * attrDataSize);
     src->getValue(attrDataType, value, attrDataSize);
 
-    PVUnionPtr destUnion(dest->getSubField<PVUnion>("value"));
-
-    if(!destUnion->get())
-        destUnion->set(PVDC->createPVScalar<PVString>());
-
-    static_pointer_cast<PVString>(destUnion->get())->put(value);
+    static_pointer_cast<PVString>(dest->get())->put(value);
     free(value);
 }
 
-void NTNDArrayConverter::fromUndefinedAttribute (PVStructurePtr dest)
+void NTNDArrayConverter::fromUndefinedAttribute (PVUnionPtr dest)
 {
-    dest->getSubField<PVUnion>("value")->get().reset();
+    dest->set(PVFieldPtr());
 }
 
-void NTNDArrayConverter::fromAttributes (NDArray *src)
+/** Selects the value type of an attribute structure for the data type of an attribute. */
+void NTNDArrayConverter::setAttributeType (AttributeCache& entry, NDAttribute *src)
+{
+    switch(src->getDataType())
+    {
+    case NDAttrInt8:      entry.value->set(PVDC->createPVScalar<PVByte>());   break;
+    case NDAttrUInt8:     entry.value->set(PVDC->createPVScalar<PVUByte>());  break;
+    case NDAttrInt16:     entry.value->set(PVDC->createPVScalar<PVShort>());  break;
+    case NDAttrUInt16:    entry.value->set(PVDC->createPVScalar<PVUShort>()); break;
+    case NDAttrInt32:     entry.value->set(PVDC->createPVScalar<PVInt>());    break;
+    case NDAttrUInt32:    entry.value->set(PVDC->createPVScalar<PVUInt>());   break;
+    case NDAttrFloat32:   entry.value->set(PVDC->createPVScalar<PVFloat>());  break;
+    case NDAttrFloat64:   entry.value->set(PVDC->createPVScalar<PVDouble>()); break;
+    case NDAttrString:    entry.value->set(PVDC->createPVScalar<PVString>()); break;
+    case NDAttrUndefined: fromUndefinedAttribute(entry.value); break;
+    default:              throw std::runtime_error("invalid attribute data type");
+    }
+    entry.dataType = src->getDataType();
+}
+
+/** Builds the attribute structures of an NDArray for the next call to fromArray().
+  * Only structures that are not part of the NTNDArray are written, so this can be called
+  * without the record lock; it must not be called from more than one thread at a time.
+  *
+  * The structures are kept between arrays and only their values are updated while the
+  * attribute in the same position of the list has the same name and data type.  There are
+  * two sets of structures used for alternate arrays, because the NTNDArray holds the set of
+  * the previous array; a structure that a monitor still holds is replaced by a new one.
+  */
+void NTNDArrayConverter::prepareAttributes (NDArray *src)
 {
-    PVStructureArrayPtr dest(m_array->getAttribute());
     NDAttributeList *srcList = src->pAttributeList;
     NDAttribute *attr = NULL;
-    StructureConstPtr structure(dest->getStructureArray()->getStructure());
-    PVStructureArray::svector destVec(dest->reuse());
+    vector<AttributeCache>& cache = m_attributeCache[m_attributeSet];
+    size_t count = srcList->count();
+    size_t i = 0;
 
-    destVec.resize(srcList->count());
+    m_attributeSet = 1 - m_attributeSet;
+    cache.resize(count);
+    m_attributes = PVStructureArray::svector(count);
 
-    size_t i = 0;
-    while((attr = srcList->next(attr)))
+    while((attr = srcList->next(attr)) && (i < count))
     {
-        if(!destVec[i].get() || !destVec[i].unique())
-            destVec[i] = PVDC->createPVStructure(structure);
+        AttributeCache& entry = cache[i];
 
-        PVStructurePtr pvAttr(destVec[i]);
+        if(!entry.structure.get() || !entry.structure.unique())
+        {
+            entry.structure = PVDC->createPVStructure(m_attributeStructure);
+            entry.name       = entry.structure->getSubField<PVString>("name");
+            entry.descriptor = entry.structure->getSubField<PVString>("descriptor");
+            entry.source     = entry.structure->getSubField<PVString>("source");
+            entry.sourceType = entry.structure->getSubField<PVInt>("sourceType");
+            entry.value      = entry.structure->getSubField<PVUnion>("value");
+            entry.valid      = false;
+        }
 
-        pvAttr->getSubField<PVString>("name")->put(attr->getName());
-        pvAttr->getSubField<PVString>("descriptor")->put(attr->getDescription());
-        pvAttr->getSubField<PVString>("source")->put(attr->getSource());
+        if(!entry.valid || entry.attrName != attr->getName() ||
+           entry.dataType != attr->getDataType())
+        {
+            entry.attrName = attr->getName();
+            entry.name->put(entry.attrName);
+            setAttributeType(entry, attr);
+            entry.valid = true;
+        }
+
+        // The descriptor and source rarely change, only put them when they do
+        if(entry.descriptor->get() != attr->getDescription())
+            entry.descriptor->put(attr->getDescription());
+        if(entry.source->get() != attr->getSource())
+            entry.source->put(attr->getSource());
 
         NDAttrSource_t sourceType;
         attr->getSourceInfo(&sourceType);
-        pvAttr->getSubField<PVInt>("sourceType")->put(sourceType);
+        if(entry.sourceType->get() != sourceType)
+            entry.sourceType->put(sourceType);
 
-        switch(attr->getDataType())
+        switch(entry.dataType)
         {
-        case NDAttrInt8:      fromAttribute <PVByte,   int8_t>  (pvAttr, attr); break;
-        case NDAttrUInt8:     fromAttribute <PVUByte,  uint8_t> (pvAttr, attr); break;
-        case NDAttrInt16:     fromAttribute <PVShort,  int16_t> (pvAttr, attr); break;
-        case NDAttrUInt16:    fromAttribute <PVUShort, uint16_t>(pvAttr, attr); break;
-        case NDAttrInt32:     fromAttribute <PVInt,    int32_t> (pvAttr, attr); break;
-        case NDAttrUInt32:    fromAttribute <PVUInt,   uint32_t>(pvAttr, attr); break;
-        case NDAttrFloat32:   fromAttribute <PVFloat,  float>   (pvAttr, attr); break;
-        case NDAttrFloat64:   fromAttribute <PVDouble, double>  (pvAttr, attr); break;
-        case NDAttrString:    fromStringAttribute(pvAttr, attr); break;
-        case NDAttrUndefined: fromUndefinedAttribute(pvAttr); break;
-        default:              throw std::runtime_error("invalid attribute data type");
+        case NDAttrInt8:      fromAttribute <PVByte,   int8_t>  (entry.value, attr); break;
+        case NDAttrUInt8:     fromAttribute <PVUByte,  uint8_t> (entry.value, attr); break;
+        case NDAttrInt16:     fromAttribute <PVShort,  int16_t> (entry.value, attr); break;
+        case NDAttrUInt16:    fromAttribute <PVUShort, uint16_t>(entry.value, attr); break;
+        case NDAttrInt32:     fromAttribute <PVInt,    int32_t> (entry.value, attr); break;
+        case NDAttrUInt32:    fromAttribute <PVUInt,   uint32_t>(entry.value, attr); break;
+        case NDAttrFloat32:   fromAttribute <PVFloat,  float>   (entry.value, attr); break;
+        case NDAttrFloat64:   fromAttribute <PVDouble, double>  (entry.value, attr); break;
+        case NDAttrString:    fromStringAttribute(entry.value, attr); break;
+        default:              break;
         }
 
+        m_attributes[i] = entry.structure;
         ++i;
     }
 
-    dest->replace(freeze(destVec));
+    m_attributes.resize(i);
+    m_attributesPrepared = true;
 }
 
+void NTNDArrayConverter::fromAttributes (NDArray *src)
+{
+    if(!m_attributesPrepared)
+        prepareAttributes(src);
+
+    m_array->getAttribute()->replace(freeze(m_attributes));
+    m_attributesPrepared = false;
+}
 
 
 
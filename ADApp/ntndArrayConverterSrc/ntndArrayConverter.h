@@ -1,3 +1,6 @@
+#include <string>
+#include <vector>
+
 #include <NDArray.h>
 #include <pv/ntndarray.h>
 
@@ -24,10 +27,29 @@ public:
 
     NTNDArrayInfo_t getInfo (void);
     void toArray (NDArray *dest);
-    void fromArray (NDArray *src);
+    void prepareAttributes (NDArray *src);
+    void fromArray (NDArray *src, NDArray *compressed = NULL,
+                    const std::string& codec = "");
 
 private:
+    /** Attribute structure of the NTNDArray with its fields, reused while it has the same attribute */
+    struct AttributeCache
+    {
+        epics::pvData::PVStructurePtr structure;
+        epics::pvData::PVStringPtr name, descriptor, source;
+        epics::pvData::PVIntPtr sourceType;
+        epics::pvData::PVUnionPtr value;
+        std::string attrName;
+        NDAttrDataType_t dataType;
+        bool valid;
+    };
+
     epics::nt::NTNDArrayPtr m_array;
+    epics::pvData::StructureConstPtr m_attributeStructure;
+    std::vector<AttributeCache> m_attributeCache[2];
+    int m_attributeSet;
+    epics::pvData::PVStructureArray::svector m_attributes;
+    bool m_attributesPrepared;
 
     epics::pvData::ScalarType getValueType (void);
     NDColorMode_t getColorMode (void);
@@ -35,6 +57,7 @@ private:
     template <typename arrayType>
     void toValue (NDArray *dest);
     void toValue (NDArray *dest);
+    void toDecompressedValue (NDArray *dest, const std::string& codec);
 
     void toDimensions (NDArray *dest);
     void toTimeStamp (NDArray *dest);
@@ -49,15 +72,18 @@ private:
     template <typename arrayType, typename srcDataType>
     void fromValue (NDArray *src);
     void fromValue (NDArray *src);
+    void fromCompressedValue (NDArray *src, NDArray *compressed);
+    void fromCodec (NDArray *src, const std::string& codec);
 
     void fromDimensions (NDArray *src);
     void fromTimeStamp (NDArray *src);
     void fromDataTimeStamp (NDArray *src);
 
     template <typename pvAttrType, typename valueType>
-    void fromAttribute (epics::pvData::PVStructurePtr dest, NDAttribute *src);
-    void fromStringAttribute (epics::pvData::PVStructurePtr dest, NDAttribute *src);
-    void fromUndefinedAttribute (epics::pvData::PVStructurePtr dest);
+    void fromAttribute (epics::pvData::PVUnionPtr dest, NDAttribute *src);
+    void fromStringAttribute (epics::pvData::PVUnionPtr dest, NDAttribute *src);
+    void fromUndefinedAttribute (epics::pvData::PVUnionPtr dest);
+    void setAttributeType (AttributeCache& entry, NDAttribute *src);
     void fromAttributes (NDArray *src);
 };
 
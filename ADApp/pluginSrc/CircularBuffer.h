@@ -33,7 +33,9 @@ public:
     void push_back(const T& el) {
         buffer_[cpos_] = el;
 
-        cpos_ = (cpos_ + 1) % max_length_;
+        if (++cpos_ == max_length_) {
+            cpos_ = 0;
+        }
 
         if (size_ < max_length_) {
             size_++;
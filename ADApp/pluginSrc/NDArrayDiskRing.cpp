@@ -0,0 +1,473 @@
+/*
+ * NDArrayDiskRing.cpp
+ *
+ * Circular ring of NDArrays stored in a memory-mapped file
+ *
+ * Created October 19, 2026
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+
+#ifdef _WIN32
+  #include <windows.h>
+#elif !defined(vxWorks) && !defined(__rtems__)
+  #include <sys/types.h>
+  #include <sys/mman.h>
+  #include <fcntl.h>
+  #include <unistd.h>
+  #define ND_HAVE_MMAP
+#endif
+
+#ifdef HAVE_ZLIB
+  #include <zlib.h>
+#endif
+
+#include <epicsTypes.h>
+#include <epicsTime.h>
+
+#include <epicsExport.h>
+#include "NDArrayDiskRing.h"
+
+/** Header at the start of each record in the file.  Its size is a multiple of 8 bytes,
+  * and each record is padded to a multiple of 8 bytes, so the headers are aligned. */
+typedef struct {
+    epicsInt32     ndims;
+    epicsInt32     dataType;
+    epicsInt32     uniqueId;
+    epicsInt32     compressed;
+    epicsInt32     numAttributes;
+    epicsInt32     pad;
+    double         timeStamp;
+    epicsTimeStamp epicsTS;
+    size_t         attributeSize;
+    size_t         dataSize;
+    size_t         storedSize;
+    NDDimension_t  dims[ND_ARRAY_MAX_DIMS];
+} NDDiskRingHeader_t;
+
+static size_t roundUp8(size_t size)
+{
+  return (size + 7) & ~(size_t)7;
+}
+
+NDArrayDiskRing::NDArrayDiskRing()
+  : fileSize_(0), pMap_(NULL),
+#ifdef _WIN32
+    fileHandle_(INVALID_HANDLE_VALUE), mappingHandle_(NULL),
+#else
+    fd_(-1),
+#endif
+    maxArrays_(0), writeOffset_(0), bytesWritten_(0), bytesStored_(0)
+{
+}
+
+NDArrayDiskRing::~NDArrayDiskRing()
+{
+  close();
+}
+
+/** Opens the ring.
+  * \param[in] fileName The file to create; any existing file is overwritten.
+  * \param[in] fileSize The size of the file in bytes.
+  * \param[in] maxArrays The maximum number of arrays to keep in the ring.
+  * \return ND_SUCCESS, or ND_ERROR with errorMessage() describing the error. */
+int NDArrayDiskRing::open(const char *fileName, size_t fileSize, int maxArrays)
+{
+  if (isOpen() && (fileName_ == fileName) && (fileSize_ == fileSize)) {
+    clear();
+    maxArrays_ = maxArrays;
+    bytesWritten_ = 0;
+    bytesStored_ = 0;
+    return ND_SUCCESS;
+  }
+  close();
+  fileName_ = fileName;
+  fileSize_ = fileSize;
+  maxArrays_ = maxArrays;
+  bytesWritten_ = 0;
+  bytesStored_ = 0;
+  if (mapFile() != ND_SUCCESS) {
+    unmapFile();
+    return ND_ERROR;
+  }
+  return ND_SUCCESS;
+}
+
+void NDArrayDiskRing::close()
+{
+  clear();
+  unmapFile();
+}
+
+bool NDArrayDiskRing::isOpen()
+{
+  return pMap_ != NULL;
+}
+
+int NDArrayDiskRing::size()
+{
+  return (int)records_.size();
+}
+
+void NDArrayDiskRing::clear()
+{
+  records_.clear();
+  writeOffset_ = 0;
+}
+
+double NDArrayDiskRing::bytesWritten()
+{
+  return bytesWritten_;
+}
+
+double NDArrayDiskRing::bytesStored()
+{
+  return bytesStored_;
+}
+
+const char *NDArrayDiskRing::errorMessage()
+{
+  return errorMessage_.c_str();
+}
+
+/** Returns true if addToEnd() can compress arrays, i.e. if this was built with zlib */
+bool NDArrayDiskRing::compressionAvailable()
+{
+#ifdef HAVE_ZLIB
+  return true;
+#else
+  return false;
+#endif
+}
+
+int NDArrayDiskRing::mapFile()
+{
+  if (fileSize_ == 0) {
+    errorMessage_ = "file size is 0";
+    return ND_ERROR;
+  }
+#if defined(_WIN32)
+  // FILE_FLAG_DELETE_ON_CLOSE removes the file when the handle is closed
+  HANDLE fileHandle = CreateFileA(fileName_.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                                  FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+  if (fileHandle == INVALID_HANDLE_VALUE) {
+    errorMessage_ = "cannot create " + fileName_;
+    return ND_ERROR;
+  }
+  fileHandle_ = fileHandle;
+  mappingHandle_ = CreateFileMappingA(fileHandle, NULL, PAGE_READWRITE,
+                                      (DWORD)((epicsUInt64)fileSize_ >> 32), (DWORD)(fileSize_ & 0xFFFFFFFF), NULL);
+  if (mappingHandle_ == NULL) {
+    errorMessage_ = "cannot create a file mapping for " + fileName_;
+    return ND_ERROR;
+  }
+  pMap_ = (char *)MapViewOfFile(mappingHandle_, FILE_MAP_ALL_ACCESS, 0, 0, fileSize_);
+  if (pMap_ == NULL) {
+    errorMessage_ = "cannot map " + fileName_;
+    return ND_ERROR;
+  }
+  return ND_SUCCESS;
+#elif defined(ND_HAVE_MMAP)
+  void *pMap;
+  int status;
+
+  fd_ = ::open(fileName_.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+  if (fd_ < 0) {
+    errorMessage_ = "cannot create " + fileName_ + ": " + strerror(errno);
+    return ND_ERROR;
+  }
+  // Allocate the blocks now where possible, so a full disk is an error here rather than
+  // a SIGBUS when the mapped memory is written
+#if defined(__linux__)
+  status = posix_fallocate(fd_, 0, (off_t)fileSize_);
+#else
+  status = ftruncate(fd_, (off_t)fileSize_) ? errno : 0;
+#endif
+  if (status) {
+    errorMessage_ = "cannot allocate " + fileName_ + ": " + strerror(status);
+    return ND_ERROR;
+  }
+  pMap = mmap(NULL, fileSize_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+  if (pMap == MAP_FAILED) {
+    errorMessage_ = "cannot map " + fileName_ + ": " + strerror(errno);
+    return ND_ERROR;
+  }
+  pMap_ = (char *)pMap;
+  return ND_SUCCESS;
+#else
+  errorMessage_ = "memory-mapped files are not supported on this OS";
+  return ND_ERROR;
+#endif
+}
+
+void NDArrayDiskRing::unmapFile()
+{
+#if defined(_WIN32)
+  if (pMap_) UnmapViewOfFile(pMap_);
+  if (mappingHandle_) CloseHandle(mappingHandle_);
+  if (fileHandle_ != INVALID_HANDLE_VALUE) CloseHandle(fileHandle_);
+  mappingHandle_ = NULL;
+  fileHandle_ = INVALID_HANDLE_VALUE;
+#elif defined(ND_HAVE_MMAP)
+  if (pMap_) munmap(pMap_, fileSize_);
+  if (fd_ >= 0) {
+    ::close(fd_);
+    remove(fileName_.c_str());
+  }
+#endif
+#ifndef _WIN32
+  fd_ = -1;
+#endif
+  pMap_ = NULL;
+}
+
+/** Serializes an attribute list.  Each attribute is its name and description with terminating
+  * nulls, its data type and value size as epicsInt32, and its value.
+  * \param[in] pList The attributes.
+  * \param[out] buffer The serialized attributes. */
+void NDArrayDiskRing::serializeAttributes(NDAttributeList *pList, std::vector<char>& buffer)
+{
+  NDAttrDataType_t dataType;
+  size_t valueSize, nameSize, descriptionSize, offset;
+  epicsInt32 info[2];
+
+  buffer.clear();
+  for (NDAttribute *pAttr = pList->next(NULL); pAttr; pAttr = pList->next(pAttr)) {
+    pAttr->getValueInfo(&dataType, &valueSize);
+    nameSize = strlen(pAttr->getName()) + 1;
+    descriptionSize = strlen(pAttr->getDescription()) + 1;
+    offset = buffer.size();
+    buffer.resize(offset + nameSize + descriptionSize + sizeof(info) + valueSize);
+    char *pOut = &buffer[offset];
+    memcpy(pOut, pAttr->getName(), nameSize);
+    pOut += nameSize;
+    memcpy(pOut, pAttr->getDescription(), descriptionSize);
+    pOut += descriptionSize;
+    info[0] = dataType;
+    info[1] = (epicsInt32)valueSize;
+    memcpy(pOut, info, sizeof(info));
+    pOut += sizeof(info);
+    if (valueSize > 0) pAttr->getValue(dataType, pOut, valueSize);
+  }
+}
+
+void NDArrayDiskRing::deserializeAttributes(const char *pIn, size_t size, int numAttributes, NDAttributeList *pList)
+{
+  const char *pEnd = pIn + size;
+  const char *pName, *pDescription;
+  epicsInt32 info[2];
+
+  pList->clear();
+  for (int i=0; (i<numAttributes) && (pIn < pEnd); i++) {
+    pName = pIn;
+    pIn += strlen(pName) + 1;
+    pDescription = pIn;
+    pIn += strlen(pDescription) + 1;
+    memcpy(info, pIn, sizeof(info));
+    pIn += sizeof(info);
+    pList->add(pName, pDescription, (NDAttrDataType_t)info[0], info[1] > 0 ? (void *)pIn : NULL);
+    pIn += info[1];
+  }
+}
+
+/** Writes the record of an array: the header, the attributes and the data.
+  * \param[in] pArray The array.
+  * \param[in] attributes The serialized attributes of the array.
+  * \param[in] compress Compress the data with zlib if this was built with zlib and this
+  *            makes the array smaller.
+  * \param[out] pRecord The record, which must have room for recordSize() bytes.
+  * \return The size of the record. */
+static size_t writeRecord(NDArray *pArray, const std::vector<char>& attributes, bool compress, char *pRecord)
+{
+  NDArrayInfo_t arrayInfo;
+  NDDiskRingHeader_t header;
+  char *pData;
+
+  pArray->getInfo(&arrayInfo);
+  memset(&header, 0, sizeof(header));
+  header.ndims = pArray->ndims;
+  header.dataType = pArray->dataType;
+  header.uniqueId = pArray->uniqueId;
+  header.numAttributes = pArray->pAttributeList->count();
+  header.timeStamp = pArray->timeStamp;
+  header.epicsTS = pArray->epicsTS;
+  header.attributeSize = attributes.size();
+  header.dataSize = arrayInfo.totalBytes;
+  header.storedSize = arrayInfo.totalBytes;
+  memcpy(header.dims, pArray->dims, sizeof(header.dims));
+
+  pData = pRecord + sizeof(header) + attributes.size();
+  if (!attributes.empty()) memcpy(pRecord + sizeof(header), &attributes[0], attributes.size());
+#ifdef HAVE_ZLIB
+  if (compress) {
+    uLongf storedSize = (uLongf)compressBound((uLong)arrayInfo.totalBytes);
+    if ((compress2((Bytef *)pData, &storedSize, (const Bytef *)pArray->pData, (uLong)arrayInfo.totalBytes,
+                   Z_BEST_SPEED) == Z_OK) && (storedSize < arrayInfo.totalBytes)) {
+      header.compressed = 1;
+      header.storedSize = storedSize;
+    }
+  }
+#endif
+  if (!header.compressed) memcpy(pData, pArray->pData, arrayInfo.totalBytes);
+  memcpy(pRecord, &header, sizeof(header));
+  return roundUp8(sizeof(header) + header.attributeSize + header.storedSize);
+}
+
+/** Returns the maximum size of the record of an array.
+  * \param[in] pArray The array.
+  * \param[in] attributeSize The size of the serialized attributes of the array.
+  * \param[in] compress Whether the data will be compressed. */
+static size_t recordSize(NDArray *pArray, size_t attributeSize, bool compress)
+{
+  NDArrayInfo_t arrayInfo;
+  size_t maxStoredSize;
+
+  pArray->getInfo(&arrayInfo);
+  maxStoredSize = arrayInfo.totalBytes;
+#ifdef HAVE_ZLIB
+  if (compress) maxStoredSize = compressBound((uLong)arrayInfo.totalBytes);
+#endif
+  return roundUp8(sizeof(NDDiskRingHeader_t) + attributeSize + maxStoredSize);
+}
+
+/** Makes room for a record at the end of the ring, discarding the oldest records if required.
+  * \param[in] size The maximum size of the record.
+  * \return The address to write the record to, or NULL with errorMessage() describing the error. */
+char *NDArrayDiskRing::reserve(size_t size)
+{
+  if (!pMap_ || (maxArrays_ <= 0)) {
+    errorMessage_ = "ring is not open";
+    return NULL;
+  }
+  if (size > fileSize_) {
+    errorMessage_ = "array is larger than the file";
+    return NULL;
+  }
+
+  // The records after writeOffset_ are the oldest.  If the record does not fit before the
+  // end of the file discard those and start again at the beginning of the file.
+  if (writeOffset_ + size > fileSize_) {
+    while (!records_.empty() && (records_.front().offset >= writeOffset_)) records_.pop_front();
+    writeOffset_ = 0;
+  }
+  while (!records_.empty() &&
+         (((int)records_.size() >= maxArrays_) ||
+          ((records_.front().offset < writeOffset_ + size) &&
+           (records_.front().offset + records_.front().size > writeOffset_)))) {
+    records_.pop_front();
+  }
+  return pMap_ + writeOffset_;
+}
+
+/** Adds the record written to the address returned by reserve() to the ring.
+  * \param[in] size The size of the record. */
+void NDArrayDiskRing::commit(size_t size)
+{
+  NDDiskRingHeader_t header;
+  record newRecord;
+
+  memcpy(&header, pMap_ + writeOffset_, sizeof(header));
+  newRecord.offset = writeOffset_;
+  newRecord.size = size;
+  records_.push_back(newRecord);
+  writeOffset_ += size;
+  bytesWritten_ += (double)header.dataSize;
+  bytesStored_ += (double)header.storedSize;
+}
+
+/** Writes an array to the end of the ring.
+  * If there is not enough room in the file, or the ring already has maxArrays arrays,
+  * the oldest arrays are discarded.
+  * \param[in] pArray The array to write; the caller keeps its reference.
+  * \param[in] compress Compress the data with zlib if this was built with zlib and this
+  *            makes the array smaller.
+  * \return ND_SUCCESS, or ND_ERROR with errorMessage() describing the error. */
+int NDArrayDiskRing::addToEnd(NDArray *pArray, bool compress)
+{
+  char *pRecord;
+
+  serializeAttributes(pArray->pAttributeList, attributeBuffer_);
+  pRecord = reserve(recordSize(pArray, attributeBuffer_.size(), compress));
+  if (!pRecord) return ND_ERROR;
+  commit(writeRecord(pArray, attributeBuffer_, compress, pRecord));
+  return ND_SUCCESS;
+}
+
+/** Encodes an array as a record for addRecord().  This does not use the ring, so it can be called
+  * without the lock that protects the ring, and the slow part of writing a compressed array, the
+  * compression, can be done while the ring is in use.
+  * \param[in] pArray The array; the caller keeps its reference.
+  * \param[in] compress Compress the data with zlib if this was built with zlib and this
+  *            makes the array smaller.
+  * \param[out] record The record. */
+void NDArrayDiskRing::encode(NDArray *pArray, bool compress, std::vector<char>& record)
+{
+  std::vector<char> attributes;
+
+  serializeAttributes(pArray->pAttributeList, attributes);
+  record.resize(recordSize(pArray, attributes.size(), compress));
+  record.resize(writeRecord(pArray, attributes, compress, &record[0]));
+}
+
+/** Writes a record made by encode() to the end of the ring, like addToEnd().
+  * \param[in] record The record.
+  * \return ND_SUCCESS, or ND_ERROR with errorMessage() describing the error. */
+int NDArrayDiskRing::addRecord(const std::vector<char>& record)
+{
+  char *pRecord;
+
+  pRecord = reserve(record.size());
+  if (!pRecord) return ND_ERROR;
+  memcpy(pRecord, &record[0], record.size());
+  commit(record.size());
+  return ND_SUCCESS;
+}
+
+/** Reads an array from the ring.
+  * \param[in] index The index of the array, 0 is the oldest and size()-1 the newest.
+  * \param[in] pNDArrayPool The pool to allocate the array from.
+  * \return The array, which the caller must release, or NULL with errorMessage() describing the error. */
+NDArray *NDArrayDiskRing::read(int index, NDArrayPool *pNDArrayPool)
+{
+  NDDiskRingHeader_t header;
+  size_t dims[ND_ARRAY_MAX_DIMS];
+  const char *pRecord, *pData;
+  NDArray *pArray;
+
+  if ((index < 0) || (index >= size())) {
+    errorMessage_ = "index out of range";
+    return NULL;
+  }
+  pRecord = pMap_ + records_[index].offset;
+  memcpy(&header, pRecord, sizeof(header));
+  for (int i=0; i<ND_ARRAY_MAX_DIMS; i++) dims[i] = header.dims[i].size;
+  pArray = pNDArrayPool->alloc(header.ndims, dims, (NDDataType_t)header.dataType, 0, NULL);
+  if (!pArray) {
+    errorMessage_ = "cannot allocate array";
+    return NULL;
+  }
+  memcpy(pArray->dims, header.dims, sizeof(header.dims));
+  pArray->uniqueId = header.uniqueId;
+  pArray->timeStamp = header.timeStamp;
+  pArray->epicsTS = header.epicsTS;
+  deserializeAttributes(pRecord + sizeof(header), header.attributeSize, header.numAttributes, pArray->pAttributeList);
+  pData = pRecord + sizeof(header) + header.attributeSize;
+  if (header.compressed) {
+#ifdef HAVE_ZLIB
+    uLongf dataSize = (uLongf)header.dataSize;
+    if ((uncompress((Bytef *)pArray->pData, &dataSize, (const Bytef *)pData, (uLong)header.storedSize) != Z_OK) ||
+        (dataSize != header.dataSize)) {
+      errorMessage_ = "error decompressing array";
+      pArray->release();
+      return NULL;
+    }
+#endif
+  } else {
+    memcpy(pArray->pData, pData, header.dataSize);
+  }
+  return pArray;
+}
+
@@ -0,0 +1,91 @@
+#ifndef NDARRAYDISKRING_H
+#define NDARRAYDISKRING_H
+
+#include <deque>
+#include <vector>
+#include <string>
+
+#include <shareLib.h>
+
+#include "NDArray.h"
+
+/** Ring of NDArrays stored in a memory-mapped file, used by NDPluginCircularBuff to hold
+  * the oldest part of a pre-trigger buffer that is too large to keep in memory.
+  * Each array is stored as a record with its dimensions, time stamps, attributes and data,
+  * which can optionally be compressed with zlib.  When there is no room for a new record the
+  * oldest records are discarded.  The file is scratch space for this process only; it is
+  * deleted when the ring is closed.  The ring is not thread safe, the caller must lock it;
+  * encode() does not use the ring, so arrays can be compressed without the lock.
+  */
+class epicsShareClass NDArrayDiskRing
+{
+  public:
+    NDArrayDiskRing();
+    ~NDArrayDiskRing();
+
+    // Creates and maps the file, or just clears the ring if it is already open with this file and size
+    int open(const char *fileName, size_t fileSize, int maxArrays);
+
+    // Unmaps and deletes the file
+    void close();
+
+    bool isOpen();
+
+    // Number of arrays in the ring
+    int size();
+
+    // Writes an array to the end of the ring, discarding the oldest arrays if required
+    int addToEnd(NDArray *pArray, bool compress);
+
+    // Encodes an array as a record without using the ring, so it can be done without the lock
+    static void encode(NDArray *pArray, bool compress, std::vector<char>& record);
+
+    // Writes a record from encode() to the end of the ring, like addToEnd()
+    int addRecord(const std::vector<char>& record);
+
+    // Reads an array from the ring, 0 is the oldest
+    NDArray *read(int index, NDArrayPool *pNDArrayPool);
+
+    // Removes all the arrays from the ring
+    void clear();
+
+    // Number of bytes of array data written since the ring was opened, before and after compression
+    double bytesWritten();
+    double bytesStored();
+
+    static bool compressionAvailable();
+
+    const char *errorMessage();
+
+  private:
+    struct record {
+      size_t offset;
+      size_t size;
+    };
+    int mapFile();
+    void unmapFile();
+    char *reserve(size_t size);
+    void commit(size_t size);
+    static void serializeAttributes(NDAttributeList *pList, std::vector<char>& buffer);
+    void deserializeAttributes(const char *pIn, size_t size, int numAttributes, NDAttributeList *pList);
+
+    std::string fileName_;
+    size_t fileSize_;
+    char *pMap_;
+#ifdef _WIN32
+    void *fileHandle_;
+    void *mappingHandle_;
+#else
+    int fd_;
+#endif
+    int maxArrays_;
+    size_t writeOffset_;
+    std::deque<record> records_;
+    std::vector<char> attributeBuffer_;
+    double bytesWritten_;
+    double bytesStored_;
+    std::string errorMessage_;
+};
+
+#endif
+
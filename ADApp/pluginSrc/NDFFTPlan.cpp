@@ -0,0 +1,531 @@
+/**
+ * NDFFTPlan.cpp
+ *
+ * Mixed radix, real input and Bluestein FFTs with cached plans.
+ *
+ * The complex transforms use the Stockham autosort formulation, which needs no bit
+ * reversal pass: each stage reads x[q + s*(p + k*m)] and writes y[q + s*(r*p + j)],
+ * for radix r, m = (remaining length)/r and stride s = product of the previous radices.
+ * Starting with s equal to the number of transforms computes that many interleaved
+ * transforms in a single pass, which is how the columns of a 2-D array are done.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <map>
+#include <utility>
+
+#include <epicsMutex.h>
+#include <epicsThread.h>
+
+#include <epicsExport.h>
+
+#include "NDFFTPlan.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* Some systems do not define M_PI in math.h */
+#ifndef M_PI
+  #define M_PI 3.14159265358979323846
+#endif
+
+/* Largest prime factor done with a generic radix stage, lengths with larger prime factors use Bluestein */
+#define MAX_GENERIC_RADIX 31
+
+/* Complex arithmetic on one (re, im) pair.  With SSE2 a complex number is held in one register. */
+#if defined(__SSE2__)
+typedef __m128d fftComplex;
+
+static inline fftComplex cLoad(const double *p) { return _mm_loadu_pd(p); }
+static inline void cStore(double *p, fftComplex a) { _mm_storeu_pd(p, a); }
+static inline fftComplex cSet(double re, double im) { return _mm_set_pd(im, re); }
+static inline fftComplex cAdd(fftComplex a, fftComplex b) { return _mm_add_pd(a, b); }
+static inline fftComplex cSub(fftComplex a, fftComplex b) { return _mm_sub_pd(a, b); }
+static inline fftComplex cScale(fftComplex a, double s) { return _mm_mul_pd(a, _mm_set1_pd(s)); }
+static inline fftComplex cConj(fftComplex a) { return _mm_xor_pd(a, _mm_set_pd(-0.0, 0.0)); }
+static inline fftComplex cMul(fftComplex a, fftComplex b)
+{
+  __m128d t = _mm_mul_pd(_mm_shuffle_pd(a, a, 1), _mm_unpackhi_pd(b, b));
+  return _mm_add_pd(_mm_mul_pd(a, _mm_unpacklo_pd(b, b)), _mm_xor_pd(t, _mm_set_pd(0.0, -0.0)));
+}
+/* Multiply by i for S=+1 or by -i for S=-1 */
+template <int S> static inline fftComplex cMulI(fftComplex a)
+{
+  return _mm_xor_pd(_mm_shuffle_pd(a, a, 1), (S > 0) ? _mm_set_pd(0.0, -0.0) : _mm_set_pd(-0.0, 0.0));
+}
+#else
+typedef struct {
+  double re;
+  double im;
+} fftComplex;
+
+static inline fftComplex cLoad(const double *p) { fftComplex c = {p[0], p[1]}; return c; }
+static inline void cStore(double *p, fftComplex a) { p[0] = a.re; p[1] = a.im; }
+static inline fftComplex cSet(double re, double im) { fftComplex c = {re, im}; return c; }
+static inline fftComplex cAdd(fftComplex a, fftComplex b) { return cSet(a.re + b.re, a.im + b.im); }
+static inline fftComplex cSub(fftComplex a, fftComplex b) { return cSet(a.re - b.re, a.im - b.im); }
+static inline fftComplex cScale(fftComplex a, double s) { return cSet(a.re * s, a.im * s); }
+static inline fftComplex cConj(fftComplex a) { return cSet(a.re, -a.im); }
+static inline fftComplex cMul(fftComplex a, fftComplex b)
+{
+  return cSet(a.re*b.re - a.im*b.im, a.re*b.im + a.im*b.re);
+}
+template <int S> static inline fftComplex cMulI(fftComplex a)
+{
+  return (S > 0) ? cSet(-a.im, a.re) : cSet(a.im, -a.re);
+}
+#endif
+
+/* Butterfly stages.  tw holds the r-1 twiddle factors w^(p*j), j=1..r-1, for each p;
+ * p=0 has unit twiddles and is not multiplied. */
+
+template <int S>
+static void radix2(int m, int s, const double *tw, const double *x, double *y)
+{
+  const size_t xs = 2*(size_t)s*m, ys = 2*(size_t)s;
+  for (int p=0; p<m; p++) {
+    const double *px = x + 2*(size_t)s*p;
+    double *py = y + 2*ys*p;
+    if (p == 0) {
+      for (int q=0; q<2*s; q+=2) {
+        fftComplex a0 = cLoad(px+q), a1 = cLoad(px+xs+q);
+        cStore(py+q,    cAdd(a0, a1));
+        cStore(py+ys+q, cSub(a0, a1));
+      }
+    } else {
+      fftComplex w1 = cLoad(tw + 2*p);
+      for (int q=0; q<2*s; q+=2) {
+        fftComplex a0 = cLoad(px+q), a1 = cLoad(px+xs+q);
+        cStore(py+q,    cAdd(a0, a1));
+        cStore(py+ys+q, cMul(cSub(a0, a1), w1));
+      }
+    }
+  }
+}
+
+template <int S>
+static void radix3(int m, int s, const double *tw, const double *x, double *y)
+{
+  const size_t xs = 2*(size_t)s*m, ys = 2*(size_t)s;
+  const double c = -0.5, d = sqrt(0.75);
+  fftComplex w1 = cSet(1., 0.), w2 = w1;
+  for (int p=0; p<m; p++) {
+    const double *px = x + 2*(size_t)s*p;
+    double *py = y + 3*ys*p;
+    if (p > 0) {
+      w1 = cLoad(tw + 4*p);
+      w2 = cLoad(tw + 4*p + 2);
+    }
+    for (int q=0; q<2*s; q+=2) {
+      fftComplex a0 = cLoad(px+q), a1 = cLoad(px+xs+q), a2 = cLoad(px+2*xs+q);
+      fftComplex t = cAdd(a1, a2);
+      fftComplex u = cAdd(a0, cScale(t, c));
+      fftComplex v = cMulI<S>(cScale(cSub(a1, a2), d));
+      fftComplex b1 = cAdd(u, v), b2 = cSub(u, v);
+      cStore(py+q, cAdd(a0, t));
+      if (p > 0) {
+        b1 = cMul(b1, w1);
+        b2 = cMul(b2, w2);
+      }
+      cStore(py+ys+q,   b1);
+      cStore(py+2*ys+q, b2);
+    }
+  }
+}
+
+template <int S>
+static void radix4(int m, int s, const double *tw, const double *x, double *y)
+{
+  const size_t xs = 2*(size_t)s*m, ys = 2*(size_t)s;
+  fftComplex w1 = cSet(1., 0.), w2 = w1, w3 = w1;
+  for (int p=0; p<m; p++) {
+    const double *px = x + 2*(size_t)s*p;
+    double *py = y + 4*ys*p;
+    if (p > 0) {
+      w1 = cLoad(tw + 6*p);
+      w2 = cLoad(tw + 6*p + 2);
+      w3 = cLoad(tw + 6*p + 4);
+    }
+    for (int q=0; q<2*s; q+=2) {
+      fftComplex a0 = cLoad(px+q), a1 = cLoad(px+xs+q), a2 = cLoad(px+2*xs+q), a3 = cLoad(px+3*xs+q);
+      fftComplex t0 = cAdd(a0, a2), t1 = cSub(a0, a2);
+      fftComplex t2 = cAdd(a1, a3), t3 = cMulI<S>(cSub(a1, a3));
+      fftComplex b1 = cAdd(t1, t3), b2 = cSub(t0, t2), b3 = cSub(t1, t3);
+      cStore(py+q, cAdd(t0, t2));
+      if (p > 0) {
+        b1 = cMul(b1, w1);
+        b2 = cMul(b2, w2);
+        b3 = cMul(b3, w3);
+      }
+      cStore(py+ys+q,   b1);
+      cStore(py+2*ys+q, b2);
+      cStore(py+3*ys+q, b3);
+    }
+  }
+}
+
+template <int S>
+static void radix5(int m, int s, const double *tw, const double *x, double *y)
+{
+  const size_t xs = 2*(size_t)s*m, ys = 2*(size_t)s;
+  const double c1 = cos(2.*M_PI/5.), c2 = cos(4.*M_PI/5.);
+  const double s1 = sin(2.*M_PI/5.), s2 = sin(4.*M_PI/5.);
+  fftComplex w[4];
+  for (int j=0; j<4; j++) w[j] = cSet(1., 0.);
+  for (int p=0; p<m; p++) {
+    const double *px = x + 2*(size_t)s*p;
+    double *py = y + 5*ys*p;
+    if (p > 0) {
+      for (int j=0; j<4; j++) w[j] = cLoad(tw + 8*p + 2*j);
+    }
+    for (int q=0; q<2*s; q+=2) {
+      fftComplex a0 = cLoad(px+q), a1 = cLoad(px+xs+q), a2 = cLoad(px+2*xs+q);
+      fftComplex a3 = cLoad(px+3*xs+q), a4 = cLoad(px+4*xs+q);
+      fftComplex t1 = cAdd(a1, a4), t2 = cAdd(a2, a3);
+      fftComplex d1 = cSub(a1, a4), d2 = cSub(a2, a3);
+      fftComplex u1 = cAdd(a0, cAdd(cScale(t1, c1), cScale(t2, c2)));
+      fftComplex u2 = cAdd(a0, cAdd(cScale(t1, c2), cScale(t2, c1)));
+      fftComplex v1 = cMulI<S>(cAdd(cScale(d1, s1), cScale(d2, s2)));
+      fftComplex v2 = cMulI<S>(cSub(cScale(d1, s2), cScale(d2, s1)));
+      fftComplex b[4];
+      b[0] = cAdd(u1, v1);
+      b[1] = cAdd(u2, v2);
+      b[2] = cSub(u2, v2);
+      b[3] = cSub(u1, v1);
+      cStore(py+q, cAdd(a0, cAdd(t1, t2)));
+      for (int j=0; j<4; j++) {
+        cStore(py+(j+1)*ys+q, (p > 0) ? cMul(b[j], w[j]) : b[j]);
+      }
+    }
+  }
+}
+
+/* Generic odd prime radix r <= MAX_GENERIC_RADIX.  roots holds cos and sin of 2*pi*k/r, k<r.
+ * Inputs k and r-k are combined so that outputs j and r-j share the work. */
+template <int S>
+static void radixN(int r, int m, int s, const double *tw, const double *roots, const double *x, double *y)
+{
+  const size_t xs = 2*(size_t)s*m, ys = 2*(size_t)s;
+  const int h = r/2;
+  fftComplex a0, t[MAX_GENERIC_RADIX/2+1], d[MAX_GENERIC_RADIX/2+1];
+  for (int p=0; p<m; p++) {
+    const double *px = x + 2*(size_t)s*p;
+    const double *pw = tw + 2*(size_t)(r-1)*p;
+    double *py = y + r*ys*p;
+    for (int q=0; q<2*s; q+=2) {
+      fftComplex sum;
+      a0 = sum = cLoad(px+q);
+      for (int k=1; k<=h; k++) {
+        fftComplex ak = cLoad(px+k*xs+q), bk = cLoad(px+(r-k)*xs+q);
+        t[k] = cAdd(ak, bk);
+        d[k] = cSub(ak, bk);
+        sum = cAdd(sum, t[k]);
+      }
+      cStore(py+q, sum);
+      for (int j=1; j<=h; j++) {
+        fftComplex u = a0, v = cSet(0., 0.);
+        int jk = 0;
+        for (int k=1; k<=h; k++) {
+          jk += j;
+          if (jk >= r) jk -= r;
+          u = cAdd(u, cScale(t[k], roots[2*jk]));
+          v = cAdd(v, cScale(d[k], roots[2*jk+1]));
+        }
+        v = cMulI<S>(v);
+        fftComplex b1 = cAdd(u, v), b2 = cSub(u, v);
+        if (p > 0) {
+          b1 = cMul(b1, cLoad(pw + 2*(j-1)));
+          b2 = cMul(b2, cLoad(pw + 2*(r-j-1)));
+        }
+        cStore(py+j*ys+q,     b1);
+        cStore(py+(r-j)*ys+q, b2);
+      }
+    }
+  }
+}
+
+/* Plan caches, keyed by (length, sign).  Plans are never deleted. */
+static epicsMutexId planLock;
+static epicsThreadOnceId planOnceId = EPICS_THREAD_ONCE_INIT;
+static std::map<std::pair<int, int>, NDFFTPlan *> complexPlans;
+static std::map<std::pair<int, int>, NDFFTRealPlan *> realPlans;
+
+static void planOnce(void *)
+{
+  planLock = epicsMutexMustCreate();
+}
+
+/** Returns the cached plan for complex transforms of length n, creating it if needed.
+  * \param[in] n Transform length, any value >= 1.
+  * \param[in] sign +1 for the forward transform with the fft.c convention, -1 for the inverse.
+  * \return The plan, or NULL if n < 1.
+  */
+const NDFFTPlan *NDFFTPlan::get(int n, int sign)
+{
+  NDFFTPlan *pPlan;
+
+  if (n < 1) return NULL;
+  sign = (sign < 0) ? -1 : 1;
+  epicsThreadOnce(&planOnceId, planOnce, NULL);
+  // The lock is recursive, the constructor can get the plans it builds on
+  epicsMutexLock(planLock);
+  std::map<std::pair<int, int>, NDFFTPlan *>::iterator it = complexPlans.find(std::make_pair(n, sign));
+  if (it != complexPlans.end()) {
+    pPlan = it->second;
+  } else {
+    pPlan = new NDFFTPlan(n, sign);
+    complexPlans[std::make_pair(n, sign)] = pPlan;
+  }
+  epicsMutexUnlock(planLock);
+  return pPlan;
+}
+
+NDFFTPlan::NDFFTPlan(int n, int sign)
+  : n_(n), sign_(sign), convSize_(0), pConvForward_(0), pConvInverse_(0)
+{
+  int rest = n;
+  int i, j, k;
+
+  // Factor the length, using radix 4 as much as possible
+  while (rest % 4 == 0) { radix_.push_back(4); rest /= 4; }
+  if (rest % 2 == 0)    { radix_.push_back(2); rest /= 2; }
+  for (i=3; (i <= MAX_GENERIC_RADIX) && (rest > 1); i+=2) {
+    while (rest % i == 0) { radix_.push_back(i); rest /= i; }
+  }
+
+  if (rest > 1) {
+    // A large prime factor, use Bluestein's algorithm with a power of 2 convolution
+    radix_.clear();
+    convSize_ = 1;
+    while (convSize_ < 2*n - 1) convSize_ *= 2;
+    pConvForward_ = NDFFTPlan::get(convSize_, -1);
+    pConvInverse_ = NDFFTPlan::get(convSize_, 1);
+    chirp_.resize(2*n);
+    for (k=0; k<n; k++) {
+      // k*k mod 2n keeps the argument small for large k
+      double phase = sign * M_PI * (double)(((long long)k * k) % (2*(long long)n)) / n;
+      chirp_[2*k]   = cos(phase);
+      chirp_[2*k+1] = sin(phase);
+    }
+    kernel_.assign(2*convSize_, 0.);
+    for (k=0; k<n; k++) {
+      kernel_[2*k]   = chirp_[2*k];
+      kernel_[2*k+1] = -chirp_[2*k+1];
+      if (k > 0) {
+        kernel_[2*(convSize_-k)]   = chirp_[2*k];
+        kernel_[2*(convSize_-k)+1] = -chirp_[2*k+1];
+      }
+    }
+    std::vector<double> work(pConvForward_->workSize(1));
+    pConvForward_->stockham(&kernel_[0], 1, &work[0]);
+    for (k=0; k<2*convSize_; k++) kernel_[k] /= convSize_;
+    return;
+  }
+
+  // Twiddle factors for each stage, followed by the roots for generic radix stages
+  int m = n;
+  for (i=0; i<(int)radix_.size(); i++) {
+    int r = radix_[i];
+    int len = m;
+    m /= r;
+    twiddleOffset_.push_back(twiddle_.size());
+    for (j=0; j<m; j++) {
+      for (k=1; k<r; k++) {
+        double phase = sign * 2. * M_PI * (double)(((long long)j * k) % len) / len;
+        twiddle_.push_back(cos(phase));
+        twiddle_.push_back(sin(phase));
+      }
+    }
+    if (r > 5) {
+      for (k=0; k<r; k++) {
+        twiddle_.push_back(cos(2. * M_PI * k / r));
+        twiddle_.push_back(sin(2. * M_PI * k / r));
+      }
+    }
+  }
+}
+
+/** Returns the number of doubles of work space that execute() needs.
+  * \param[in] howmany The number of interleaved transforms that will be done in one call.
+  */
+size_t NDFFTPlan::workSize(int howmany) const
+{
+  if (convSize_) return 4 * (size_t)convSize_;
+  return 2 * (size_t)n_ * howmany;
+}
+
+/** Computes howmany interleaved transforms in place.
+  * Element j of transform k is the complex number at data[2*(j*howmany + k)], so the
+  * columns of a row-major array with howmany columns are transformed in one call.
+  * \param[in,out] data The complex input data, replaced by the transforms.
+  * \param[in] howmany The number of transforms.
+  * \param[in] work Work space of at least workSize(howmany) doubles.
+  */
+void NDFFTPlan::execute(double *data, int howmany, double *work) const
+{
+  if (convSize_) bluestein(data, howmany, work);
+  else stockham(data, howmany, work);
+}
+
+/** Computes the transforms of howmany contiguous rows in place.
+  * \param[in,out] data The complex input rows, each of size() complex numbers, replaced by the transforms.
+  * \param[in] howmany The number of rows.
+  * \param[in] work Work space of at least workSize(1) doubles.
+  */
+void NDFFTPlan::executeRows(double *data, int howmany, double *work) const
+{
+  for (int i=0; i<howmany; i++) {
+    execute(data + 2*(size_t)n_*i, 1, work);
+  }
+}
+
+void NDFFTPlan::stockham(double *data, int howmany, double *work) const
+{
+  double *x = data, *y = work, *t;
+  int m = n_, s = howmany;
+
+  for (size_t i=0; i<radix_.size(); i++) {
+    int r = radix_[i];
+    const double *tw = &twiddle_[twiddleOffset_[i]];
+    m /= r;
+    switch (r) {
+      case 2:
+        if (sign_ > 0) radix2<1>(m, s, tw, x, y); else radix2<-1>(m, s, tw, x, y);
+        break;
+      case 3:
+        if (sign_ > 0) radix3<1>(m, s, tw, x, y); else radix3<-1>(m, s, tw, x, y);
+        break;
+      case 4:
+        if (sign_ > 0) radix4<1>(m, s, tw, x, y); else radix4<-1>(m, s, tw, x, y);
+        break;
+      case 5:
+        if (sign_ > 0) radix5<1>(m, s, tw, x, y); else radix5<-1>(m, s, tw, x, y);
+        break;
+      default: {
+        const double *roots = tw + 2*(size_t)(r-1)*m;
+        if (sign_ > 0) radixN<1>(r, m, s, tw, roots, x, y); else radixN<-1>(r, m, s, tw, roots, x, y);
+        break;
+      }
+    }
+    s *= r;
+    t = x; x = y; y = t;
+  }
+  if (x != data) memcpy(data, x, 2 * (size_t)n_ * howmany * sizeof(double));
+}
+
+void NDFFTPlan::bluestein(double *data, int howmany, double *work) const
+{
+  double *conv = work, *convWork = work + 2*(size_t)convSize_;
+  int j, k;
+
+  for (k=0; k<howmany; k++) {
+    for (j=0; j<n_; j++) {
+      cStore(conv + 2*j, cMul(cLoad(data + 2*((size_t)j*howmany + k)), cLoad(&chirp_[2*j])));
+    }
+    memset(conv + 2*n_, 0, 2 * (size_t)(convSize_ - n_) * sizeof(double));
+    pConvForward_->stockham(conv, 1, convWork);
+    for (j=0; j<convSize_; j++) {
+      cStore(conv + 2*j, cMul(cLoad(conv + 2*j), cLoad(&kernel_[2*j])));
+    }
+    pConvInverse_->stockham(conv, 1, convWork);
+    for (j=0; j<n_; j++) {
+      cStore(data + 2*((size_t)j*howmany + k), cMul(cLoad(conv + 2*j), cLoad(&chirp_[2*j])));
+    }
+  }
+}
+
+/** Returns the cached plan for real transforms of length n, creating it if needed.
+  * \param[in] n Transform length, any value >= 1.
+  * \param[in] sign +1 for the forward transform with the fft.c convention, -1 for the inverse.
+  * \return The plan, or NULL if n < 1.
+  */
+const NDFFTRealPlan *NDFFTRealPlan::get(int n, int sign)
+{
+  NDFFTRealPlan *pPlan;
+
+  if (n < 1) return NULL;
+  sign = (sign < 0) ? -1 : 1;
+  epicsThreadOnce(&planOnceId, planOnce, NULL);
+  epicsMutexLock(planLock);
+  std::map<std::pair<int, int>, NDFFTRealPlan *>::iterator it = realPlans.find(std::make_pair(n, sign));
+  if (it != realPlans.end()) {
+    pPlan = it->second;
+  } else {
+    pPlan = new NDFFTRealPlan(n, sign);
+    realPlans[std::make_pair(n, sign)] = pPlan;
+  }
+  epicsMutexUnlock(planLock);
+  return pPlan;
+}
+
+NDFFTRealPlan::NDFFTRealPlan(int n, int sign)
+  : n_(n), sign_(sign)
+{
+  if (n % 2) {
+    pComplex_ = NDFFTPlan::get(n, sign);
+    return;
+  }
+  pComplex_ = NDFFTPlan::get(n/2, sign);
+  for (int k=0; k<=n/4; k++) {
+    twiddle_.push_back(cos(2. * M_PI * k / n));
+    twiddle_.push_back(sign * sin(2. * M_PI * k / n));
+  }
+}
+
+/** Returns the number of doubles of work space that execute() needs. */
+size_t NDFFTRealPlan::workSize() const
+{
+  if (n_ % 2) return 2 * (size_t)n_ + pComplex_->workSize(1);
+  return pComplex_->workSize(1);
+}
+
+/** Computes the transforms of howmany contiguous rows of real data.
+  * \param[in] in The input rows, each of size() doubles.
+  * \param[out] out The output rows, each of outputSize() complex numbers.
+  * \param[in] howmany The number of rows.
+  * \param[in] work Work space of at least workSize() doubles.
+  */
+void NDFFTRealPlan::execute(const double *in, double *out, int howmany, double *work) const
+{
+  int h = n_/2;
+  int j, k;
+
+  for (int i=0; i<howmany; i++) {
+    const double *x = in + (size_t)n_*i;
+    double *z = out + 2*(size_t)(h+1)*i;
+
+    if (n_ % 2) {
+      for (j=0; j<n_; j++) {
+        work[2*j]   = x[j];
+        work[2*j+1] = 0.;
+      }
+      pComplex_->execute(work, 1, work + 2*n_);
+      memcpy(z, work, 2 * (size_t)(h+1) * sizeof(double));
+      continue;
+    }
+
+    // The even and odd samples are the real and imaginary parts of a half length transform
+    memcpy(z, x, n_ * sizeof(double));
+    pComplex_->execute(z, 1, work);
+
+    // Split it into the transforms of the even and odd samples, E and O, and combine them.
+    // Outputs k and h-k depend on the same pair of inputs, so this can be done in place.
+    double re = z[0], im = z[1];
+    z[0] = re + im;
+    z[1] = 0.;
+    z[2*h]   = re - im;
+    z[2*h+1] = 0.;
+    for (k=1; 2*k<=h; k++) {
+      fftComplex zk = cLoad(z + 2*k), zh = cConj(cLoad(z + 2*(h-k)));
+      fftComplex e = cScale(cAdd(zk, zh), 0.5);
+      fftComplex o = cMulI<-1>(cScale(cSub(zk, zh), 0.5));
+      fftComplex t = cMul(cLoad(&twiddle_[2*k]), o);
+      cStore(z + 2*(h-k), cConj(cSub(e, t)));
+      cStore(z + 2*k, cAdd(e, t));
+    }
+  }
+}
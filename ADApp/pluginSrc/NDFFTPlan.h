@@ -0,0 +1,84 @@
+/**
+ * NDFFTPlan.h
+ *
+ * Cached FFT plans used by NDPluginFFT.
+ *
+ * A plan holds everything that depends only on the transform length and direction
+ * (the factorization, the per-stage twiddle tables and, for awkward lengths, the
+ * Bluestein chirp), so that repeated transforms of the same size only do the butterflies.
+ * Plans are created once per (length, direction) and shared by all callers for the
+ * lifetime of the process; they are immutable after creation so they can be used
+ * from several threads at once, each thread supplying its own work buffer.
+ *
+ * Complex data are interleaved (re, im) doubles.  The direction follows the
+ * Numerical Recipes convention used by fft.c: sign=+1 computes
+ * X[k] = sum_j x[j] exp(+2*pi*i*j*k/n), sign=-1 the unnormalized inverse.
+ */
+
+#ifndef NDFFTPlan_H
+#define NDFFTPlan_H
+
+#include <stddef.h>
+#include <vector>
+
+#include <shareLib.h>
+
+/** Plan for complex-to-complex transforms of one length and direction.
+  * Lengths whose prime factors are all small are done with a mixed radix (4, 2, 3, 5
+  * and other small primes) Stockham algorithm; other lengths use Bluestein's algorithm
+  * on top of a power of 2 plan. */
+class epicsShareClass NDFFTPlan {
+public:
+  static const NDFFTPlan *get(int n, int sign);
+
+  int size() const { return n_; }
+  size_t workSize(int howmany) const;
+  void execute(double *data, int howmany, double *work) const;
+  void executeRows(double *data, int howmany, double *work) const;
+
+private:
+  NDFFTPlan(int n, int sign);
+  void stockham(double *data, int howmany, double *work) const;
+  void bluestein(double *data, int howmany, double *work) const;
+
+  int n_;
+  int sign_;
+  /** Radix of each Stockham stage, empty when Bluestein's algorithm is used */
+  std::vector<int> radix_;
+  /** Offset of each stage's twiddle factors in twiddle_ */
+  std::vector<size_t> twiddleOffset_;
+  std::vector<double> twiddle_;
+  /** Bluestein convolution length and the power of 2 plans for it */
+  int convSize_;
+  const NDFFTPlan *pConvForward_;
+  const NDFFTPlan *pConvInverse_;
+  /** Chirp exp(sign*i*pi*k*k/n) and the transform of the convolution kernel, scaled by 1/convSize_ */
+  std::vector<double> chirp_;
+  std::vector<double> kernel_;
+};
+
+/** Plan for transforms of real data.
+  * A real row of length n is transformed to the n/2+1 non-redundant complex outputs.
+  * Even lengths are done as a complex transform of half the length followed by a
+  * split step, odd lengths fall back to a full length complex transform. */
+class epicsShareClass NDFFTRealPlan {
+public:
+  static const NDFFTRealPlan *get(int n, int sign);
+
+  int size() const { return n_; }
+  /** Number of complex outputs per row */
+  int outputSize() const { return n_/2 + 1; }
+  size_t workSize() const;
+  void execute(const double *in, double *out, int howmany, double *work) const;
+
+private:
+  NDFFTRealPlan(int n, int sign);
+
+  int n_;
+  int sign_;
+  const NDFFTPlan *pComplex_;
+  /** exp(sign*2*pi*i*k/n) for k <= n/4, used by the split step */
+  std::vector<double> twiddle_;
+};
+
+#endif //NDFFTPlan_H
@@ -10,7 +10,6 @@
 
 #include <epicsExport.h>
 #include "NDPluginAttrPlot.h"
-#include "CircularBuffer.h"
 
 ExposeDataTask::ExposeDataTask(NDPluginAttrPlot& plugin)
     : plugin_(plugin),
@@ -25,9 +24,11 @@ void ExposeDataTask::start() {
 
 void ExposeDataTask::run() {
     while (!stop_) {
-        plugin_.lock();
-        plugin_.callback_data();
-        plugin_.unlock();
+        // Only expose the data if there is something new, the plugin lock
+        // is only taken for the selections and the callbacks
+        if (ndAtomicGet(&plugin_.data_changed_)) {
+            plugin_.callback_data();
+        }
         epicsThreadSleep(ND_ATTRPLOT_DATA_EXPOSURE_PERIOD);
     }
 }
@@ -66,6 +67,13 @@ NDPluginAttrPlot::NDPluginAttrPlot(const char * port, int n_attributes,
       uids_(cache_size),
       n_attributes_(n_attributes),
       attributes_(),
+      schema_(NULL),
+      column_slots_(),
+      name_columns_(),
+      new_values_(),
+      expose_buffer_(n_data_blocks * cache_size),
+      expose_selections_(n_data_blocks),
+      data_changed_(0),
       n_data_blocks_(n_data_blocks),
       data_selections_(n_data_blocks, ND_ATTRPLOT_NONE_INDEX),
       expose_task_(*this)
@@ -95,20 +103,29 @@ void NDPluginAttrPlot::start_expose() {
 }
 
 void NDPluginAttrPlot::callback_data() {
+    // Cleared first so that data pushed during the exposure is exposed again
+    ndAtomicSet(&data_changed_, 0);
+
+    // The selections are changed under the lock by writeInt32 and
+    // rebuild_attributes
+    this->lock();
+    expose_selections_ = data_selections_;
+    this->unlock();
 
+    // The values are pushed before the uid, so each selected ring has at
+    // least this many values
     size_t size = uids_.size();
-    size_t cache_size = uids_.max_size();
-    double * const tmp_arr = new double[cache_size];
+    size_t cache_size = uids_.maxSize();
 
     size_t n_copied;
     for (size_t i = 0; i < n_data_blocks_; ++i) {
-        int selected = data_selections_[i];
+        double * const tmp_arr = &expose_buffer_[i * cache_size];
+        int selected = expose_selections_[i];
         if (selected == ND_ATTRPLOT_UID_INDEX) {
-            n_copied = uids_.copy_to_array(tmp_arr, size);
+            n_copied = uids_.copyLatest(tmp_arr, size);
         } else if (selected >= 0 &&
                 static_cast<unsigned>(selected) < data_.size()) {
-            n_copied = data_[selected].copy_to_array(tmp_arr,
-                    size);
+            n_copied = data_[selected].copyLatest(tmp_arr, size);
         } else {
             std::fill(tmp_arr, tmp_arr + size, epicsNAN);
             n_copied = size;
@@ -117,18 +134,23 @@ void NDPluginAttrPlot::callback_data() {
         // the remaining arrays with the last point
         std::fill(tmp_arr + n_copied,
                 tmp_arr + cache_size,
-                *(tmp_arr + n_copied - 1));
-        doCallbacksFloat64Array(tmp_arr, cache_size, NDAttrPlotData, (int)i);
+                n_copied > 0 ? *(tmp_arr + n_copied - 1) : epicsNAN);
     }
 
-    delete[] tmp_arr;
+    this->lock();
+    for (size_t i = 0; i < n_data_blocks_; ++i) {
+        doCallbacksFloat64Array(&expose_buffer_[i * cache_size], cache_size,
+                NDAttrPlotData, (int)i);
+    }
+    this->unlock();
 }
 
 void NDPluginAttrPlot::processCallbacks(NDArray *pArray) {
-    NDAttributeList attr_list;
+    // The values are read directly from the attribute list of the array,
+    // it does not need to be copied
+    NDAttributeList& attr_list = *pArray->pAttributeList;
 
     NDPluginDriver::beginProcessCallbacks(pArray);
-    pArray->pAttributeList->copy(&attr_list);
 
     epicsInt32 uid;
     getIntegerParam(NDUniqueId, &uid);
@@ -161,7 +183,7 @@ void NDPluginAttrPlot::rebuild_attributes(NDAttributeList& attr_list) {
 
     attributes_.clear();
     for (NDAttribute * attr = attr_list.next(NULL);
-            attr != NULL && attributes_.size() <= n_attributes_;
+            attr != NULL && attributes_.size() < n_attributes_;
             attr = attr_list.next(attr)) {
         std::string name(attr->getName());
         NDAttrDataType_t type = attr->getDataType();
@@ -196,10 +218,35 @@ void NDPluginAttrPlot::rebuild_attributes(NDAttributeList& attr_list) {
         }
     }
 
+    new_values_.resize(attributes_.size());
+    resolve_columns(attr_list);
+
     callback_attributes();
     callback_selected();
 }
 
+void NDPluginAttrPlot::resolve_columns(NDAttributeList& attr_list) {
+    NDAttributeSchema * schema = attr_list.getSchema();
+    if (schema) {
+        schema->reserve();
+    }
+    if (schema_) {
+        schema_->release();
+    }
+    schema_ = schema;
+
+    column_slots_.assign(attributes_.size(), -1);
+    name_columns_.clear();
+    for (size_t i = 0; i < attributes_.size(); ++i) {
+        if (schema_) {
+            column_slots_[i] = schema_->findSlot(attributes_[i].c_str());
+        }
+        if (column_slots_[i] < 0) {
+            name_columns_.push_back(i);
+        }
+    }
+}
+
 
 void NDPluginAttrPlot::reset_data() {
     state_ = NDAttrPlot_InitState;
@@ -208,6 +255,7 @@ void NDPluginAttrPlot::reset_data() {
             it != data_.end(); ++it) {
         it->clear();
     }
+    ndAtomicSet(&data_changed_, 1);
 }
 
 void NDPluginAttrPlot::callback_attributes() {
@@ -241,28 +289,33 @@ void NDPluginAttrPlot::callback_selected() {
 
 asynStatus NDPluginAttrPlot::push_data(epicsInt32 uid, NDAttributeList& list) {
     size_t length = attributes_.size();
-    double *new_values = new double[length];
-    std::fill(new_values, new_values + length, epicsNAN);
 
-    // Populate the new values with values from the attribute list
-    for (NDAttribute * attr = list.next(NULL);
-            attr != NULL; attr = list.next(attr)) {
-        std::string name(attr->getName());
-        std::vector<std::string>::const_iterator it = std::find(
-                attributes_.begin(), attributes_.end(), name);
-        if (it != attributes_.end()) {
-            ptrdiff_t index = it - attributes_.begin();
-            attr->getValue(NDAttrFloat64, &new_values[index], 1);
+    if (list.getSchema() != schema_) {
+        resolve_columns(list);
+    }
+    std::fill(new_values_.begin(), new_values_.end(), epicsNAN);
+
+    // Populate the new values with values from the attribute list, by slot
+    // for the attributes in the schema and by name for the others
+    if (schema_ && length > 0) {
+        list.getSlotValues((int)length, &column_slots_[0], &new_values_[0]);
+    }
+    for (std::vector<size_t>::const_iterator it = name_columns_.begin();
+            it != name_columns_.end(); ++it) {
+        NDAttribute * attr = list.find(attributes_[*it].c_str());
+        if (attr != NULL) {
+            attr->getValue(NDAttrFloat64, &new_values_[*it], 1);
         }
     }
 
-    // Push the new values to the data block
-    uids_.push_back(uid);
+    // Push the new values to the data blocks, and then the uid that
+    // callback_data uses to count them
     for (size_t i = 0; i < length; ++i) {
-        data_[i].push_back(new_values[i]);
+        data_[i].push(new_values_[i]);
     }
+    uids_.push(uid);
 
-    delete new_values;
+    ndAtomicSet(&data_changed_, 1);
     return asynSuccess;
 }
 
@@ -284,7 +337,8 @@ asynStatus NDPluginAttrPlot::writeInt32(asynUser * pasynUser, epicsInt32 value)
         }
         data_selections_[addr] = value;
         callback_selected();
-        callback_data();
+        // The expose task sends the newly selected data
+        ndAtomicSet(&data_changed_, 1);
         return asynSuccess;
     } else if (reason == NDAttrPlotReset) {
         reset_data();
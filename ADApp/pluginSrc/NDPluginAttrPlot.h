@@ -15,7 +15,7 @@
  *                             max_attributes instances loaded
  */
 
-#include "CircularBuffer.h"
+#include "NDRingBuffer.h"
 
 #include <NDPluginDriver.h>
 #include <epicsThread.h>
@@ -92,7 +92,7 @@ private:
  */
 class NDPluginAttrPlot : public NDPluginDriver
 {
-    typedef CircularBuffer<double> CB;
+    typedef NDRingBuffer<double> CB;
 
 public:
     /**
@@ -174,6 +174,18 @@ private:
      */
     void rebuild_attributes(NDAttributeList& attr_list);
 
+    /**
+     * \brief Finds where the value of each saved attribute is read from.
+     *
+     * If the attribute list is compact the attributes in its schema are
+     * read by slot, the others are found by name. This is done when the
+     * attributes are rebuilt and when the schema of the lists changes,
+     * not for every array.
+     *
+     * \param attr_list Attribute list whose schema is used.
+     */
+    void resolve_columns(NDAttributeList& attr_list);
+
     /**
      * \brief Clears all the data from the cache and reinitializes the plugin.
      */
@@ -188,6 +200,10 @@ private:
 
     /**
      * \brief Exposes the selected data fields to EPICS layer.
+     *
+     * Only called by the expose task. The selections are copied under the
+     * plugin lock, the data is copied from the ring buffers without it while
+     * processCallbacks adds to them, and the callbacks are done with it.
      */
     void callback_data();
 
@@ -217,6 +233,29 @@ private:
     /** Attribute names of the saved data */
     std::vector<std::string> attributes_;
 
+    /** Schema of the attribute lists the columns were resolved for, NULL
+     *  if the lists are not compact */
+    NDAttributeSchema * schema_;
+
+    /** Slot of each saved attribute in schema_, -1 if it is not in it */
+    std::vector<int> column_slots_;
+
+    /** Saved attributes that are not in schema_ and are found by name */
+    std::vector<size_t> name_columns_;
+
+    /** Values of the saved attributes of the array being processed */
+    std::vector<double> new_values_;
+
+    /** Buffer for the data exposed to the EPICS layer, cache_size values
+     *  for each data block */
+    std::vector<double> expose_buffer_;
+
+    /** Copy of data_selections_ used while the data is exposed */
+    std::vector<int> expose_selections_;
+
+    /** Set when the data changes, cleared when it is exposed */
+    int data_changed_;
+
     const unsigned n_data_blocks_;
     std::vector<int> data_selections_;
 
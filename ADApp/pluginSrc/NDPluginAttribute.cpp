@@ -40,6 +40,144 @@ typedef enum {
 
 #define DEFAULT_NUM_TSPOINTS 2048
 
+/** Looks up where the value of an attribute address comes from.  Called when its name is written.
+  * \param[in] addr The attribute address.
+  */
+void NDPluginAttribute::resolveSource(int addr)
+{
+  char attrName[MAX_ATTR_NAME_] = {0};
+  NDAttrSourceCache_t *pSource = &sources_[addr];
+
+  getStringParam(addr, NDPluginAttributeAttrName, MAX_ATTR_NAME_, attrName);
+  pSource->name = attrName;
+  if (pSource->pSchema) pSource->pSchema->release();
+  pSource->pSchema = NULL;
+  pSource->slot = -1;
+  if (attrName[0] == 0) {
+    pSource->source = NDAttrValueNone;
+  } else if (strcmp(attrName, UNIQUE_ID_NAME_) == 0) {
+    pSource->source = NDAttrValueUniqueId;
+  } else if (strcmp(attrName, TIMESTAMP_NAME_) == 0) {
+    pSource->source = NDAttrValueTimeStamp;
+  } else if (strcmp(attrName, EPICS_TS_SEC_NAME_) == 0) {
+    pSource->source = NDAttrValueEpicsTSSec;
+  } else if (strcmp(attrName, EPICS_TS_NSEC_NAME_) == 0) {
+    pSource->source = NDAttrValueEpicsTSNsec;
+  } else {
+    pSource->source = NDAttrValueAttribute;
+  }
+}
+
+/** Reads the value of an attribute address from an array.
+  * Attributes of compact attribute lists are read by their slot in the schema, which is looked up
+  * again only when the schema changes.  Other attributes are found by name.
+  * \param[in] pArray The array.
+  * \param[in] addr The attribute address.
+  * \param[out] pValue The value.
+  * \return true if the value was read.
+  */
+bool NDPluginAttribute::readValue(NDArray *pArray, int addr, epicsFloat64 *pValue)
+{
+  NDAttrSourceCache_t *pSource = &sources_[addr];
+  NDAttributeList *pAttrList = pArray->pAttributeList;
+  NDAttributeSchema *pSchema;
+  NDAttribute *pAttribute;
+  static const char *functionName = "NDPluginAttribute::readValue";
+
+  switch (pSource->source) {
+    case NDAttrValueNone:
+      return false;
+    case NDAttrValueUniqueId:
+      *pValue = (epicsFloat64)pArray->uniqueId;
+      return true;
+    case NDAttrValueTimeStamp:
+      *pValue = pArray->timeStamp;
+      return true;
+    case NDAttrValueEpicsTSSec:
+      *pValue = (epicsFloat64)pArray->epicsTS.secPastEpoch;
+      return true;
+    case NDAttrValueEpicsTSNsec:
+      *pValue = (epicsFloat64)pArray->epicsTS.nsec;
+      return true;
+    case NDAttrValueAttribute:
+      break;
+  }
+  pSchema = pAttrList->getSchema();
+  if (pSchema && (pSchema != pSource->pSchema)) {
+    // Keep a reference so that a new schema cannot be allocated at the same address
+    pSchema->reserve();
+    if (pSource->pSchema) pSource->pSchema->release();
+    pSource->pSchema = pSchema;
+    pSource->slot = pSchema->findSlot(pSource->name.c_str());
+  }
+  if (pSchema && (pSource->slot >= 0)) {
+    if (pAttrList->getSlotValue(pSource->slot, pValue) == ND_SUCCESS) return true;
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s: Error reading value for NDAttribute %s. \n",
+              functionName, pSource->name.c_str());
+    return false;
+  }
+  pAttribute = pAttrList->find(pSource->name.c_str());
+  if (!pAttribute) {
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s: Error finding NDAttribute %s. \n",
+              functionName, pSource->name.c_str());
+    return false;
+  }
+  if (pAttribute->getValue(NDAttrFloat64, pValue) != ND_SUCCESS) {
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s: Error reading value for NDAttribute %s. \n",
+              functionName, pSource->name.c_str());
+    return false;
+  }
+  return true;
+}
+
+/** Sets the value parameters from the latest values and does the parameter callbacks.  Called with the lock held. */
+void NDPluginAttribute::publishValues()
+{
+  int i;
+
+  for (i=0; i<maxAttributes_; i++) {
+    setDoubleParam(i, NDPluginAttributeVal, values_[i]);
+    setDoubleParam(i, NDPluginAttributeValSum, valueSums_[i]);
+    callParamCallbacks(i);
+  }
+  publishPending_ = false;
+  epicsTimeGetCurrent(&lastPublishTime_);
+}
+
+/** Publishes the values that processCallbacks did not publish because of PublishRate, once
+  * 1/PublishRate has passed, so the last values are published when arrays stop arriving.
+  */
+void NDPluginAttribute::publishTask()
+{
+  double publishRate;
+  double delay;
+  epicsTimeStamp now;
+
+  this->lock();
+  while (!exiting_) {
+    getDoubleParam(NDPluginAttributePublishRate, &publishRate);
+    if (publishPending_) {
+      epicsTimeGetCurrent(&now);
+      if ((publishRate <= 0.) || (epicsTimeDiffInSeconds(&now, &lastPublishTime_) >= 1./publishRate)) {
+        publishValues();
+      }
+    }
+    delay = (publishRate > 0.) ? 1./publishRate : 1.0;
+    if (delay < 0.01) delay = 0.01;
+    this->unlock();
+    epicsEventWaitWithTimeout(publishEvent_, delay);
+    this->lock();
+  }
+  this->unlock();
+  epicsEventSignal(publishExitEvent_);
+}
+
+static void publishTaskC(void *drvPvt)
+{
+  NDPluginAttribute *pPvt = (NDPluginAttribute *)drvPvt;
+  pPvt->publishTask();
+}
+
 /** 
   * \param[in] pArray  The NDArray from the callback.
   */
@@ -50,83 +188,87 @@ void NDPluginAttribute::processCallbacks(NDArray *pArray)
      * structures don't need to be protected.
      */
 
-  int status = 0;
   int currentTSPoint;
   int numTSPoints;
   int TSAcquiring;
-  double valueSum;
+  double publishRate;
   int i;
-  char attrName[MAX_ATTR_NAME_] = {0};
-  NDAttribute *pAttribute = NULL;
-  NDAttributeList *pAttrList = NULL;
   epicsFloat64 attrValue = 0.0;
+  epicsTimeStamp now;
 
-  static const char *functionName = "NDPluginAttribute::processCallbacks";
-  
   /* Call the base class method */
   NDPluginDriver::beginProcessCallbacks(pArray);
   
-  /* Get the attributes for this driver */
-  pAttrList = pArray->pAttributeList;
-  
   getIntegerParam(NDPluginAttributeTSCurrentPoint, &currentTSPoint);
   getIntegerParam(NDPluginAttributeTSNumPoints,    &numTSPoints);
   getIntegerParam(NDPluginAttributeTSAcquiring,    &TSAcquiring);
+  getDoubleParam(NDPluginAttributePublishRate,     &publishRate);
 
+  // The values, sums and time series are updated for every array, only the callbacks are limited by PublishRate
   for (i=0; i<maxAttributes_; i++) {
-    getStringParam(i, NDPluginAttributeAttrName, MAX_ATTR_NAME_, attrName);
-
-    asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "Finding the attribute %s\n", attrName);
-
-    if (strcmp(attrName, UNIQUE_ID_NAME_) == 0) {
-      attrValue = (epicsFloat64) pArray->uniqueId;
-    } else if (strcmp(attrName, TIMESTAMP_NAME_) == 0) {
-      attrValue = pArray->timeStamp;
-    } else if (strcmp(attrName, EPICS_TS_SEC_NAME_) == 0) {
-      attrValue = (epicsFloat64)pArray->epicsTS.secPastEpoch;
-    } else if (strcmp(attrName, EPICS_TS_NSEC_NAME_) == 0) {
-      attrValue = (epicsFloat64)pArray->epicsTS.nsec;
-    } else {
-      pAttribute = pAttrList->find(attrName);
-      if (pAttribute) {
-        status = pAttribute->getValue(NDAttrFloat64, &attrValue);
-        if (status != asynSuccess) {
-          asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s: Error reading value for NDAttribute %s. \n", functionName, attrName);
-          continue;
-        }
-        asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "Attribute %s value is %f\n", attrName, attrValue);
-      } else {
-        asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s: Error finding NDAttribute %s. \n", functionName, attrName);
-        continue;
-      }
+    if (!readValue(pArray, i, &attrValue)) {
+      // Keep the time series of all the attributes the same length
+      if (TSAcquiring) TSBuffers_[i].push(0.0);
+      continue;
     }
-    setDoubleParam(i, NDPluginAttributeVal, attrValue);
-    getDoubleParam(i, NDPluginAttributeValSum, &valueSum);
-    valueSum += attrValue;
-    setDoubleParam(i, NDPluginAttributeValSum, valueSum);
+    values_[i] = attrValue;
+    valueSums_[i] += attrValue;
     if (TSAcquiring) {
-      pTSArray_[i][currentTSPoint] = attrValue;
+      TSBuffers_[i].push(attrValue);
     }
-    callParamCallbacks(i);
   }
+  publishPending_ = true;
   if (TSAcquiring) {
     currentTSPoint++;
     setIntegerParam(NDPluginAttributeTSCurrentPoint, currentTSPoint);
     if (currentTSPoint >= numTSPoints) {
         doTimeSeriesCallbacks();
         setIntegerParam(NDPluginAttributeTSAcquiring, 0);
+        publishValues();
+    }
+  }
+  if (publishPending_) {
+    epicsTimeGetCurrent(&now);
+    if ((publishRate <= 0.) || (epicsTimeDiffInSeconds(&now, &lastPublishTime_) >= 1./publishRate)) {
+      publishValues();
     }
   }
 }
 
+/** Does the callbacks of the time series of all the attributes.
+  * This must be called with the plugin lock held: the callbacks are passed the storage of the
+  * buffers without a copy, and writes to TSNumPoints, Reset and TSControl replace or clear the
+  * buffers with the lock held. */
 void NDPluginAttribute::doTimeSeriesCallbacks()
 {
-  int currentTSPoint;
+  NDRingBuffer<epicsFloat64>::Segment segments[2];
+  std::vector<epicsFloat64> series;
+  size_t numPoints;
+  int i;
+
+  for (i=0; i<maxAttributes_; i++) {
+    numPoints = TSBuffers_[i].maxSize();
+    TSBuffers_[i].getView(numPoints, segments);
+    if (segments[1].size == 0) {
+      // The buffers are cleared when a series starts so it does not wrap, and it is sent without a copy.
+      // Points are only added after the end of the series, so the ones being sent do not change.
+      doCallbacksFloat64Array(const_cast<epicsFloat64 *>(segments[0].data), segments[0].size,
+                              NDPluginAttributeTSArrayValue, i);
+    } else {
+      series.resize(numPoints);
+      series.resize(TSBuffers_[i].copyLatest(&series[0], numPoints));
+      doCallbacksFloat64Array(series.empty() ? NULL : &series[0], series.size(), NDPluginAttributeTSArrayValue, i);
+    }
+  }
+}
+
+/** Empties the time series buffers */
+void NDPluginAttribute::clearTimeSeries()
+{
   int i;
 
-  getIntegerParam(NDPluginAttributeTSCurrentPoint, &currentTSPoint);
   for (i=0; i<maxAttributes_; i++) {
-    doCallbacksFloat64Array(pTSArray_[i], currentTSPoint, NDPluginAttributeTSArrayValue, i);
+    TSBuffers_[i].clear();
   }
 }
 
@@ -137,6 +279,7 @@ asynStatus NDPluginAttribute::writeInt32(asynUser *pasynUser, epicsInt32 value)
   asynStatus status = asynSuccess;
   int numTSPoints, currentTSPoint;
   int i;
+  std::vector<epicsFloat64> zeros;
   static const char *functionName = "NDPluginAttribute::writeInt32";
 
   /* Set the parameter in the parameter library. */
@@ -144,31 +287,29 @@ asynStatus NDPluginAttribute::writeInt32(asynUser *pasynUser, epicsInt32 value)
 
   if (function == NDPluginAttributeReset) {
   getIntegerParam(NDPluginAttributeTSNumPoints, &numTSPoints);
+    // Clear the time series and send zeros
+    clearTimeSeries();
+    zeros.assign(numTSPoints > 0 ? numTSPoints : 1, 0.0);
+    values_.assign(maxAttributes_, 0.0);
+    valueSums_.assign(maxAttributes_, 0.0);
+    publishPending_ = false;
     for (i=0; i<maxAttributes_; i++) {
       setDoubleParam(i, NDPluginAttributeVal, 0.0);
       setDoubleParam(i, NDPluginAttributeValSum, 0.0);
-      // Clear the time series array
-      memset(pTSArray_[i], 0, numTSPoints*sizeof(epicsFloat64));
-      doCallbacksFloat64Array(this->pTSArray_[i], numTSPoints, NDPluginAttributeTSArrayValue, i);
+      doCallbacksFloat64Array(&zeros[0], numTSPoints > 0 ? numTSPoints : 0, NDPluginAttributeTSArrayValue, i);
       callParamCallbacks(i);
     }
     setIntegerParam(NDPluginAttributeTSCurrentPoint, 0);
   } 
   else if (function == NDPluginAttributeTSNumPoints) {
-    for (i=0; i<maxAttributes_; i++) {
-      free(pTSArray_[i]);
-      pTSArray_[i] = static_cast<epicsFloat64 *>(calloc(value, sizeof(epicsFloat64)));
-    }
+    TSBuffers_.assign(maxAttributes_, NDRingBuffer<epicsFloat64>(value > 0 ? value : 1));
   } 
   else if (function == NDPluginAttributeTSControl) {
     switch (value) {
       case TSEraseStart:
         setIntegerParam(NDPluginAttributeTSCurrentPoint, 0);
         setIntegerParam(NDPluginAttributeTSAcquiring, 1);
-        getIntegerParam(NDPluginAttributeTSNumPoints, &numTSPoints);
-        for (i=0; i<maxAttributes_; i++) {
-          memset(pTSArray_[i], 0, numTSPoints*sizeof(epicsFloat64));
-        }
+        clearTimeSeries();
         doTimeSeriesCallbacks();
         break;
       case TSStart:
@@ -181,6 +322,7 @@ asynStatus NDPluginAttribute::writeInt32(asynUser *pasynUser, epicsInt32 value)
       case TSStop:
         setIntegerParam(NDPluginAttributeTSAcquiring, 0);
         doTimeSeriesCallbacks();
+        if (publishPending_) publishValues();
         break;
       case TSRead:
         doTimeSeriesCallbacks();
@@ -208,6 +350,28 @@ asynStatus NDPluginAttribute::writeInt32(asynUser *pasynUser, epicsInt32 value)
 }
 
 
+/** Called when asyn clients call pasynOctet->write().
+  * Looks up the source of the value of an attribute when its name is written.
+  * \param[in] pasynUser pasynUser structure that encodes the reason and address.
+  * \param[in] value Address of the string to write.
+  * \param[in] nChars Number of characters to write.
+  * \param[out] nActual Number of characters actually written. */
+asynStatus NDPluginAttribute::writeOctet(asynUser *pasynUser, const char *value,
+                                         size_t nChars, size_t *nActual)
+{
+  int function = pasynUser->reason;
+  int addr = 0;
+  asynStatus status;
+
+  status = NDPluginDriver::writeOctet(pasynUser, value, nChars, nActual);
+  if ((status == asynSuccess) && (function == NDPluginAttributeAttrName)) {
+    getAddress(pasynUser, &addr);
+    resolveSource(addr);
+  }
+  return status;
+}
+
+
 /** Constructor for NDPluginAttribute; most parameters are simply passed to NDPluginDriver::NDPluginDriver.
   *
   * \param[in] portName The name of the asyn port driver to be created.
@@ -239,7 +403,7 @@ NDPluginAttribute::NDPluginAttribute(const char *portName, int queueSize, int bl
                    ASYN_MULTIDEVICE, 1, priority, stackSize, 1)
 {
   int i;
-  static const char *functionName = "NDPluginAttribute::NDPluginAttribute";
+  NDAttrSourceCache_t noSource;
 
   maxAttributes_ = maxAttributes;
   if (maxAttributes_ < 1) maxAttributes_ = 1;
@@ -253,25 +417,27 @@ NDPluginAttribute::NDPluginAttribute(const char *portName, int queueSize, int bl
   createParam(NDPluginAttributeTSCurrentPointString, asynParamInt32,        &NDPluginAttributeTSCurrentPoint);
   createParam(NDPluginAttributeTSAcquiringString,    asynParamInt32,        &NDPluginAttributeTSAcquiring);
   createParam(NDPluginAttributeTSArrayValueString,   asynParamFloat64Array, &NDPluginAttributeTSArrayValue);
+  createParam(NDPluginAttributePublishRateString,    asynParamFloat64,      &NDPluginAttributePublishRate);
 
   /* Set the plugin type string */
   setStringParam(NDPluginDriverPluginType, "NDPluginAttribute");
 
   setIntegerParam(NDPluginAttributeTSNumPoints, DEFAULT_NUM_TSPOINTS);
-  pTSArray_ = static_cast<epicsFloat64 **>(calloc(maxAttributes_, sizeof(epicsFloat64 *)));
-  if (pTSArray_ == NULL) {
-    perror(functionName);
-    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, "%s: Error from calloc for pTSArray_.\n", functionName);
-  }
+  setDoubleParam(NDPluginAttributePublishRate, 0.0);
+  TSBuffers_.assign(maxAttributes_, NDRingBuffer<epicsFloat64>(DEFAULT_NUM_TSPOINTS));
+  noSource.source = NDAttrValueNone;
+  noSource.pSchema = NULL;
+  noSource.slot = -1;
+  sources_.assign(maxAttributes_, noSource);
+  values_.assign(maxAttributes_, 0.0);
+  valueSums_.assign(maxAttributes_, 0.0);
+  publishPending_ = false;
+  epicsTimeGetCurrent(&lastPublishTime_);
   for (i=0; i<maxAttributes_; i++) {
-    pTSArray_[i] = static_cast<epicsFloat64*>(calloc(DEFAULT_NUM_TSPOINTS, sizeof(epicsFloat64)));
     setDoubleParam(i, NDPluginAttributeVal, 0.0);
     setDoubleParam(i, NDPluginAttributeValSum, 0.0);
     setStringParam(i, NDPluginAttributeAttrName, "");
-    if (pTSArray_[i] == NULL) {
-      perror(functionName);
-      asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, "%s: Error from calloc for pTSArray_.\n", functionName);
-    }
+    resolveSource(i);
     callParamCallbacks(i);
   }
 
@@ -279,11 +445,33 @@ NDPluginAttribute::NDPluginAttribute(const char *portName, int queueSize, int bl
   // This plugin currently does not do array callbacks, so make the setting reflect the behavior
   setIntegerParam(NDArrayCallbacks, 0);
 
+  /* Start the task that publishes values held back by PublishRate */
+  exiting_ = false;
+  publishEvent_ = epicsEventMustCreate(epicsEventEmpty);
+  publishExitEvent_ = epicsEventMustCreate(epicsEventEmpty);
+  epicsThreadCreate("NDPluginAttributePublish", epicsThreadPriorityMedium,
+                    epicsThreadGetStackSize(epicsThreadStackMedium),
+                    (EPICSTHREADFUNC)publishTaskC, this);
+
   /* Try to connect to the array port */
   connectToArrayPort();
 
 }
 
+NDPluginAttribute::~NDPluginAttribute()
+{
+  this->lock();
+  exiting_ = true;
+  this->unlock();
+  epicsEventSignal(publishEvent_);
+  epicsEventWait(publishExitEvent_);
+  epicsEventDestroy(publishEvent_);
+  epicsEventDestroy(publishExitEvent_);
+  for (size_t i=0; i<sources_.size(); i++) {
+    if (sources_[i].pSchema) sources_[i].pSchema->release();
+  }
+}
+
 /** Configuration command */
 extern "C" int NDAttrConfigure(const char *portName, int queueSize, int blockingCallbacks,
                                const char *NDArrayPort, int NDArrayAddr,
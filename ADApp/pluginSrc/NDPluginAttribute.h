@@ -2,9 +2,15 @@
 #ifndef NDPluginAttribute_H
 #define NDPluginAttribute_H
 
+#include <string>
+#include <vector>
+
 #include <epicsTypes.h>
+#include <epicsEvent.h>
+#include <epicsTime.h>
 
 #include "NDPluginDriver.h"
+#include "NDRingBuffer.h"
 
 /* General parameters */
 #define NDPluginAttributeAttrNameString       "ATTR_ATTRNAME"         /* (asynInt32,        r/w) Name of Attribute */
@@ -16,6 +22,25 @@
 #define NDPluginAttributeTSCurrentPointString "ATTR_TS_CURRENT_POINT" /* (asynInt32,        r/o) Current point in time series */
 #define NDPluginAttributeTSAcquiringString    "ATTR_TS_ACQUIRING"     /* (asynInt32,        r/o) Acquiring time series */
 #define NDPluginAttributeTSArrayValueString   "ATTR_TS_ARRAY_VALUE"   /* (asynFloat64Array, r/o) Series of minimum counts */
+#define NDPluginAttributePublishRateString    "ATTR_PUBLISH_RATE"     /* (asynFloat64,      r/w) Maximum rate of value callbacks, 0=every array */
+
+/** Where the value of an attribute comes from, resolved from its name when the name is written */
+typedef enum {
+    NDAttrValueNone,        /**< No name, nothing is read */
+    NDAttrValueUniqueId,    /**< NDArray::uniqueId */
+    NDAttrValueTimeStamp,   /**< NDArray::timeStamp */
+    NDAttrValueEpicsTSSec,  /**< NDArray::epicsTS.secPastEpoch */
+    NDAttrValueEpicsTSNsec, /**< NDArray::epicsTS.nsec */
+    NDAttrValueAttribute    /**< An NDAttribute of the array */
+} NDAttrValueSource_t;
+
+/** Cached source of the value of one attribute address */
+typedef struct {
+    NDAttrValueSource_t source;
+    std::string name;
+    NDAttributeSchema *pSchema;  /**< Reserved schema that slot was found in, NULL if not yet looked up */
+    int slot;                    /**< Slot of the attribute in pSchema, -1 if it is not in it */
+} NDAttrSourceCache_t;
 
 /** Extract an Attribute from an NDArray and publish the value (and array of values) over channel access.  */
 class epicsShareClass NDPluginAttribute : public NDPluginDriver {
@@ -24,9 +49,12 @@ public:
                       const char *NDArrayPort, int NDArrayAddr, int maxAttributes,
                       int maxBuffers, size_t maxMemory,
                       int priority, int stackSize);
+    ~NDPluginAttribute();
     /* These methods override the virtual methods in the base class */
     void processCallbacks(NDArray *pArray);
     asynStatus writeInt32(asynUser *pasynUser, epicsInt32 value);
+    asynStatus writeOctet(asynUser *pasynUser, const char *value, size_t nChars, size_t *nActual);
+    void publishTask();
 
 protected:
     int NDPluginAttributeAttrName;
@@ -39,10 +67,15 @@ protected:
     int NDPluginAttributeTSCurrentPoint;
     int NDPluginAttributeTSAcquiring;
     int NDPluginAttributeTSArrayValue;
+    int NDPluginAttributePublishRate;
                                 
 private:
 
     void doTimeSeriesCallbacks();
+    void clearTimeSeries();
+    void resolveSource(int addr);
+    bool readValue(NDArray *pArray, int addr, epicsFloat64 *pValue);
+    void publishValues();
     static const epicsInt32 MAX_ATTR_NAME_;
     static const char*      UNIQUE_ID_NAME_;
     static const char*      TIMESTAMP_NAME_;
@@ -50,7 +83,18 @@ private:
     static const char*      EPICS_TS_NSEC_NAME_;
 
     int maxAttributes_;
-    epicsFloat64 **pTSArray_;
+    /** Time series of each attribute.  Values are pushed by processCallbacks and
+      * the series can be exported without the plugin lock. */
+    std::vector<NDRingBuffer<epicsFloat64> > TSBuffers_;
+    std::vector<NDAttrSourceCache_t> sources_;
+    /** Latest value and sum of each attribute, updated for every array and published at PublishRate */
+    std::vector<epicsFloat64> values_;
+    std::vector<epicsFloat64> valueSums_;
+    bool publishPending_;
+    epicsTimeStamp lastPublishTime_;
+    bool exiting_;
+    epicsEventId publishEvent_;
+    epicsEventId publishExitEvent_;
 
 };
     
@@ -11,6 +11,8 @@
 #include <string.h>
 #include <stdio.h>
 #include <math.h>
+#include <limits.h>
+#include <ctype.h>
 
 #include <epicsTypes.h>
 #include <epicsMessageQueue.h>
@@ -31,64 +33,326 @@ static const char *driverName="NDPluginCircularBuff";
 
 #define DEFAULT_TRIGGER_CALC "0"
 
-asynStatus NDPluginCircularBuff::calculateTrigger(NDArray *pArray, int *trig)
+/** Returns the value of a trigger attribute as a double, or NaN if the array does not have it.
+  * \param[in] pList The attribute list of the array.
+  * \param[in] name The name of the attribute.
+  * \param[in] slot The slot of the attribute in the schema of pList, or -1 to look it up by name. */
+double NDPluginCircularBuff::triggerAttributeValue(NDAttributeList *pList, const std::string& name, int slot)
 {
-    NDAttribute *trigger;
-    char triggerString[256];
-    double triggerValue;
+    NDAttribute *pAttribute;
+    double value;
+
+    if (name.empty()) return epicsNAN;
+    if ((slot >= 0) && (pList->getSlotValue(slot, &value) == ND_SUCCESS)) return value;
+    pAttribute = pList->find(name.c_str());
+    if (pAttribute && (pAttribute->getValue(NDAttrFloat64, &value) == ND_SUCCESS)) return value;
+    return epicsNAN;
+}
+
+/** Evaluates the trigger calculation for an array and applies the trigger mode and number of events.
+  * This only uses the trigger state kept in the object, not the parameter library.
+  * The trigger attributes are read by slot when the arrays have compact attribute lists;
+  * their slots are found again when the schema of the arrays changes.
+  * \param[in] pArray The array.
+  * \param[in] preCount The number of pre-trigger arrays.
+  * \param[in] postCount The number of post-trigger arrays.
+  * \param[in] currentImage The number of arrays in the buffer.
+  * \param[out] trig Set to 1 if the array is a trigger, otherwise 0. */
+asynStatus NDPluginCircularBuff::calculateTrigger(NDArray *pArray, int preCount, int postCount, int currentImage, int *trig)
+{
+    NDAttributeList *pList = pArray->pAttributeList;
+    NDAttributeSchema *pSchema;
     double calcResult;
-    int status;
-    int preTrigger, postTrigger, currentImage, triggered;
+    int status, condition, event;
+    int aSlot = -1, bSlot = -1;
     static const char *functionName="calculateTrigger";
     
     *trig = 0;
-    
-    getIntegerParam(NDCircBuffPreTrigger,   &preTrigger);
-    getIntegerParam(NDCircBuffPostTrigger,  &postTrigger);
-    getIntegerParam(NDCircBuffCurrentImage, &currentImage);
-    getIntegerParam(NDCircBuffTriggered,    &triggered);   
-
-    triggerCalcArgs_[0] = epicsNAN;
-    triggerCalcArgs_[1] = epicsNAN;
-    triggerCalcArgs_[2] = preTrigger;
-    triggerCalcArgs_[3] = postTrigger;
-    triggerCalcArgs_[4] = currentImage;
-    triggerCalcArgs_[5] = triggered;
-
-    getStringParam(NDCircBuffTriggerA, sizeof(triggerString), triggerString);
-    trigger = pArray->pAttributeList->find(triggerString);
-    if (trigger != NULL) {
-        status = trigger->getValue(NDAttrFloat64, &triggerValue);
-        if (status == asynSuccess) {
-            triggerCalcArgs_[0] = triggerValue;
-        }
+
+    pSchema = pList->getSchema();
+    if (pSchema && (pSchema != pTriggerSchema_)) {
+        // Keep a reference to the schema so that it cannot be replaced by another one at the same address
+        pSchema->reserve();
+        if (pTriggerSchema_) pTriggerSchema_->release();
+        pTriggerSchema_ = pSchema;
+        triggerASlot_ = triggerAName_.empty() ? -1 : pSchema->findSlot(triggerAName_.c_str());
+        triggerBSlot_ = triggerBName_.empty() ? -1 : pSchema->findSlot(triggerBName_.c_str());
     }
-    getStringParam(NDCircBuffTriggerB, sizeof(triggerString), triggerString);
-    trigger = pArray->pAttributeList->find(triggerString);
-    if (trigger != NULL) {
-        status = trigger->getValue(NDAttrFloat64, &triggerValue);
-        if (status == asynSuccess) {
-            triggerCalcArgs_[1] = triggerValue;
-        }
+    if (pSchema && (pSchema == pTriggerSchema_)) {
+        aSlot = triggerASlot_;
+        bSlot = triggerBSlot_;
     }
+
+    triggerCalcArgs_[0] = triggerAttributeValue(pList, triggerAName_, aSlot);
+    triggerCalcArgs_[1] = triggerAttributeValue(pList, triggerBName_, bSlot);
+    triggerCalcArgs_[2] = preCount;
+    triggerCalcArgs_[3] = postCount;
+    triggerCalcArgs_[4] = currentImage;
+    triggerCalcArgs_[5] = 0;
     
     setDoubleParam(NDCircBuffTriggerAVal, triggerCalcArgs_[0]);
     setDoubleParam(NDCircBuffTriggerBVal, triggerCalcArgs_[1]);
-    status = calcPerform(triggerCalcArgs_, &calcResult, triggerCalcPostfix_);
-    if (status) {
-        asynPrint(pasynUserSelf, ASYN_TRACE_ERROR,
-            "%s::%s error evaluating expression=%s\n",
-            driverName, functionName, calcErrorStr(status));
-        return asynError;
+    if (triggerCalcConstant_) {
+        calcResult = triggerCalcConstantValue_;
+    } else {
+        status = calcPerform(triggerCalcArgs_, &calcResult, triggerCalcPostfix_);
+        if (status) {
+            asynPrint(pasynUserSelf, ASYN_TRACE_ERROR,
+                "%s::%s error evaluating expression=%s\n",
+                driverName, functionName, calcErrorStr(status));
+            return asynError;
+        }
     }
-    
-    if (!isnan(calcResult) && !isinf(calcResult) && (calcResult != 0)) *trig = 1;
     setDoubleParam(NDCircBuffTriggerCalcVal, calcResult);
+    
+    condition = (!isnan(calcResult) && !isinf(calcResult) && (calcResult != 0)) ? 1 : 0;
+    switch (triggerMode_) {
+        case NDCircBuffTriggerModeRisingEdge:
+            event = condition && (previousCondition_ == 0);
+            break;
+        case NDCircBuffTriggerModeFallingEdge:
+            event = !condition && (previousCondition_ == 1);
+            break;
+        case NDCircBuffTriggerModeThreshold:
+            event = 0;
+            if (thresholdArmed_ && (calcResult >= triggerThreshold_)) {
+                event = 1;
+                thresholdArmed_ = false;
+            } else if (calcResult < triggerThreshold_ - triggerHysteresis_) {
+                thresholdArmed_ = true;
+            }
+            break;
+        default:
+            event = condition;
+            break;
+    }
+    previousCondition_ = condition;
+    if (event && (++triggerEventCount_ >= triggerEvents_)) {
+        triggerEventCount_ = 0;
+        *trig = 1;
+    }
 
     return asynSuccess;
 }
+
+/** Checks whether the trigger calculation uses any arguments after it has been converted to postfix.
+  * If it does not, and does not use random numbers, it is evaluated once here rather than for each array. */
+void NDPluginCircularBuff::compileTriggerCalc()
+{
+    unsigned long inputs = 0, stores = 0;
+    double args[CALCPERFORM_NARGS];
+    char infix[MAX_INFIX_SIZE];
+
+    triggerCalcConstant_ = false;
+    if (calcArgUsage(triggerCalcPostfix_, &inputs, &stores) || inputs || stores) return;
+    // RNDM and NRNDN do not use arguments but give a different value each time
+    strncpy(infix, triggerCalcInfix_, sizeof(infix)-1);
+    infix[sizeof(infix)-1] = 0;
+    for (char *pc = infix; *pc; pc++) *pc = (char)toupper((unsigned char)*pc);
+    if (strstr(infix, "RND")) return;
+    for (int i=0; i<CALCPERFORM_NARGS; i++) args[i] = 0.;
+    if (calcPerform(args, &triggerCalcConstantValue_, triggerCalcPostfix_) == 0) triggerCalcConstant_ = true;
+}
+
+/** Resets the state of the trigger conditions, so that edges and threshold crossings
+  * are only detected in arrays after this. */
+void NDPluginCircularBuff::resetTrigger()
+{
+    triggerEventCount_ = 0;
+    previousCondition_ = -1;
+    thresholdArmed_ = false;
+}
     
 
+/** Estimates how many more arrays of the size of pArray its NDArrayPool can provide,
+  * from the free arrays and the buffers and memory it is still allowed to allocate.
+  * The pool is not locked, so this is only an estimate. */
+static int poolFreeBuffers(NDArray *pArray)
+{
+    NDArrayPool *pPool = pArray->pNDArrayPool;
+    NDArrayInfo_t arrayInfo;
+    int freeBuffers = INT_MAX;
+    int maxBuffers = pPool->maxBuffers();
+    size_t maxMemory = pPool->maxMemory();
+    size_t memorySize = pPool->memorySize();
+    int numFree = pPool->numFree();
+
+    if (maxBuffers > 0) {
+        freeBuffers = maxBuffers - pPool->numBuffers() + numFree;
+    }
+    if (maxMemory > 0) {
+        pArray->getInfo(&arrayInfo);
+        if (arrayInfo.totalBytes > 0) {
+            size_t memoryBuffers = (maxMemory > memorySize) ? (maxMemory - memorySize) / arrayInfo.totalBytes : 0;
+            if ((size_t)freeBuffers > memoryBuffers + numFree) freeBuffers = (int)(memoryBuffers + numFree);
+        }
+    }
+    return freeBuffers;
+}
+
+/** Returns an array with the data of pArray to store in the buffer.
+  * If NDCircBuffStoreReferences is set this is pArray itself with an extra reference, unless
+  * that would leave fewer than NDCircBuffMinFreeBuffers arrays for the driver that owns pArray,
+  * in which case, or if NDCircBuffStoreReferences is not set, it is a copy from our own pool.
+  * Storing references only works if the driver does not reuse the memory of arrays that it has
+  * passed to plugins, which is the case for drivers that allocate their arrays from their NDArrayPool.
+  * \param[in] pArray  The NDArray from the callback.
+  * \return Returns the array to store, with a reference for the caller, or NULL if it cannot be copied. */
+NDArray *NDPluginCircularBuff::storeArray(NDArray *pArray)
+{
+    int storeReferences, minFreeBuffers;
+    int numReferenced, numCopied;
+    NDArray *pArrayOut;
+
+    getIntegerParam(NDCircBuffStoreReferences, &storeReferences);
+    getIntegerParam(NDCircBuffMinFreeBuffers,  &minFreeBuffers);
+    if (storeReferences && pArray->pNDArrayPool && (poolFreeBuffers(pArray) >= minFreeBuffers)) {
+        pArray->reserve();
+        getIntegerParam(NDCircBuffNumReferenced, &numReferenced);
+        setIntegerParam(NDCircBuffNumReferenced, numReferenced+1);
+        return pArray;
+    }
+    pArrayOut = this->pNDArrayPool->copy(pArray, NULL, 1);
+    if (pArrayOut) {
+        getIntegerParam(NDCircBuffNumCopied, &numCopied);
+        setIntegerParam(NDCircBuffNumCopied, numCopied+1);
+    }
+    return pArrayOut;
+}
+
+/** Opens the spill file at the start of a capture if spilling is enabled and the memory depth is
+  * less than the number of pre-trigger arrays, otherwise closes it.
+  * \param[in] preCount The number of pre-trigger arrays.
+  * \return Returns the number of pre-trigger arrays to keep in memory. */
+int NDPluginCircularBuff::openSpillBuffer(int preCount)
+{
+    int spillEnable, memoryDepth, fileSize;
+    char fileName[MAX_FILENAME_LEN];
+    static const char *functionName = "openSpillBuffer";
+
+    spillBuffer_.clear();
+    spillGeneration_++;
+    spillWrapped_ = false;
+    spillWriteTime_ = 0.;
+    setIntegerParam(NDCircBuffSpillQty, 0);
+    setIntegerParam(NDCircBuffSpillWritten, 0);
+    setIntegerParam(NDCircBuffSpillErrors, 0);
+    setDoubleParam(NDCircBuffSpillWriteRate, 0.);
+    setDoubleParam(NDCircBuffSpillReadRate, 0.);
+    setDoubleParam(NDCircBuffSpillRatio, 1.);
+    setStringParam(NDCircBuffSpillMessage, "");
+
+    getIntegerParam(NDCircBuffSpillEnable,   &spillEnable);
+    getIntegerParam(NDCircBuffMemoryDepth,   &memoryDepth);
+    getIntegerParam(NDCircBuffSpillFileSize, &fileSize);
+    getStringParam(NDCircBuffSpillFile, sizeof(fileName), fileName);
+    if (!spillEnable || (memoryDepth >= preCount)) {
+        spillBuffer_.close();
+        return preCount;
+    }
+    if (memoryDepth < 0) memoryDepth = 0;
+    if (strlen(fileName) == 0) {
+        spillBuffer_.close();
+        setStringParam(NDCircBuffSpillMessage, "No spill file");
+        return memoryDepth;
+    }
+    if (spillBuffer_.open(fileName, (size_t)fileSize * 1024 * 1024, preCount - memoryDepth)) {
+        spillError(functionName);
+    }
+    return memoryDepth;
+}
+
+/** Writes an array that no longer fits in the memory ring to the spill file.
+  * Compressed arrays are compressed with the lock released, so that parameter writes and
+  * readbacks are not blocked for the compression time; the array is dropped if a new capture
+  * was started meanwhile.
+  * \param[in] pArray The array; the caller keeps its reference. */
+void NDPluginCircularBuff::spillArray(NDArray *pArray)
+{
+    int compress, numWritten, status;
+    int spillQty;
+    int generation = spillGeneration_;
+    epicsTimeStamp tStart, tEnd;
+    static const char *functionName = "spillArray";
+
+    getIntegerParam(NDCircBuffSpillCompress, &compress);
+    epicsTimeGetCurrent(&tStart);
+    if (compress && NDArrayDiskRing::compressionAvailable()) {
+        this->unlock();
+        NDArrayDiskRing::encode(pArray, true, spillRecord_);
+        this->lock();
+        if ((generation != spillGeneration_) || !spillBuffer_.isOpen()) return;
+        spillQty = spillBuffer_.size();
+        status = spillBuffer_.addRecord(spillRecord_);
+    } else {
+        spillQty = spillBuffer_.size();
+        status = spillBuffer_.addToEnd(pArray, false);
+    }
+    if (status) {
+        spillError(functionName);
+        return;
+    }
+    epicsTimeGetCurrent(&tEnd);
+    spillWriteTime_ += epicsTimeDiffInSeconds(&tEnd, &tStart);
+    // The oldest arrays in the file were discarded if the number of arrays did not increase
+    if (spillBuffer_.size() <= spillQty) spillWrapped_ = true;
+
+    getIntegerParam(NDCircBuffSpillWritten, &numWritten);
+    setIntegerParam(NDCircBuffSpillWritten, numWritten+1);
+    setIntegerParam(NDCircBuffSpillQty, spillBuffer_.size());
+    if (spillWriteTime_ > 0.) {
+        setDoubleParam(NDCircBuffSpillWriteRate, spillBuffer_.bytesWritten() / spillWriteTime_ / 1.e6);
+    }
+    if (spillBuffer_.bytesStored() > 0.) {
+        setDoubleParam(NDCircBuffSpillRatio, spillBuffer_.bytesWritten() / spillBuffer_.bytesStored());
+    }
+}
+
+/** Reads the arrays in the spill file, oldest first, and does callbacks with them.
+  * The arrays are allocated from our NDArrayPool one at a time. */
+void NDPluginCircularBuff::flushSpillBuffer()
+{
+    NDArray *pSpilled;
+    NDArrayInfo_t arrayInfo;
+    epicsTimeStamp tStart, tEnd;
+    double readTime = 0., bytesRead = 0.;
+    static const char *functionName = "flushSpillBuffer";
+
+    for (int i=0; i<spillBuffer_.size(); i++) {
+        epicsTimeGetCurrent(&tStart);
+        pSpilled = spillBuffer_.read(i, this->pNDArrayPool);
+        epicsTimeGetCurrent(&tEnd);
+        if (!pSpilled) {
+            spillError(functionName);
+            continue;
+        }
+        readTime += epicsTimeDiffInSeconds(&tEnd, &tStart);
+        pSpilled->getInfo(&arrayInfo);
+        bytesRead += arrayInfo.totalBytes;
+        doCallbacksGenericPointer(pSpilled, NDArrayData, 0);
+        pSpilled->release();
+    }
+    spillBuffer_.clear();
+    spillWrapped_ = false;
+    setIntegerParam(NDCircBuffSpillQty, 0);
+    if (readTime > 0.) {
+        setDoubleParam(NDCircBuffSpillReadRate, bytesRead / readTime / 1.e6);
+    }
+}
+
+/** Counts and reports an error writing or reading the spill file */
+void NDPluginCircularBuff::spillError(const char *functionName)
+{
+    int numErrors;
+
+    getIntegerParam(NDCircBuffSpillErrors, &numErrors);
+    setIntegerParam(NDCircBuffSpillErrors, numErrors+1);
+    setStringParam(NDCircBuffSpillMessage, spillBuffer_.errorMessage());
+    asynPrint(pasynUserSelf, ASYN_TRACE_ERROR,
+              "%s::%s spill file error: %s\n",
+              driverName, functionName, spillBuffer_.errorMessage());
+}
+
 /** Callback function that is called by the NDArray driver with new NDArray data.
   * Stores the number of pre-trigger images prior to the trigger in a ring buffer.
   * Once the trigger has been received stores the number of post-trigger buffers
@@ -122,7 +386,6 @@ void NDPluginCircularBuff::processCallbacks(NDArray *pArray)
     getIntegerParam(NDCircBuffPostCount,          &currentPostCount);
     getIntegerParam(NDCircBuffSoftTrigger,        &softTrigger);
     getIntegerParam(NDCircBuffPresetTriggerCount, &presetTriggerCount);
-    getIntegerParam(NDCircBuffPresetTriggerCount, &presetTriggerCount);
     getIntegerParam(NDCircBuffActualTriggerCount, &actualTriggerCount);
 
     // Are we running?
@@ -136,28 +399,31 @@ void NDPluginCircularBuff::processCallbacks(NDArray *pArray)
         getIntegerParam(NDCircBuffTriggered, &triggered);
         if (!triggered) { 
           // Check for the trigger based on meta-data in the NDArray and the trigger calculation
-          calculateTrigger(pArray, &triggered);
+          calculateTrigger(pArray, preCount, postCount, currentImage, &triggered);
           setIntegerParam(NDCircBuffTriggered, triggered);
         }
       }
 
-      // First copy the buffer into our buffer pool so we can release the resource on the driver
-      pArrayCpy = this->pNDArrayPool->copy(pArray, NULL, 1);
+      // Keep a reference to the array or copy it into our buffer pool so we can release the resource on the driver
+      pArrayCpy = storeArray(pArray);
 
       if (pArrayCpy){
 
         // Have we detected a trigger event yet?
         if (!triggered){
           // No trigger so add the NDArray to the pre-trigger ring
-          pOldArray_ = preBuffer_->addToEnd(pArrayCpy);
-          // If we overwrote an existing array in the ring, release it here
-          if (pOldArray_){
-            pOldArray_->release();
-            pOldArray_ = NULL;
+          // The array that was overwritten is kept in a local variable, because spillArray()
+          // can release the lock and a new capture resets pOldArray_
+          NDArray *pOldArray = preBuffer_->addToEnd(pArrayCpy);
+          // If we overwrote an existing array in the ring, move it to the spill file
+          // if we are using one, and release it here
+          if (pOldArray){
+            if (spillBuffer_.isOpen()) spillArray(pOldArray);
+            pOldArray->release();
           }
           // Set the size
-          setIntegerParam(NDCircBuffCurrentImage,  preBuffer_->size());
-          if (preBuffer_->size() == preCount){
+          setIntegerParam(NDCircBuffCurrentImage,  preBuffer_->size() + spillBuffer_.size());
+          if ((preBuffer_->size() + spillBuffer_.size() == preCount) || spillWrapped_){
             setStringParam(NDCircBuffStatus, "Buffer Wrapping");
           }
         } else {
@@ -168,8 +434,10 @@ void NDPluginCircularBuff::processCallbacks(NDArray *pArray)
           // Has the trigger occured on this frame?
           if (previousTrigger_ == 0){
             previousTrigger_ = 1;
-            // Yes, so flush the ring first
-
+            // Yes, so flush the spill file and the ring first
+            if (spillBuffer_.size() > 0){
+              flushSpillBuffer();
+            }
             if (preBuffer_->size() > 0){
               doCallbacksGenericPointer(preBuffer_->readFromStart(), NDArrayData, 0);
               while (preBuffer_->hasNext()) {
@@ -195,6 +463,7 @@ void NDPluginCircularBuff::processCallbacks(NDArray *pArray)
               ((presetTriggerCount > 0) && (actualTriggerCount < presetTriggerCount)))
           {
             previousTrigger_ = 0;
+            resetTrigger();
             // Set the status to buffer filling
             setIntegerParam(NDCircBuffControl, 1);
             setIntegerParam(NDCircBuffSoftTrigger, 0);
@@ -226,7 +495,7 @@ asynStatus NDPluginCircularBuff::writeInt32(asynUser *pasynUser, epicsInt32 valu
 {
     int function = pasynUser->reason;
     asynStatus status = asynSuccess;
-    int preCount;
+    int preCount, spillEnable;
     static const char *functionName = "writeInt32";
 
     if (function == NDCircBuffControl){
@@ -236,19 +505,23 @@ asynStatus NDPluginCircularBuff::writeInt32(asynUser *pasynUser, epicsInt32 valu
           if (preBuffer_){
             delete preBuffer_;
           }
-          preBuffer_ = new NDArrayRing(preCount);
+          // Arrays that do not fit in the ring go to the spill file if that is enabled
+          preBuffer_ = new NDArrayRing(openSpillBuffer(preCount));
           if (pOldArray_){
             pOldArray_->release();
           }
           pOldArray_ = NULL;
  
           previousTrigger_ = 0;
+          resetTrigger();
 
           // Set the status to buffer filling
           setIntegerParam(NDCircBuffSoftTrigger, 0);
           setIntegerParam(NDCircBuffTriggered, 0);
           setIntegerParam(NDCircBuffPostCount, 0);
           setIntegerParam(NDCircBuffActualTriggerCount, 0);
+          setIntegerParam(NDCircBuffNumReferenced, 0);
+          setIntegerParam(NDCircBuffNumCopied, 0);
           setStringParam(NDCircBuffStatus, "Buffer filling");
         } else {
           // Control is turned off, before we have finished
@@ -270,13 +543,38 @@ asynStatus NDPluginCircularBuff::writeInt32(asynUser *pasynUser, epicsInt32 valu
         setIntegerParam(NDCircBuffTriggered, 1);
 
     }  else if (function == NDCircBuffPreTrigger){
-        // Check the value of pretrigger does not exceed max buffers
-        if (value > (maxBuffers_ - 1)){
+        // Check the value of pretrigger does not exceed max buffers, unless the arrays
+        // that do not fit in memory are spilled to a file
+        getIntegerParam(NDCircBuffSpillEnable, &spillEnable);
+        if (!spillEnable && (value > (maxBuffers_ - 1))){
           setStringParam(NDCircBuffStatus, "Pre-count too high");
         } else {
           // Set the parameter in the parameter library.
           status = (asynStatus) setIntegerParam(function, value);
         }
+    }  else if (function == NDCircBuffMemoryDepth){
+        // Check the memory depth does not exceed max buffers
+        if ((maxBuffers_ > 0) && (value > (maxBuffers_ - 1))){
+          setStringParam(NDCircBuffStatus, "Memory depth too high");
+        } else {
+          status = (asynStatus) setIntegerParam(function, value);
+        }
+    }  else if ((function == NDCircBuffTriggerMode) || (function == NDCircBuffTriggerEvents)){
+        if (function == NDCircBuffTriggerMode) {
+          triggerMode_ = value;
+        } else {
+          if (value < 1) value = 1;
+          triggerEvents_ = value;
+        }
+        status = (asynStatus) setIntegerParam(function, value);
+        resetTrigger();
+    }  else if (function == NDCircBuffSpillCompress){
+        if (value && !NDArrayDiskRing::compressionAvailable()){
+          setStringParam(NDCircBuffSpillMessage, "Compression not available");
+          status = asynError;
+        } else {
+          status = (asynStatus) setIntegerParam(function, value);
+        }
     }  else {
 
         // Set the parameter in the parameter library.
@@ -301,6 +599,45 @@ asynStatus NDPluginCircularBuff::writeInt32(asynUser *pasynUser, epicsInt32 valu
     return status;
 }
 
+/** Called when asyn clients call pasynFloat64->write().
+  * This function performs actions for some parameters.
+  * For all parameters it sets the value in the parameter library and calls any registered callbacks..
+  * \param[in] pasynUser pasynUser structure that encodes the reason and address.
+  * \param[in] value Value to write. */
+asynStatus NDPluginCircularBuff::writeFloat64(asynUser *pasynUser, epicsFloat64 value)
+{
+    int function = pasynUser->reason;
+    asynStatus status = asynSuccess;
+    static const char *functionName = "writeFloat64";
+
+    // Set the parameter in the parameter library.
+    status = (asynStatus) setDoubleParam(function, value);
+
+    if (function == NDCircBuffTriggerThreshold){
+        triggerThreshold_ = value;
+        resetTrigger();
+    } else if (function == NDCircBuffTriggerHysteresis){
+        triggerHysteresis_ = value;
+        resetTrigger();
+    } else if (function < FIRST_NDPLUGIN_CIRC_BUFF_PARAM) {
+        // If this parameter belongs to a base class call its method
+        status = NDPluginDriver::writeFloat64(pasynUser, value);
+    }
+
+    // Do callbacks so higher layers see any changes
+    callParamCallbacks();
+
+    if (status)
+        epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+                  "%s:%s: status=%d, function=%d, value=%f",
+                  driverName, functionName, status, function, value);
+    else
+        asynPrint(pasynUser, ASYN_TRACEIO_DRIVER,
+              "%s:%s: function=%d, value=%f\n",
+              driverName, functionName, function, value);
+    return status;
+}
+
 /** Called when asyn clients call pasynOctet->write().
   * This function performs actions for some parameters, including AttributesFile.
   * For all parameters it sets the value in the parameter library and calls any registered callbacks..
@@ -335,8 +672,22 @@ asynStatus NDPluginCircularBuff::writeOctet(asynUser *pasynUser, const char *val
       asynPrint(pasynUserSelf, ASYN_TRACE_ERROR,
       "%s::%s error processing infix expression=%s, error=%s\n",
       driverName, functionName, triggerCalcInfix_, calcErrorStr(postfixError));
+      triggerCalcConstant_ = false;
+    } else {
+      compileTriggerCalc();
     }
   } 
+
+  else if ((function == NDCircBuffTriggerA) || (function == NDCircBuffTriggerB)){
+    if (function == NDCircBuffTriggerA) {
+      triggerAName_ = value;
+    } else {
+      triggerBName_ = value;
+    }
+    // Find the slots of the attributes again with the next array
+    if (pTriggerSchema_) pTriggerSchema_->release();
+    pTriggerSchema_ = NULL;
+  }
   
   else if (function < FIRST_NDPLUGIN_CIRC_BUFF_PARAM) {
       /* If this parameter belongs to a base class call its method */
@@ -390,7 +741,19 @@ NDPluginCircularBuff::NDPluginCircularBuff(const char *portName, int queueSize,
                    0, 1, priority, stackSize, 1), pOldArray_(NULL)
 {
     //const char *functionName = "NDPluginCircularBuff";
+    short postfixError;
     preBuffer_ = NULL;
+    spillGeneration_ = 0;
+    pTriggerSchema_ = NULL;
+    triggerASlot_ = -1;
+    triggerBSlot_ = -1;
+    triggerMode_ = NDCircBuffTriggerModeLevel;
+    triggerThreshold_ = 0.;
+    triggerHysteresis_ = 0.;
+    triggerEvents_ = 1;
+    resetTrigger();
+    spillWrapped_ = false;
+    spillWriteTime_ = 0.;
 
     maxBuffers_ = maxBuffers;
 
@@ -411,6 +774,26 @@ NDPluginCircularBuff::NDPluginCircularBuff(const char *portName, int queueSize,
     createParam(NDCircBuffPostCountString,          asynParamInt32,      &NDCircBuffPostCount);
     createParam(NDCircBuffSoftTriggerString,        asynParamInt32,      &NDCircBuffSoftTrigger);
     createParam(NDCircBuffTriggeredString,          asynParamInt32,      &NDCircBuffTriggered);
+    createParam(NDCircBuffStoreReferencesString,    asynParamInt32,      &NDCircBuffStoreReferences);
+    createParam(NDCircBuffMinFreeBuffersString,     asynParamInt32,      &NDCircBuffMinFreeBuffers);
+    createParam(NDCircBuffNumReferencedString,      asynParamInt32,      &NDCircBuffNumReferenced);
+    createParam(NDCircBuffNumCopiedString,          asynParamInt32,      &NDCircBuffNumCopied);
+    createParam(NDCircBuffSpillEnableString,        asynParamInt32,      &NDCircBuffSpillEnable);
+    createParam(NDCircBuffSpillFileString,          asynParamOctet,      &NDCircBuffSpillFile);
+    createParam(NDCircBuffSpillFileSizeString,      asynParamInt32,      &NDCircBuffSpillFileSize);
+    createParam(NDCircBuffMemoryDepthString,        asynParamInt32,      &NDCircBuffMemoryDepth);
+    createParam(NDCircBuffSpillCompressString,      asynParamInt32,      &NDCircBuffSpillCompress);
+    createParam(NDCircBuffSpillQtyString,           asynParamInt32,      &NDCircBuffSpillQty);
+    createParam(NDCircBuffSpillWrittenString,       asynParamInt32,      &NDCircBuffSpillWritten);
+    createParam(NDCircBuffSpillErrorsString,        asynParamInt32,      &NDCircBuffSpillErrors);
+    createParam(NDCircBuffSpillWriteRateString,     asynParamFloat64,    &NDCircBuffSpillWriteRate);
+    createParam(NDCircBuffSpillReadRateString,      asynParamFloat64,    &NDCircBuffSpillReadRate);
+    createParam(NDCircBuffSpillRatioString,         asynParamFloat64,    &NDCircBuffSpillRatio);
+    createParam(NDCircBuffSpillMessageString,       asynParamOctet,      &NDCircBuffSpillMessage);
+    createParam(NDCircBuffTriggerModeString,        asynParamInt32,      &NDCircBuffTriggerMode);
+    createParam(NDCircBuffTriggerThresholdString,   asynParamFloat64,    &NDCircBuffTriggerThreshold);
+    createParam(NDCircBuffTriggerHysteresisString,  asynParamFloat64,    &NDCircBuffTriggerHysteresis);
+    createParam(NDCircBuffTriggerEventsString,      asynParamInt32,      &NDCircBuffTriggerEvents);
 
     // Set the plugin type string
     setStringParam(NDPluginDriverPluginType, "NDPluginCircularBuff");
@@ -432,6 +815,39 @@ NDPluginCircularBuff::NDPluginCircularBuff(const char *portName, int queueSize,
     // Init the preset trigger count to 1
     setIntegerParam(NDCircBuffPresetTriggerCount, 1);
     setIntegerParam(NDCircBuffActualTriggerCount, 0);
+
+    // Copy the arrays by default, leave 10 buffers for the driver when storing references
+    setIntegerParam(NDCircBuffStoreReferences, 0);
+    setIntegerParam(NDCircBuffMinFreeBuffers, 10);
+    setIntegerParam(NDCircBuffNumReferenced, 0);
+    setIntegerParam(NDCircBuffNumCopied, 0);
+
+    // Keep all of the pre-trigger arrays in memory by default
+    setIntegerParam(NDCircBuffSpillEnable, 0);
+    setStringParam(NDCircBuffSpillFile, "");
+    setIntegerParam(NDCircBuffSpillFileSize, 1024);
+    setIntegerParam(NDCircBuffMemoryDepth, 100);
+    setIntegerParam(NDCircBuffSpillCompress, 0);
+    setIntegerParam(NDCircBuffSpillQty, 0);
+    setIntegerParam(NDCircBuffSpillWritten, 0);
+    setIntegerParam(NDCircBuffSpillErrors, 0);
+    setDoubleParam(NDCircBuffSpillWriteRate, 0.);
+    setDoubleParam(NDCircBuffSpillReadRate, 0.);
+    setDoubleParam(NDCircBuffSpillRatio, 1.);
+    setStringParam(NDCircBuffSpillMessage, "");
+
+    // Trigger on each array for which the calculation is non-zero
+    setIntegerParam(NDCircBuffTriggerMode, NDCircBuffTriggerModeLevel);
+    setDoubleParam(NDCircBuffTriggerThreshold, 0.);
+    setDoubleParam(NDCircBuffTriggerHysteresis, 0.);
+    setIntegerParam(NDCircBuffTriggerEvents, 1);
+    setStringParam(NDCircBuffTriggerA, "");
+    setStringParam(NDCircBuffTriggerB, "");
+    setStringParam(NDCircBuffTriggerCalc, DEFAULT_TRIGGER_CALC);
+    strcpy(triggerCalcInfix_, DEFAULT_TRIGGER_CALC);
+    postfix(triggerCalcInfix_, triggerCalcPostfix_, &postfixError);
+    triggerCalcConstant_ = false;
+    compileTriggerCalc();
     
     // Enable ArrayCallbacks.  
     // This plugin currently ignores this setting and always does callbacks, so make the setting reflect the behavior
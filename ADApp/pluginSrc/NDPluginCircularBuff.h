@@ -1,11 +1,14 @@
 #ifndef NDPluginCircularBuff_H
 #define NDPluginCircularBuff_H
 
+#include <string>
+
 #include <epicsTypes.h>
 #include <postfix.h>
 
 #include "NDPluginDriver.h"
 #include "NDArrayRing.h"
+#include "NDArrayDiskRing.h"
 
 /* Param definitions */
 #define NDCircBuffControlString             "CIRC_BUFF_CONTROL"               /* (asynInt32,        r/w) Run scope? */
@@ -24,7 +27,35 @@
 #define NDCircBuffPostCountString           "CIRC_BUFF_POST_COUNT"            /* (asynInt32,        r/o) Number of the current post count image */
 #define NDCircBuffSoftTriggerString         "CIRC_BUFF_SOFT_TRIGGER"          /* (asynInt32,        r/w) Force a soft trigger */
 #define NDCircBuffTriggeredString           "CIRC_BUFF_TRIGGERED"             /* (asynInt32,        r/o) Have we had a trigger event */
+#define NDCircBuffStoreReferencesString     "CIRC_BUFF_STORE_REFERENCES"      /* (asynInt32,        r/w) Store references to the input arrays rather than copies */
+#define NDCircBuffMinFreeBuffersString      "CIRC_BUFF_MIN_FREE_BUFFERS"      /* (asynInt32,        r/w) Copy arrays if the input pool would have fewer free buffers */
+#define NDCircBuffNumReferencedString       "CIRC_BUFF_NUM_REFERENCED"        /* (asynInt32,        r/o) Number of arrays stored by reference */
+#define NDCircBuffNumCopiedString           "CIRC_BUFF_NUM_COPIED"            /* (asynInt32,        r/o) Number of arrays stored as copies */
+#define NDCircBuffSpillEnableString         "CIRC_BUFF_SPILL_ENABLE"          /* (asynInt32,        r/w) Spill the oldest pre-trigger arrays to a file */
+#define NDCircBuffSpillFileString           "CIRC_BUFF_SPILL_FILE"            /* (asynOctetWrite,   r/w) Path of the spill file */
+#define NDCircBuffSpillFileSizeString       "CIRC_BUFF_SPILL_FILE_SIZE"       /* (asynInt32,        r/w) Size of the spill file in MB */
+#define NDCircBuffMemoryDepthString         "CIRC_BUFF_MEMORY_DEPTH"          /* (asynInt32,        r/w) Number of pre-trigger arrays kept in memory when spilling */
+#define NDCircBuffSpillCompressString       "CIRC_BUFF_SPILL_COMPRESS"        /* (asynInt32,        r/w) Compress the arrays in the spill file */
+#define NDCircBuffSpillQtyString            "CIRC_BUFF_SPILL_QTY"             /* (asynInt32,        r/o) Number of arrays in the spill file */
+#define NDCircBuffSpillWrittenString        "CIRC_BUFF_SPILL_WRITTEN"         /* (asynInt32,        r/o) Number of arrays written to the spill file */
+#define NDCircBuffSpillErrorsString         "CIRC_BUFF_SPILL_ERRORS"          /* (asynInt32,        r/o) Number of arrays that could not be written or read */
+#define NDCircBuffSpillWriteRateString      "CIRC_BUFF_SPILL_WRITE_RATE"      /* (asynFloat64,      r/o) Spill file write throughput in MB/s */
+#define NDCircBuffSpillReadRateString       "CIRC_BUFF_SPILL_READ_RATE"       /* (asynFloat64,      r/o) Spill file read throughput in MB/s */
+#define NDCircBuffSpillRatioString          "CIRC_BUFF_SPILL_RATIO"           /* (asynFloat64,      r/o) Compression ratio of the spill file */
+#define NDCircBuffSpillMessageString        "CIRC_BUFF_SPILL_MESSAGE"         /* (asynOctetRead,    r/o) Spill file error message */
+#define NDCircBuffTriggerModeString         "CIRC_BUFF_TRIGGER_MODE"          /* (asynInt32,        r/w) Condition on the calculation value for a trigger */
+#define NDCircBuffTriggerThresholdString    "CIRC_BUFF_TRIGGER_THRESHOLD"     /* (asynFloat64,      r/w) Threshold for the Threshold trigger mode */
+#define NDCircBuffTriggerHysteresisString   "CIRC_BUFF_TRIGGER_HYSTERESIS"    /* (asynFloat64,      r/w) Hysteresis for the Threshold trigger mode */
+#define NDCircBuffTriggerEventsString       "CIRC_BUFF_TRIGGER_EVENTS"        /* (asynInt32,        r/w) Number of trigger conditions for a trigger */
+
 
+/** Conditions on the trigger calculation value for a trigger */
+typedef enum {
+    NDCircBuffTriggerModeLevel,         /**< The value is non-zero */
+    NDCircBuffTriggerModeRisingEdge,    /**< The value changes from zero to non-zero */
+    NDCircBuffTriggerModeFallingEdge,   /**< The value changes from non-zero to zero */
+    NDCircBuffTriggerModeThreshold      /**< The value rises to the threshold after being below threshold-hysteresis */
+} NDCircBuffTriggerMode_t;
 
 /** Performs a scope like capture.  Records a quantity
   * of pre-trigger and post-trigger images
@@ -38,6 +69,7 @@ public:
     /* These methods override the virtual methods in the base class */
     void processCallbacks(NDArray *pArray);
     asynStatus writeInt32(asynUser *pasynUser, epicsInt32 value);
+    asynStatus writeFloat64(asynUser *pasynUser, epicsFloat64 value);
     asynStatus writeOctet(asynUser *pasynUser, const char *value, size_t nChars, size_t *nActual);
     
     //template <typename epicsType> asynStatus doProcessCircularBuffT(NDArray *pArray);
@@ -62,17 +94,66 @@ protected:
     int NDCircBuffPostCount;
     int NDCircBuffSoftTrigger;
     int NDCircBuffTriggered;
+    int NDCircBuffStoreReferences;
+    int NDCircBuffMinFreeBuffers;
+    int NDCircBuffNumReferenced;
+    int NDCircBuffNumCopied;
+    int NDCircBuffSpillEnable;
+    int NDCircBuffSpillFile;
+    int NDCircBuffSpillFileSize;
+    int NDCircBuffMemoryDepth;
+    int NDCircBuffSpillCompress;
+    int NDCircBuffSpillQty;
+    int NDCircBuffSpillWritten;
+    int NDCircBuffSpillErrors;
+    int NDCircBuffSpillWriteRate;
+    int NDCircBuffSpillReadRate;
+    int NDCircBuffSpillRatio;
+    int NDCircBuffSpillMessage;
+    int NDCircBuffTriggerMode;
+    int NDCircBuffTriggerThreshold;
+    int NDCircBuffTriggerHysteresis;
+    int NDCircBuffTriggerEvents;
 
 private:
 
-    asynStatus calculateTrigger(NDArray *pArray, int *trig);
+    asynStatus calculateTrigger(NDArray *pArray, int preCount, int postCount, int currentImage, int *trig);
+    void compileTriggerCalc();
+    void resetTrigger();
+    double triggerAttributeValue(NDAttributeList *pList, const std::string& name, int slot);
+    NDArray *storeArray(NDArray *pArray);
+    int openSpillBuffer(int preCount);
+    void spillArray(NDArray *pArray);
+    void flushSpillBuffer();
+    void spillError(const char *functionName);
     NDArrayRing *preBuffer_;
+    NDArrayDiskRing spillBuffer_;
+    std::vector<char> spillRecord_;   /**< Record compressed by spillArray() without the lock */
+    int spillGeneration_;             /**< Incremented when the spill file is reset for a new capture */
+    bool spillWrapped_;
+    double spillWriteTime_;
     NDArray *pOldArray_;
     int previousTrigger_;
     int maxBuffers_;
     char triggerCalcInfix_[MAX_INFIX_SIZE];
     char triggerCalcPostfix_[MAX_POSTFIX_SIZE];
     double triggerCalcArgs_[CALCPERFORM_NARGS];
+    /* The trigger state is only changed by the parameter write methods and processCallbacks,
+     * so evaluating the trigger does not read the parameter library */
+    std::string triggerAName_;
+    std::string triggerBName_;
+    NDAttributeSchema *pTriggerSchema_;     /**< Schema that triggerASlot_ and triggerBSlot_ refer to */
+    int triggerASlot_;
+    int triggerBSlot_;
+    bool triggerCalcConstant_;              /**< The trigger calculation does not use any arguments */
+    double triggerCalcConstantValue_;
+    int triggerMode_;
+    double triggerThreshold_;
+    double triggerHysteresis_;
+    int triggerEvents_;
+    int triggerEventCount_;
+    int previousCondition_;                 /**< Condition for the previous array, -1 if none */
+    bool thresholdArmed_;
 };
     
 #endif
@@ -11,13 +11,17 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <stddef.h>
 #include <math.h>
+#include <limits>
 
 #include <epicsTypes.h>
 #include <epicsMessageQueue.h>
 #include <epicsThread.h>
 #include <epicsEvent.h>
+#include <epicsMutex.h>
 #include <epicsTime.h>
+#include <epicsStdio.h>
 #include <iocsh.h>
 
 #include <asynDriver.h>
@@ -25,491 +29,1275 @@
 #include <epicsExport.h>
 #include "NDPluginDriver.h"
 #include "colorMaps.h"
-#ifdef HAVE_PVAPI
-  #include "PvApi.h"
-#endif
 #include "NDPluginColorConvert.h"
 
+#if defined(__SSE2__)
+  #include <emmintrin.h>
+#endif
+#if defined(__SSSE3__)
+  #include <tmmintrin.h>
+#endif
+
 static const char *driverName="NDPluginColorConvert";
 
-/* This function returns 1 if it did a conversion, 0 if it did not */
+/* Arrays are not split into bands of fewer rows than this */
+#define MIN_ROWS_PER_BAND 16
+
+/** The conversions done by the conversion engine */
+typedef enum {
+    colorConvertMonoToRGB,
+    colorConvertFalseColor,
+    colorConvertRGBToMono,
+    colorConvertRGBToRGB,
+    colorConvertBayerToRGB,
+    colorConvertYUVToRGB,
+    colorConvertYUVToMono
+} colorConvertKind_t;
+
+/** Location of the data of an image. Color c of pixel (x, y) is element
+  * y*rowStride + c*colorStride + x*pixelStride of the array. */
+typedef struct {
+    size_t pixelStride;
+    size_t colorStride;
+    size_t rowStride;
+} colorLayout_t;
+
+/** Everything needed to convert one array.  The array is converted in bands of rows,
+  * the bands can be converted by different threads. */
+struct NDColorConvertTask {
+    colorConvertKind_t kind;
+    NDDataType_t dataType;
+    NDColorMode_t colorModeIn;
+    const void *pIn;
+    void *pOut;
+    size_t rowSize;                     /**< Number of pixels in each row */
+    size_t numRows;
+    colorLayout_t inLayout;
+    colorLayout_t outLayout;
+    int redX;                           /**< Column (0 or 1) of the red pixels of a Bayer image */
+    int redY;                           /**< Row (0 or 1) of the red pixels of a Bayer image */
+    int bayerMethod;
+    const epicsUInt8 (*pColorMap)[4];   /**< False color lookup table, R, G, B and 1 unused byte per entry */
+    void *pScratch;                     /**< 3 rows per band for conversions that produce RGB1 via separate color rows */
+    int bandsPending;
+    NDColorConvertSync *pSync;          /**< Signals the end of the bands, NULL if there is 1 band */
+};
+
+/** Lock and event used to wait for the band threads.  They are created the first time
+  * a processing thread converts an array in bands, and kept in a free list for later arrays. */
+struct NDColorConvertSync {
+    epicsMutex lock;
+    epicsEvent done;
+    NDColorConvertSync *pNext;
+};
+
+/** Message sent to the band threads */
+typedef struct {
+    NDColorConvertTask *pTask;          /**< NULL tells the thread to exit */
+    int band;
+    size_t firstRow;
+    size_t lastRow;
+} colorConvertBand_t;
+
+/** False color lookup table for 8 or 16 bit mono arrays, indexed by the pixel values
+  * reinterpreted as unsigned.  The FalseColorMin and FalseColorMax scaling is included in
+  * the table.  The plugin caches the table for the current parameters, each conversion using
+  * it holds a reference so that it can be replaced while arrays are being converted. */
+struct NDFalseColorLUT {
+    int falseColor;
+    NDDataType_t dataType;
+    int minValue;
+    int maxValue;
+    int refCount;
+    epicsUInt8 (*pEntries)[4];          /**< R, G, B and 1 unused byte per entry */
+};
+
+static colorLayout_t colorLayout(NDColorMode_t colorMode, size_t rowSize, size_t numRows)
+{
+    colorLayout_t layout;
+
+    layout.pixelStride = 1;
+    layout.colorStride = 0;
+    layout.rowStride   = rowSize;
+    switch (colorMode) {
+        case NDColorModeRGB1:
+            layout.pixelStride = 3;
+            layout.colorStride = 1;
+            layout.rowStride   = 3*rowSize;
+            break;
+        case NDColorModeRGB2:
+            layout.colorStride = rowSize;
+            layout.rowStride   = 3*rowSize;
+            break;
+        case NDColorModeRGB3:
+            layout.colorStride = rowSize*numRows;
+            break;
+        default:
+            break;
+    }
+    return layout;
+}
+
+/** Arithmetic used for interpolation.  8 and 16 bit data are interpolated with integers,
+  * rounding to the nearest value, 32 bit and floating point data with doubles. */
+template <typename epicsType, bool smallInteger>
+struct colorMath {
+    typedef epicsFloat64 sum_t;
+    static epicsType clip(sum_t value)
+    {
+        if (std::numeric_limits<epicsType>::is_integer) {
+            if (value < (sum_t)std::numeric_limits<epicsType>::min()) return std::numeric_limits<epicsType>::min();
+            if (value > (sum_t)std::numeric_limits<epicsType>::max()) return std::numeric_limits<epicsType>::max();
+        }
+        return (epicsType)value;
+    }
+    static epicsType scale(sum_t sum, int shift) { return clip(sum / (1 << shift)); }
+};
+
+template <typename epicsType>
+struct colorMath<epicsType, true> {
+    typedef int sum_t;
+    static epicsType clip(sum_t value)
+    {
+        if (value < std::numeric_limits<epicsType>::min()) return std::numeric_limits<epicsType>::min();
+        if (value > std::numeric_limits<epicsType>::max()) return std::numeric_limits<epicsType>::max();
+        return (epicsType)value;
+    }
+    static epicsType scale(sum_t sum, int shift) { return clip((sum + (1 << (shift-1))) >> shift); }
+};
+
+template <typename epicsType>
+struct colorTraits : colorMath<epicsType, (sizeof(epicsType) <= 2)> {};
+
+template <typename sum_t>
+static inline sum_t absValue(sum_t value)
+{
+    return (value < 0) ? -value : value;
+}
+
+/** Copies n values from pIn with stride inStride to pOut with stride outStride */
+template <typename epicsType>
+static void copyColorRow(const epicsType *pIn, size_t inStride, epicsType *pOut, size_t outStride, size_t n)
+{
+    size_t i;
+
+    if ((inStride == 1) && (outStride == 1)) {
+        memcpy(pOut, pIn, n*sizeof(epicsType));
+        return;
+    }
+    for (i=0; i<n; i++) pOut[i*outStride] = pIn[i*inStride];
+}
+
+/* The SSSE3 byte shuffles below move 16 pixels between 3 color registers and 48 bytes of RGB1 data */
+#if defined(__SSSE3__)
+static inline void loadRGB1x16(const epicsUInt8 *pIn, __m128i *pRed, __m128i *pGreen, __m128i *pBlue)
+{
+    __m128i a = _mm_loadu_si128((const __m128i *)pIn);
+    __m128i b = _mm_loadu_si128((const __m128i *)(pIn + 16));
+    __m128i c = _mm_loadu_si128((const __m128i *)(pIn + 32));
+
+    *pRed   = _mm_or_si128(_mm_or_si128(
+              _mm_shuffle_epi8(a, _mm_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+              _mm_shuffle_epi8(b, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1))),
+              _mm_shuffle_epi8(c, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13)));
+    *pGreen = _mm_or_si128(_mm_or_si128(
+              _mm_shuffle_epi8(a, _mm_setr_epi8(1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+              _mm_shuffle_epi8(b, _mm_setr_epi8(-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1))),
+              _mm_shuffle_epi8(c, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14)));
+    *pBlue  = _mm_or_si128(_mm_or_si128(
+              _mm_shuffle_epi8(a, _mm_setr_epi8(2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+              _mm_shuffle_epi8(b, _mm_setr_epi8(-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1))),
+              _mm_shuffle_epi8(c, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15)));
+}
+
+static inline void storeRGB1x16(__m128i red, __m128i green, __m128i blue, epicsUInt8 *pOut)
+{
+    __m128i a = _mm_or_si128(_mm_or_si128(
+                _mm_shuffle_epi8(red,   _mm_setr_epi8(0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1, 5)),
+                _mm_shuffle_epi8(green, _mm_setr_epi8(-1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1))),
+                _mm_shuffle_epi8(blue,  _mm_setr_epi8(-1, -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1)));
+    __m128i b = _mm_or_si128(_mm_or_si128(
+                _mm_shuffle_epi8(red,   _mm_setr_epi8(-1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10, -1)),
+                _mm_shuffle_epi8(green, _mm_setr_epi8(5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10))),
+                _mm_shuffle_epi8(blue,  _mm_setr_epi8(-1, 5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1)));
+    __m128i c = _mm_or_si128(_mm_or_si128(
+                _mm_shuffle_epi8(red,   _mm_setr_epi8(-1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1, -1)),
+                _mm_shuffle_epi8(green, _mm_setr_epi8(-1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1))),
+                _mm_shuffle_epi8(blue,  _mm_setr_epi8(10, -1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15)));
+
+    _mm_storeu_si128((__m128i *)pOut, a);
+    _mm_storeu_si128((__m128i *)(pOut + 16), b);
+    _mm_storeu_si128((__m128i *)(pOut + 32), c);
+}
+#endif
+
+/** Interleaves 3 color rows into one RGB1 row */
+static void interleaveBytes(const epicsUInt8 *pRed, const epicsUInt8 *pGreen, const epicsUInt8 *pBlue,
+                            epicsUInt8 *pOut, size_t n)
+{
+    size_t i=0;
+
+#if defined(__SSSE3__)
+    for (; i+16<=n; i+=16) {
+        storeRGB1x16(_mm_loadu_si128((const __m128i *)(pRed + i)),
+                     _mm_loadu_si128((const __m128i *)(pGreen + i)),
+                     _mm_loadu_si128((const __m128i *)(pBlue + i)), pOut + 3*i);
+    }
+#endif
+    for (; i<n; i++) {
+        pOut[3*i]   = pRed[i];
+        pOut[3*i+1] = pGreen[i];
+        pOut[3*i+2] = pBlue[i];
+    }
+}
+
+/** Splits one RGB1 row into 3 color rows */
+static void deinterleaveBytes(const epicsUInt8 *pIn, epicsUInt8 *pRed, epicsUInt8 *pGreen, epicsUInt8 *pBlue, size_t n)
+{
+    size_t i=0;
+
+#if defined(__SSSE3__)
+    __m128i red, green, blue;
+    for (; i+16<=n; i+=16) {
+        loadRGB1x16(pIn + 3*i, &red, &green, &blue);
+        _mm_storeu_si128((__m128i *)(pRed + i), red);
+        _mm_storeu_si128((__m128i *)(pGreen + i), green);
+        _mm_storeu_si128((__m128i *)(pBlue + i), blue);
+    }
+#endif
+    for (; i<n; i++) {
+        pRed[i]   = pIn[3*i];
+        pGreen[i] = pIn[3*i+1];
+        pBlue[i]  = pIn[3*i+2];
+    }
+}
+
+template <typename epicsType>
+static void interleaveRow(const epicsType *pRed, const epicsType *pGreen, const epicsType *pBlue,
+                          epicsType *pOut, size_t n)
+{
+    size_t i;
+
+    if (sizeof(epicsType) == 1) {
+        interleaveBytes((const epicsUInt8 *)pRed, (const epicsUInt8 *)pGreen, (const epicsUInt8 *)pBlue,
+                        (epicsUInt8 *)pOut, n);
+        return;
+    }
+    for (i=0; i<n; i++) {
+        pOut[3*i]   = pRed[i];
+        pOut[3*i+1] = pGreen[i];
+        pOut[3*i+2] = pBlue[i];
+    }
+}
+
+template <typename epicsType>
+static void deinterleaveRow(const epicsType *pIn, epicsType *pRed, epicsType *pGreen, epicsType *pBlue, size_t n)
+{
+    size_t i;
+
+    if (sizeof(epicsType) == 1) {
+        deinterleaveBytes((const epicsUInt8 *)pIn, (epicsUInt8 *)pRed, (epicsUInt8 *)pGreen, (epicsUInt8 *)pBlue, n);
+        return;
+    }
+    for (i=0; i<n; i++) {
+        pRed[i]   = pIn[3*i];
+        pGreen[i] = pIn[3*i+1];
+        pBlue[i]  = pIn[3*i+2];
+    }
+}
+
+/** Copies a mono row to all 3 colors of an RGB row */
+template <typename epicsType>
+static void monoToRGBRow(const epicsType *pIn, epicsType *pOut[3], size_t pixelStride, size_t n)
+{
+    int color;
+
+    if (pixelStride == 3) {
+        interleaveRow(pIn, pIn, pIn, pOut[0], n);
+        return;
+    }
+    for (color=0; color<3; color++) memcpy(pOut[color], pIn, n*sizeof(epicsType));
+}
+
+/** Looks up the colors of an 8 or 16 bit mono row in a false color lookup table */
+template <typename indexType>
+static void falseColorRow(const indexType *pIn, const epicsUInt8 (*pColorMap)[4],
+                          epicsUInt8 *pRed, epicsUInt8 *pGreen, epicsUInt8 *pBlue, size_t pixelStride, size_t n)
+{
+    size_t i;
+
+    if (n == 0) return;
+    if (pixelStride == 3) {
+        /* Each map entry is copied as a single 4 byte word, the extra byte is overwritten by the next pixel */
+        for (i=0; i<n-1; i++) memcpy(pRed + 3*i, pColorMap[pIn[i]], 4);
+        memcpy(pRed + 3*i, pColorMap[pIn[i]], 3);
+        return;
+    }
+    for (i=0; i<n; i++) {
+        pRed[i]   = pColorMap[pIn[i]][0];
+        pGreen[i] = pColorMap[pIn[i]][1];
+        pBlue[i]  = pColorMap[pIn[i]][2];
+    }
+}
+
+template <typename epicsType>
+static inline epicsType averageRGB(epicsType red, epicsType green, epicsType blue)
+{
+    return (epicsType)((red + green + blue)/3.);
+}
+
+#if defined(__SSE2__)
+/** Computes (red + green + blue)/3 of 16 unsigned bytes.  The sums are at most 765,
+  * for which multiplying by 21846/65536 truncates to the same value as dividing by 3. */
+static inline __m128i averageRGBx16(__m128i red, __m128i green, __m128i blue)
+{
+    const __m128i zero  = _mm_setzero_si128();
+    const __m128i third = _mm_set1_epi16(21846);
+    __m128i low  = _mm_add_epi16(_mm_add_epi16(_mm_unpacklo_epi8(red, zero), _mm_unpacklo_epi8(green, zero)),
+                                 _mm_unpacklo_epi8(blue, zero));
+    __m128i high = _mm_add_epi16(_mm_add_epi16(_mm_unpackhi_epi8(red, zero), _mm_unpackhi_epi8(green, zero)),
+                                 _mm_unpackhi_epi8(blue, zero));
+
+    return _mm_packus_epi16(_mm_mulhi_epu16(low, third), _mm_mulhi_epu16(high, third));
+}
+#endif
+
+/** Averages the 3 colors of an unsigned 8 bit RGB row, returns the number of pixels done */
+static size_t rgbToMonoBytes(const epicsUInt8 *pRed, const epicsUInt8 *pGreen, const epicsUInt8 *pBlue,
+                             size_t pixelStride, epicsUInt8 *pOut, size_t n)
+{
+    size_t i=0;
+
+#if defined(__SSE2__)
+    if (pixelStride == 1) {
+        for (; i+16<=n; i+=16) {
+            _mm_storeu_si128((__m128i *)(pOut + i),
+                             averageRGBx16(_mm_loadu_si128((const __m128i *)(pRed + i)),
+                                           _mm_loadu_si128((const __m128i *)(pGreen + i)),
+                                           _mm_loadu_si128((const __m128i *)(pBlue + i))));
+        }
+    }
+  #if defined(__SSSE3__)
+    if (pixelStride == 3) {
+        __m128i red, green, blue;
+        for (; i+16<=n; i+=16) {
+            loadRGB1x16(pRed + 3*i, &red, &green, &blue);
+            _mm_storeu_si128((__m128i *)(pOut + i), averageRGBx16(red, green, blue));
+        }
+    }
+  #endif
+#endif
+    return i;
+}
+
+/** Converts an RGB row to mono by averaging the 3 colors */
+template <typename epicsType>
+static void rgbToMonoRow(const epicsType *pIn[3], size_t pixelStride, epicsType *pOut, size_t n)
+{
+    size_t i=0;
+
+    if (std::numeric_limits<epicsType>::is_integer && !std::numeric_limits<epicsType>::is_signed &&
+        (sizeof(epicsType) == 1)) {
+        i = rgbToMonoBytes((const epicsUInt8 *)pIn[0], (const epicsUInt8 *)pIn[1], (const epicsUInt8 *)pIn[2],
+                           pixelStride, (epicsUInt8 *)pOut, n);
+    }
+    for (; i<n; i++) {
+        pOut[i] = averageRGB(pIn[0][i*pixelStride], pIn[1][i*pixelStride], pIn[2][i*pixelStride]);
+    }
+}
+
+/** Converts a row between the RGB1, RGB2 and RGB3 layouts */
+template <typename epicsType>
+static void rgbToRGBRow(const epicsType *pIn[3], size_t inPixelStride, epicsType *pOut[3], size_t outPixelStride,
+                        size_t n)
+{
+    int color;
+
+    if ((inPixelStride == 3) && (outPixelStride == 1)) {
+        deinterleaveRow(pIn[0], pOut[0], pOut[1], pOut[2], n);
+    } else if ((inPixelStride == 1) && (outPixelStride == 3)) {
+        interleaveRow(pIn[0], pIn[1], pIn[2], pOut[0], n);
+    } else {
+        for (color=0; color<3; color++) copyColorRow(pIn[color], inPixelStride, pOut[color], outPixelStride, n);
+    }
+}
+
+static inline epicsUInt8 clipByte(int value)
+{
+    return (epicsUInt8)((value < 0) ? 0 : ((value > 255) ? 255 : value));
+}
+
+/** Converts one pixel from YUV to RGB with the ITU-R BT.601 full range coefficients
+  * in 7 bit fixed point */
+static inline void yuvToRGB(int y, int u, int v, epicsUInt8 *pRed, epicsUInt8 *pGreen, epicsUInt8 *pBlue)
+{
+    u -= 128;
+    v -= 128;
+    *pRed   = clipByte(y + ((179*v + 64) >> 7));
+    *pGreen = clipByte(y - ((44*u + 91*v + 64) >> 7));
+    *pBlue  = clipByte(y + ((227*u + 64) >> 7));
+}
+
+#if defined(__SSE2__)
+/** Same as yuvToRGB for 8 pixels in 16 bit lanes; the results are not yet clipped */
+static inline void yuvToRGBx8(__m128i y, __m128i u, __m128i v, __m128i *pRed, __m128i *pGreen, __m128i *pBlue)
+{
+    const __m128i offset = _mm_set1_epi16(128);
+    const __m128i round  = _mm_set1_epi16(64);
+
+    u = _mm_sub_epi16(u, offset);
+    v = _mm_sub_epi16(v, offset);
+    *pRed   = _mm_add_epi16(y, _mm_srai_epi16(_mm_add_epi16(_mm_mullo_epi16(v, _mm_set1_epi16(179)), round), 7));
+    *pGreen = _mm_sub_epi16(y, _mm_srai_epi16(_mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(u, _mm_set1_epi16(44)),
+                                                                          _mm_mullo_epi16(v, _mm_set1_epi16(91))),
+                                                            round), 7));
+    *pBlue  = _mm_add_epi16(y, _mm_srai_epi16(_mm_add_epi16(_mm_mullo_epi16(u, _mm_set1_epi16(227)), round), 7));
+}
+#endif
+
+/** Converts one row of YUV data to RGB.  The byte order is that of the IIDC (DCAM) specification:
+  * U Y V for YUV444, U Y0 V Y1 for YUV422 and U Y0 Y1 V Y2 Y3 for YUV411. */
+static void yuvToRGBRow(NDColorMode_t colorMode, const epicsUInt8 *pIn,
+                        epicsUInt8 *pRed, epicsUInt8 *pGreen, epicsUInt8 *pBlue, size_t n)
+{
+    size_t i=0;
+#if defined(__SSE2__)
+    __m128i y, u, v, red[2], green[2], blue[2];
+    int half;
+#endif
+#if defined(__SSSE3__)
+    const __m128i zero = _mm_setzero_si128();
+#endif
+
+    switch (colorMode) {
+        case NDColorModeYUV444:
+#if defined(__SSSE3__)
+            for (; i+16<=n; i+=16) {
+                loadRGB1x16(pIn + 3*i, &u, &y, &v);
+                yuvToRGBx8(_mm_unpacklo_epi8(y, zero), _mm_unpacklo_epi8(u, zero), _mm_unpacklo_epi8(v, zero),
+                           &red[0], &green[0], &blue[0]);
+                yuvToRGBx8(_mm_unpackhi_epi8(y, zero), _mm_unpackhi_epi8(u, zero), _mm_unpackhi_epi8(v, zero),
+                           &red[1], &green[1], &blue[1]);
+                _mm_storeu_si128((__m128i *)(pRed + i),   _mm_packus_epi16(red[0], red[1]));
+                _mm_storeu_si128((__m128i *)(pGreen + i), _mm_packus_epi16(green[0], green[1]));
+                _mm_storeu_si128((__m128i *)(pBlue + i),  _mm_packus_epi16(blue[0], blue[1]));
+            }
+#endif
+            for (; i<n; i++) {
+                yuvToRGB(pIn[3*i+1], pIn[3*i], pIn[3*i+2], pRed + i, pGreen + i, pBlue + i);
+            }
+            break;
+        case NDColorModeYUV422:
+#if defined(__SSE2__)
+            /* Each 16 bit lane holds one pixel: Y in the high byte, U or V in the low byte */
+            for (; i+16<=n; i+=16) {
+                for (half=0; half<2; half++) {
+                    __m128i pixels = _mm_loadu_si128((const __m128i *)(pIn + 2*i + 16*half));
+                    __m128i chroma = _mm_and_si128(pixels, _mm_set1_epi16(0xff));
+                    y = _mm_srli_epi16(pixels, 8);
+                    u = _mm_shufflehi_epi16(_mm_shufflelo_epi16(chroma, _MM_SHUFFLE(2, 2, 0, 0)), _MM_SHUFFLE(2, 2, 0, 0));
+                    v = _mm_shufflehi_epi16(_mm_shufflelo_epi16(chroma, _MM_SHUFFLE(3, 3, 1, 1)), _MM_SHUFFLE(3, 3, 1, 1));
+                    yuvToRGBx8(y, u, v, &red[half], &green[half], &blue[half]);
+                }
+                _mm_storeu_si128((__m128i *)(pRed + i),   _mm_packus_epi16(red[0], red[1]));
+                _mm_storeu_si128((__m128i *)(pGreen + i), _mm_packus_epi16(green[0], green[1]));
+                _mm_storeu_si128((__m128i *)(pBlue + i),  _mm_packus_epi16(blue[0], blue[1]));
+            }
+#endif
+            for (; i+2<=n; i+=2) {
+                const epicsUInt8 *p = pIn + 2*i;
+                yuvToRGB(p[1], p[0], p[2], pRed + i,     pGreen + i,     pBlue + i);
+                yuvToRGB(p[3], p[0], p[2], pRed + i + 1, pGreen + i + 1, pBlue + i + 1);
+            }
+            break;
+        case NDColorModeYUV411:
+            for (; i+4<=n; i+=4) {
+                const epicsUInt8 *p = pIn + 3*i/2;
+                yuvToRGB(p[1], p[0], p[3], pRed + i,     pGreen + i,     pBlue + i);
+                yuvToRGB(p[2], p[0], p[3], pRed + i + 1, pGreen + i + 1, pBlue + i + 1);
+                yuvToRGB(p[4], p[0], p[3], pRed + i + 2, pGreen + i + 2, pBlue + i + 2);
+                yuvToRGB(p[5], p[0], p[3], pRed + i + 3, pGreen + i + 3, pBlue + i + 3);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+/** Copies the Y values of one row of YUV data */
+static void yuvToMonoRow(NDColorMode_t colorMode, const epicsUInt8 *pIn, epicsUInt8 *pOut, size_t n)
+{
+    size_t i;
+
+    switch (colorMode) {
+        case NDColorModeYUV444:
+            for (i=0; i<n; i++) pOut[i] = pIn[3*i+1];
+            break;
+        case NDColorModeYUV422:
+            for (i=0; i<n; i++) pOut[i] = pIn[2*i+1];
+            break;
+        case NDColorModeYUV411:
+            for (i=0; i+4<=n; i+=4) {
+                const epicsUInt8 *p = pIn + 3*i/2;
+                pOut[i]   = p[1];
+                pOut[i+1] = p[2];
+                pOut[i+2] = p[4];
+                pOut[i+3] = p[5];
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+/** Interpolates the missing colors of one pixel of a Bayer image.
+  * \param[in] p Pointer to the pixel; its neighbours up to 2 pixels away must be valid
+  * \param[in] xStep Offset from a pixel to the next pixel in the row
+  * \param[in] yStep Offset from a pixel to the pixel below it
+  * \param[in] colorSite Non-zero if the pixel has the color of its row (red in rows containing red, blue
+  *            in rows containing blue), zero if the pixel is green
+  * \param[in] bayerMethod The NDBayerMethod_t
+  * \param[out] pRowColor The color of the row
+  * \param[out] pGreen Green
+  * \param[out] pOtherColor The color missing from the row */
+template <typename epicsType>
+static inline void demosaicPixel(const epicsType *p, ptrdiff_t xStep, ptrdiff_t yStep, int colorSite,
+                                 int bayerMethod, epicsType *pRowColor, epicsType *pGreen, epicsType *pOtherColor)
+{
+    typedef colorTraits<epicsType> traits;
+    typedef typename traits::sum_t sum_t;
+    sum_t center = p[0];
+    sum_t west   = p[-xStep];
+    sum_t east   = p[xStep];
+    sum_t north  = p[-yStep];
+    sum_t south  = p[yStep];
+    sum_t laplaceH, laplaceV, gradientH, gradientV;
+
+    if (!colorSite) {
+        *pGreen      = p[0];
+        *pRowColor   = traits::scale(west + east, 1);
+        *pOtherColor = traits::scale(north + south, 1);
+        return;
+    }
+    *pRowColor   = p[0];
+    *pOtherColor = traits::scale((sum_t)p[-yStep-xStep] + p[-yStep+xStep] + p[yStep-xStep] + p[yStep+xStep], 2);
+    if (bayerMethod != NDBayerMethodEdgeAware) {
+        *pGreen = traits::scale(west + east + north + south, 2);
+        return;
+    }
+    /* Hamilton-Adams: interpolate along the direction with the smaller gradient,
+     * corrected with the second derivative of the pixel's own color */
+    laplaceH  = 2*center - p[-2*xStep] - p[2*xStep];
+    laplaceV  = 2*center - p[-2*yStep] - p[2*yStep];
+    gradientH = absValue(west - east) + absValue(laplaceH);
+    gradientV = absValue(north - south) + absValue(laplaceV);
+    if (gradientH < gradientV)
+        *pGreen = traits::scale(2*(west + east) + laplaceH, 2);
+    else if (gradientV < gradientH)
+        *pGreen = traits::scale(2*(north + south) + laplaceV, 2);
+    else
+        *pGreen = traits::scale(2*(west + east + north + south) + laplaceH + laplaceV, 3);
+}
+
+/** Reflects a coordinate that is outside the image back into it, preserving the Bayer phase */
+static inline size_t reflectIndex(ptrdiff_t i, size_t n)
+{
+    if (i < 0) i = -i;
+    if (i >= (ptrdiff_t)n) i = 2*((ptrdiff_t)n - 1) - i;
+    if (i < 0) i = 0;
+    return (size_t)i;
+}
+
+/** Demosaics a pixel within 2 pixels of the edge of the image, using the reflected image beyond the edge */
 template <typename epicsType>
+static void demosaicEdgePixel(const epicsType *pRaw, size_t rowSize, size_t numRows, size_t x, size_t y,
+                              int colorSite, int bayerMethod,
+                              epicsType *pRowColor, epicsType *pGreen, epicsType *pOtherColor)
+{
+    epicsType neighbours[5][5];
+    int i, j;
+
+    for (j=0; j<5; j++) {
+        const epicsType *pRow = pRaw + reflectIndex((ptrdiff_t)y + j - 2, numRows)*rowSize;
+        for (i=0; i<5; i++) neighbours[j][i] = pRow[reflectIndex((ptrdiff_t)x + i - 2, rowSize)];
+    }
+    demosaicPixel(&neighbours[2][2], 1, 5, colorSite, bayerMethod, pRowColor, pGreen, pOtherColor);
+}
+
+#if defined(__SSE2__)
+static inline __m128i loadBytesx8(const epicsUInt8 *p)
+{
+    return _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)p), _mm_setzero_si128());
+}
+
+static inline __m128i selectx8(__m128i mask, __m128i a, __m128i b)
+{
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+/** Same as demosaicPixel for unsigned 8 bit data, 8 pixels at a time, starting at an even column x.
+  * Returns the column after the last pixel done. */
+static size_t demosaicBytes(const epicsUInt8 *pRaw, size_t rowSize, size_t x, size_t xEnd, int colorParity,
+                            int bayerMethod, epicsUInt8 *pRowColor, epicsUInt8 *pGreen, epicsUInt8 *pOtherColor)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i colorSite = colorParity ? _mm_setr_epi16(0, -1, 0, -1, 0, -1, 0, -1)
+                                          : _mm_setr_epi16(-1, 0, -1, 0, -1, 0, -1, 0);
+    const __m128i one = _mm_set1_epi16(1);
+    const __m128i two = _mm_set1_epi16(2);
+    const __m128i four = _mm_set1_epi16(4);
+    __m128i center, west, east, north, south, diagonal, green, rowColor, otherColor;
+    __m128i laplaceH, laplaceV, gradientH, gradientV, greenH, greenV, greenHV;
+
+    for (; x+8<=xEnd; x+=8) {
+        const epicsUInt8 *p = pRaw + x;
+        center = loadBytesx8(p);
+        west   = loadBytesx8(p - 1);
+        east   = loadBytesx8(p + 1);
+        north  = loadBytesx8(p - rowSize);
+        south  = loadBytesx8(p + rowSize);
+        diagonal = _mm_add_epi16(_mm_add_epi16(loadBytesx8(p - rowSize - 1), loadBytesx8(p - rowSize + 1)),
+                                 _mm_add_epi16(loadBytesx8(p + rowSize - 1), loadBytesx8(p + rowSize + 1)));
+        diagonal = _mm_srai_epi16(_mm_add_epi16(diagonal, two), 2);
+        if (bayerMethod != NDBayerMethodEdgeAware) {
+            green = _mm_add_epi16(_mm_add_epi16(west, east), _mm_add_epi16(north, south));
+            green = _mm_srai_epi16(_mm_add_epi16(green, two), 2);
+        } else {
+            laplaceH = _mm_sub_epi16(_mm_add_epi16(center, center), _mm_add_epi16(loadBytesx8(p - 2), loadBytesx8(p + 2)));
+            laplaceV = _mm_sub_epi16(_mm_add_epi16(center, center),
+                                     _mm_add_epi16(loadBytesx8(p - 2*rowSize), loadBytesx8(p + 2*rowSize)));
+            gradientH = _mm_sub_epi16(west, east);
+            gradientH = _mm_add_epi16(_mm_max_epi16(gradientH, _mm_sub_epi16(zero, gradientH)),
+                                      _mm_max_epi16(laplaceH, _mm_sub_epi16(zero, laplaceH)));
+            gradientV = _mm_sub_epi16(north, south);
+            gradientV = _mm_add_epi16(_mm_max_epi16(gradientV, _mm_sub_epi16(zero, gradientV)),
+                                      _mm_max_epi16(laplaceV, _mm_sub_epi16(zero, laplaceV)));
+            greenH  = _mm_add_epi16(_mm_add_epi16(west, east), _mm_add_epi16(west, east));
+            greenV  = _mm_add_epi16(_mm_add_epi16(north, south), _mm_add_epi16(north, south));
+            greenHV = _mm_add_epi16(_mm_add_epi16(greenH, greenV), _mm_add_epi16(laplaceH, laplaceV));
+            greenH  = _mm_srai_epi16(_mm_add_epi16(_mm_add_epi16(greenH, laplaceH), two), 2);
+            greenV  = _mm_srai_epi16(_mm_add_epi16(_mm_add_epi16(greenV, laplaceV), two), 2);
+            greenHV = _mm_srai_epi16(_mm_add_epi16(greenHV, four), 3);
+            green = selectx8(_mm_cmplt_epi16(gradientH, gradientV), greenH,
+                             selectx8(_mm_cmplt_epi16(gradientV, gradientH), greenV, greenHV));
+        }
+        rowColor   = selectx8(colorSite, center, _mm_srai_epi16(_mm_add_epi16(_mm_add_epi16(west, east), one), 1));
+        otherColor = selectx8(colorSite, diagonal, _mm_srai_epi16(_mm_add_epi16(_mm_add_epi16(north, south), one), 1));
+        green      = selectx8(colorSite, green, center);
+        _mm_storel_epi64((__m128i *)(pRowColor + x),   _mm_packus_epi16(rowColor, rowColor));
+        _mm_storel_epi64((__m128i *)(pGreen + x),      _mm_packus_epi16(green, green));
+        _mm_storel_epi64((__m128i *)(pOtherColor + x), _mm_packus_epi16(otherColor, otherColor));
+    }
+    return x;
+}
+#endif
+
+/** Demosaics row y of a Bayer image into separate red, green and blue rows */
+template <typename epicsType>
+static void demosaicRow(const epicsType *pRaw, size_t rowSize, size_t numRows, size_t y, int redX, int redY,
+                        int bayerMethod, epicsType *pRed, epicsType *pGreen, epicsType *pBlue)
+{
+    int redRow = ((int)(y & 1) == redY);
+    int colorParity = redRow ? redX : 1 - redX;
+    epicsType *pRowColor   = redRow ? pRed : pBlue;
+    epicsType *pOtherColor = redRow ? pBlue : pRed;
+    const epicsType *pRow = pRaw + y*rowSize;
+    size_t x=0;
+
+    if ((y >= 2) && (y+2 < numRows) && (rowSize >= 5)) {
+        for (; x<2; x++) {
+            demosaicEdgePixel(pRaw, rowSize, numRows, x, y, (int)(x & 1) == colorParity, bayerMethod,
+                              pRowColor + x, pGreen + x, pOtherColor + x);
+        }
+#if defined(__SSE2__)
+        if (std::numeric_limits<epicsType>::is_integer && !std::numeric_limits<epicsType>::is_signed &&
+            (sizeof(epicsType) == 1)) {
+            x = demosaicBytes((const epicsUInt8 *)pRow, rowSize, x, rowSize-2, colorParity, bayerMethod,
+                              (epicsUInt8 *)pRowColor, (epicsUInt8 *)pGreen, (epicsUInt8 *)pOtherColor);
+        }
+#endif
+        for (; x<rowSize-2; x++) {
+            demosaicPixel(pRow + x, 1, (ptrdiff_t)rowSize, (int)(x & 1) == colorParity, bayerMethod,
+                          pRowColor + x, pGreen + x, pOtherColor + x);
+        }
+    }
+    for (; x<rowSize; x++) {
+        demosaicEdgePixel(pRaw, rowSize, numRows, x, y, (int)(x & 1) == colorParity, bayerMethod,
+                          pRowColor + x, pGreen + x, pOtherColor + x);
+    }
+}
+
+/** Converts rows firstRow to lastRow-1 of the array described by pTask */
+template <typename epicsType>
+static void convertRows(const NDColorConvertTask *pTask, int band, size_t firstRow, size_t lastRow)
+{
+    const epicsType *pIn = (const epicsType *)pTask->pIn;
+    epicsType *pOut = (epicsType *)pTask->pOut;
+    const colorLayout_t *pInLayout = &pTask->inLayout;
+    const colorLayout_t *pOutLayout = &pTask->outLayout;
+    size_t rowSize = pTask->rowSize;
+    const epicsType *pInRow[3];
+    epicsType *pOutRow[3];
+    epicsType *pColorRow[3];
+    epicsType *pScratchRow[3] = {NULL, NULL, NULL};
+    size_t y;
+    int color;
+
+    if (pTask->pScratch) {
+        for (color=0; color<3; color++) pScratchRow[color] = (epicsType *)pTask->pScratch + (3*band + color)*rowSize;
+    }
+    for (y=firstRow; y<lastRow; y++) {
+        for (color=0; color<3; color++) {
+            pInRow[color]  = pIn  + y*pInLayout->rowStride  + color*pInLayout->colorStride;
+            pOutRow[color] = pOut + y*pOutLayout->rowStride + color*pOutLayout->colorStride;
+            /* Bayer and YUV conversions produce separate color rows, for RGB1 these are then interleaved */
+            pColorRow[color] = (pOutLayout->pixelStride == 1) ? pOutRow[color] : pScratchRow[color];
+        }
+        switch (pTask->kind) {
+            case colorConvertMonoToRGB:
+                monoToRGBRow(pInRow[0], pOutRow, pOutLayout->pixelStride, rowSize);
+                break;
+            case colorConvertFalseColor:
+                /* The output is 8 bit, this is done by falseColorRows */
+                break;
+            case colorConvertRGBToMono:
+                rgbToMonoRow(pInRow, pInLayout->pixelStride, pOutRow[0], rowSize);
+                break;
+            case colorConvertRGBToRGB:
+                rgbToRGBRow(pInRow, pInLayout->pixelStride, pOutRow, pOutLayout->pixelStride, rowSize);
+                break;
+            case colorConvertBayerToRGB:
+                demosaicRow(pIn, rowSize, pTask->numRows, y, pTask->redX, pTask->redY, pTask->bayerMethod,
+                            pColorRow[0], pColorRow[1], pColorRow[2]);
+                if (pOutLayout->pixelStride == 3) interleaveRow(pColorRow[0], pColorRow[1], pColorRow[2], pOutRow[0], rowSize);
+                break;
+            case colorConvertYUVToRGB:
+                yuvToRGBRow(pTask->colorModeIn, (const epicsUInt8 *)pInRow[0], (epicsUInt8 *)pColorRow[0],
+                            (epicsUInt8 *)pColorRow[1], (epicsUInt8 *)pColorRow[2], rowSize);
+                if (pOutLayout->pixelStride == 3) interleaveRow(pColorRow[0], pColorRow[1], pColorRow[2], pOutRow[0], rowSize);
+                break;
+            case colorConvertYUVToMono:
+                yuvToMonoRow(pTask->colorModeIn, (const epicsUInt8 *)pInRow[0], (epicsUInt8 *)pOutRow[0], rowSize);
+                break;
+        }
+    }
+}
+
+/** Converts rows firstRow to lastRow-1 of an 8 or 16 bit mono array with the false color
+  * lookup table of pTask.  The output array is always 8 bit. */
+static void falseColorRows(const NDColorConvertTask *pTask, size_t firstRow, size_t lastRow)
+{
+    const colorLayout_t *pOutLayout = &pTask->outLayout;
+    size_t rowSize = pTask->rowSize;
+    epicsUInt8 *pOutRow[3];
+    size_t y;
+    int color;
+
+    for (y=firstRow; y<lastRow; y++) {
+        for (color=0; color<3; color++) {
+            pOutRow[color] = (epicsUInt8 *)pTask->pOut + y*pOutLayout->rowStride + color*pOutLayout->colorStride;
+        }
+        if ((pTask->dataType == NDInt8) || (pTask->dataType == NDUInt8)) {
+            falseColorRow((const epicsUInt8 *)pTask->pIn + y*rowSize, pTask->pColorMap,
+                          pOutRow[0], pOutRow[1], pOutRow[2], pOutLayout->pixelStride, rowSize);
+        } else {
+            falseColorRow((const epicsUInt16 *)pTask->pIn + y*rowSize, pTask->pColorMap,
+                          pOutRow[0], pOutRow[1], pOutRow[2], pOutLayout->pixelStride, rowSize);
+        }
+    }
+}
+
+static void convertBandRows(const NDColorConvertTask *pTask, int band, size_t firstRow, size_t lastRow)
+{
+    if (pTask->kind == colorConvertFalseColor) {
+        falseColorRows(pTask, firstRow, lastRow);
+        return;
+    }
+    switch (pTask->dataType) {
+        case NDInt8:
+            convertRows<epicsInt8>(pTask, band, firstRow, lastRow);
+            break;
+        case NDUInt8:
+            convertRows<epicsUInt8>(pTask, band, firstRow, lastRow);
+            break;
+        case NDInt16:
+            convertRows<epicsInt16>(pTask, band, firstRow, lastRow);
+            break;
+        case NDUInt16:
+            convertRows<epicsUInt16>(pTask, band, firstRow, lastRow);
+            break;
+        case NDInt32:
+            convertRows<epicsInt32>(pTask, band, firstRow, lastRow);
+            break;
+        case NDUInt32:
+            convertRows<epicsUInt32>(pTask, band, firstRow, lastRow);
+            break;
+        case NDFloat32:
+            convertRows<epicsFloat32>(pTask, band, firstRow, lastRow);
+            break;
+        case NDFloat64:
+            convertRows<epicsFloat64>(pTask, band, firstRow, lastRow);
+            break;
+        default:
+            break;
+    }
+}
+
+static void bandTaskC(void *drvPvt)
+{
+    NDPluginColorConvert *pPvt = (NDPluginColorConvert *)drvPvt;
+    pPvt->bandTask();
+}
+
+/** Thread that converts the bands of rows sent to it by convertBands.
+  * This method should really be private, but it must be called from a
+  * C-linkage callback function, so it must be public. */
+void NDPluginColorConvert::bandTask()
+{
+    colorConvertBand_t band;
+    NDColorConvertTask *pTask;
+    int numBytes;
+    static const char *functionName = "bandTask";
+
+    while (1) {
+        numBytes = pBandMsgQ_->receive(&band, sizeof(band));
+        if (numBytes != sizeof(band)) {
+            asynPrint(pasynUserSelf, ASYN_TRACE_ERROR,
+                "%s::%s error reading message queue, expected size=%d, actual=%d\n",
+                driverName, functionName, (int)sizeof(band), numBytes);
+            continue;
+        }
+        pTask = band.pTask;
+        if (!pTask) break;
+        convertBandRows(pTask, band.band, band.firstRow, band.lastRow);
+        /* The task can go out of scope as soon as the lock is released after the last band */
+        pTask->pSync->lock.lock();
+        if (--pTask->bandsPending == 0) pTask->pSync->done.signal();
+        pTask->pSync->lock.unlock();
+    }
+    epicsEventSignal(bandExitEvent_);
+}
+
+/** Creates threads so that there are numThreads band threads.
+  * This method is called with the lock held. */
+asynStatus NDPluginColorConvert::createBandThreads(int numThreads)
+{
+    char taskName[256];
+    epicsThreadId threadId;
+    static const char *functionName = "createBandThreads";
+
+    if (!pBandMsgQ_) {
+        pBandMsgQ_ = new epicsMessageQueue(MAX_COLOR_CONVERT_BANDS, sizeof(colorConvertBand_t));
+        bandExitEvent_ = epicsEventCreate(epicsEventEmpty);
+    }
+    for (; numBandThreads_<numThreads; numBandThreads_++) {
+        epicsSnprintf(taskName, sizeof(taskName)-1, "%s_Band_%d", portName, numBandThreads_+1);
+        threadId = epicsThreadCreate(taskName,
+                                     this->threadPriority_,
+                                     this->threadStackSize_,
+                                     (EPICSTHREADFUNC)bandTaskC, this);
+        if (threadId == 0) {
+            asynPrint(pasynUserSelf, ASYN_TRACE_ERROR,
+                "%s::%s error creating band thread %s\n",
+                driverName, functionName, taskName);
+            return asynError;
+        }
+    }
+    return asynSuccess;
+}
+
+/** Converts an array in numBands bands of rows, numBands-1 of which are sent to the band threads
+  * while the calling thread converts the first band. */
+void NDPluginColorConvert::convertBands(NDColorConvertTask *pTask, int numBands)
+{
+    colorConvertBand_t band;
+    int i;
+
+    pTask->bandsPending = numBands - 1;
+    for (i=1; i<numBands; i++) {
+        band.pTask    = pTask;
+        band.band     = i;
+        band.firstRow = i*pTask->numRows/numBands;
+        band.lastRow  = (i+1)*pTask->numRows/numBands;
+        pBandMsgQ_->send(&band, sizeof(band));
+    }
+    convertBandRows(pTask, 0, 0, pTask->numRows/numBands);
+    if (numBands > 1) {
+        pTask->pSync->done.wait();
+        /* Wait for the thread that signalled us to release the task */
+        pTask->pSync->lock.lock();
+        pTask->pSync->lock.unlock();
+    }
+}
+
+/** Gets a lock and event to wait for the band threads, creating them if none is free.
+  * This method is called with the lock held. */
+NDColorConvertSync *NDPluginColorConvert::allocSync()
+{
+    NDColorConvertSync *pSync = pFreeSync_;
+
+    if (pSync) {
+        pFreeSync_ = pSync->pNext;
+    } else {
+        pSync = new NDColorConvertSync;
+    }
+    pSync->pNext = NULL;
+    return pSync;
+}
+
+/** Returns a lock and event from allocSync to the free list.
+  * This method is called with the lock held. */
+void NDPluginColorConvert::freeSync(NDColorConvertSync *pSync)
+{
+    if (!pSync) return;
+    pSync->pNext = pFreeSync_;
+    pFreeSync_ = pSync;
+}
+
+/** Creates a false color lookup table.  Entry i is the color of the pixel value i for
+  * unsigned data, and of (epicsInt8)i or (epicsInt16)i for signed data.  Values up to minValue
+  * get the first color of the color map, values from maxValue on get the last one.
+  * \param[in] falseColor The color map, 1 (Rainbow) or 2 (Iron)
+  * \param[in] dataType The data type of the arrays, NDInt8, NDUInt8, NDInt16 or NDUInt16
+  * \param[in] minValue The pixel value mapped to the first color
+  * \param[in] maxValue The pixel value mapped to the last color */
+static NDFalseColorLUT *createFalseColorLUT(int falseColor, NDDataType_t dataType, int minValue, int maxValue)
+{
+    const unsigned char *colorMapR=RainbowColorR;
+    const unsigned char *colorMapG=RainbowColorG;
+    const unsigned char *colorMapB=RainbowColorB;
+    int numEntries = ((dataType == NDInt8) || (dataType == NDUInt8)) ? 256 : 65536;
+    NDFalseColorLUT *pLUT;
+    int i, value, index;
+
+    if (falseColor == 2) {
+        colorMapR = IronColorR;
+        colorMapG = IronColorG;
+        colorMapB = IronColorB;
+    }
+    pLUT = (NDFalseColorLUT *)malloc(sizeof(NDFalseColorLUT));
+    if (!pLUT) return NULL;
+    pLUT->pEntries = (epicsUInt8 (*)[4])malloc(numEntries * sizeof(*pLUT->pEntries));
+    if (!pLUT->pEntries) {
+        free(pLUT);
+        return NULL;
+    }
+    pLUT->falseColor = falseColor;
+    pLUT->dataType   = dataType;
+    pLUT->minValue   = minValue;
+    pLUT->maxValue   = maxValue;
+    pLUT->refCount   = 1;
+    for (i=0; i<numEntries; i++) {
+        switch (dataType) {
+            case NDInt8:  value = (epicsInt8)i;  break;
+            case NDInt16: value = (epicsInt16)i; break;
+            default:      value = i;             break;
+        }
+        if (value <= minValue)      index = 0;
+        else if (value >= maxValue) index = 255;
+        else                        index = (int)(((double)value - minValue)*255. / ((double)maxValue - minValue) + 0.5);
+        pLUT->pEntries[i][0] = colorMapR[index];
+        pLUT->pEntries[i][1] = colorMapG[index];
+        pLUT->pEntries[i][2] = colorMapB[index];
+        pLUT->pEntries[i][3] = 0;
+    }
+    return pLUT;
+}
+
+/** Returns a reference to the false color lookup table for the current parameters, creating it
+  * if the parameters have changed since the cached table was created.
+  * This method is called with the lock held.
+  * \return The table, which must be released with releaseFalseColorLUT, or NULL on error */
+NDFalseColorLUT* NDPluginColorConvert::getFalseColorLUT(int falseColor, NDDataType_t dataType, int minValue, int maxValue)
+{
+    NDFalseColorLUT *pLUT = pFalseColorLUT_;
+    static const char *functionName = "getFalseColorLUT";
+
+    if (!pLUT || (pLUT->falseColor != falseColor) || (pLUT->dataType != dataType) ||
+        (pLUT->minValue != minValue) || (pLUT->maxValue != maxValue)) {
+        pLUT = createFalseColorLUT(falseColor, dataType, minValue, maxValue);
+        if (!pLUT) {
+            asynPrint(pasynUserSelf, ASYN_TRACE_ERROR,
+                "%s::%s error allocating false color lookup table\n",
+                driverName, functionName);
+            return NULL;
+        }
+        /* The previous table is deleted when the conversions using it release it */
+        releaseFalseColorLUT(pFalseColorLUT_);
+        pFalseColorLUT_ = pLUT;
+    }
+    pLUT->refCount++;
+    return pLUT;
+}
+
+/** Releases a reference to a false color lookup table, deleting it if it was the last one.
+  * This method is called with the lock held. */
+void NDPluginColorConvert::releaseFalseColorLUT(NDFalseColorLUT *pLUT)
+{
+    if (!pLUT) return;
+    if (--pLUT->refCount > 0) return;
+    free(pLUT->pEntries);
+    free(pLUT);
+}
+
+/** Allocates the output array of a conversion and copies everything except the data
+  * (uniqueId, timeStamp, attributes, ...) from the input array.
+  * \param[in] pArray The input array
+  * \param[in] colorModeOut The color mode of the output array
+  * \param[in] dataTypeOut The data type of the output array
+  * \param[in] pXDim The X dimension of the output image
+  * \param[in] pYDim The Y dimension of the output image
+  * \param[in] pColorDim The color dimension of the output image, not used for mono */
+NDArray* NDPluginColorConvert::allocOutput(NDArray *pArray, NDColorMode_t colorModeOut, NDDataType_t dataTypeOut,
+                                           const NDDimension_t *pXDim, const NDDimension_t *pYDim,
+                                           const NDDimension_t *pColorDim)
+{
+    NDDimension_t outDims[3];
+    size_t dims[3];
+    int ndims = 3;
+    int i;
+    NDArray *pArrayOut;
+
+    switch (colorModeOut) {
+        case NDColorModeRGB1:
+            outDims[0] = *pColorDim;
+            outDims[1] = *pXDim;
+            outDims[2] = *pYDim;
+            break;
+        case NDColorModeRGB2:
+            outDims[0] = *pXDim;
+            outDims[1] = *pColorDim;
+            outDims[2] = *pYDim;
+            break;
+        case NDColorModeRGB3:
+            outDims[0] = *pXDim;
+            outDims[1] = *pYDim;
+            outDims[2] = *pColorDim;
+            break;
+        default:
+            ndims = 2;
+            outDims[0] = *pXDim;
+            outDims[1] = *pYDim;
+            break;
+    }
+    for (i=0; i<ndims; i++) dims[i] = outDims[i].size;
+    pArrayOut = this->pNDArrayPool->alloc(ndims, dims, dataTypeOut, 0, NULL);
+    if (!pArrayOut) return NULL;
+    /* Copy everything except the data, e.g. uniqueId and timeStamp, attributes. */
+    this->pNDArrayPool->copy(pArray, pArrayOut, 0);
+    /* That replaced the dimensions and data type in the output array, need to fix. */
+    pArrayOut->ndims = ndims;
+    pArrayOut->dataType = dataTypeOut;
+    for (i=0; i<ndims; i++) pArrayOut->dims[i] = outDims[i];
+    return pArrayOut;
+}
+
+/** Converts the color mode of an array, and does the callbacks with the result */
 void NDPluginColorConvert::convertColor(NDArray *pArray)
 {
     NDColorMode_t colorModeOut;
     static const char* functionName = "convertColor";
-    size_t i, j;
-    epicsType *pIn, *pRedIn, *pGreenIn, *pBlueIn;
-    epicsType *pOut, *pRedOut, *pGreenOut, *pBlueOut;
-    epicsType *pDataIn  = (epicsType *)pArray->pData;
-    epicsType *pDataOut;
+    NDColorConvertTask task;
     NDArray *pArrayOut=NULL;
-    size_t imageSize, rowSize, numRows;
-    size_t dims[3];
-    NDDimension_t tmpDim;
-    #ifdef HAVE_PVAPI
-    tPvFrame PvFrame, *pFrame=&PvFrame;
-    int ndims;
-    #endif
-    double value;
+    NDArrayInfo_t arrayInfo;
+    NDDimension_t xDim, yDim, colorDim;
+    size_t yuvRowBytes=0;
     int colorMode=NDColorModeMono, bayerPattern=NDBayerRGGB;
     int falseColor=0;
-    int changedColorMode=0;
-    const unsigned char *colorMapR=NULL;
-    const unsigned char *colorMapG=NULL;
-    const unsigned char *colorMapB=NULL;        
-    const unsigned char *colorMapRGB=NULL;     
+    int falseColorMin=0, falseColorMax=255;
+    int bayerMethod=NDBayerMethodBilinear;
+    int bandThreads=1;
+    int numBands;
+    int convert=0;
+    int is8Bit = (pArray->dataType == NDInt8) || (pArray->dataType == NDUInt8);
+    int is16Bit = (pArray->dataType == NDInt16) || (pArray->dataType == NDUInt16);
+    NDDataType_t dataTypeOut = pArray->dataType;
+    NDFalseColorLUT *pFalseColorLUT=NULL;
+    NDColorConvertSync *pSync=NULL;
     NDAttribute *pAttribute;
-     
+
     getIntegerParam(NDPluginColorConvertColorModeOut, (int *)&colorModeOut);
+    getIntegerParam(NDPluginColorConvertBayerMethod, &bayerMethod);
+    getIntegerParam(NDPluginColorConvertBandThreads, &bandThreads);
     pAttribute = pArray->pAttributeList->find("ColorMode");
     if (pAttribute) pAttribute->getValue(NDAttrInt32, &colorMode);
     pAttribute = pArray->pAttributeList->find("BayerPattern");
     if (pAttribute) pAttribute->getValue(NDAttrInt32, &bayerPattern);
-    
-    /* if we have int8 data then check for false color */
-    if (pArray->dataType == NDInt8 || pArray->dataType == NDUInt8) {
-        getIntegerParam(NDPluginColorConvertFalseColor, &falseColor);            
-        switch (falseColor) {
-        case 1:
-            colorMapR = RainbowColorR;
-            colorMapG = RainbowColorG;
-            colorMapB = RainbowColorB;
-            colorMapRGB = RainbowColorRGB;      
-            break;
-        case 2:
-            colorMapR = IronColorR;
-            colorMapG = IronColorG;
-            colorMapB = IronColorB;
-            colorMapRGB = IronColorRGB;                        
-            break;
-        default:
-            falseColor = 0;
+
+    /* if we have 8 or 16 bit mono data that is converted to RGB then check for false color.
+     * The lookup table is only built for that conversion, and only rebuilt when the
+     * parameters or the data type change. */
+    if ((is8Bit || is16Bit) && (colorMode == NDColorModeMono) && (pArray->ndims == 2) &&
+        ((colorModeOut == NDColorModeRGB1) || (colorModeOut == NDColorModeRGB2) ||
+         (colorModeOut == NDColorModeRGB3))) {
+        getIntegerParam(NDPluginColorConvertFalseColor, &falseColor);
+        getIntegerParam(NDPluginColorConvertFalseColorMin, &falseColorMin);
+        getIntegerParam(NDPluginColorConvertFalseColorMax, &falseColorMax);
+        if ((falseColor == 1) || (falseColor == 2)) {
+            pFalseColorLUT = getFalseColorLUT(falseColor, pArray->dataType, falseColorMin, falseColorMax);
         }
-    }     
+        if (!pFalseColorLUT) falseColor = 0;
+    }
+    if (bandThreads > MAX_COLOR_CONVERT_BANDS) bandThreads = MAX_COLOR_CONVERT_BANDS;
+    if (bandThreads > numBandThreads_ + 1) createBandThreads(bandThreads - 1);
+    numBands = bandThreads;
+    if (numBands > numBandThreads_ + 1) numBands = numBandThreads_ + 1;
+    if (numBands > 1) pSync = allocSync();
+
     /* This function is called with the lock taken, and it must be set when we exit.
      * The following code can be exected without the mutex because we are not accessing elements of
      * pPvt that other threads can access. */
     this->unlock();
+    memset(&colorDim, 0, sizeof(colorDim));
+    colorDim.size = 3;
+    colorDim.binning = 1;
     switch (colorMode) {
         case NDColorModeMono:
             if (pArray->ndims != 2) break;
-            rowSize   = pArray->dims[0].size;
-            numRows   = pArray->dims[1].size;
-            imageSize = rowSize * numRows;
-            switch (colorModeOut) {
-                case NDColorModeRGB1:
-                    dims[0] = 3;
-                    dims[1] = rowSize;
-                    dims[2] = numRows;
-                    pArrayOut = this->pNDArrayPool->alloc(3, dims, pArray->dataType, 0, NULL);
-                    tmpDim = pArrayOut->dims[0];
-                    /* Copy everything except the data, e.g. uniqueId and timeStamp, attributes. */
-                    this->pNDArrayPool->copy(pArray, pArrayOut, 0);
-                    /* That replaced the dimensions in the output array, need to fix. */
-                    pArrayOut->ndims = 3;
-                    pArrayOut->dims[2] = pArrayOut->dims[1];
-                    pArrayOut->dims[1] = pArrayOut->dims[0];
-                    pArrayOut->dims[0] = tmpDim;
-                    pDataOut = (epicsType *)pArrayOut->pData;
-                    pOut = pDataOut;
-                    pIn  = pDataIn;
-                    if (falseColor) {
-                        for (i=0; i<imageSize; i++) {
-                            memcpy(pOut, colorMapRGB + 3 * ((unsigned char)*pIn++), 3);
-                            pOut+=3;
-                        }                                       
-                    } else {
-                        for (i=0; i<imageSize; i++) {
-                            *pOut++ = *pIn;
-                            *pOut++ = *pIn;
-                            *pOut++ = *pIn++;
-                        }
-                    }
-                    changedColorMode = 1;
-                    break;
-                case NDColorModeRGB2:
-                    /* Make a new 3-D array */
-                    dims[0] = rowSize;
-                    dims[1] = 3;
-                    dims[2] = numRows;
-                    pArrayOut = this->pNDArrayPool->alloc(3, dims, pArray->dataType, 0, NULL);
-                    tmpDim = pArrayOut->dims[1];
-                    /* Copy everything except the data, e.g. uniqueId and timeStamp, attributes. */
-                    this->pNDArrayPool->copy(pArray, pArrayOut, 0);
-                    /* That replaced the dimensions in the output array, need to fix. */
-                    pArrayOut->ndims = 3;
-                    pArrayOut->dims[2] = pArrayOut->dims[1];
-                    pArrayOut->dims[1] = tmpDim;
-                    pDataOut = (epicsType *)pArrayOut->pData;
-                    pIn  = pDataIn;
-                    if (falseColor) {
-                        for (i=0; i<numRows; i++) {
-                            pRedOut   = pDataOut + 3*i*rowSize;
-                            pGreenOut = pRedOut + rowSize;
-                            pBlueOut  = pRedOut + 2*rowSize;
-                            for (j=0; j<rowSize; j++) {
-                                *pRedOut++   = colorMapR[(unsigned char)*pIn];
-                                *pGreenOut++ = colorMapG[(unsigned char)*pIn];
-                                *pBlueOut++  = colorMapB[(unsigned char)*pIn++];
-                            }
-                        }                                
-                    } else {
-                        for (i=0; i<numRows; i++) {
-                            pRedOut   = pDataOut + 3*i*rowSize;
-                            pGreenOut = pRedOut + rowSize;
-                            pBlueOut  = pRedOut + 2*rowSize;
-                            for (j=0; j<rowSize; j++) {
-                                *pRedOut++   = *pIn;
-                                *pGreenOut++ = *pIn;
-                                *pBlueOut++  = *pIn++;
-                            }
-                        }
-                    }                    
-                    changedColorMode = 1;
-                    break;
-                case NDColorModeRGB3:
-                    /* Make a new 3-D array */
-                    dims[0] = rowSize;
-                    dims[1] = numRows;
-                    dims[2] = 3;
-                    pArrayOut = this->pNDArrayPool->alloc(3, dims, pArray->dataType, 0, NULL);
-                    tmpDim = pArrayOut->dims[2];
-                    /* Copy everything except the data, e.g. uniqueId and timeStamp, attributes. */
-                    this->pNDArrayPool->copy(pArray, pArrayOut, 0);
-                    /* That replaced the dimensions in the output array, need to fix. */
-                    pArrayOut->ndims = 3;
-                    pArrayOut->dims[2] = tmpDim;
-                    pDataOut = (epicsType *)pArrayOut->pData;
-                    pRedOut   = pDataOut;
-                    pGreenOut = pDataOut + imageSize;
-                    pBlueOut  = pDataOut + 2*imageSize;
-                    pIn  = pDataIn;
-                    if (falseColor) {  
-                        for (i=0; i<imageSize; i++) {                    
-                            *pRedOut++   = colorMapR[(unsigned char)*pIn];
-                            *pGreenOut++ = colorMapG[(unsigned char)*pIn];
-                            *pBlueOut++  = colorMapB[(unsigned char)*pIn++];
-                        }                                                   
-                    } else {                                      
-                        for (i=0; i<imageSize; i++) {
-                            *pRedOut++   = *pIn;
-                            *pGreenOut++ = *pIn;
-                            *pBlueOut++  = *pIn++;
-                        }
-                    }                        
-                    changedColorMode = 1;
-                    break;
-                default:
-                    break;
+            xDim = pArray->dims[0];
+            yDim = pArray->dims[1];
+            if ((colorModeOut == NDColorModeRGB1) || (colorModeOut == NDColorModeRGB2) ||
+                (colorModeOut == NDColorModeRGB3)) {
+                task.kind = falseColor ? colorConvertFalseColor : colorConvertMonoToRGB;
+                /* False color images are always 8 bit */
+                if (falseColor) dataTypeOut = is8Bit ? pArray->dataType : NDUInt8;
+                convert = 1;
             }
             break;
-        #ifdef HAVE_PVAPI
         case NDColorModeBayer:
             if (pArray->ndims != 2) break;
-            switch (colorModeOut) {
-                case NDColorModeRGB1:
-                case NDColorModeRGB2:
-                case NDColorModeRGB3:
-                    rowSize   = pArray->dims[0].size;
-                    numRows   = pArray->dims[1].size;
-                    imageSize = rowSize * numRows;
-                    ndims = 3;
-                    dims[0] = 3;
-                    dims[1] = rowSize;
-                    dims[2] = numRows;
-                    /* There is a problem: the uniqueId and timeStamp are not preserved! */
-                    pArrayOut = this->pNDArrayPool->alloc(ndims, dims, pArray->dataType, 0, NULL);
-                    pArrayOut->uniqueId = pArray->uniqueId;
-                    pArrayOut->epicsTS = pArray->epicsTS;
-                    pArrayOut->timeStamp = pArray->timeStamp;
-                    pDataOut = (epicsType *)pArrayOut->pData;
-                    /* For now we use the Prosilica library functions to convert Bayer to RGB */
-                    /* This requires creating their tPvFrame data structure */
-                    memset(pFrame, 0, sizeof(tPvFrame));
-                    pFrame->Width = (unsigned long)pArray->dims[0].size;
-                    pFrame->Height = (unsigned long)pArray->dims[1].size;
-                    pFrame->RegionX = (unsigned long)pArray->dims[0].offset;
-                    pFrame->RegionY = (unsigned long)pArray->dims[1].offset;
-                    pFrame->ImageBuffer = pArray->pData;
-                    pFrame->ImageBufferSize = (unsigned long)pArray->dataSize;
-                    pFrame->ImageSize = pFrame->ImageBufferSize;
-                    pFrame->BayerPattern = (tPvBayerPattern)bayerPattern;
-                    switch(pArray->dataType) {
-                        case NDInt8:
-                        case NDUInt8:
-                            pFrame->Format = ePvFmtBayer8;
-                            pFrame->BitDepth = 8;
-                            break;
-                        case NDInt16:
-                        case NDUInt16:
-                            pFrame->Format = ePvFmtBayer16;
-                            pFrame->BitDepth = 16;
-                            break;
-                        default:
-                            asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
-                                "%s:%s: error unsupported data type=%d\n",
-                                driverName, functionName, pArray->dataType);
-                            break;
-                    }
-                    break;
-                default: 
-                    break;
-            }
-            switch (colorModeOut) {
-                case NDColorModeRGB1:
-                    PvUtilityColorInterpolate(pFrame, pDataOut, pDataOut+1, pDataOut+2, 2, 0);
-                    pArrayOut->dims[0].size = 3;
-                    memcpy(&pArrayOut->dims[1], &pArray->dims[0], sizeof(NDDimension_t));
-                    memcpy(&pArrayOut->dims[2], &pArray->dims[1], sizeof(NDDimension_t));
-                    changedColorMode = 1;
-                    break;
-                
-                case NDColorModeRGB2:
-                    PvUtilityColorInterpolate(pFrame, pDataOut,  pDataOut+rowSize, pDataOut+2*rowSize, 
-                                              0, (unsigned long)(2*rowSize));
-                    memcpy(&pArrayOut->dims[0], &pArray->dims[0], sizeof(NDDimension_t));
-                    pArrayOut->dims[1].size = 3;
-                    memcpy(&pArrayOut->dims[2], &pArray->dims[1], sizeof(NDDimension_t));
-                    changedColorMode = 1;
-                    break;
-
-                case NDColorModeRGB3:
-                    PvUtilityColorInterpolate(pFrame, pDataOut,  pDataOut+imageSize, pDataOut+2*imageSize, 0, 0);
-                    memcpy(&pArrayOut->dims[0], &pArray->dims[0], sizeof(NDDimension_t));
-                    memcpy(&pArrayOut->dims[1], &pArray->dims[1], sizeof(NDDimension_t));
-                    pArrayOut->dims[2].size = 3;
-                    changedColorMode = 1;
-                    break;
-                default:
-                    break;
+            xDim = pArray->dims[0];
+            yDim = pArray->dims[1];
+            if ((colorModeOut == NDColorModeRGB1) || (colorModeOut == NDColorModeRGB2) ||
+                (colorModeOut == NDColorModeRGB3)) {
+                task.kind = colorConvertBayerToRGB;
+                convert = 1;
             }
             break;
-        #endif
         case NDColorModeRGB1:
-            if (pArray->ndims != 3) break;
-            rowSize   = pArray->dims[1].size;
-            numRows   = pArray->dims[2].size;
-            imageSize = rowSize * numRows;
-            switch (colorModeOut) {
-                case NDColorModeMono:
-                    /* Make a new 2-D array */
-                    dims[0] = rowSize;
-                    dims[1] = numRows;
-                    pArrayOut = this->pNDArrayPool->alloc(2, dims, pArray->dataType, 0, NULL);
-                    /* Copy everything except the data, e.g. uniqueId and timeStamp, attributes. */
-                    this->pNDArrayPool->copy(pArray, pArrayOut, 0);
-                    /* That replaced the dimensions in the output array, need to fix. */
-                    pArrayOut->ndims = 2;
-                    pArrayOut->dims[0] = pArrayOut->dims[1];
-                    pArrayOut->dims[1] = pArrayOut->dims[2];
-                    pDataOut = (epicsType *)pArrayOut->pData;
-                    pOut = pDataOut;
-                    pIn = pDataIn;
-                    for (i=0; i<imageSize; i++) {
-                        value  = (*pIn + *(pIn+1) + *(pIn+2))/3.;
-                        *pOut++ = (epicsType)value;
-                        pIn += 3;
-                    }
-                    changedColorMode = 1;
-                    break;
-                case NDColorModeRGB2:
-                    pArrayOut = this->pNDArrayPool->copy(pArray, NULL, 0);
-                    pDataOut = (epicsType *)pArrayOut->pData;
-                    pIn = pDataIn;
-                    for (i=0; i<numRows; i++) {
-                        pRedOut   = pDataOut + 3*i*rowSize;
-                        pGreenOut = pRedOut + rowSize;
-                        pBlueOut  = pRedOut + 2*rowSize;
-                        for (j=0; j<rowSize; j++) {
-                            *pRedOut++   = *pIn++;
-                            *pGreenOut++ = *pIn++;
-                            *pBlueOut++  = *pIn++;
-                        }
-                    }
-                    memcpy(&pArrayOut->dims[0], &pArray->dims[1], sizeof(NDDimension_t));
-                    memcpy(&pArrayOut->dims[1], &pArray->dims[0], sizeof(NDDimension_t));
-                    memcpy(&pArrayOut->dims[2], &pArray->dims[2], sizeof(NDDimension_t));
-                    changedColorMode = 1;
-                    break;
-                case NDColorModeRGB3:
-                    pArrayOut = this->pNDArrayPool->copy(pArray, NULL, 0);
-                    pDataOut = (epicsType *)pArrayOut->pData;
-                    pIn = pDataIn;
-                    pRedOut   = pDataOut;
-                    pGreenOut = pDataOut + imageSize;
-                    pBlueOut  = pDataOut + 2*imageSize;
-                    for (i=0; i<imageSize; i++) {
-                        *pRedOut++   = *pIn++;
-                        *pGreenOut++ = *pIn++;
-                        *pBlueOut++  = *pIn++;
-                    }
-                    memcpy(&pArrayOut->dims[0], &pArray->dims[1], sizeof(NDDimension_t));
-                    memcpy(&pArrayOut->dims[1], &pArray->dims[2], sizeof(NDDimension_t));
-                    memcpy(&pArrayOut->dims[2], &pArray->dims[0], sizeof(NDDimension_t));
-                    changedColorMode = 1;
-                    break;
-                default:
-                    break;
-            }        
-            break;
         case NDColorModeRGB2:
-            if (pArray->ndims != 3) break;
-            rowSize   = pArray->dims[0].size;
-            numRows   = pArray->dims[2].size;
-            imageSize = rowSize * numRows;
-            switch (colorModeOut) {
-                case NDColorModeMono:
-                    /* Make a new 2-D array */
-                    dims[0] = rowSize;
-                    dims[1] = numRows;
-                    pArrayOut = this->pNDArrayPool->alloc(2, dims, pArray->dataType, 0, NULL);
-                    /* Copy everything except the data, e.g. uniqueId and timeStamp, attributes. */
-                    this->pNDArrayPool->copy(pArray, pArrayOut, 0);
-                    /* That replaced the dimensions in the output array, need to fix. */
-                    pArrayOut->ndims = 2;
-                    pArrayOut->dims[1] = pArrayOut->dims[2];
-                    pDataOut = (epicsType *)pArrayOut->pData;
-                    pOut = pDataOut;
-                    for (i=0; i<numRows; i++) {
-                        pRedIn   = pDataIn + 3*i*rowSize;
-                        pGreenIn = pRedIn + rowSize;
-                        pBlueIn  = pRedIn + 2*rowSize;
-                        for (j=0; j<rowSize; j++) {
-                            value = (*pRedIn++ + *pGreenIn++ + *pBlueIn++)/3.;
-                            *pOut++ = (epicsType)value;
-                        }
-                    }
-                    changedColorMode = 1;
-                    break;
-                case NDColorModeRGB1:
-                    pArrayOut = this->pNDArrayPool->copy(pArray, NULL, 0);
-                    pDataOut = (epicsType *)pArrayOut->pData;
-                    pOut = pDataOut;
-                    for (i=0; i<numRows; i++) {
-                        pRedIn   = pDataIn + 3*i*rowSize;
-                        pGreenIn = pRedIn + rowSize;
-                        pBlueIn  = pRedIn + 2*rowSize;
-                        for (j=0; j<rowSize; j++) {
-                            *pOut++  = *pRedIn++;
-                            *pOut++  = *pGreenIn++;
-                            *pOut++  = *pBlueIn++;
-                        }
-                    }
-                    memcpy(&pArrayOut->dims[0], &pArray->dims[1], sizeof(NDDimension_t));
-                    memcpy(&pArrayOut->dims[1], &pArray->dims[0], sizeof(NDDimension_t));
-                    memcpy(&pArrayOut->dims[2], &pArray->dims[2], sizeof(NDDimension_t));
-                    changedColorMode = 1;
-                    break;
-                case NDColorModeRGB3:
-                    pArrayOut = this->pNDArrayPool->copy(pArray, NULL, 0);
-                    pDataOut = (epicsType *)pArrayOut->pData;
-                    pRedOut   = pDataOut;
-                    pGreenOut = pDataOut + imageSize;
-                    pBlueOut  = pDataOut + 2*imageSize;
-                    for (i=0; i<numRows; i++) {
-                        pRedIn   = pDataIn + 3*i*rowSize;
-                        pGreenIn = pRedIn + rowSize;
-                        pBlueIn  = pRedIn + 2*rowSize;
-                        for (j=0; j<rowSize; j++) {
-                            *pRedOut++   = *pRedIn++;
-                            *pGreenOut++ = *pGreenIn++;
-                            *pBlueOut++  = *pBlueIn++;
-                        }
-                    }
-                    memcpy(&pArrayOut->dims[0], &pArray->dims[0], sizeof(NDDimension_t));
-                    memcpy(&pArrayOut->dims[1], &pArray->dims[2], sizeof(NDDimension_t));
-                    memcpy(&pArrayOut->dims[2], &pArray->dims[1], sizeof(NDDimension_t));
-                    changedColorMode = 1;
-                    break;
-                default:
-                    break;
-            }        
-            break;
         case NDColorModeRGB3:
             if (pArray->ndims != 3) break;
-            rowSize   = pArray->dims[0].size;
-            numRows   = pArray->dims[1].size;
-            imageSize = rowSize * numRows;
-            switch (colorModeOut) {
-                case NDColorModeMono:
-                    /* Make a new 2-D array */
-                    dims[0] = rowSize;
-                    dims[1] = numRows;
-                    pArrayOut = this->pNDArrayPool->alloc(2, dims, pArray->dataType, 0, NULL);
-                    /* Copy everything except the data, e.g. uniqueId and timeStamp, attributes. */
-                    this->pNDArrayPool->copy(pArray, pArrayOut, 0);
-                    /* That replaced the dimensions in the output array, need to fix. */
-                    pArrayOut->ndims = 2;
-                    pDataOut = (epicsType *)pArrayOut->pData;
-                    pOut = pDataOut;
-                    pRedIn   = pDataIn;
-                    pGreenIn = pDataIn + imageSize;
-                    pBlueIn  = pDataIn + 2*imageSize;
-                    for (i=0; i<imageSize; i++) {
-                        value = (*pRedIn++ + *pGreenIn++ + *pBlueIn++)/3.;
-                        *pOut++ = (epicsType)value;
-                    }
-                    changedColorMode = 1;
-                    break;
-                case NDColorModeRGB1:
-                    pArrayOut = this->pNDArrayPool->copy(pArray, NULL, 0);
-                    pDataOut = (epicsType *)pArrayOut->pData;
-                    pRedIn   = pDataIn;
-                    pGreenIn = pDataIn + imageSize;
-                    pBlueIn  = pDataIn + 2*imageSize;
-                    pOut = pDataOut;
-                    for (i=0; i<imageSize; i++) {
-                        *pOut++ = *pRedIn++;
-                        *pOut++ = *pGreenIn++;
-                        *pOut++ = *pBlueIn++;
-                    }
-                    memcpy(&pArrayOut->dims[0], &pArray->dims[2], sizeof(NDDimension_t));
-                    memcpy(&pArrayOut->dims[1], &pArray->dims[0], sizeof(NDDimension_t));
-                    memcpy(&pArrayOut->dims[2], &pArray->dims[1], sizeof(NDDimension_t));
-                    changedColorMode = 1;
-                    break;
-                case NDColorModeRGB2:
-                    pArrayOut = this->pNDArrayPool->copy(pArray, NULL, 0);
-                    pDataOut = (epicsType *)pArrayOut->pData;
-                    pRedIn   = pDataIn;
-                    pGreenIn = pDataIn + imageSize;
-                    pBlueIn  = pDataIn + 2*imageSize;
-                    for (i=0; i<numRows; i++) {
-                        pRedOut   = pDataOut + 3*i*rowSize;
-                        pGreenOut = pRedOut + rowSize;
-                        pBlueOut  = pRedOut + 2*rowSize;
-                        for (j=0; j<rowSize; j++) {
-                            *pRedOut++   = *pRedIn++;
-                            *pGreenOut++ = *pGreenIn++;
-                            *pBlueOut++  = *pBlueIn++;
-                        }
-                    }
-                    memcpy(&pArrayOut->dims[0], &pArray->dims[0], sizeof(NDDimension_t));
-                    memcpy(&pArrayOut->dims[1], &pArray->dims[2], sizeof(NDDimension_t));
-                    memcpy(&pArrayOut->dims[2], &pArray->dims[1], sizeof(NDDimension_t));
-                    changedColorMode = 1;
-                    break;
-                default:
-                    break;
+            if (colorMode == NDColorModeRGB1) {
+                colorDim = pArray->dims[0];
+                xDim     = pArray->dims[1];
+                yDim     = pArray->dims[2];
+            } else if (colorMode == NDColorModeRGB2) {
+                xDim     = pArray->dims[0];
+                colorDim = pArray->dims[1];
+                yDim     = pArray->dims[2];
+            } else {
+                xDim     = pArray->dims[0];
+                yDim     = pArray->dims[1];
+                colorDim = pArray->dims[2];
+            }
+            if (colorDim.size != 3) break;
+            if (colorModeOut == NDColorModeMono) {
+                task.kind = colorConvertRGBToMono;
+                convert = 1;
+            } else if (((colorModeOut == NDColorModeRGB1) || (colorModeOut == NDColorModeRGB2) ||
+                        (colorModeOut == NDColorModeRGB3)) && (colorModeOut != colorMode)) {
+                task.kind = colorConvertRGBToRGB;
+                convert = 1;
+            }
+            break;
+        case NDColorModeYUV444:
+        case NDColorModeYUV422:
+        case NDColorModeYUV411:
+            /* YUV images are 8 bit arrays with the bytes of each row in dimension 0 */
+            if ((pArray->ndims != 2) || !is8Bit) break;
+            xDim = pArray->dims[0];
+            yDim = pArray->dims[1];
+            yuvRowBytes = xDim.size;
+            if (colorMode == NDColorModeYUV444) {
+                if (yuvRowBytes % 3) break;
+                xDim.size = yuvRowBytes/3;
+            } else if (colorMode == NDColorModeYUV422) {
+                if (yuvRowBytes % 4) break;
+                xDim.size = yuvRowBytes/2;
+            } else {
+                if (yuvRowBytes % 6) break;
+                xDim.size = yuvRowBytes*2/3;
+            }
+            if (colorModeOut == NDColorModeMono) {
+                task.kind = colorConvertYUVToMono;
+                convert = 1;
+            } else if ((colorModeOut == NDColorModeRGB1) || (colorModeOut == NDColorModeRGB2) ||
+                       (colorModeOut == NDColorModeRGB3)) {
+                task.kind = colorConvertYUVToRGB;
+                convert = 1;
             }
             break;
         default:
             break;
     }
+    if (convert) {
+        pArrayOut = allocOutput(pArray, colorModeOut, dataTypeOut, &xDim, &yDim, &colorDim);
+        if (!pArrayOut) {
+            asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                "%s:%s: error allocating output array\n",
+                driverName, functionName);
+            this->lock();
+            releaseFalseColorLUT(pFalseColorLUT);
+            freeSync(pSync);
+            return;
+        }
+        task.dataType     = pArray->dataType;
+        task.colorModeIn  = (NDColorMode_t)colorMode;
+        task.pIn          = pArray->pData;
+        task.pOut         = pArrayOut->pData;
+        task.rowSize      = xDim.size;
+        task.numRows      = yDim.size;
+        task.inLayout     = colorLayout((NDColorMode_t)colorMode, task.rowSize, task.numRows);
+        if (yuvRowBytes) task.inLayout.rowStride = yuvRowBytes;
+        task.outLayout    = colorLayout(colorModeOut, task.rowSize, task.numRows);
+        task.redX         = (bayerPattern == NDBayerGRBG) || (bayerPattern == NDBayerBGGR);
+        task.redY         = (bayerPattern == NDBayerGBRG) || (bayerPattern == NDBayerBGGR);
+        task.bayerMethod  = bayerMethod;
+        task.pColorMap    = pFalseColorLUT ? pFalseColorLUT->pEntries : NULL;
+        task.pScratch     = NULL;
+        task.pSync        = pSync;
+        if ((int)(task.numRows/MIN_ROWS_PER_BAND) < numBands) numBands = (int)(task.numRows/MIN_ROWS_PER_BAND);
+        if (numBands < 1) numBands = 1;
+        if (((task.kind == colorConvertBayerToRGB) || (task.kind == colorConvertYUVToRGB)) &&
+            (colorModeOut == NDColorModeRGB1)) {
+            pArrayOut->getInfo(&arrayInfo);
+            task.pScratch = malloc(numBands * 3 * task.rowSize * arrayInfo.bytesPerElement);
+            if (!task.pScratch) {
+                asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                    "%s:%s: error allocating scratch rows\n",
+                    driverName, functionName);
+                pArrayOut->release();
+                this->lock();
+                releaseFalseColorLUT(pFalseColorLUT);
+                freeSync(pSync);
+                return;
+            }
+        }
+        convertBands(&task, numBands);
+        free(task.pScratch);
+    }
     /* If the output array pointer is null then no conversion was done, copy the input to the output */
     if (!pArrayOut) pArrayOut = this->pNDArrayPool->copy(pArray, NULL, 1);
     this->lock();
+    releaseFalseColorLUT(pFalseColorLUT);
+    freeSync(pSync);
+    if (!pArrayOut) {
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+            "%s:%s: error allocating output array\n",
+            driverName, functionName);
+        return;
+    }
     /* Get the attributes for this plugin */
     this->getAttributes(pArrayOut->pAttributeList);
-    /* If we changed the color mode then set the attribute */
-    if (changedColorMode) pArrayOut->pAttributeList->add("ColorMode", "Color Mode", NDAttrInt32, &colorModeOut);
+    /* If we converted the color mode then set the attribute */
+    if (convert) pArrayOut->pAttributeList->add("ColorMode", "Color Mode", NDAttrInt32, &colorModeOut);
 
     // Do NDArray callbacks.  We don't need to copy the array or get the attributes
     NDPluginDriver::endProcessCallbacks(pArrayOut, false, false);
-    asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, 
-              "%s:%s: pArray->colorMode=%d, colorModeOut=%d, pArrayOut=%p\n",
-              driverName, functionName, colorMode, colorModeOut, pArrayOut);
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW,
+              "%s:%s: pArray->colorMode=%d, colorModeOut=%d, pArrayOut=%p, numBands=%d\n",
+              driverName, functionName, colorMode, colorModeOut, pArrayOut, numBands);
 }
 
 /** Callback function that is called by the NDArray driver with new NDArray data.
@@ -538,36 +1326,12 @@ void NDPluginColorConvert::processCallbacks(NDArray *pArray)
               "%s:%s: dataType=%d\n",
               driverName, functionName, pArray->dataType);
 
-    switch (pArray->dataType) {
-        case NDInt8:
-            this->convertColor<epicsInt8>(pArray);
-            break;
-        case NDUInt8:
-            this->convertColor<epicsUInt8>(pArray);
-            break;
-        case NDInt16:
-            this->convertColor<epicsInt16>(pArray);
-            break;
-        case NDUInt16:
-            this->convertColor<epicsUInt16>(pArray);
-            break;
-       case NDInt32:
-            this->convertColor<epicsInt32>(pArray);
-            break;
-        case NDUInt32:
-            this->convertColor<epicsUInt32>(pArray);
-            break;
-        case NDFloat32:
-            this->convertColor<epicsFloat32>(pArray);
-            break;
-        case NDFloat64:
-            this->convertColor<epicsFloat64>(pArray);
-            break;
-        default:
-            asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, 
-                      "%s:%s: ERROR: unknown data type=%d\n",
-                      driverName, functionName, pArray->dataType);
-            break;
+    if ((pArray->dataType >= NDInt8) && (pArray->dataType <= NDFloat64)) {
+        this->convertColor(pArray);
+    } else {
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, 
+                  "%s:%s: ERROR: unknown data type=%d\n",
+                  driverName, functionName, pArray->dataType);
     }
    
     callParamCallbacks();
@@ -603,17 +1367,26 @@ NDPluginColorConvert::NDPluginColorConvert(const char *portName, int queueSize,
                    NDArrayPort, NDArrayAddr, 1, maxBuffers, maxMemory,
                    asynGenericPointerMask, 
                    asynGenericPointerMask,
-                   0, 1, priority, stackSize, maxThreads)  /* Not ASYN_CANBLOCK or ASYN_MULTIDEVICE, do autoConnect */
+                   0, 1, priority, stackSize, maxThreads),  /* Not ASYN_CANBLOCK or ASYN_MULTIDEVICE, do autoConnect */
+      pBandMsgQ_(NULL), bandExitEvent_(0), numBandThreads_(0), pFreeSync_(NULL), pFalseColorLUT_(NULL)
 {
     //static const char *functionName = "NDPluginColorConvert";
 
     createParam(NDPluginColorConvertColorModeOutString, asynParamInt32, &NDPluginColorConvertColorModeOut);
     createParam(NDPluginColorConvertFalseColorString,   asynParamInt32, &NDPluginColorConvertFalseColor);    
+    createParam(NDPluginColorConvertFalseColorMinString, asynParamInt32, &NDPluginColorConvertFalseColorMin);
+    createParam(NDPluginColorConvertFalseColorMaxString, asynParamInt32, &NDPluginColorConvertFalseColorMax);
+    createParam(NDPluginColorConvertBayerMethodString,  asynParamInt32, &NDPluginColorConvertBayerMethod);
+    createParam(NDPluginColorConvertBandThreadsString,  asynParamInt32, &NDPluginColorConvertBandThreads);
 
     /* Set the plugin type string */    
     setStringParam(NDPluginDriverPluginType, "NDPluginColorConvert");
     
     setIntegerParam(NDPluginColorConvertColorModeOut, NDColorModeMono);
+    setIntegerParam(NDPluginColorConvertFalseColorMin, 0);
+    setIntegerParam(NDPluginColorConvertFalseColorMax, 255);
+    setIntegerParam(NDPluginColorConvertBayerMethod, NDBayerMethodBilinear);
+    setIntegerParam(NDPluginColorConvertBandThreads, 1);
 
     // Enable ArrayCallbacks.  
     // This plugin currently ignores this setting and always does callbacks, so make the setting reflect the behavior
@@ -623,6 +1396,29 @@ NDPluginColorConvert::NDPluginColorConvert(const char *portName, int queueSize,
     connectToArrayPort();
 }
 
+NDPluginColorConvert::~NDPluginColorConvert()
+{
+    colorConvertBand_t band;
+    NDColorConvertSync *pSync;
+    int i;
+
+    releaseFalseColorLUT(pFalseColorLUT_);
+    while (pFreeSync_) {
+        pSync = pFreeSync_;
+        pFreeSync_ = pSync->pNext;
+        delete pSync;
+    }
+    if (!pBandMsgQ_) return;
+    /* Stop the band threads one at a time, each one signals bandExitEvent_ when it exits */
+    memset(&band, 0, sizeof(band));
+    for (i=0; i<numBandThreads_; i++) {
+        pBandMsgQ_->send(&band, sizeof(band));
+        epicsEventWait(bandExitEvent_);
+    }
+    delete pBandMsgQ_;
+    epicsEventDestroy(bandExitEvent_);
+}
+
 extern "C" int NDColorConvertConfigure(const char *portName, int queueSize, int blockingCallbacks, 
                                           const char *NDArrayPort, int NDArrayAddr, 
                                           int maxBuffers, size_t maxMemory,
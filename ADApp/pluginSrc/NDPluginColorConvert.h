@@ -2,11 +2,29 @@
 #define NDPluginColorConvert_H
 
 #include <epicsTypes.h>
+#include <epicsEvent.h>
 
 #include "NDPluginDriver.h"
 
 #define NDPluginColorConvertColorModeOutString  "COLOR_MODE_OUT" /* (NDColorMode_t r/w) Output color mode */
 #define NDPluginColorConvertFalseColorString    "FALSE_COLOR"    /* (NDColorMode_t r/w) Output color mode */
+#define NDPluginColorConvertFalseColorMinString "FALSE_COLOR_MIN" /* (asynInt32 r/w) Pixel value mapped to the first false color */
+#define NDPluginColorConvertFalseColorMaxString "FALSE_COLOR_MAX" /* (asynInt32 r/w) Pixel value mapped to the last false color */
+#define NDPluginColorConvertBayerMethodString   "BAYER_METHOD"   /* (NDBayerMethod_t r/w) Bayer demosaic method */
+#define NDPluginColorConvertBandThreadsString   "BAND_THREADS"   /* (asynInt32 r/w) Number of threads converting each array */
+
+/** The maximum number of row bands that one array is split into */
+#define MAX_COLOR_CONVERT_BANDS 64
+
+/** Methods used to interpolate the missing colors of Bayer images */
+typedef enum {
+    NDBayerMethodBilinear,  /**< Average of the nearest pixels of each color */
+    NDBayerMethodEdgeAware  /**< Green is interpolated along the direction with the smaller gradient */
+} NDBayerMethod_t;
+
+struct NDColorConvertTask;
+struct NDColorConvertSync;
+struct NDFalseColorLUT;
 
 /** Convert NDArrays from one NDColorMode to another.
   * This plugin is as source of NDArray callbacks, passing the (possibly converted) NDArray
@@ -15,32 +33,57 @@
   * <ul>
   *  <li> Mono to RGB1, RGB2 or RGB3 </li>
   *  <li> RGB1, RGB2 or RGB3 to mono</li>
-  *  <li> Bayer color to RGB1, RGB2 or RGB3 (Windows and Linux only)</li>
+  *  <li> Bayer color to RGB1, RGB2 or RGB3 </li>
   *  <li> RGB1 to RGB2 or RGB3 </li> 
   *  <li> RGB2 to RGB1 or RGB3 </li> 
   *  <li> RGB3 to RGB1 or RGB2 </li> 
+  *  <li> YUV444, YUV422 or YUV411 to mono, RGB1, RGB2 or RGB3 </li>
   * </ul> 
-  * It also applies a false color map if requested for 8 bit data  
+  * It also applies a false color map if requested for 8 and 16 bit mono data, scaling the
+  * range FalseColorMin to FalseColorMax to the color map.  
   * If the conversion required by the input color mode and output color mode are not
-  * in this supported list then the NDArray is passed on without conversion. */
+  * in this supported list then the NDArray is passed on without conversion.
+  * Each array can be converted by several threads, each converting a band of rows. */
 class epicsShareClass NDPluginColorConvert : public NDPluginDriver {
 public:
     NDPluginColorConvert(const char *portName, int queueSize, int blockingCallbacks, 
                          const char *NDArrayPort, int NDArrayAddr,
                          int maxBuffers, size_t maxMemory,
                          int priority, int stackSize, int maxThreads);
+    ~NDPluginColorConvert();
 
     /* These methods override the virtual methods in the base class */
     void processCallbacks(NDArray *pArray);
 
+    /* These methods are new to this class */
+    void bandTask();
+
 protected:
     int NDPluginColorConvertColorModeOut;
     #define FIRST_NDPLUGIN_COLOR_CONVERT_PARAM NDPluginColorConvertColorModeOut
     int NDPluginColorConvertFalseColor;    
+    int NDPluginColorConvertFalseColorMin;
+    int NDPluginColorConvertFalseColorMax;
+    int NDPluginColorConvertBayerMethod;
+    int NDPluginColorConvertBandThreads;
 
 private:
     /* These methods are just for this class */
-    template <typename epicsType> void convertColor(NDArray *pArray);
+    void convertColor(NDArray *pArray);
+    NDArray *allocOutput(NDArray *pArray, NDColorMode_t colorModeOut, NDDataType_t dataTypeOut,
+                         const NDDimension_t *pXDim, const NDDimension_t *pYDim, const NDDimension_t *pColorDim);
+    NDFalseColorLUT *getFalseColorLUT(int falseColor, NDDataType_t dataType, int minValue, int maxValue);
+    void releaseFalseColorLUT(NDFalseColorLUT *pLUT);
+    void convertBands(NDColorConvertTask *pTask, int numBands);
+    NDColorConvertSync *allocSync();
+    void freeSync(NDColorConvertSync *pSync);
+    asynStatus createBandThreads(int numThreads);
+
+    epicsMessageQueue *pBandMsgQ_;
+    epicsEventId bandExitEvent_;
+    int numBandThreads_;
+    NDColorConvertSync *pFreeSync_;
+    NDFalseColorLUT *pFalseColorLUT_;
 };
  
 #endif
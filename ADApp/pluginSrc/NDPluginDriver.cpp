@@ -24,6 +24,7 @@
 
 #include <epicsExport.h>
 #include "NDPluginDriver.h"
+#include "NDAtomic.h"
 
 typedef enum {
     ToThreadMessageData,
@@ -98,6 +99,7 @@ NDPluginDriver::NDPluginDriver(const char *portName, int queueSize, int blocking
     firstOutputArray_(true),
     pToThreadMsgQ_(NULL),
     pFromThreadMsgQ_(NULL),
+    queueFree_(0),
     prevUniqueId_(-1000),
     sortingThreadId_(0)  
 {
@@ -154,6 +156,7 @@ NDPluginDriver::NDPluginDriver(const char *portName, int queueSize, int blocking
     setIntegerParam(NDPluginDriverDroppedOutputArrays, 0);
     setIntegerParam(NDPluginDriverQueueSize, queueSize);
     setIntegerParam(NDPluginDriverQueueFree, queueSize);
+    ndAtomicSet(&queueFree_, queueSize);
     setIntegerParam(NDPluginDriverMaxThreads, maxThreads);
     setIntegerParam(NDPluginDriverNumThreads, 1);
     setIntegerParam(NDPluginDriverBlockingCallbacks, blockingCallbacks);
@@ -323,6 +326,24 @@ extern "C" {static void driverCallback(void *drvPvt, asynUser *pasynUser, void *
     pNDPluginDriver->driverCallback(pasynUser, genericPointer);
 }}
 
+/** Returns the plugin that registered an asynGenericPointer interrupt callback.
+  * This lets a plugin that does the callbacks itself, such as NDPluginScatter, find out about
+  * the state of the plugins that it calls.
+  * \param[in] pInterrupt The interrupt from the list of asynGenericPointer clients.
+  * \return Returns the plugin, or NULL if the client is not an NDPluginDriver. */
+NDPluginDriver *NDPluginDriver::getCallbackPlugin(asynGenericPointerInterrupt *pInterrupt)
+{
+    if (pInterrupt->callback != ::driverCallback) return NULL;
+    return (NDPluginDriver *)pInterrupt->userPvt;
+}
+
+/** Returns the number of free elements in the input queue (NDPluginDriverQueueFree).
+  * This method does not take the lock, so it does not wait for processCallbacks. */
+int NDPluginDriver::getQueueFree()
+{
+    return ndAtomicGet(&queueFree_);
+}
+
 /** Method that is called from the driver with a new NDArray.
   * It calls the processCallbacks function, which typically is implemented in the
   * derived class.
@@ -381,6 +402,7 @@ void NDPluginDriver::driverCallback(asynUser *pasynUser, void *genericPointer)
             status = pToThreadMsgQ_->trySend(&msg, sizeof(msg));
             queueFree = queueSize - pToThreadMsgQ_->pending();
             setIntegerParam(NDPluginDriverQueueFree, queueFree);
+            ndAtomicSet(&queueFree_, queueFree);
             if (status) {
                 pasynUser->auxStatus = asynOverflow;
                 if (!ignoreQueueFull) {
@@ -460,6 +482,7 @@ void NDPluginDriver::processTask()
         getIntegerParam(NDPluginDriverQueueSize, &queueSize);
         queueFree = queueSize - pToThreadMsgQ_->pending();
         setIntegerParam(NDPluginDriverQueueFree, queueFree);
+        ndAtomicSet(&queueFree_, queueFree);
 
         /* Call the function that does the business of this callback.
          * This function should release the lock during time-consuming operations,
@@ -917,6 +940,7 @@ asynStatus NDPluginDriver::createCallbackThreads()
     }
     getIntegerParam(NDPluginDriverEnableCallbacks, &enableCallbacks);
     setIntegerParam(NDPluginDriverQueueFree, queueSize);
+    ndAtomicSet(&queueFree_, queueSize);
     if (enableCallbacks) this->setArrayInterrupt(1);
     return (asynStatus) status;
 }
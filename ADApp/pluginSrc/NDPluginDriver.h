@@ -70,6 +70,8 @@ public:
     virtual void run(void);
     virtual asynStatus start(void);
     void sortingTask();
+    int getQueueFree();
+    static NDPluginDriver *getCallbackPlugin(asynGenericPointerInterrupt *pInterrupt);
 
 protected:
     virtual void processCallbacks(NDArray *pArray) = 0;
@@ -123,6 +125,7 @@ private:
     std::vector<epicsThread*>pThreads_;
     epicsMessageQueue *pToThreadMsgQ_;
     epicsMessageQueue *pFromThreadMsgQ_;
+    int queueFree_;                              /**< Copy of NDPluginDriverQueueFree that getQueueFree() reads without the lock */
     std::multiset<sortedListElement> sortedNDArrayList_;
     int prevUniqueId_;
     epicsThreadId sortingThreadId_;
@@ -26,9 +26,9 @@
 #include <epicsExport.h>
 
 #include "NDPluginFFT.h"
-#include "fft.h"
 
 #define MIN(A,B) ((A <= B) ? A : B)
+#define MAX(A,B) ((A >= B) ? A : B)
 
 //static const char *driverName = "NDPluginFFT";
 
@@ -60,7 +60,7 @@ NDPluginFFT::NDPluginFFT(const char *portName, int queueSize, int blockingCallba
              asynFloat64Mask | asynFloat64ArrayMask | asynGenericPointerMask,
              asynFloat64Mask | asynFloat64ArrayMask | asynGenericPointerMask,
              0, 1, priority, stackSize, maxThreads),
-    uniqueId_(0), FFTAbsValue_(0), timePerPoint_(0), timeAxis_(0), freqAxis_(0)
+    uniqueId_(0), nTimeXIn_(0), nTimeYIn_(0), zeroPad_(-1), FFTAbsValue_(0), timePerPoint_(0), timeAxis_(0), freqAxis_(0)
 {
   //const char *functionName = "NDPluginFFT::NDPluginFFT";
 
@@ -69,6 +69,7 @@ NDPluginFFT::NDPluginFFT(const char *portName, int queueSize, int blockingCallba
   createParam(FFTTimePerPointString,          asynParamFloat64, &P_FFTTimePerPoint);
   createParam(FFTDirectionString,               asynParamInt32, &P_FFTDirection);
   createParam(FFTSuppressDCString,              asynParamInt32, &P_FFTSuppressDC);
+  createParam(FFTZeroPadString,                 asynParamInt32, &P_FFTZeroPad);
   createParam(FFTNumAverageString,              asynParamInt32, &P_FFTNumAverage);
   createParam(FFTNumAveragedString,             asynParamInt32, &P_FFTNumAveraged);
   createParam(FFTResetAverageString,            asynParamInt32, &P_FFTResetAverage);
@@ -78,6 +79,8 @@ NDPluginFFT::NDPluginFFT(const char *portName, int queueSize, int blockingCallba
   createParam(FFTImaginaryString,        asynParamFloat64Array, &P_FFTImaginary);
   createParam(FFTAbsValueString,         asynParamFloat64Array, &P_FFTAbsValue);
  
+  setIntegerParam(P_FFTZeroPad, 1);
+
   /* Set the plugin type string */
   setStringParam(NDPluginDriverPluginType, "NDPluginFFT");
   
@@ -102,21 +105,37 @@ int NDPluginFFT::nextPow2(int v)
 
 void NDPluginFFT::allocateArrays(fftPvt_t *pPvt, bool sizeChanged)
 {
-  // Round dimensions up to next power of 2
-  pPvt->nTimeX = nextPow2(pPvt->nTimeXIn);
-  pPvt->nTimeY = nextPow2(pPvt->nTimeYIn);
+  if (pPvt->zeroPad) {
+    // Round dimensions up to next power of 2
+    pPvt->nTimeX = nextPow2(pPvt->nTimeXIn);
+    pPvt->nTimeY = nextPow2(pPvt->nTimeYIn);
+  } else {
+    // The FFT plans handle any length directly
+    pPvt->nTimeX = pPvt->nTimeXIn;
+    pPvt->nTimeY = pPvt->nTimeYIn;
+  }
 
   pPvt->nFreqX = pPvt->nTimeX / 2;
   pPvt->nFreqY = pPvt->nTimeY / 2;
   if (pPvt->nFreqY < 1) pPvt->nFreqY = 1;
 
+  // The plans are cached, so the twiddle factors are only computed the first time a size is used
+  pPvt->pRowPlan    = NDFFTRealPlan::get(pPvt->nTimeX, 1);
+  pPvt->pColumnPlan = NDFFTPlan::get(pPvt->nTimeY, 1);
+
   size_t timeSize = pPvt->nTimeX * pPvt->nTimeY;
+  size_t complexSize = 2 * pPvt->pRowPlan->outputSize() * pPvt->nTimeY; // Complex data
   size_t freqSize = pPvt->nFreqX * pPvt->nFreqY;
-  pPvt->timeSeries   = (double *)calloc(timeSize, sizeof(double));
-  pPvt->FFTComplex   = (double *)calloc(timeSize, sizeof(double) * 2); // Complex data
-  pPvt->FFTReal      = (double *)calloc(freqSize, sizeof(double));
-  pPvt->FFTImaginary = (double *)calloc(freqSize, sizeof(double));
-  pPvt->FFTAbsValue  = (double *)calloc(freqSize, sizeof(double));
+  size_t workSize = MAX(pPvt->pRowPlan->workSize(),
+                        pPvt->pColumnPlan->workSize(pPvt->pRowPlan->outputSize()));
+  // One allocation for all of the buffers used for this array
+  pPvt->buffer       = (double *)calloc(timeSize + complexSize + 3*freqSize + workSize, sizeof(double));
+  pPvt->timeSeries   = pPvt->buffer;
+  pPvt->FFTComplex   = pPvt->timeSeries + timeSize;
+  pPvt->FFTReal      = pPvt->FFTComplex + complexSize;
+  pPvt->FFTImaginary = pPvt->FFTReal + freqSize;
+  pPvt->FFTAbsValue  = pPvt->FFTImaginary + freqSize;
+  pPvt->work         = pPvt->FFTAbsValue + freqSize;
   if (sizeChanged) {
     if (FFTAbsValue_) {
       free(FFTAbsValue_);
@@ -132,11 +151,7 @@ void NDPluginFFT::computeFFT_1D(fftPvt_t *pPvt)
 {
   int j;
 
-  for (j=0; j<pPvt->nTimeX; j++) {
-    pPvt->FFTComplex[2*j] = pPvt->timeSeries[j];
-    pPvt->FFTComplex[2*j+1] = 0.;
-  }
-  fft_1D(pPvt->FFTComplex, pPvt->nTimeX, 1);
+  pPvt->pRowPlan->execute(pPvt->timeSeries, pPvt->FFTComplex, 1, pPvt->work);
   for (j=0; j<pPvt->nFreqX; j++) {
     pPvt->FFTReal     [j] = pPvt->FFTComplex[2*j]; 
     pPvt->FFTImaginary[j] = pPvt->FFTComplex[2*j+1]; 
@@ -154,18 +169,15 @@ void NDPluginFFT::computeFFT_2D(fftPvt_t *pPvt)
 {
   int i,j, k;
   double *pIn;
-  unsigned long dims[2];
- 
-  for (j=0; j<pPvt->nTimeX*pPvt->nTimeY; j++) {
-    pPvt->FFTComplex[2*j] = pPvt->timeSeries[j];
-    pPvt->FFTComplex[2*j+1] = 0.;
-  }
-  dims[0] = pPvt->nTimeX;
-  dims[1] = pPvt->nTimeY;
-  fft_ND(pPvt->FFTComplex, dims, 2, 1);
+  int nRowOut = pPvt->pRowPlan->outputSize();
+
+  // Real transforms of all of the rows, then the columns of the result as one batch.
+  // Only the nTimeX/2+1 non-redundant columns of the row transforms need to be transformed.
+  pPvt->pRowPlan->execute(pPvt->timeSeries, pPvt->FFTComplex, pPvt->nTimeY, pPvt->work);
+  pPvt->pColumnPlan->execute(pPvt->FFTComplex, nRowOut, pPvt->work);
   for (i=0, k=0, pIn=pPvt->FFTComplex; 
        i<pPvt->nFreqY; 
-       i++, pIn+=pPvt->nTimeX*2) {
+       i++, pIn+=nRowOut*2) {
     for (j=0; j<pPvt->nFreqX; j++, k++) {
       pPvt->FFTReal     [k] = pIn[j*2]; 
       pPvt->FFTImaginary[k] = pIn[j*2+1]; 
@@ -234,11 +246,7 @@ void NDPluginFFT::doArrayCallbacks(fftPvt_t *pPvt)
   doCallbacksFloat64Array(pPvt->FFTReal,      pPvt->nFreqX, P_FFTReal,       0);
   doCallbacksFloat64Array(pPvt->FFTImaginary, pPvt->nFreqX, P_FFTImaginary,  0);
   doCallbacksFloat64Array(FFTAbsValue_,       MIN(pPvt->nFreqX, nFreqX_), P_FFTAbsValue,   0);
-  free(pPvt->timeSeries);
-  free(pPvt->FFTComplex);
-  free(pPvt->FFTReal);
-  free(pPvt->FFTImaginary);
-  free(pPvt->FFTAbsValue);
+  free(pPvt->buffer);
 }
 
 void NDPluginFFT::createAxisArrays(fftPvt_t *pPvt)
@@ -295,7 +303,8 @@ void NDPluginFFT::processCallbacks(NDArray *pArray)
   //It unlocks it during long calculations when private structures don't need to be protected.
 
   double timePerPoint;
-  fftPvt_t *pPvt = new fftPvt_t;
+  fftPvt_t fftPvt;
+  fftPvt_t *pPvt = &fftPvt;
   bool sizeChanged = false;  
   const char* functionName = "NDPluginFFT::processCallbacks";
 
@@ -322,15 +331,18 @@ void NDPluginFFT::processCallbacks(NDArray *pArray)
       break;
   }
 
+  getIntegerParam(P_FFTSuppressDC, &pPvt->suppressDC);
+  getIntegerParam(P_FFTZeroPad, &pPvt->zeroPad);
+
   if ((pPvt->nTimeXIn != nTimeXIn_) ||
-      (pPvt->nTimeYIn != nTimeYIn_)) {
+      (pPvt->nTimeYIn != nTimeYIn_) ||
+      (pPvt->zeroPad != zeroPad_)) {
     sizeChanged = true;
     nTimeXIn_ = pPvt->nTimeXIn;
     nTimeYIn_ = pPvt->nTimeYIn;
+    zeroPad_ = pPvt->zeroPad;
   }
 
-  getIntegerParam(P_FFTSuppressDC, &pPvt->suppressDC);
-
   allocateArrays(pPvt, sizeChanged);
   getDoubleParam(P_FFTTimePerPoint, &timePerPoint);
   if (timePerPoint != timePerPoint_) {
@@ -374,7 +386,6 @@ void NDPluginFFT::processCallbacks(NDArray *pArray)
   // Take the lock again
   this->lock();
   doArrayCallbacks(pPvt);
-  delete pPvt;
   callParamCallbacks();
 }
 
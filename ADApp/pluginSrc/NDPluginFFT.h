@@ -14,12 +14,14 @@
 #include <epicsTime.h>
 
 #include "NDPluginDriver.h"
+#include "NDFFTPlan.h"
 
 #define FFTTimeAxisString        "FFT_TIME_AXIS"        /* (asynFloat64Array, r/o) Time axis array */
 #define FFTFreqAxisString        "FFT_FREQ_AXIS"        /* (asynFloat64Array, r/o) Frequency axis array */
 #define FFTTimePerPointString    "FFT_TIME_PER_POINT"   /* (asynFloat64,      r/o) Time per time point from driver */
 #define FFTDirectionString       "FFT_DIRECTION"        /* (asynInt32,        r/w) FFT direction */
 #define FFTSuppressDCString      "FFT_SUPPRESS_DC"      /* (asynInt32,        r/w) FFT DC offset suppression */
+#define FFTZeroPadString         "FFT_ZERO_PAD"         /* (asynInt32,        r/w) Zero pad to a power of 2 */
 #define FFTNumAverageString      "FFT_NUM_AVERAGE"      /* (asynInt32,        r/w) # of FFTs to average */
 #define FFTNumAveragedString     "FFT_NUM_AVERAGED"     /* (asynInt32,        r/o) # of FFTs averaged */
 #define FFTResetAverageString    "FFT_RESET_AVERAGE"    /* (asynInt32,        r/w) Reset FFT average */
@@ -37,7 +39,12 @@ typedef struct {
   int nFreqX;
   int nFreqY;
   int suppressDC;
+  int zeroPad;
   int numAverage;
+  const NDFFTRealPlan *pRowPlan;
+  const NDFFTPlan *pColumnPlan;
+  double *buffer;
+  double *work;
   double *timeSeries;
   double *FFTComplex;
   double *FFTReal;
@@ -64,6 +71,7 @@ protected:
   int P_FFTTimePerPoint;
   int P_FFTDirection;
   int P_FFTSuppressDC;
+  int P_FFTZeroPad;
   int P_FFTNumAverage;
   int P_FFTNumAveraged;
   int P_FFTResetAverage;
@@ -86,6 +94,7 @@ private:
   int uniqueId_;
   int nTimeXIn_;
   int nTimeYIn_;
+  int zeroPad_;
   // Note FFTAbsValue_ is guaranteed to be size nFreqX_ * nFreqY_
   // These could change between when a thread began computing the FFT and when it does the callbacks
   int nFreqX_;
@@ -13,6 +13,7 @@
 #include <epicsTypes.h>
 #include <epicsMessageQueue.h>
 #include <epicsThread.h>
+#include <epicsEvent.h>
 #include <epicsTime.h>
 #include <iocsh.h>
 
@@ -24,6 +25,12 @@
 
 static const char *driverName="NDPluginGather";
 
+static void dropTaskC(void *drvPvt)
+{
+    NDPluginGather *pPvt = (NDPluginGather *)drvPvt;
+    pPvt->dropTask();
+}
+
 /** Constructor for NDPluginGather; most parameters are simply passed to NDPluginDriver::NDPluginDriver.
   *
   * \param[in] portName The name of the asyn port driver to be created.
@@ -51,14 +58,25 @@ NDPluginGather::NDPluginGather(const char *portName, int queueSize, int blocking
                    asynInt32Mask | asynFloat64Mask | asynGenericPointerMask,
                    asynInt32Mask | asynFloat64Mask | asynGenericPointerMask,
                    ASYN_MULTIDEVICE, 1, priority, stackSize, 1),
-    maxPorts_(maxPorts)
+    maxPorts_(maxPorts), numConnected_(0)
 {
     int i;
     NDGatherNDArraySource_t *pArraySrc;
     //static const char *functionName = "NDPluginGather";
 
+    createParam(NDPluginGatherModeString,           asynParamInt32,   &NDPluginGatherMode);
+    createParam(NDPluginGatherGroupTimeoutString,   asynParamFloat64, &NDPluginGatherGroupTimeout);
+    createParam(NDPluginGatherGroupsCompleteString, asynParamInt32,   &NDPluginGatherGroupsComplete);
+    createParam(NDPluginGatherGroupsDroppedString,  asynParamInt32,   &NDPluginGatherGroupsDropped);
+    createParam(NDPluginGatherGroupsPendingString,  asynParamInt32,   &NDPluginGatherGroupsPending);
+
     /* Set the plugin type string */
     setStringParam(NDPluginDriverPluginType, "NDPluginGather");
+    setIntegerParam(NDPluginGatherMode, NDGatherModeImmediate);
+    setDoubleParam(NDPluginGatherGroupTimeout, 1.0);
+    setIntegerParam(NDPluginGatherGroupsComplete, 0);
+    setIntegerParam(NDPluginGatherGroupsDropped, 0);
+    setIntegerParam(NDPluginGatherGroupsPending, 0);
     
     if (maxPorts_ < 1) maxPorts_ = 1;
     NDArraySrc_ = (NDGatherNDArraySource_t *)calloc(sizeof(NDGatherNDArraySource_t), maxPorts_);
@@ -69,6 +87,55 @@ NDPluginGather::NDPluginGather(const char *portName, int queueSize, int blocking
         pArraySrc->pasynUserGenericPointer->userPvt = this;
         pArraySrc->pasynUserGenericPointer->reason = NDArrayData;
     }
+
+    /* Start the task that drops incomplete groups when no more arrays arrive */
+    exiting_ = false;
+    dropEvent_ = epicsEventMustCreate(epicsEventEmpty);
+    dropExitEvent_ = epicsEventMustCreate(epicsEventEmpty);
+    epicsThreadCreate("NDPluginGatherDrop", epicsThreadPriorityLow,
+                      epicsThreadGetStackSize(epicsThreadStackMedium),
+                      (EPICSTHREADFUNC)dropTaskC, this);
+}
+
+NDPluginGather::~NDPluginGather()
+{
+    this->lock();
+    exiting_ = true;
+    this->unlock();
+    epicsEventSignal(dropEvent_);
+    epicsEventWait(dropExitEvent_);
+    epicsEventDestroy(dropEvent_);
+    epicsEventDestroy(dropExitEvent_);
+    this->lock();
+    dropGroups(true);
+    this->unlock();
+}
+
+/** Drops the incomplete groups that have waited for longer than GroupTimeout, so that their
+  * arrays are released when acquisition stops before the groups are complete.
+  * addToGroup() also drops them, this task is needed when no more arrays arrive.
+  */
+void NDPluginGather::dropTask()
+{
+    double timeout;
+    double delay;
+
+    this->lock();
+    while (!exiting_) {
+        if (!groups_.empty()) {
+            dropGroups(false);
+            callParamCallbacks();
+        }
+        getDoubleParam(NDPluginGatherGroupTimeout, &timeout);
+        delay = (timeout > 0.) ? timeout/2. : 1.0;
+        if (delay < 0.01) delay = 0.01;
+        if (delay > 1.0) delay = 1.0;
+        this->unlock();
+        epicsEventWaitWithTimeout(dropEvent_, delay);
+        this->lock();
+    }
+    this->unlock();
+    epicsEventSignal(dropExitEvent_);
 }
 
 
@@ -79,7 +146,9 @@ extern "C" {static void driverCallback(void *drvPvt, asynUser *pasynUser, void *
 }}
 
 
-/** 
+/** Callback function that is called by the NDArray driver with new NDArray data.
+  * In Immediate mode the array is passed on at once, in Group mode it is held until an array
+  * with the same UniqueId has arrived from each connected port.
   * \param[in] pArray  The NDArray from the callback.
   */
 void NDPluginGather::processCallbacks(NDArray *pArray)
@@ -87,12 +156,118 @@ void NDPluginGather::processCallbacks(NDArray *pArray)
     /* This function is called with the mutex already locked.  It unlocks it during long calculations when private
     * structures don't need to be protected. 
     */
+    int mode;
     //static const char *functionName = "processCallbacks";
 
     /* Call the base class method */
     NDPluginDriver::beginProcessCallbacks(pArray);
 
-    NDPluginDriver::endProcessCallbacks(pArray, true, true);
+    getIntegerParam(NDPluginGatherMode, &mode);
+    if ((mode == NDGatherModeGroup) && (numConnected_ > 1)) {
+        addToGroup(pArray);
+    } else {
+        sendArray(pArray);
+    }
+    callParamCallbacks();
+}
+
+/** Passes an array to the downstream plugins.
+  * Neither this plugin nor the downstream plugins modify the array, so unless this plugin
+  * has attributes of its own to add the original array is passed on by reference.
+  * Otherwise the array is copied, which only copies the attributes by reference
+  * because they are shared copy-on-write.
+  * The caller keeps its own reference to the array.
+  * \param[in] pArray  The NDArray.
+  */
+void NDPluginGather::sendArray(NDArray *pArray)
+{
+    if (this->pAttributeList->count() == 0) {
+        /* The reference is kept in pArrays[0] by endProcessCallbacks */
+        pArray->reserve();
+        NDPluginDriver::endProcessCallbacks(pArray, false, false);
+    } else {
+        NDPluginDriver::endProcessCallbacks(pArray, true, true);
+    }
+}
+
+/** Adds an array to the group with its UniqueId, and sends the group if it is complete.
+  * The groups are only checked for being complete by counting the arrays, so each port
+  * must only send one array with each UniqueId.
+  * \param[in] pArray  The NDArray.
+  */
+void NDPluginGather::addToGroup(NDArray *pArray)
+{
+    NDGatherGroup_t *pGroup;
+    std::vector<NDArray *> arrays;
+    int groupsComplete;
+    size_t i;
+
+    dropGroups(false);
+    pGroup = &groups_[pArray->uniqueId];
+    if (pGroup->arrays.empty()) epicsTimeGetCurrent(&pGroup->firstTime);
+    pArray->reserve();
+    pGroup->arrays.push_back(pArray);
+    if ((int)pGroup->arrays.size() >= numConnected_) {
+        /* Remove the group before sending it because the lock is released during the callbacks */
+        arrays.swap(pGroup->arrays);
+        groups_.erase(pArray->uniqueId);
+        for (i=0; i<arrays.size(); i++) {
+            sendArray(arrays[i]);
+            arrays[i]->release();
+        }
+        getIntegerParam(NDPluginGatherGroupsComplete, &groupsComplete);
+        setIntegerParam(NDPluginGatherGroupsComplete, groupsComplete+1);
+    }
+    setIntegerParam(NDPluginGatherGroupsPending, (int)groups_.size());
+}
+
+/** Drops incomplete groups, releasing their arrays.
+  * \param[in] all If true all groups are dropped, otherwise only those that have been waiting
+  *            for longer than GroupTimeout.  A GroupTimeout of 0 means wait forever.
+  */
+void NDPluginGather::dropGroups(bool all)
+{
+    std::map<int, NDGatherGroup_t>::iterator it;
+    epicsTimeStamp now;
+    double timeout;
+    int groupsDropped;
+    size_t i;
+
+    getDoubleParam(NDPluginGatherGroupTimeout, &timeout);
+    if (!all && (timeout <= 0.)) return;
+    getIntegerParam(NDPluginGatherGroupsDropped, &groupsDropped);
+    epicsTimeGetCurrent(&now);
+    for (it=groups_.begin(); it!=groups_.end();) {
+        if (all || (epicsTimeDiffInSeconds(&now, &it->second.firstTime) > timeout)) {
+            for (i=0; i<it->second.arrays.size(); i++) it->second.arrays[i]->release();
+            groups_.erase(it++);
+            groupsDropped++;
+        } else {
+            ++it;
+        }
+    }
+    setIntegerParam(NDPluginGatherGroupsDropped, groupsDropped);
+    setIntegerParam(NDPluginGatherGroupsPending, (int)groups_.size());
+}
+
+/** Called when asyn clients call pasynInt32->write().
+  * Changing the mode drops any incomplete groups.
+  * For other parameters it calls NDPluginDriver::writeInt32.
+  * \param[in] pasynUser pasynUser structure that encodes the reason and address.
+  * \param[in] value Value to write. */
+asynStatus NDPluginGather::writeInt32(asynUser *pasynUser, epicsInt32 value)
+{
+    int function = pasynUser->reason;
+    asynStatus status = asynSuccess;
+
+    if (function == NDPluginGatherMode) {
+        setIntegerParam(function, value);
+        dropGroups(true);
+        callParamCallbacks();
+    } else {
+        status = NDPluginDriver::writeInt32(pasynUser, value);
+    }
+    return status;
 }
 
 /** Register or unregister to receive asynGenericPointer (NDArray) callbacks from the driver.
@@ -148,6 +323,7 @@ asynStatus NDPluginGather::connectToArrayPort(void)
     static const char *functionName = "connectToArrayPort";
 
     getIntegerParam(NDPluginDriverEnableCallbacks, &enableCallbacks);
+    numConnected_ = 0;
     for (i=0; i<maxPorts_; i++, pArraySrc++) {
         getStringParam(i, NDPluginDriverArrayPort, sizeof(arrayPort), arrayPort);
         getIntegerParam(i, NDPluginDriverArrayAddr, &arrayAddr);
@@ -183,6 +359,7 @@ asynStatus NDPluginGather::connectToArrayPort(void)
         pArraySrc->pasynGenericPointer = (asynGenericPointer *)pasynInterface->pinterface;
         pArraySrc->asynGenericPointerPvt = pasynInterface->drvPvt;
         pArraySrc->connectedToArrayPort = true;
+        numConnected_++;
     }
     /* Enable or disable interrupt callbacks */
     status = setArrayInterrupt(enableCallbacks);
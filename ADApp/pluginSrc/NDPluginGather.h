@@ -2,9 +2,32 @@
 #define NDPluginGather_H
 
 #include <set>
+#include <map>
+#include <vector>
+
+#include <epicsEvent.h>
 
 #include "NDPluginDriver.h"
 
+/* General parameters */
+#define NDPluginGatherModeString           "GATHER_MODE"            /* (asynInt32,   r/w) 0=Immediate, 1=Group by UniqueId */
+#define NDPluginGatherGroupTimeoutString   "GATHER_GROUP_TIMEOUT"   /* (asynFloat64, r/w) Time to wait for a group to be complete */
+#define NDPluginGatherGroupsCompleteString "GATHER_GROUPS_COMPLETE" /* (asynInt32,   r/w) Number of complete groups sent */
+#define NDPluginGatherGroupsDroppedString  "GATHER_GROUPS_DROPPED"  /* (asynInt32,   r/w) Number of incomplete groups dropped */
+#define NDPluginGatherGroupsPendingString  "GATHER_GROUPS_PENDING"  /* (asynInt32,   r/o) Number of incomplete groups waiting */
+
+/** Gather modes */
+typedef enum {
+    NDGatherModeImmediate,  /**< Each array is passed on as soon as it arrives */
+    NDGatherModeGroup       /**< Arrays are held until one with the same UniqueId has arrived from each port */
+} NDGatherMode_t;
+
+/** Arrays with the same UniqueId waiting for the arrays from the other ports */
+typedef struct {
+    epicsTimeStamp firstTime;       /**< Time the first array arrived */
+    std::vector<NDArray *> arrays;  /**< The arrays in the order they arrived, each reserved */
+} NDGatherGroup_t;
+
 typedef struct {
     void *asynGenericPointerInterruptPvt;        /**< InterruptPvt for connecting to NDArray driver interupts */
     asynUser *pasynUserGenericPointer;           /**< asynUser for connecting to NDArray driver */
@@ -20,6 +43,10 @@ public:
                    int maxPorts, 
                    int maxBuffers, size_t maxMemory,
                    int priority, int stackSize);
+    ~NDPluginGather();
+
+    virtual asynStatus writeInt32(asynUser *pasynUser, epicsInt32 value);
+    void dropTask();
 
 protected:
     /* These methods override the virtual methods in the base class */
@@ -27,10 +54,24 @@ protected:
     virtual asynStatus connectToArrayPort(void);    
     virtual asynStatus setArrayInterrupt(int connect);
 
+    int NDPluginGatherMode;
+    #define FIRST_NDPLUGIN_GATHER_PARAM NDPluginGatherMode
+    int NDPluginGatherGroupTimeout;
+    int NDPluginGatherGroupsComplete;
+    int NDPluginGatherGroupsDropped;
+    int NDPluginGatherGroupsPending;
                                 
 private:
+    void sendArray(NDArray *pArray);
+    void addToGroup(NDArray *pArray);
+    void dropGroups(bool all);
     int maxPorts_;
+    int numConnected_;
     NDGatherNDArraySource_t *NDArraySrc_;
+    std::map<int, NDGatherGroup_t> groups_;  /**< Incomplete groups in Group mode, indexed by UniqueId */
+    bool exiting_;
+    epicsEventId dropEvent_;
+    epicsEventId dropExitEvent_;
 };
     
 #endif
@@ -69,18 +69,70 @@ void NDPluginOverlay::setPixel(epicsType *pValue, NDOverlay_t *pOverlay, NDArray
 
 
 
-template <typename epicsType>
-void NDPluginOverlay::doOverlayT(NDArray *pArray, NDOverlay_t *pOverlay, NDArrayInfo_t *pArrayInfo)
+/** Adds the pixels xStart to xEnd-1 of row y to a list of spans, clipped to the array.
+  * The span is merged with the previous one if it continues it. */
+static void addSpan(std::vector<NDOverlaySpan_t> &spans, int y, int xStart, int xEnd, NDArrayInfo_t *pArrayInfo)
+{
+  NDOverlaySpan_t span;
+
+  if ((y < 0) || (y >= (int)pArrayInfo->ySize)) return;
+  if (xStart < 0) xStart = 0;
+  if (xEnd > (int)pArrayInfo->xSize) xEnd = (int)pArrayInfo->xSize;
+  if (xStart >= xEnd) return;
+  if (!spans.empty()) {
+    NDOverlaySpan_t &last = spans.back();
+    if ((last.y == y) && (xStart >= last.xStart) && (xStart <= last.xEnd)) {
+      if (xEnd > last.xEnd) last.xEnd = xEnd;
+      return;
+    }
+  }
+  span.y = y;
+  span.xStart = xStart;
+  span.xEnd = xEnd;
+  spans.push_back(span);
+}
+
+static bool spanLess(const NDOverlaySpan_t &a, const NDOverlaySpan_t &b)
+{
+  return (a.y < b.y) || ((a.y == b.y) && (a.xStart < b.xStart));
+}
+
+/** Sorts a list of spans by row and column and merges the spans that overlap or touch.
+  * Each pixel is then drawn only once, which the XOR draw mode requires.
+  * The shapes other than ellipses produce their spans in order, so the sort is normally skipped. */
+static void normalizeSpans(std::vector<NDOverlaySpan_t> &spans)
+{
+  size_t i, n;
+
+  for (i=1; i<spans.size(); i++) {
+    if (spanLess(spans[i], spans[i-1])) {
+      std::sort(spans.begin(), spans.end(), spanLess);
+      break;
+    }
+  }
+  for (i=0, n=0; i<spans.size(); i++) {
+    if ((n > 0) && (spans[n-1].y == spans[i].y) && (spans[i].xStart <= spans[n-1].xEnd)) {
+      if (spans[i].xEnd > spans[n-1].xEnd) spans[n-1].xEnd = spans[i].xEnd;
+    } else {
+      spans[n++] = spans[i];
+    }
+  }
+  spans.resize(n);
+}
+
+/** Computes the pixels of an overlay as run length encoded spans.
+  * This is only called when the overlay or the array dimensions have changed,
+  * or for text overlays with a time stamp.
+  * \param[in] pArray The array, only its time stamp is used
+  * \param[in] pOverlay The overlay
+  * \param[in] pArrayInfo Information about the array */
+void NDPluginOverlay::computeSpans(NDArray *pArray, NDOverlay_t *pOverlay, NDArrayInfo_t *pArrayInfo)
 {
   int xmin, xmax, ymin, ymax, xcent, ycent, xsize, ysize, ix, iy, ii, jj, ib;
-  int xwide, ywide, xwidemax_line, xwidemin_line;
-  int xStride = (int)pArrayInfo->xStride;
-  int yStride = (int)pArrayInfo->yStride;
-  std::vector<int>::iterator it;
+  int xwide, ywide;
   int nSteps;
   double theta, thetaStep;
-  int rowOffset;
-  epicsType *pData=(epicsType *)pArray->pData;
+  std::vector<NDOverlaySpan_t> &spans = pOverlay->spans;
   char textOutStr[512];                    // our string, maybe with a time stamp, to place into the image array
   char *cp;                                // character pointer to current character being rendered
   int bmc;                                 // current byte in the font bitmap
@@ -89,184 +141,189 @@ void NDPluginOverlay::doOverlayT(NDArray *pArray, NDOverlay_t *pOverlay, NDArray
   NDPluginOverlayTextFontBitmapType *bmp;  // pointer to our font information (bitmap pointer, perhaps misnamed)
   int bpc;                                 // bytes per char, ie, 1 for 6x13 font, 2 for 9x15 font
   int sbc;                                 // "sub" byte counter to keep track of which byte we are looking at for multi byte fonts
-  //static const char *functionName = "doOverlayT";
 
-  asynPrint(pasynUserSelf, ASYN_TRACEIO_DRIVER,
-    "NDPluginOverlay::DoOverlayT, shape=%d, Xpos=%d, Ypos=%d, Xsize=%d, Ysize=%d\n",
-    pOverlay->shape, (int)pOverlay->PositionX, (int)pOverlay->PositionY, 
-    (int)pOverlay->SizeX, (int)pOverlay->SizeY);
+  spans.clear();
+
+  switch(pOverlay->shape) {
+    case NDOverlayCross:
+      xcent = (int)(pOverlay->PositionX + pOverlay->SizeX/2. + 0.5);
+      ycent = (int)(pOverlay->PositionY + pOverlay->SizeY/2. + 0.5);
+      xmin = (int)CLIPX(xcent - pOverlay->SizeX/2. + 0.5);
+      xmax = (int)CLIPX(xcent + pOverlay->SizeX/2. + 0.5);
+      ymin = (int)CLIPY(ycent - pOverlay->SizeY/2. + 0.5);
+      ymax = (int)CLIPY(ycent + pOverlay->SizeY/2. + 0.5);
+      xwide = pOverlay->WidthX / 2;
+      ywide = pOverlay->WidthY / 2;
+
+      for (iy=ymin; iy<=ymax; iy++) {
+        if ((iy >= (ycent - ywide)) && (iy <= ycent + ywide)) {
+          addSpan(spans, iy, xmin, xmax+1, pArrayInfo);
+        } else {
+          addSpan(spans, iy, xcent - xwide, xcent + xwide + 1, pArrayInfo);
+        }
+      }
+      break;
+
+    case NDOverlayRectangle:
+      xmin = CLIPX(pOverlay->PositionX);
+      xmax = CLIPX(pOverlay->PositionX + pOverlay->SizeX);
+      ymin = CLIPY(pOverlay->PositionY);
+      ymax = CLIPY(pOverlay->PositionY + pOverlay->SizeY);
+      xwide = pOverlay->WidthX;
+      ywide = pOverlay->WidthY;
+      xwide = MIN(xwide, (int)pOverlay->SizeX-1);
+      ywide = MIN(ywide, (int)pOverlay->SizeY-1);
+
+      //For non-zero width, grow the rectangle towards the center.
+      for (iy=ymin; iy<=ymax; iy++) {
+        if ((iy < (ymin + ywide)) || (iy > (ymax - ywide))) {
+          addSpan(spans, iy, xmin, xmax+1, pArrayInfo);
+        } else {
+          addSpan(spans, iy, xmin, CLIPX(xmin+xwide), pArrayInfo);
+          addSpan(spans, iy, CLIPX(xmax-xwide+1), xmax+1, pArrayInfo);
+        }
+      }
+      break;
 
-  if (pOverlay->changed) {
-    pOverlay->addressOffset.clear();
-
-    switch(pOverlay->shape) {
-      case NDOverlayCross:
-        xcent = (int)(pOverlay->PositionX + pOverlay->SizeX/2. + 0.5);
-        ycent = (int)(pOverlay->PositionY + pOverlay->SizeY/2. + 0.5);
-        xmin = (int)CLIPX(xcent - pOverlay->SizeX/2. + 0.5);
-        xmax = (int)CLIPX(xcent + pOverlay->SizeX/2. + 0.5);
-        ymin = (int)CLIPY(ycent - pOverlay->SizeY/2. + 0.5);
-        ymax = (int)CLIPY(ycent + pOverlay->SizeY/2. + 0.5);
-        xwide = pOverlay->WidthX / 2;
-        ywide = pOverlay->WidthY / 2;
-
-        for (iy=ymin; iy<=ymax; iy++) {
-          rowOffset = iy*yStride;
-          if ((iy >= (ycent - ywide)) && (iy <= ycent + ywide)) {
-            for (ix=xmin; ix<=xmax; ++ix) {
-              pOverlay->addressOffset.push_back(rowOffset + ix*xStride);
+    case NDOverlayEllipse:
+      xwide = pOverlay->WidthX;
+      ywide = pOverlay->WidthY;
+      xwide = MIN(xwide, (int)pOverlay->SizeX-1);
+      ywide = MIN(ywide, (int)pOverlay->SizeY-1);
+      xcent = (int)(pOverlay->PositionX + pOverlay->SizeX/2. + 0.5);
+      ycent = (int)(pOverlay->PositionY + pOverlay->SizeY/2. + 0.5);
+      xsize = pOverlay->SizeX/2;
+      ysize = pOverlay->SizeY/2;
+      xmax = (int)(pArrayInfo->xSize-1);
+      ymax = (int)(pArrayInfo->ySize-1);
+
+      // Use the parametric equation for an ellipse.  
+      // Only need to compute 0 to pi/2, other quadrants by symmetry
+      // Make 2*(xsize + ysize) angle points
+      nSteps = 2*(xsize + ysize);
+      thetaStep = M_PI / 2. / nSteps;
+      for (ii=0, theta=0.; ii<=nSteps; ii++, theta+=thetaStep) {
+        for (jj=0; jj<xwide; jj++) {
+          ix = (int)((xsize-jj) * cos(theta) + 0.5);
+          iy = (int)((ysize-jj) * sin(theta) + 0.5);
+          if (((ycent + iy - 1) >= 0) && ((ycent + iy) <= ymax)) {
+            if (((xcent + ix) >= 0) && ((xcent + ix) <= xmax)) {
+              addSpan(spans, ycent + iy, xcent + ix, xcent + ix + 1, pArrayInfo);
             }
-          } else {
-            xwidemin_line = xcent - xwide;
-            xwidemax_line = xcent + xwide;
-            for (int line=xwidemin_line; line<=xwidemax_line; ++line) {
-              pOverlay->addressOffset.push_back(rowOffset + line*xStride);
+            if (((xcent - ix) >= 0) && ((xcent - ix) <= xmax)) {
+              addSpan(spans, ycent + iy, xcent - ix, xcent - ix + 1, pArrayInfo);
             }
           }
-        }
-        break;
-
-      case NDOverlayRectangle:
-        xmin = CLIPX(pOverlay->PositionX);
-        xmax = CLIPX(pOverlay->PositionX + pOverlay->SizeX);
-        ymin = CLIPY(pOverlay->PositionY);
-        ymax = CLIPY(pOverlay->PositionY + pOverlay->SizeY);
-        xwide = pOverlay->WidthX;
-        ywide = pOverlay->WidthY;
-        xwide = MIN(xwide, (int)pOverlay->SizeX-1);
-        ywide = MIN(ywide, (int)pOverlay->SizeY-1);
-
-        //For non-zero width, grow the rectangle towards the center.
-        for (iy=ymin; iy<=ymax; iy++) {
-          rowOffset = iy*yStride;
-          if (iy < (ymin + ywide)) {
-            for (ix=xmin; ix<=xmax; ix++) pOverlay->addressOffset.push_back(rowOffset + ix*xStride);
-          } else if (iy > (ymax - ywide)) {
-            for (ix=xmin; ix<=xmax; ix++) pOverlay->addressOffset.push_back(rowOffset + ix*xStride);
-          } else {
-            for (int line=xmin; line<CLIPX(xmin+xwide); ++line) {
-              pOverlay->addressOffset.push_back(rowOffset + line*xStride);
+          if (((ycent - iy) >= 0) && ((ycent - iy) <= ymax)) {
+            if (((xcent + ix) >= 0) && ((xcent + ix) <= xmax)) {
+              addSpan(spans, ycent - iy, xcent + ix, xcent + ix + 1, pArrayInfo);
             }
-            for (int line=CLIPX(xmax-xwide+1); line<=xmax; ++line) {
-              pOverlay->addressOffset.push_back(rowOffset + line*xStride);
+            if (((xcent - ix) >= 0) && ((xcent - ix) <= xmax)) {
+              addSpan(spans, ycent - iy, xcent - ix, xcent - ix + 1, pArrayInfo);
             }
           }
         }
-        break;
-
-      case NDOverlayEllipse:
-        xwide = pOverlay->WidthX;
-        ywide = pOverlay->WidthY;
-        xwide = MIN(xwide, (int)pOverlay->SizeX-1);
-        ywide = MIN(ywide, (int)pOverlay->SizeY-1);
-        xcent = (int)(pOverlay->PositionX + pOverlay->SizeX/2. + 0.5);
-        ycent = (int)(pOverlay->PositionY + pOverlay->SizeY/2. + 0.5);
-        xsize = pOverlay->SizeX/2;
-        ysize = pOverlay->SizeY/2;
-        xmax = (int)(pArrayInfo->xSize-1);
-        ymax = (int)(pArrayInfo->ySize-1);
-
-        // Use the parametric equation for an ellipse.  
-        // Only need to compute 0 to pi/2, other quadrants by symmetry
-        // Make 2*(xsize + ysize) angle points
-        nSteps = 2*(xsize + ysize);
-        thetaStep = M_PI / 2. / nSteps;
-        for (ii=0, theta=0.; ii<=nSteps; ii++, theta+=thetaStep) {
-          for (jj=0; jj<xwide; jj++) {
-            ix = (int)((xsize-jj) * cos(theta) + 0.5);
-            iy = (int)((ysize-jj) * sin(theta) + 0.5);
-            if (((ycent + iy - 1) >= 0) && ((ycent + iy) <= ymax)) {
-              rowOffset = (ycent + iy)*yStride;
-              if (((xcent + ix) >= 0) && ((xcent + ix) <= xmax)) {
-                pOverlay->addressOffset.push_back(rowOffset + (xcent + ix)*xStride);
-              }
-              if (((xcent - ix) >= 0) && ((xcent - ix) <= xmax)) {
-                pOverlay->addressOffset.push_back(rowOffset + (xcent - ix)*xStride);
-              }
+      }
+      break;
+
+    case NDOverlayText:
+      if ((pOverlay->Font >= 0) && (pOverlay->Font < NDPluginOverlayTextFontBitmapTypeN)) {
+        bmp = &NDPluginOverlayTextFontBitmaps[pOverlay->Font];
+      } else {
+        // Really, no reason to go on if the font is ill defined
+        return;
+      }
+
+      bpc = bmp->width / 8 + 1;
+
+      if (strlen(pOverlay->TimeStampFormat) > 0) {
+        epicsTimeToStrftime(tstr, sizeof(tstr)-1, pOverlay->TimeStampFormat, &pArray->epicsTS);
+        epicsSnprintf(textOutStr, sizeof(textOutStr)-1, "%s%s", pOverlay->DisplayText, tstr);
+      } else {
+        epicsSnprintf(textOutStr, sizeof(textOutStr)-1, "%s", pOverlay->DisplayText);
+      }
+      textOutStr[sizeof(textOutStr)-1] = 0;
+
+      cp   = textOutStr;
+      xmin = CLIPX(pOverlay->PositionX);
+      xmax = CLIPX(pOverlay->PositionX + pOverlay->SizeX);
+      ymin = CLIPY(pOverlay->PositionY);
+      ymax = pOverlay->PositionY + pOverlay->SizeY;
+      ymax = MIN(ymax, pOverlay->PositionY + bmp->height);
+      ymax = CLIPY(ymax);
+
+      // Loop over vertical lines
+      for (jj=0, iy=ymin; iy<ymax; jj++, iy++) {
+
+        // Loop over characters
+        for (ii=0; cp[ii]!=0; ii++) {
+          if( cp[ii] < 32)
+            continue;
+
+          if (xmin+ii * bmp->width >= xmax)
+            // None of this character can be written
+            break;
+
+          sbc = 0;
+          bmc = bmp->bitmap[(bmp->height*(cp[ii] - 32) + jj)*bpc];
+          mask = 0x80;
+          for (ib=0; ib<bmp->width; ib++) {
+            ix = xmin + ii * bmp->width + ib;
+            if (ix >= xmax)
+              break;
+            // Adjacent pixels that are set are merged into one span
+            if (mask & bmc) {
+              addSpan(spans, iy, ix, ix+1, pArrayInfo);
             }
-            if (((ycent - iy) >= 0) && ((ycent - iy) <= ymax)) {
-              rowOffset = (ycent - iy)*yStride; 
-              if (((xcent + ix) >= 0) && ((xcent + ix) <= xmax)) {
-                pOverlay->addressOffset.push_back(rowOffset + (xcent + ix)*xStride);
-              }
-              if (((xcent - ix) >= 0) && ((xcent - ix) <= xmax)) {
-                pOverlay->addressOffset.push_back(rowOffset + (xcent - ix)*xStride);
-              }
+            mask >>= 1;
+            if (!mask) {
+              mask = 0x80;
+              sbc++;
+              bmc = bmp->bitmap[(bmp->height*(cp[ii] - 32) + jj)*bpc + sbc];
             }
           }
         }
-        // There may be duplicate pixels in the address list.  
-        // We must remove them or the XOR draw mode won't work because the pixel will be set and then unset
-        std::sort(pOverlay->addressOffset.begin(), pOverlay->addressOffset.end());
-        it = std::unique(pOverlay->addressOffset.begin(), pOverlay->addressOffset.end());
-        pOverlay->addressOffset.resize(std::distance(pOverlay->addressOffset.begin(), it));
-        break;
-
-      case NDOverlayText:
-        if ((pOverlay->Font >= 0) && (pOverlay->Font < NDPluginOverlayTextFontBitmapTypeN)) {
-          bmp = &NDPluginOverlayTextFontBitmaps[pOverlay->Font];
-        } else {
-          // Really, no reason to go on if the font is ill defined
-          return;
-        }
+      }
+      break;
+  } // switch(pOverlay->shape)
 
-        bpc = bmp->width / 8 + 1;
+  // There may be duplicate pixels, for example in ellipses.
+  // We must remove them or the XOR draw mode won't work because the pixel will be set and then unset
+  normalizeSpans(spans);
+}
 
-        if (strlen(pOverlay->TimeStampFormat) > 0) {
-          epicsTimeToStrftime(tstr, sizeof(tstr)-1, pOverlay->TimeStampFormat, &pArray->epicsTS);
-          epicsSnprintf(textOutStr, sizeof(textOutStr)-1, "%s%s", pOverlay->DisplayText, tstr);
-        } else {
-          epicsSnprintf(textOutStr, sizeof(textOutStr)-1, "%s", pOverlay->DisplayText);
-        }
-        textOutStr[sizeof(textOutStr)-1] = 0;
-
-        cp   = textOutStr;
-        xmin = CLIPX(pOverlay->PositionX);
-        xmax = CLIPX(pOverlay->PositionX + pOverlay->SizeX);
-        ymin = CLIPY(pOverlay->PositionY);
-        ymax = pOverlay->PositionY + pOverlay->SizeY;
-        ymax = MIN(ymax, pOverlay->PositionY + bmp->height);
-        ymax = CLIPY(ymax);
-
-        // Loop over vertical lines
-        for (jj=0, iy=ymin; iy<ymax; jj++, iy++) {
-          rowOffset = iy*yStride;
-
-          // Loop over characters
-          for (ii=0; cp[ii]!=0; ii++) {
-            if( cp[ii] < 32)
-              continue;
-
-            if (xmin+ii * bmp->width >= xmax)
-              // None of this character can be written
-              break;
+/** Draws the spans of an overlay into an array */
+template <typename epicsType>
+void NDPluginOverlay::doOverlayT(NDArray *pArray, NDOverlay_t *pOverlay, NDArrayInfo_t *pArrayInfo)
+{
+  int ix;
+  int xStride = (int)pArrayInfo->xStride;
+  int yStride = (int)pArrayInfo->yStride;
+  epicsType *pData=(epicsType *)pArray->pData;
+  epicsType *pValue;
+  std::vector<NDOverlaySpan_t>::const_iterator span;
+  bool isColor = (pArrayInfo->colorMode == NDColorModeRGB1) ||
+                 (pArrayInfo->colorMode == NDColorModeRGB2) ||
+                 (pArrayInfo->colorMode == NDColorModeRGB3);
+  // Mono pixels that are set are contiguous in each span, so they can be filled
+  bool fillSpans = !isColor && (xStride == 1) && (pOverlay->drawMode == NDOverlaySet);
+  //static const char *functionName = "doOverlayT";
 
-            sbc = 0;
-            bmc = bmp->bitmap[(bmp->height*(cp[ii] - 32) + jj)*bpc];
-            mask = 0x80;
-            for (ib=0; ib<bmp->width; ib++) {
-              ix = xmin + ii * bmp->width + ib;
-              if (ix >= xmax)
-                break;
-              if (mask & bmc) {
-                pOverlay->addressOffset.push_back(rowOffset + ix*xStride);
-              }
-              mask >>= 1;
-              if (!mask) {
-                mask = 0x80;
-                sbc++;
-                bmc = bmp->bitmap[(bmp->height*(cp[ii] - 32) + jj)*bpc + sbc];
-              }
-            }
-          }
-        }
-        break;
-    } // switch(pOverlay->shape)
-  } // if (pOverlay->changed)
+  asynPrint(pasynUserSelf, ASYN_TRACEIO_DRIVER,
+    "NDPluginOverlay::DoOverlayT, shape=%d, Xpos=%d, Ypos=%d, Xsize=%d, Ysize=%d\n",
+    pOverlay->shape, (int)pOverlay->PositionX, (int)pOverlay->PositionY, 
+    (int)pOverlay->SizeX, (int)pOverlay->SizeY);
 
-  // Set the pixels in the image from the addressOffset vector list
-  for (ii=0; ii<(int)pOverlay->addressOffset.size(); ii++) {
-    setPixel(pData + pOverlay->addressOffset[ii], pOverlay, pArrayInfo);
+  // Set the pixels in the image from the spans
+  for (span=pOverlay->spans.begin(); span!=pOverlay->spans.end(); ++span) {
+    pValue = pData + span->y*yStride + span->xStart*xStride;
+    if (fillSpans) {
+      std::fill(pValue, pValue + (span->xEnd - span->xStart), (epicsType)pOverlay->green);
+      continue;
+    }
+    for (ix=span->xStart; ix<span->xEnd; ix++, pValue+=xStride) {
+      setPixel(pValue, pOverlay, pArrayInfo);
+    }
   }
 }
 
@@ -306,7 +363,8 @@ int NDPluginOverlay::doOverlay(NDArray *pArray, NDOverlay_t *pOverlay, NDArrayIn
 
 
 /** Callback function that is called by the NDArray driver with new NDArray data.
-  * Draws overlays on top of the array.
+  * Draws overlays on top of a copy of the array.  If CopyOnWrite is enabled and none of the
+  * overlays has any pixels in the array then the input array is passed on without being copied.
   * \param[in] pArray  The NDArray from the callback.
   */
 void NDPluginOverlay::processCallbacks(NDArray *pArray)
@@ -318,22 +376,23 @@ void NDPluginOverlay::processCallbacks(NDArray *pArray)
 
   int overlay;
   int itemp;
-  NDArray *pOutput;
+  int copyOnWrite;
+  NDArray *pOutput=NULL;
   NDArrayInfo arrayInfo;
   std::vector<NDOverlay_t>pOverlays;
   NDOverlay_t *pOverlay;
   bool arrayInfoChanged;
-  int overlayUserLen = sizeof(*pOverlay) - sizeof(pOverlay->addressOffset);
+  bool visible = false;
+  int overlayUserLen = sizeof(*pOverlay) - sizeof(pOverlay->spans);
   static const char* functionName = "processCallbacks";
 
   /* Call the base class method */
   NDPluginDriver::beginProcessCallbacks(pArray);
 
-  /* Copy the input array so we can modify it. */
-  pOutput = this->pNDArrayPool->copy(pArray, NULL, 1);
-  
+  getIntegerParam(NDPluginOverlayCopyOnWrite, &copyOnWrite);
+
   /* Get information about the array needed later */
-  pOutput->getInfo(&arrayInfo);
+  pArray->getInfo(&arrayInfo);
   arrayInfoChanged = (memcmp(&arrayInfo, &this->prevArrayInfo_, sizeof(arrayInfo)) != 0);
   this->prevArrayInfo_ = arrayInfo;
   setIntegerParam(NDPluginOverlayMaxSizeX, (int)arrayInfo.xSize);
@@ -383,17 +442,44 @@ void NDPluginOverlay::processCallbacks(NDArray *pArray)
    * The following code can be exected without the mutex because we are not accessing memory
    * that other threads can access. */
   this->unlock();
+  /* Only the overlays that have changed need their pixels computed again */
   for (overlay=0; overlay<this->maxOverlays_; overlay++) {
     pOverlay = &pOverlays[overlay];
     if (!pOverlay->use) continue;
-    this->doOverlay(pOutput, pOverlay, &arrayInfo);
+    if (pOverlay->changed) this->computeSpans(pArray, pOverlay, &arrayInfo);
+    if (!pOverlay->spans.empty()) visible = true;
     asynPrint(pasynUserSelf, ASYN_TRACEIO_DRIVER, 
-      "%s::%s overlay %d, changed=%d, points=%d\n", 
-      driverName, functionName, overlay, pOverlay->changed, (int)pOverlay->addressOffset.size());
+      "%s::%s overlay %d, changed=%d, spans=%d\n", 
+      driverName, functionName, overlay, pOverlay->changed, (int)pOverlay->spans.size());
+  }
+  if (visible || !copyOnWrite) {
+    /* Copy the input array so we can modify it. */
+    pOutput = this->pNDArrayPool->copy(pArray, NULL, 1);
+    if (pOutput) {
+      for (overlay=0; overlay<this->maxOverlays_; overlay++) {
+        pOverlay = &pOverlays[overlay];
+        if (!pOverlay->use) continue;
+        this->doOverlay(pOutput, pOverlay, &arrayInfo);
+      }
+    }
   }
   this->lock();
   this->prevOverlays_ = pOverlays;
-  NDPluginDriver::endProcessCallbacks(pOutput, false, true);
+  if (visible || !copyOnWrite) {
+    if (!pOutput) {
+      asynPrint(pasynUserSelf, ASYN_TRACE_ERROR,
+        "%s::%s error allocating output array\n",
+        driverName, functionName);
+      callParamCallbacks();
+      return;
+    }
+    NDPluginDriver::endProcessCallbacks(pOutput, false, true);
+  } else {
+    /* Nothing to draw, pass the input array on.  It is shared with the upstream driver and other
+     * plugins, so the attributes of this plugin are not added to it. */
+    pArray->reserve();
+    NDPluginDriver::endProcessCallbacks(pArray, false, false);
+  }
   callParamCallbacks();
 }
 
@@ -439,6 +525,7 @@ NDPluginOverlay::NDPluginOverlay(const char *portName, int queueSize, int blocki
 
   createParam(NDPluginOverlayMaxSizeXString,        asynParamInt32, &NDPluginOverlayMaxSizeX);
   createParam(NDPluginOverlayMaxSizeYString,        asynParamInt32, &NDPluginOverlayMaxSizeY);
+  createParam(NDPluginOverlayCopyOnWriteString,     asynParamInt32, &NDPluginOverlayCopyOnWrite);
   createParam(NDPluginOverlayNameString,            asynParamOctet, &NDPluginOverlayName);
   createParam(NDPluginOverlayUseString,             asynParamInt32, &NDPluginOverlayUse);
   createParam(NDPluginOverlayPositionXString,       asynParamInt32, &NDPluginOverlayPositionX);
@@ -460,6 +547,7 @@ NDPluginOverlay::NDPluginOverlay(const char *portName, int queueSize, int blocki
 
   /* Set the plugin type string */
   setStringParam(NDPluginDriverPluginType, "NDPluginOverlay");
+  setIntegerParam(NDPluginOverlayCopyOnWrite, 0);
 
   // Enable ArrayCallbacks.  
   // This plugin currently ignores this setting and always does callbacks, so make the setting reflect the behavior
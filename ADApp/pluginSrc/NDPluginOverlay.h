@@ -17,6 +17,13 @@ typedef enum {
     NDOverlayXOR
 } NDOverlayDrawMode_t;
 
+/** A run of pixels in one row of an overlay, columns xStart to xEnd-1 of row y */
+typedef struct {
+    int y;
+    int xStart;
+    int xEnd;
+} NDOverlaySpan_t;
+
 /** Structure defining an overlay */
 typedef struct NDOverlay {
     int changed;
@@ -35,12 +42,15 @@ typedef struct NDOverlay {
     char TimeStampFormat[64];
     int Font;
     char DisplayText[256];
-    std::vector<int> addressOffset;
+    /* The pixels of the overlay as run length encoded spans, sorted by row and column and not overlapping.
+     * This must be the last field, the fields before it are compared to detect changes. */
+    std::vector<NDOverlaySpan_t> spans;
 } NDOverlay_t;
 
 
 #define NDPluginOverlayMaxSizeXString           "MAX_SIZE_X"            /* (asynInt32,   r/o) Maximum size of overlay in X dimension */
 #define NDPluginOverlayMaxSizeYString           "MAX_SIZE_Y"            /* (asynInt32,   r/o) Maximum size of overlay in Y dimension */
+#define NDPluginOverlayCopyOnWriteString        "COPY_ON_WRITE"         /* (asynInt32,   r/w) Pass arrays without visible overlays through without copying */
 #define NDPluginOverlayNameString               "NAME"                  /* (asynOctet,   r/w) Name of this overlay */
 #define NDPluginOverlayUseString                "USE"                   /* (asynInt32,   r/w) Use this overlay? */
 #define NDPluginOverlayPositionXString          "OVERLAY_POSITION_X"    /* (asynInt32,   r/w) X position (upper left) of overlay */
@@ -72,6 +82,7 @@ public:
     asynStatus writeInt32(asynUser *pasynUser, epicsInt32 value);
 
     /* These methods are new to this class */
+    void computeSpans(NDArray *pArray, NDOverlay_t *pOverlay, NDArrayInfo_t *pArrayInfo);
     template <typename epicsType> void doOverlayT(NDArray *pArray, NDOverlay_t *pOverlay, NDArrayInfo_t *pArrayInfo);
     int doOverlay(NDArray *pArray, NDOverlay_t *pOverlay, NDArrayInfo_t *pArrayInfo);
     template <typename epicsType> void setPixel(epicsType *pValue, NDOverlay_t *pOverlay, NDArrayInfo_t *pArrayInfo);
@@ -80,6 +91,7 @@ protected:
     int NDPluginOverlayMaxSizeX;
     #define FIRST_NDPLUGIN_OVERLAY_PARAM NDPluginOverlayMaxSizeX
     int NDPluginOverlayMaxSizeY;
+    int NDPluginOverlayCopyOnWrite;
     int NDPluginOverlayName;
     int NDPluginOverlayUse;
     int NDPluginOverlayPositionX;
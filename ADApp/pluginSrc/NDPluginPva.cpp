@@ -8,12 +8,18 @@
 
 #include <ntndArrayConverter.h>
 
+#ifdef HAVE_BLOSC
+#include <blosc.h>
+#endif
+
 #include <asynDriver.h>
 
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 
+#include <epicsStdio.h>
+
 #include "NDPluginDriver.h"
 #include "NDPluginPva.h"
 
@@ -43,7 +49,7 @@ public:
     virtual bool init ();
     virtual void destroy ();
     virtual void process () {}
-    void update (NDArray *pArray);
+    void update (NDArray *pArray, NDArray *pCompressed, string const & codec);
 };
 
 NTNDArrayRecordPtr NTNDArrayRecord::create (string const & name)
@@ -73,14 +79,18 @@ void NTNDArrayRecord::destroy()
     PVRecord::destroy();
 }
 
-void NTNDArrayRecord::update(NDArray *pArray)
+void NTNDArrayRecord::update(NDArray *pArray, NDArray *pCompressed, string const & codec)
 {
+    // Build the attribute structures before taking the record lock,
+    // so monitors are not held up while they are built
+    m_converter->prepareAttributes(pArray);
+
     lock();
 
     try
     {
         beginGroupPut();
-        m_converter->fromArray(pArray);
+        m_converter->fromArray(pArray, pCompressed, codec);
         endGroupPut();
     }
     catch(...)
@@ -92,21 +102,133 @@ void NTNDArrayRecord::update(NDArray *pArray)
     unlock();
 }
 
+static const char *driverName = "NDPluginPva";
+
+/** Compressed the data of an NDArray with blosc.
+  * Called without the lock; several threads can compress at the same time.
+  * \param[in] pArray The array.
+  * \param[in] compressor The blosc compressor, NDPvaCompressor_t.
+  * \param[in] compressLevel The compression level, 0 to 9.
+  * \param[in] shuffle The blosc shuffle, 0=none, 1=byte, 2=bit.
+  * \param[in] numThreads The number of threads blosc uses.
+  * \return An NDUInt8 array with the compressed data, or NULL if the data could not be compressed.
+  */
+NDArray *NDPluginPva::compressArray(NDArray *pArray, int compressor, int compressLevel,
+                                    int shuffle, int numThreads)
+{
+    static const char *functionName = "compressArray";
+#ifdef HAVE_BLOSC
+    static const char *compressorNames[] = {"blosclz", "lz4", "lz4hc", "snappy", "zlib", "zstd"};
+    NDArrayInfo_t info;
+    NDArray *pCompressed;
+    size_t size;
+    int compressedSize;
+
+    if ((compressor < NDPvaBloscLZ) || (compressor > NDPvaBloscZstd)) compressor = NDPvaBloscLZ;
+    pArray->getInfo(&info);
+    size = info.totalBytes + BLOSC_MAX_OVERHEAD;
+    pCompressed = this->pNDArrayPool->alloc(1, &size, NDUInt8, 0, NULL);
+    if (!pCompressed) {
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+            "%s::%s cannot allocate the compressed array\n", driverName, functionName);
+        return NULL;
+    }
+    compressedSize = blosc_compress_ctx(compressLevel, shuffle, info.bytesPerElement,
+                                        info.totalBytes, pArray->pData, pCompressed->pData,
+                                        size, compressorNames[compressor], 0,
+                                        numThreads < 1 ? 1 : numThreads);
+    if (compressedSize <= 0) {
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+            "%s::%s blosc error %d\n", driverName, functionName, compressedSize);
+        pCompressed->release();
+        return NULL;
+    }
+    pCompressed->dims[0].size = compressedSize;
+    return pCompressed;
+#else
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+        "%s::%s the plugin was built without blosc\n", driverName, functionName);
+    return NULL;
+#endif
+}
+
 /** Callback function that is called by the NDArray driver with new NDArray
   * data.
+  * If Codec is not None the data are compressed before they are published; arrays that
+  * cannot be compressed are published uncompressed.
   * \param[in] pArray  The NDArray from the callback.
   */
 void NDPluginPva::processCallbacks(NDArray *pArray)
 {
+    NDArray *pCompressed = NULL;
+    NDArrayInfo_t info;
+    int codec, compressor, compressLevel, shuffle, numThreads;
+
     NDPluginDriver::beginProcessCallbacks(pArray);   // Base class method
 
+    getIntegerParam(NDPluginPvaCodec, &codec);
+    getIntegerParam(NDPluginPvaCompressor, &compressor);
+    getIntegerParam(NDPluginPvaCompressLevel, &compressLevel);
+    getIntegerParam(NDPluginPvaShuffle, &shuffle);
+    getIntegerParam(NDPluginPvaCodecThreads, &numThreads);
+
     this->unlock();             // Function called with the lock taken
-    m_record->update(pArray);
+    if (codec == NDPvaCodecBlosc)
+        pCompressed = compressArray(pArray, compressor, compressLevel, shuffle, numThreads);
+    m_record->update(pArray, pCompressed, pCompressed ? "blosc" : "");
     this->lock();               // Must return locked
 
+    if (pCompressed) {
+        pArray->getInfo(&info);
+        setDoubleParam(NDPluginPvaCompressionFactor,
+                       (double)info.totalBytes / pCompressed->dims[0].size);
+        pCompressed->release();
+    } else {
+        setDoubleParam(NDPluginPvaCompressionFactor, 1.0);
+    }
+
     callParamCallbacks();
 }
 
+/** Called when asyn clients call pasynInt32->write().
+  * Rejects the blosc codec if the plugin was built without blosc.
+  * \param[in] pasynUser pasynUser structure that encodes the reason and address.
+  * \param[in] value Value to write.
+  */
+asynStatus NDPluginPva::writeInt32(asynUser *pasynUser, epicsInt32 value)
+{
+    int function = pasynUser->reason;
+    asynStatus status = asynSuccess;
+    static const char *functionName = "writeInt32";
+
+    if (function == NDPluginPvaCodec) {
+#ifndef HAVE_BLOSC
+        if (value != NDPvaCodecNone) {
+            epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+                "%s::%s the plugin was built without blosc", driverName, functionName);
+            return asynError;
+        }
+#endif
+        status = setIntegerParam(function, value);
+    } else if (function < FIRST_NDPLUGIN_PVA_PARAM) {
+        /* If this parameter belongs to a base class call its method */
+        status = NDPluginDriver::writeInt32(pasynUser, value);
+    } else {
+        status = setIntegerParam(function, value);
+    }
+
+    callParamCallbacks();
+    if (status)
+        epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+            "%s::%s error, status=%d function=%d, value=%d",
+            driverName, functionName, status, function, value);
+    else
+        asynPrint(pasynUser, ASYN_TRACEIO_DRIVER,
+            "%s::%s function=%d, value=%d\n",
+            driverName, functionName, function, value);
+    return status;
+}
+
 /** Constructor for NDPluginPva
   * This plugin cannot block (ASYN_CANBLOCK=0) and is not multi-device (ASYN_MULTIDEVICE=0).
   * \param[in] portName The name of the asyn port driver to be created.
@@ -142,7 +264,13 @@ NDPluginPva::NDPluginPva(const char *portName, int queueSize,
             0, 1, priority, stackSize, 1),
             m_record(NTNDArrayRecord::create(pvName))
 {
-    createParam(NDPluginPvaPvNameString, asynParamOctet, &NDPluginPvaPvName);
+    createParam(NDPluginPvaPvNameString,            asynParamOctet,   &NDPluginPvaPvName);
+    createParam(NDPluginPvaCodecString,             asynParamInt32,   &NDPluginPvaCodec);
+    createParam(NDPluginPvaCompressorString,        asynParamInt32,   &NDPluginPvaCompressor);
+    createParam(NDPluginPvaCompressLevelString,     asynParamInt32,   &NDPluginPvaCompressLevel);
+    createParam(NDPluginPvaShuffleString,           asynParamInt32,   &NDPluginPvaShuffle);
+    createParam(NDPluginPvaCodecThreadsString,      asynParamInt32,   &NDPluginPvaCodecThreads);
+    createParam(NDPluginPvaCompressionFactorString, asynParamFloat64, &NDPluginPvaCompressionFactor);
 
     if(!m_record.get())
         throw runtime_error("failed to create NTNDArrayRecord");
@@ -153,6 +281,14 @@ NDPluginPva::NDPluginPva(const char *portName, int queueSize,
     /* Set PvName */
     setStringParam(NDPluginPvaPvName, pvName);
 
+    /* Publish uncompressed data by default */
+    setIntegerParam(NDPluginPvaCodec, NDPvaCodecNone);
+    setIntegerParam(NDPluginPvaCompressor, NDPvaBloscLZ4);
+    setIntegerParam(NDPluginPvaCompressLevel, 5);
+    setIntegerParam(NDPluginPvaShuffle, 1);
+    setIntegerParam(NDPluginPvaCodecThreads, 1);
+    setDoubleParam(NDPluginPvaCompressionFactor, 1.0);
+
     /* Try to connect to the NDArray port */
     connectToArrayPort();
 
@@ -11,7 +11,29 @@
 #include <pv/pvData.h>
 #include <vector>
 
-#define NDPluginPvaPvNameString "PV_NAME"
+#define NDPluginPvaPvNameString            "PV_NAME"
+#define NDPluginPvaCodecString             "PVA_CODEC"
+#define NDPluginPvaCompressorString        "PVA_COMPRESSOR"
+#define NDPluginPvaCompressLevelString     "PVA_COMPRESS_LEVEL"
+#define NDPluginPvaShuffleString           "PVA_SHUFFLE"
+#define NDPluginPvaCodecThreadsString      "PVA_CODEC_THREADS"
+#define NDPluginPvaCompressionFactorString "PVA_COMPRESSION_FACTOR"
+
+/** Codecs for the value of the NTNDArray */
+typedef enum {
+    NDPvaCodecNone,     /**< The data are not compressed */
+    NDPvaCodecBlosc     /**< The data are compressed with blosc */
+} NDPvaCodec_t;
+
+/** Compressors used by blosc */
+typedef enum {
+    NDPvaBloscLZ,
+    NDPvaBloscLZ4,
+    NDPvaBloscLZ4HC,
+    NDPvaBloscSnappy,
+    NDPvaBloscZlib,
+    NDPvaBloscZstd
+} NDPvaCompressor_t;
 
 class NTNDArrayRecord;
 typedef std::tr1::shared_ptr<NTNDArrayRecord> NTNDArrayRecordPtr;
@@ -29,11 +51,22 @@ public:
 
     /* These methods override the virtual methods in the base class */
     void processCallbacks(NDArray *pArray);
+    asynStatus writeInt32(asynUser *pasynUser, epicsInt32 value);
 
 protected:
     int NDPluginPvaPvName;
+    #define FIRST_NDPLUGIN_PVA_PARAM NDPluginPvaPvName
+    int NDPluginPvaCodec;
+    int NDPluginPvaCompressor;
+    int NDPluginPvaCompressLevel;
+    int NDPluginPvaShuffle;
+    int NDPluginPvaCodecThreads;
+    int NDPluginPvaCompressionFactor;
 
 private:
+    NDArray *compressArray(NDArray *pArray, int compressor, int compressLevel,
+                           int shuffle, int numThreads);
+
     NTNDArrayRecordPtr m_record;
 };
 
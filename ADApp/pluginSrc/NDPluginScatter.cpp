@@ -59,6 +59,9 @@ void NDPluginScatter::processCallbacks(NDArray *pArray)
 }
 
 /** Called by driver to do the callbacks to the next registered client on the asynGenericPointer interface.
+  * The client that is tried first is chosen by the scatter method.  If that client cannot accept the array
+  * because its queue is full the following clients are tried in turn, except with the UniqueId method,
+  * where the array is only passed to the chosen client.
   * \param[in] pArray Pointer to the NDArray 
   * \param[in] reason A client will be called if reason matches pasynUser->reason registered for that client.
   * \param[in] address A client will be called if address matches the address registered for that client. */
@@ -66,32 +69,210 @@ asynStatus NDPluginScatter::doNDArrayCallbacks(NDArray *pArray, int reason, int
 {
     ELLLIST *pclientList;
     interruptNode *pnode;
+    asynGenericPointerInterrupt *pInterrupt;
+    NDPluginDriver *pPlugin;
     int addr;
-    int numNodes;
-    int i;
+    int method;
+    int numClients;
+    int first, client=0;
+    int i, numTried;
+    bool accepted=false;
     //static const char *functionName = "doNDArrayCallbacks";
 
     pasynManager->interruptStart(this->asynStdInterfaces.genericPointerInterruptPvt, &pclientList);
-    numNodes = ellCount(pclientList);
-    for (i=0; i<numNodes; i++) {
-        if (nextClient_ > numNodes) nextClient_ = 1;
-        pnode = (interruptNode *)ellNth(pclientList, nextClient_);
-        nextClient_++;
-        asynGenericPointerInterrupt *pInterrupt = (asynGenericPointerInterrupt *)pnode->drvPvt;
+    clients_.clear();
+    for (pnode = (interruptNode *)ellFirst(pclientList); pnode; pnode = (interruptNode *)ellNext(&pnode->node)) {
+        pInterrupt = (asynGenericPointerInterrupt *)pnode->drvPvt;
         pasynManager->getAddr(pInterrupt->pasynUser, &addr);
         /* If this is not a multi-device then address is -1, change to 0 */
         if (addr == -1) addr = 0;
         if ((pInterrupt->pasynUser->reason != reason) || (address != addr)) continue;
+        clients_.push_back(pInterrupt);
+    }
+    numClients = (int)clients_.size();
+    if (numClients == 0) {
+        pasynManager->interruptEnd(this->asynStdInterfaces.genericPointerInterruptPvt);
+        return asynSuccess;
+    }
+
+    this->lock();
+    getIntegerParam(NDPluginScatterMethod, &method);
+    if (method == NDScatterLeastQueue) {
+        /* getQueueFree() does not take the lock of the client, so a busy client does not hold us up.
+         * Clients that are not plugins are only chosen if no plugin has free queue elements. */
+        queueFree_.resize(numClients);
+        for (i=0; i<numClients; i++) {
+            pPlugin = NDPluginDriver::getCallbackPlugin(clients_[i]);
+            queueFree_[i] = pPlugin ? pPlugin->getQueueFree() : -1;
+        }
+    }
+    resizeClients(numClients);
+    first = chooseClient(pArray, method);
+    this->unlock();
+
+    for (numTried=0; numTried<numClients; numTried++) {
+        client = (first + numTried) % numClients;
+        pInterrupt = clients_[client];
         /* Set pasynUser->auxStatus to asynOverflow.  
          * This is a flag that means return without generating an error if the queue is full.
          * We don't set this for the last node because if the last node cannot queue the array
          * then the array will be dropped */
         pInterrupt->pasynUser->auxStatus = asynOverflow;
-        if (i == numNodes-1) pInterrupt->pasynUser->auxStatus = asynSuccess;
+        if ((numTried == numClients-1) || (method == NDScatterUniqueId)) pInterrupt->pasynUser->auxStatus = asynSuccess;
         pInterrupt->callback(pInterrupt->userPvt, pInterrupt->pasynUser, pArray);
-        if (pInterrupt->pasynUser->auxStatus == asynSuccess) break;
+        if (pInterrupt->pasynUser->auxStatus == asynSuccess) {
+            accepted = true;
+            break;
+        }
+        if (method == NDScatterUniqueId) break;
     }
     pasynManager->interruptEnd(this->asynStdInterfaces.genericPointerInterruptPvt);
+
+    this->lock();
+    if ((int)dispatched_.size() == numClients) {
+        for (i=0; i<numTried; i++) skipped_[(first + i) % numClients]++;
+        if (accepted) dispatched_[client]++;
+        else if (numTried < numClients) skipped_[client]++;
+    }
+    this->unlock();
+    return asynSuccess;
+}
+
+/** Chooses the client to try first for an array; called with the lock held.
+  * \param[in] pArray Pointer to the NDArray
+  * \param[in] method The scatter method (NDScatterMethod_t)
+  * \return Returns the index of the client in clients_. */
+int NDPluginScatter::chooseClient(NDArray *pArray, int method)
+{
+    int numClients = (int)clients_.size();
+    int client = nextClient_ % numClients;
+    int best, total;
+    int i, j;
+
+    switch (method) {
+    case NDScatterLeastQueue:
+        /* Start the search at the next client so that clients with equal queues take turns */
+        best = client;
+        for (i=1; i<numClients; i++) {
+            j = (client + i) % numClients;
+            if (queueFree_[j] > queueFree_[best]) best = j;
+        }
+        client = best;
+        break;
+    case NDScatterWeighted:
+        /* Smooth weighted round robin: each client gains its weight in credit, and the client with
+         * the most credit gets the array and pays the total weight.  This spreads each client's
+         * arrays evenly rather than sending them in bursts. */
+        total = 0;
+        best = -1;
+        for (i=0; i<numClients; i++) {
+            credits_[i] += weights_[i];
+            total += weights_[i];
+            if ((weights_[i] > 0) && ((best < 0) || (credits_[i] > credits_[best]))) best = i;
+        }
+        /* If all of the weights are 0 use round robin */
+        if (best >= 0) {
+            credits_[best] -= total;
+            client = best;
+        }
+        break;
+    case NDScatterUniqueId:
+        client = (int)((unsigned int)pArray->uniqueId % numClients);
+        break;
+    default:
+        break;
+    }
+    nextClient_ = (client + 1) % numClients;
+    return client;
+}
+
+/** Resizes the per-client arrays when the number of clients changes; called with the lock held.
+  * The clients are numbered in the order they registered for callbacks, so the counters are reset
+  * because they may no longer belong to the same clients.
+  * \param[in] numClients The number of clients */
+void NDPluginScatter::resizeClients(size_t numClients)
+{
+    if (dispatched_.size() == numClients) return;
+    dispatched_.assign(numClients, 0);
+    skipped_.assign(numClients, 0);
+    credits_.assign(numClients, 0);
+    /* Weights are kept for clients that have not connected yet; new clients have a weight of 1 */
+    if (weights_.size() < numClients) {
+        weights_.resize(numClients, 1);
+        doCallbacksInt32Array(&weights_[0], weights_.size(), NDPluginScatterWeights, 0);
+    }
+    setIntegerParam(NDPluginScatterNumClients, (int)numClients);
+    callParamCallbacks();
+}
+
+/** Called when asyn clients call pasynInt32->write().
+  * This function performs actions for NDPluginScatterMethod and NDPluginScatterResetCounters.
+  * For other parameters it calls NDPluginDriver::writeInt32.
+  * \param[in] pasynUser pasynUser structure that encodes the reason and address.
+  * \param[in] value Value to write. */
+asynStatus NDPluginScatter::writeInt32(asynUser *pasynUser, epicsInt32 value)
+{
+    int function = pasynUser->reason;
+    asynStatus status = asynSuccess;
+
+    if (function == NDPluginScatterMethod) {
+        setIntegerParam(function, value);
+        credits_.assign(credits_.size(), 0);
+    } else if (function == NDPluginScatterResetCounters) {
+        dispatched_.assign(dispatched_.size(), 0);
+        skipped_.assign(skipped_.size(), 0);
+    } else {
+        return NDPluginDriver::writeInt32(pasynUser, value);
+    }
+    callParamCallbacks();
+    return status;
+}
+
+/** Called when asyn clients call pasynInt32Array->read().
+  * Returns the per-client weights and counters, and calls NDPluginDriver::readInt32Array for other parameters.
+  * \param[in] pasynUser pasynUser structure that encodes the reason and address.
+  * \param[out] value Array of values.
+  * \param[in] nElements Maximum number of elements to read.
+  * \param[out] nIn Number of elements read. */
+asynStatus NDPluginScatter::readInt32Array(asynUser *pasynUser, epicsInt32 *value,
+                                           size_t nElements, size_t *nIn)
+{
+    int function = pasynUser->reason;
+    std::vector<int> *pValues;
+    size_t i;
+
+    if      (function == NDPluginScatterWeights)    pValues = &weights_;
+    else if (function == NDPluginScatterDispatched) pValues = &dispatched_;
+    else if (function == NDPluginScatterSkipped)    pValues = &skipped_;
+    else return NDPluginDriver::readInt32Array(pasynUser, value, nElements, nIn);
+
+    if (nElements > pValues->size()) nElements = pValues->size();
+    for (i=0; i<nElements; i++) value[i] = (*pValues)[i];
+    *nIn = nElements;
+    return asynSuccess;
+}
+
+/** Called when asyn clients call pasynInt32Array->write().
+  * Sets the weights of the clients for the Weighted method; negative weights are set to 0.
+  * \param[in] pasynUser pasynUser structure that encodes the reason and address.
+  * \param[in] value Array of values.
+  * \param[in] nElements Number of elements to write. */
+asynStatus NDPluginScatter::writeInt32Array(asynUser *pasynUser, epicsInt32 *value,
+                                            size_t nElements)
+{
+    int function = pasynUser->reason;
+    size_t i;
+
+    if (function != NDPluginScatterWeights) {
+        return NDPluginDriver::writeInt32Array(pasynUser, value, nElements);
+    }
+    weights_.assign(value, value + nElements);
+    for (i=0; i<weights_.size(); i++) {
+        if (weights_[i] < 0) weights_[i] = 0;
+    }
+    if (weights_.size() < credits_.size()) weights_.resize(credits_.size(), 1);
+    credits_.assign(credits_.size(), 0);
+    if (!weights_.empty()) doCallbacksInt32Array(&weights_[0], weights_.size(), NDPluginScatterWeights, 0);
     return asynSuccess;
 }
 
@@ -123,11 +304,17 @@ NDPluginScatter::NDPluginScatter(const char *portName, int queueSize, int blocki
                    asynInt32ArrayMask | asynFloat64Mask | asynFloat64ArrayMask | asynGenericPointerMask,
                    asynInt32ArrayMask | asynFloat64Mask | asynFloat64ArrayMask | asynGenericPointerMask,
                    ASYN_MULTIDEVICE, 1, priority, stackSize, 1),
-    nextClient_(1)
+    nextClient_(0)
 {
     //static const char *functionName = "NDPluginScatter::NDPluginScatter";
 
     createParam(NDPluginScatterMethodString,         asynParamInt32,        &NDPluginScatterMethod);
+    createParam(NDPluginScatterNumClientsString,     asynParamInt32,        &NDPluginScatterNumClients);
+    createParam(NDPluginScatterWeightsString,        asynParamInt32Array,   &NDPluginScatterWeights);
+    createParam(NDPluginScatterDispatchedString,     asynParamInt32Array,   &NDPluginScatterDispatched);
+    createParam(NDPluginScatterSkippedString,        asynParamInt32Array,   &NDPluginScatterSkipped);
+    createParam(NDPluginScatterResetCountersString,  asynParamInt32,        &NDPluginScatterResetCounters);
+    setIntegerParam(NDPluginScatterNumClients, 0);
 
     /* Set the plugin type string */
     setStringParam(NDPluginDriverPluginType, "NDPluginScatter");
@@ -1,10 +1,25 @@
 #ifndef NDPluginScatter_H
 #define NDPluginScatter_H
 
+#include <vector>
+
 #include "NDPluginDriver.h"
 
 /* General parameters */
 #define NDPluginScatterMethodString          "SCATTER_METHOD"            /* (asynInt32,        r/w) Algorithm for scatter */
+#define NDPluginScatterNumClientsString      "SCATTER_NUM_CLIENTS"       /* (asynInt32,        r/o) Number of callback clients */
+#define NDPluginScatterWeightsString         "SCATTER_WEIGHTS"           /* (asynInt32Array,   r/w) Weight of each client for Weighted method */
+#define NDPluginScatterDispatchedString      "SCATTER_DISPATCHED"        /* (asynInt32Array,   r/o) Number of arrays passed to each client */
+#define NDPluginScatterSkippedString         "SCATTER_SKIPPED"           /* (asynInt32Array,   r/o) Number of arrays each client could not accept */
+#define NDPluginScatterResetCountersString   "SCATTER_RESET_COUNTERS"    /* (asynInt32,        r/w) Reset the dispatched and skipped counters */
+
+/** Scatter methods */
+typedef enum {
+    NDScatterRoundRobin,    /**< Each array goes to the next client */
+    NDScatterLeastQueue,    /**< Each array goes to the client with the most free queue elements */
+    NDScatterWeighted,      /**< Clients get arrays in proportion to their weights */
+    NDScatterUniqueId       /**< Each array goes to client number (UniqueId modulo number of clients) */
+} NDScatterMethod_t;
 
 /** A plugin that does callbacks in round-robin fashion rather than passing every NDArray to every callback client  */
 class epicsShareClass NDPluginScatter : public NDPluginDriver {
@@ -15,14 +30,32 @@ public:
                       int priority, int stackSize);
     /* These methods override the virtual methods in the base class */
     void processCallbacks(NDArray *pArray);
+    virtual asynStatus writeInt32(asynUser *pasynUser, epicsInt32 value);
+    virtual asynStatus readInt32Array(asynUser *pasynUser, epicsInt32 *value,
+                                      size_t nElements, size_t *nIn);
+    virtual asynStatus writeInt32Array(asynUser *pasynUser, epicsInt32 *value,
+                                       size_t nElements);
 
 protected:
     int NDPluginScatterMethod;
     #define FIRST_NDPLUGIN_SCATTER_PARAM NDPluginScatterMethod
+    int NDPluginScatterNumClients;
+    int NDPluginScatterWeights;
+    int NDPluginScatterDispatched;
+    int NDPluginScatterSkipped;
+    int NDPluginScatterResetCounters;
                                 
 private:
     int nextClient_;
+    std::vector<asynGenericPointerInterrupt *> clients_;  /**< Clients matching the reason and address */
+    std::vector<int> queueFree_;    /**< Free queue elements of each client for LeastQueue method */
+    std::vector<int> weights_;      /**< Weight of each client */
+    std::vector<int> credits_;      /**< Current credit of each client for Weighted method */
+    std::vector<int> dispatched_;   /**< Number of arrays passed to each client */
+    std::vector<int> skipped_;      /**< Number of arrays each client could not accept */
     asynStatus doNDArrayCallbacks(NDArray *pArray, int reason, int addr);
+    int chooseClient(NDArray *pArray, int method);
+    void resizeClients(size_t numClients);
 };
     
 #endif
@@ -13,6 +13,9 @@
 #include <string.h>
 #include <stdio.h>
 
+#include <algorithm>
+#include <vector>
+
 #include <epicsTypes.h>
 #include <epicsMessageQueue.h>
 #include <epicsThread.h>
@@ -28,6 +31,20 @@
 
 static const char *driverName="NDPluginStdArrays";
 
+/** Returns true if the data of an array of type arrayType can be passed unchanged to a client that
+  * wants type signedType.  The asyn integer array interfaces are used for both signed and unsigned data,
+  * so this is true for the unsigned type of the same size as well. */
+static bool isNativeType(NDDataType_t arrayType, NDDataType_t signedType)
+{
+    if (arrayType == signedType) return true;
+    switch (signedType) {
+        case NDInt8:  return arrayType == NDUInt8;
+        case NDInt16: return arrayType == NDUInt16;
+        case NDInt32: return arrayType == NDUInt32;
+        default:      return false;
+    }
+}
+
 template <typename epicsType, typename interruptType>
 void NDPluginStdArrays::arrayInterruptCallback(NDArray *pArray, NDArrayPool *pNDArrayPool, 
                             void *interruptPvt, int *initialized, NDDataType_t signedType)
@@ -43,18 +60,23 @@ void NDPluginStdArrays::arrayInterruptCallback(NDArray *pArray, NDArrayPool *pND
     pnode = (interruptNode *)ellFirst(pclientList);
     while (pnode) {
         interruptType *pInterrupt = (interruptType *)pnode->drvPvt;
-        if (pInterrupt->pasynUser->reason == NDPluginStdArraysData) {
+        if (clientReady(pInterrupt->pasynUser->reason, pArray)) {
             if (!*initialized) {
                 *initialized = 1;
                 pArray->getInfo(&arrayInfo);
-                status = pNDArrayPool->convert(pArray, &pOutput, signedType);
-                if (status) {
-                    asynPrint(pInterrupt->pasynUser, ASYN_TRACE_ERROR,
-                              "%s::arrayInterruptCallback: error allocating array in convert()\n",
-                               driverName);
-                    break;
+                if (isNativeType(pArray->dataType, signedType)) {
+                    /* The clients copy the data, so they can be given the data of the NDArray itself */
+                    pData = (epicsType *)pArray->pData;
+                } else {
+                    status = pNDArrayPool->convert(pArray, &pOutput, signedType);
+                    if (status) {
+                        asynPrint(pInterrupt->pasynUser, ASYN_TRACE_ERROR,
+                                  "%s::arrayInterruptCallback: error allocating array in convert()\n",
+                                   driverName);
+                        break;
+                    }
+                    pData = (epicsType *)pOutput->pData;
                 }
-                pData = (epicsType *)pOutput->pData;
             }
             pInterrupt->pasynUser->timestamp = pArray->epicsTS;
             pInterrupt->callback(pInterrupt->userPvt,
@@ -76,7 +98,7 @@ asynStatus NDPluginStdArrays::readArray(asynUser *pasynUser, epicsType *value, s
     NDArrayInfo_t arrayInfo;
 
     myArray = this->pArrays[0];
-    if (command == NDPluginStdArraysData) {
+    if (isDataReason(command)) {
         /* If there is valid data available we already have a copy of it.
          * No need to call driver just copy the data from our buffer */
         if (!myArray || !myArray->pData) {
@@ -89,17 +111,21 @@ asynStatus NDPluginStdArrays::readArray(asynUser *pasynUser, epicsType *value, s
              * Just pass the first nElements. */
              arrayInfo.nElements = nElements;
         }
-        status = (asynStatus)this->pNDArrayPool->convert(myArray, &pOutput, outputType);
-        if (status) {
-            asynPrint(pasynUser, ASYN_TRACE_ERROR,
-                      "%s::readArray: error allocating array in convert()\n",
-                       driverName);
-           goto done;
-        }
-        /* Copy the data */
         *nIn = arrayInfo.nElements;
-        memcpy(value, pOutput->pData, *nIn*sizeof(epicsType));
-        pOutput->release();
+        if (isNativeType(myArray->dataType, outputType)) {
+            memcpy(value, myArray->pData, *nIn*sizeof(epicsType));
+        } else {
+            status = (asynStatus)this->pNDArrayPool->convert(myArray, &pOutput, outputType);
+            if (status) {
+                asynPrint(pasynUser, ASYN_TRACE_ERROR,
+                          "%s::readArray: error allocating array in convert()\n",
+                           driverName);
+               goto done;
+            }
+            /* Copy the data */
+            memcpy(value, pOutput->pData, *nIn*sizeof(epicsType));
+            pOutput->release();
+        }
         /* Set the timestamp */
         pasynUser->timestamp = myArray->epicsTS;
     } else {
@@ -112,12 +138,175 @@ asynStatus NDPluginStdArrays::readArray(asynUser *pasynUser, epicsType *value, s
     return(status);
 }
 
+/** Returns true if a parameter is the array data, either NDPluginStdArraysData or the parameter
+  * for a client with a maximum callback rate.  Called with the lock held. */
+bool NDPluginStdArrays::isDataReason(int reason)
+{
+    return (reason == NDPluginStdArraysData) || (clients_.find(reason) != clients_.end());
+}
+
+/** Returns true if an array should be passed to the clients of a parameter.
+  * For clients with a maximum callback rate this is false if the last array was passed to them
+  * less than 1/MAX_RATE seconds ago.  The clients of all of the array interfaces with the same
+  * parameter are given the same arrays.  Called without the lock held.
+  * \param[in] reason The parameter of the client.
+  * \param[in] pArray The NDArray. */
+bool NDPluginStdArrays::clientReady(int reason, NDArray *pArray)
+{
+    std::map<int, NDStdArraysClient_t>::iterator it;
+    epicsTimeStamp now;
+    bool ready = false;
 
+    if (reason == NDPluginStdArraysData) return true;
+    this->lock();
+    it = clients_.find(reason);
+    if (it != clients_.end()) {
+        NDStdArraysClient_t *pClient = &it->second;
+        if (pClient->called && (pClient->lastUniqueId == pArray->uniqueId)) {
+            ready = true;
+        } else {
+            epicsTimeGetCurrent(&now);
+            if (!pClient->called || (epicsTimeDiffInSeconds(&now, &pClient->lastTime) >= pClient->minTime)) {
+                pClient->lastTime = now;
+                pClient->lastUniqueId = pArray->uniqueId;
+                pClient->called = true;
+                ready = true;
+            }
+        }
+    }
+    this->unlock();
+    return ready;
+}
+
+/** Bins the data of an array in blocks of binning x binning elements, averaging each block.
+  * The color dimension of an RGB array is not binned.
+  * \param[in] pIn The input array, which has at most 3 dimensions.
+  * \param[in] pOut The output array with the binned dimensions.
+  * \param[in] binning The binning of each of the 3 dimensions, 1 for dimensions that are not binned. */
+template <typename epicsType>
+static void binData(NDArray *pIn, NDArray *pOut, const size_t *binning)
+{
+    size_t inDims[3] = {1, 1, 1}, outDims[3] = {1, 1, 1};
+    size_t i, j, k, io, end;
+    size_t offsetK, offsetJ;
+    size_t count;
+    double sum;
+    int dim;
+    const epicsType *pData = (const epicsType *)pIn->pData;
+    epicsType *pOutData = (epicsType *)pOut->pData;
+
+    for (dim=0; dim<pIn->ndims; dim++) {
+        inDims[dim] = pIn->dims[dim].size;
+        outDims[dim] = pOut->dims[dim].size;
+    }
+    std::vector<double> sums(outDims[0]*outDims[1]*outDims[2], 0.);
+    for (k=0; k<inDims[2]; k++) {
+        offsetK = (k/binning[2])*outDims[1]*outDims[0];
+        for (j=0; j<inDims[1]; j++) {
+            offsetJ = offsetK + (j/binning[1])*outDims[0];
+            for (io=0; io<outDims[0]; io++) {
+                end = (io+1)*binning[0];
+                if (end > inDims[0]) end = inDims[0];
+                for (i=io*binning[0], sum=0.; i<end; i++) sum += *pData++;
+                sums[offsetJ + io] += sum;
+            }
+        }
+    }
+    /* The blocks at the ends of each dimension can be smaller than binning */
+    for (k=0; k<outDims[2]; k++) {
+        for (j=0; j<outDims[1]; j++) {
+            for (io=0; io<outDims[0]; io++) {
+                count = std::min(binning[0], inDims[0] - io*binning[0]) *
+                        std::min(binning[1], inDims[1] - j*binning[1]) *
+                        std::min(binning[2], inDims[2] - k*binning[2]);
+                *pOutData++ = (epicsType)(sums[(k*outDims[1] + j)*outDims[0] + io] / count);
+            }
+        }
+    }
+}
+
+/** Bins an array so it has at most maxElements elements.
+  * All of the dimensions except the color dimension of RGB arrays are binned by the same factor,
+  * the smallest one that reduces the array to maxElements.
+  * \param[in] pArray The NDArray.
+  * \param[in] maxElements The maximum number of elements.
+  * \param[out] binning The binning used.
+  * \return Returns a new binned array, or NULL if the array does not need to be binned or cannot be. */
+NDArray *NDPluginStdArrays::binArray(NDArray *pArray, int maxElements, int *binning)
+{
+    NDArrayInfo_t arrayInfo;
+    NDAttribute *pAttribute;
+    int colorMode = NDColorModeMono;
+    int colorDim = -1;
+    size_t dimBinning[3] = {1, 1, 1};
+    size_t outDims[3];
+    size_t bin, nElements;
+    int dim;
+    NDArray *pOut;
+    static const char *functionName = "binArray";
+
+    *binning = 1;
+    pArray->getInfo(&arrayInfo);
+    if ((maxElements <= 0) || (arrayInfo.nElements <= (size_t)maxElements) || (pArray->ndims > 3)) return NULL;
+    pAttribute = pArray->pAttributeList->find("ColorMode");
+    if (pAttribute) pAttribute->getValue(NDAttrInt32, &colorMode);
+    if ((pArray->ndims == 3) && (colorMode == NDColorModeRGB1)) colorDim = 0;
+    if ((pArray->ndims == 3) && (colorMode == NDColorModeRGB2)) colorDim = 1;
+    if ((pArray->ndims == 3) && (colorMode == NDColorModeRGB3)) colorDim = 2;
+
+    for (bin=2; ; bin++) {
+        for (dim=0, nElements=1; dim<pArray->ndims; dim++) {
+            outDims[dim] = pArray->dims[dim].size;
+            if (dim != colorDim) outDims[dim] = (outDims[dim] + bin - 1) / bin;
+            nElements *= outDims[dim];
+        }
+        if (nElements <= (size_t)maxElements) break;
+        /* The color dimension alone can be larger than maxElements */
+        for (dim=0; dim<pArray->ndims; dim++) {
+            if ((dim != colorDim) && (outDims[dim] > 1)) break;
+        }
+        if (dim == pArray->ndims) break;
+    }
+    for (dim=0; dim<pArray->ndims; dim++) {
+        if (dim != colorDim) dimBinning[dim] = bin;
+    }
+
+    pOut = this->pNDArrayPool->alloc(pArray->ndims, outDims, pArray->dataType, 0, NULL);
+    if (!pOut) {
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+            "%s::%s error allocating binned array\n",
+            driverName, functionName);
+        return NULL;
+    }
+    for (dim=0; dim<pArray->ndims; dim++) {
+        pOut->dims[dim].offset  = pArray->dims[dim].offset;
+        pOut->dims[dim].binning = pArray->dims[dim].binning * (int)dimBinning[dim];
+        pOut->dims[dim].reverse = pArray->dims[dim].reverse;
+    }
+    pOut->uniqueId  = pArray->uniqueId;
+    pOut->timeStamp = pArray->timeStamp;
+    pOut->epicsTS   = pArray->epicsTS;
+    pArray->pAttributeList->copy(pOut->pAttributeList);
+
+    switch (pArray->dataType) {
+        case NDInt8:    binData<epicsInt8>   (pArray, pOut, dimBinning); break;
+        case NDUInt8:   binData<epicsUInt8>  (pArray, pOut, dimBinning); break;
+        case NDInt16:   binData<epicsInt16>  (pArray, pOut, dimBinning); break;
+        case NDUInt16:  binData<epicsUInt16> (pArray, pOut, dimBinning); break;
+        case NDInt32:   binData<epicsInt32>  (pArray, pOut, dimBinning); break;
+        case NDUInt32:  binData<epicsUInt32> (pArray, pOut, dimBinning); break;
+        case NDFloat32: binData<epicsFloat32>(pArray, pOut, dimBinning); break;
+        case NDFloat64: binData<epicsFloat64>(pArray, pOut, dimBinning); break;
+    }
+    *binning = (int)bin;
+    return pOut;
+}
 
 /** Callback function that is called by the NDArray driver with new NDArray data.
   * It does callbacks with the array data to any registered asyn clients on any
   * of the asynXXXArray interfaces.  It converts the array data to the type required for that
-  * interface.
+  * interface, unless the array already has that type.  If the array has more than
+  * NDPluginStdArraysMaxElements elements it is binned first.
   * \param[in] pArray  The NDArray from the callback.
   */ 
 void NDPluginStdArrays::processCallbacks(NDArray *pArray)
@@ -132,15 +321,22 @@ void NDPluginStdArrays::processCallbacks(NDArray *pArray)
     int int32Initialized=0;
     int float32Initialized=0;
     int float64Initialized=0;
-    NDArrayInfo_t arrayInfo;
+    int maxElements, binning;
+    NDArray *pBinned;
     asynStandardInterfaces *pInterfaces = this->getAsynStdInterfaces();
     /* static const char* functionName = "processCallbacks"; */
 
-    /* Call the base class method */
+    getIntegerParam(NDPluginStdArraysMaxElements, &maxElements);
+    this->unlock();
+    pBinned = binArray(pArray, maxElements, &binning);
+    this->lock();
+    if (pBinned) pArray = pBinned;
+    setIntegerParam(NDPluginStdArraysBinning, binning);
+
+    /* Call the base class method.  This is done with the binned array so the dimensions
+     * are those of the data passed to the clients */
     NDPluginDriver::beginProcessCallbacks(pArray);
     
-    pArray->getInfo(&arrayInfo);
- 
     /* This function is called with the lock taken, and it must be set when we exit.
      * The following code can be exected without the mutex because we are not accessing pPvt */
     this->unlock();
@@ -175,7 +371,7 @@ void NDPluginStdArrays::processCallbacks(NDArray *pArray)
     /* We always keep the last array so read() can use it.  
      * Release previous one, reserve new one */
     if (this->pArrays[0]) this->pArrays[0]->release();
-    pArray->reserve();
+    if (!pBinned) pArray->reserve();
     this->pArrays[0] = pArray;
     /* Update the parameters.  The counter should be updated after data are posted
      * because clients might use that to detect new data */
@@ -244,6 +440,47 @@ asynStatus NDPluginStdArrays::readFloat64Array(asynUser *pasynUser, epicsFloat64
 }
 
 
+/** Called by asyn clients to find the parameter for a drvInfo string.
+  * An array data client can add options to the drvInfo string; "STD_ARRAY_DATA MAX_RATE=5" limits
+  * the callbacks to that client to 5 per second.  A parameter is created for each different
+  * drvInfo string with options, so clients with the same options share their callback rate.
+  * For all other drvInfo strings this calls NDPluginDriver::drvUserCreate.
+  * \param[in] pasynUser pasynUser structure that driver modifies
+  * \param[in] drvInfo String containing information about what driver function is being referenced
+  * \param[out] pptypeName Location in which driver puts a copy of drvInfo.
+  * \param[out] psize Location where driver puts size of param */
+asynStatus NDPluginStdArrays::drvUserCreate(asynUser *pasynUser, const char *drvInfo,
+                                            const char **pptypeName, size_t *psize)
+{
+    size_t len = strlen(NDPluginStdArraysDataString);
+    const char *pOption;
+    double maxRate;
+    int index;
+    NDStdArraysClient_t client;
+    static const char *functionName = "drvUserCreate";
+
+    if ((strncmp(drvInfo, NDPluginStdArraysDataString, len) == 0) && (drvInfo[len] == ' ')) {
+        this->lock();
+        if (findParam(drvInfo, &index) != asynSuccess) {
+            pOption = strstr(drvInfo + len, NDPluginStdArraysMaxRateOption);
+            if (!pOption || (sscanf(pOption + strlen(NDPluginStdArraysMaxRateOption), "%lf", &maxRate) != 1)) {
+                this->unlock();
+                asynPrint(pasynUser, ASYN_TRACE_ERROR,
+                    "%s::%s unknown option in drvInfo=%s\n",
+                    driverName, functionName, drvInfo);
+                return asynError;
+            }
+            createParam(drvInfo, asynParamGenericPointer, &index);
+            client.minTime = (maxRate > 0.) ? 1./maxRate : 0.;
+            client.lastUniqueId = 0;
+            client.called = false;
+            clients_[index] = client;
+        }
+        this->unlock();
+    }
+    return NDPluginDriver::drvUserCreate(pasynUser, drvInfo, pptypeName, psize);
+}
+
 /** Constructor for NDPluginStdArrays; all parameters are simply passed to NDPluginDriver::NDPluginDriver.
   * This plugin cannot block (ASYN_CANBLOCK=0) and is not multi-device (ASYN_MULTIDEVICE=0).
   * It allocates a maximum of 2 NDArray buffers for internal use.
@@ -283,7 +520,11 @@ NDPluginStdArrays::NDPluginStdArrays(const char *portName, int queueSize, int bl
 {
     //static const char *functionName = "NDPluginStdArrays";
     
-    createParam(NDPluginStdArraysDataString, asynParamGenericPointer, &NDPluginStdArraysData);
+    createParam(NDPluginStdArraysDataString,        asynParamGenericPointer, &NDPluginStdArraysData);
+    createParam(NDPluginStdArraysMaxElementsString, asynParamInt32,          &NDPluginStdArraysMaxElements);
+    createParam(NDPluginStdArraysBinningString,     asynParamInt32,          &NDPluginStdArraysBinning);
+    setIntegerParam(NDPluginStdArraysMaxElements, 0);
+    setIntegerParam(NDPluginStdArraysBinning, 1);
 
     /* Set the plugin type string */    
     setStringParam(NDPluginDriverPluginType, "NDPluginStdArrays");
@@ -1,11 +1,27 @@
 #ifndef NDPluginStdArrays_H
 #define NDPluginStdArrays_H
 
+#include <map>
+
 #include <epicsTypes.h>
 
 #include "NDPluginDriver.h"
 
-#define NDPluginStdArraysDataString "STD_ARRAY_DATA"           /* (asynXXXArray, r/w) Array data waveform */
+#define NDPluginStdArraysDataString        "STD_ARRAY_DATA"          /* (asynXXXArray, r/w) Array data waveform */
+#define NDPluginStdArraysMaxElementsString "STD_ARRAY_MAX_ELEMENTS"  /* (asynInt32,    r/w) Maximum elements, arrays are binned to fit; 0=no limit */
+#define NDPluginStdArraysBinningString     "STD_ARRAY_BINNING"       /* (asynInt32,    r/o) Binning used to fit MaxElements */
+
+/** Option string for an array data client; the drvInfo string is NDPluginStdArraysDataString followed by
+  * this, for example "STD_ARRAY_DATA MAX_RATE=5" */
+#define NDPluginStdArraysMaxRateOption     "MAX_RATE="
+
+/** State of array data clients that have a maximum callback rate */
+typedef struct {
+    double minTime;             /**< Minimum time between callbacks in seconds */
+    epicsTimeStamp lastTime;    /**< Time of the last callback */
+    int lastUniqueId;           /**< UniqueId of the last array passed to the clients */
+    bool called;                /**< True once the clients have been called */
+} NDStdArraysClient_t;
 
 /** Converts NDArray callback data into standard asyn arrays (asynInt8Array, asynInt16Array, asynInt32Array,
   * asynFloat32Array or asynFloat64Array); normally used for putting NDArray data in EPICS waveform records.
@@ -29,9 +45,13 @@ public:
                                         size_t nElements, size_t *nIn);
     virtual asynStatus readFloat64Array(asynUser *pasynUser, epicsFloat64 *value,
                                         size_t nElements, size_t *nIn);
+    virtual asynStatus drvUserCreate(asynUser *pasynUser, const char *drvInfo,
+                                     const char **pptypeName, size_t *psize);
 protected:
     int NDPluginStdArraysData;
     #define FIRST_NDPLUGIN_STDARRAYS_PARAM NDPluginStdArraysData
+    int NDPluginStdArraysMaxElements;
+    int NDPluginStdArraysBinning;
 private:
     /* These methods are just for this class */
     template <typename epicsType> asynStatus readArray(asynUser *pasynUser, epicsType *value, 
@@ -39,7 +59,11 @@ private:
     template <typename epicsType, typename interruptType> void arrayInterruptCallback(NDArray *pArray, 
                             NDArrayPool *pNDArrayPool, 
                             void *interruptPvt, int *initialized, NDDataType_t signedType);
-                                        
+    NDArray *binArray(NDArray *pArray, int maxElements, int *binning);
+    bool isDataReason(int reason);
+    bool clientReady(int reason, NDArray *pArray);
+    /** Clients with a maximum callback rate, indexed by the parameter created for their drvInfo string */
+    std::map<int, NDStdArraysClient_t> clients_;
 };
 
 #endif
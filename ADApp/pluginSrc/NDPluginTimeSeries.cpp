@@ -27,8 +27,18 @@
 
 #include "NDPluginTimeSeries.h"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #define DEFAULT_NUM_TSPOINTS 2048
 
+/* Size of the block of time points that are collected before they are copied to the time series.
+ * This is small enough to stay in the L1 cache while it is transposed. */
+#define TS_BLOCK_BYTES 32768
+
+#define DEFAULT_LEVEL_DECIMATION 10
+
 enum {
   TSAcquireModeFixed,
   TSAcquireModeCircular
@@ -64,7 +74,9 @@ NDPluginTimeSeries::NDPluginTimeSeries(const char *portName, int queueSize, int
              asynFloat64Mask | asynFloat64ArrayMask | asynGenericPointerMask,
              ASYN_MULTIDEVICE, 1, priority, stackSize, 1),
     dataType_(NDFloat64), dataSize_(sizeof(epicsFloat64)), numTimePoints_(DEFAULT_NUM_TSPOINTS), currentTimePoint_(0),
-    uniqueId_(0), numAverage_(1), timePerPoint_(0), signalData_(0), timeAxis_(0), timeStamp_(0), pTimeCircular_(0)
+    uniqueId_(0), numAverage_(1), timePerPoint_(0), signalData_(0), callbackData_(0),
+    signalMin_(0), signalMax_(0), blockStore_(0), blockMin_(0), blockMax_(0),
+    numLevels_(1), levelDecimation_(DEFAULT_LEVEL_DECIMATION), timeAxis_(0), timeStamp_(0)
 {
   //const char *functionName = "NDPluginTimeSeries::NDPluginTimeSeries";
 
@@ -74,6 +86,9 @@ NDPluginTimeSeries::NDPluginTimeSeries(const char *portName, int queueSize, int
   maxSignals_ = maxSignals;
   numSignals_ = maxSignals;
   averageStore_ = (double *)calloc(maxSignals_, sizeof(double));
+  minStore_     = (double *)calloc(maxSignals_, sizeof(double));
+  maxStore_     = (double *)calloc(maxSignals_, sizeof(double));
+  memset(levels_, 0, sizeof(levels_));
   
   /* Per-plugin parameters */
   createParam(TSAcquireString,                 asynParamInt32, &P_TSAcquire);
@@ -87,14 +102,34 @@ NDPluginTimeSeries::NDPluginTimeSeries(const char *portName, int queueSize, int
   createParam(TSAcquireModeString,             asynParamInt32, &P_TSAcquireMode);
   createParam(TSTimeAxisString,         asynParamFloat64Array, &P_TSTimeAxis);
   createParam(TSTimestampString,        asynParamFloat64Array, &P_TSTimestamp);
+  createParam(TSNumLevelsString,               asynParamInt32, &P_TSNumLevels);
+  createParam(TSLevelDecimationString,         asynParamInt32, &P_TSLevelDecimation);
+  createParam(TSLevel1TimeAxisString,   asynParamFloat64Array, &P_TSLevelTimeAxis[1]);
+  createParam(TSLevel2TimeAxisString,   asynParamFloat64Array, &P_TSLevelTimeAxis[2]);
+  createParam(TSLevel3TimeAxisString,   asynParamFloat64Array, &P_TSLevelTimeAxis[3]);
+  P_TSLevelTimeAxis[0] = P_TSTimeAxis;
   
   /* Per-signal parameters */
   createParam(TSTimeSeriesString,       asynParamFloat64Array, &P_TSTimeSeries);
+  createParam(TSLevel0MinString,        asynParamFloat64Array, &P_TSLevelMin[0]);
+  createParam(TSLevel0MaxString,        asynParamFloat64Array, &P_TSLevelMax[0]);
+  createParam(TSLevel1MeanString,       asynParamFloat64Array, &P_TSLevelMean[1]);
+  createParam(TSLevel1MinString,        asynParamFloat64Array, &P_TSLevelMin[1]);
+  createParam(TSLevel1MaxString,        asynParamFloat64Array, &P_TSLevelMax[1]);
+  createParam(TSLevel2MeanString,       asynParamFloat64Array, &P_TSLevelMean[2]);
+  createParam(TSLevel2MinString,        asynParamFloat64Array, &P_TSLevelMin[2]);
+  createParam(TSLevel2MaxString,        asynParamFloat64Array, &P_TSLevelMax[2]);
+  createParam(TSLevel3MeanString,       asynParamFloat64Array, &P_TSLevelMean[3]);
+  createParam(TSLevel3MinString,        asynParamFloat64Array, &P_TSLevelMin[3]);
+  createParam(TSLevel3MaxString,        asynParamFloat64Array, &P_TSLevelMax[3]);
+  P_TSLevelMean[0] = P_TSTimeSeries;
  
   /* Set the plugin type string */
   setStringParam(NDPluginDriverPluginType, "NDPluginTimeSeries");
   
   setIntegerParam(P_TSNumPoints, numTimePoints_);
+  setIntegerParam(P_TSNumLevels, numLevels_);
+  setIntegerParam(P_TSLevelDecimation, levelDecimation_);
   allocateArrays();
   
   /* Try to connect to the array port */
@@ -122,33 +157,82 @@ void NDPluginTimeSeries::computeNumAverage()
   callParamCallbacks();
 }
 
+/** Allocates the time series.
+  * Each signal is stored contiguously in signalData_ as a series of numTimePoints_ doubles,
+  * signal i starting at signalData_[i*numTimePoints_].  The minimum and maximum of level 0
+  * and the series of levels 1 to numLevels_-1 are stored the same way.
+  */
 void NDPluginTimeSeries::allocateArrays()
 {
   int numPoints;
-  int nDims=2;
-  size_t dims[2];
+  int level;
+  size_t seriesSize;
+  TSLevel_t *pLevel;
   
   getIntegerParam(P_TSNumPoints, &numPoints);
   numTimePoints_ = numPoints;
-  if (timeStamp_)  free(timeStamp_);
-  if (signalData_) free (signalData_);
-  if (pTimeCircular_) pTimeCircular_->release();
-
-  timeStamp_  = (double *)calloc(numSignals_*numTimePoints_, sizeof(double));
-  signalData_ = (double *)calloc(numSignals_*numTimePoints_, sizeof(double));
-  nDims = 2;
-  dims[0] = numTimePoints_;
-  dims[1] = numSignals_;
-  pTimeCircular_ = pNDArrayPool->alloc(nDims, dims, dataType_, 0, 0);
+  if (timeStamp_)    free(timeStamp_);
+  if (signalData_)   free(signalData_);
+  if (signalMin_)    free(signalMin_);
+  if (signalMax_)    free(signalMax_);
+  if (callbackData_) free(callbackData_);
+  if (blockStore_)   free(blockStore_);
+  if (blockMin_)     free(blockMin_);
+  if (blockMax_)     free(blockMax_);
+  for (level=1; level<TS_MAX_LEVELS; level++) {
+    pLevel = &levels_[level];
+    free(pLevel->mean);
+    free(pLevel->min);
+    free(pLevel->max);
+    free(pLevel->sumStore);
+    free(pLevel->minStore);
+    free(pLevel->maxStore);
+    memset(pLevel, 0, sizeof(*pLevel));
+  }
+
+  seriesSize = (size_t)numSignals_ * numTimePoints_;
+  blockPoints_ = (int)(TS_BLOCK_BYTES / (numSignals_ * sizeof(double)));
+  if (blockPoints_ < 2) blockPoints_ = 2;
+  timeStamp_    = (double *)calloc(numTimePoints_, sizeof(double));
+  signalData_   = (double *)calloc(seriesSize, sizeof(double));
+  signalMin_    = (double *)calloc(seriesSize, sizeof(double));
+  signalMax_    = (double *)calloc(seriesSize, sizeof(double));
+  callbackData_ = (double *)calloc(numTimePoints_, sizeof(double));
+  blockStore_   = (double *)calloc(blockPoints_*numSignals_, sizeof(double));
+  blockMin_     = (double *)calloc(blockPoints_*numSignals_, sizeof(double));
+  blockMax_     = (double *)calloc(blockPoints_*numSignals_, sizeof(double));
+  for (level=1; level<numLevels_; level++) {
+    pLevel = &levels_[level];
+    pLevel->mean     = (double *)calloc(seriesSize, sizeof(double));
+    pLevel->min      = (double *)calloc(seriesSize, sizeof(double));
+    pLevel->max      = (double *)calloc(seriesSize, sizeof(double));
+    pLevel->sumStore = (double *)calloc(numSignals_, sizeof(double));
+    pLevel->minStore = (double *)calloc(numSignals_, sizeof(double));
+    pLevel->maxStore = (double *)calloc(numSignals_, sizeof(double));
+  }
   createAxisArray();
   acquireReset();
 }
 
 void NDPluginTimeSeries::acquireReset()
 {
-  memset(signalData_,           0, numTimePoints_ * numSignals_ * sizeof(double));
-  memset(timeStamp_,            0, numTimePoints_ * sizeof(double));
-  memset(pTimeCircular_->pData, 0, numTimePoints_ * numSignals_ * dataSize_);
+  int level;
+  size_t seriesSize = (size_t)numSignals_ * numTimePoints_;
+  TSLevel_t *pLevel;
+
+  memset(signalData_, 0, seriesSize * sizeof(double));
+  memset(signalMin_,  0, seriesSize * sizeof(double));
+  memset(signalMax_,  0, seriesSize * sizeof(double));
+  memset(timeStamp_,  0, numTimePoints_ * sizeof(double));
+  for (level=1; level<numLevels_; level++) {
+    pLevel = &levels_[level];
+    memset(pLevel->mean, 0, seriesSize * sizeof(double));
+    memset(pLevel->min,  0, seriesSize * sizeof(double));
+    memset(pLevel->max,  0, seriesSize * sizeof(double));
+    pLevel->numAveraged = 0;
+    pLevel->currentPoint = 0;
+  }
+  numAveraged_ = 0;
   currentTimePoint_ = 0;
   setIntegerParam(P_TSCurrentPoint, currentTimePoint_);
   epicsTimeGetCurrent(&startTime_);
@@ -157,21 +241,179 @@ void NDPluginTimeSeries::acquireReset()
 void NDPluginTimeSeries::createAxisArray()
 {
   int i;
+  int level;
+  double timePerPoint = averagingTimeActual_;
   
   if (timeAxis_) free(timeAxis_);
   timeAxis_ = (double *)calloc(numTimePoints_, sizeof(double));
-  for (i=0; i<numTimePoints_; i++) {
-    if (acquireMode_ == TSAcquireModeFixed) {
-      timeAxis_[i] = i*averagingTimeActual_;
+  for (level=0; level<numLevels_; level++) {
+    for (i=0; i<numTimePoints_; i++) {
+      if (acquireMode_ == TSAcquireModeFixed) {
+        timeAxis_[i] = i*timePerPoint;
+      } else {
+        timeAxis_[i] = -(numTimePoints_-1-i)*timePerPoint;
+      }
+    }
+    doCallbacksFloat64Array(timeAxis_, numTimePoints_, P_TSLevelTimeAxis[level], 0);
+    timePerPoint *= levelDecimation_;
+  }
+}
+
+/**
+ * Copies a block of averaged time points into the per-signal time series.
+ * The block holds numRows time points of numCols signals, with the signals of each time point
+ * adjacent.  Each signal is written as a contiguous run of numRows points starting at
+ * pOut + signal*outStride, so the block is transposed as it is copied.
+ */
+static void transposeBlock(const double *pIn, int numRows, int numCols, double *pOut, int outStride)
+{
+  int row;
+  int col = 0;
+
+#if defined(__SSE2__)
+  // Transpose 2x2 tiles: two time points of two signals
+  for (; col+1 < numCols; col += 2) {
+    double *pOut0 = pOut + col*outStride;
+    double *pOut1 = pOut0 + outStride;
+    for (row=0; row+1 < numRows; row += 2) {
+      __m128d a = _mm_loadu_pd(pIn + row*numCols + col);
+      __m128d b = _mm_loadu_pd(pIn + (row+1)*numCols + col);
+      _mm_storeu_pd(pOut0 + row, _mm_unpacklo_pd(a, b));
+      _mm_storeu_pd(pOut1 + row, _mm_unpackhi_pd(a, b));
+    }
+    for (; row < numRows; row++) {
+      pOut0[row] = pIn[row*numCols + col];
+      pOut1[row] = pIn[row*numCols + col + 1];
+    }
+  }
+#endif
+  for (; col < numCols; col++) {
+    double *pOut0 = pOut + col*outStride;
+    for (row=0; row < numRows; row++) {
+      pOut0[row] = pIn[row*numCols + col];
+    }
+  }
+}
+
+/**
+ * Writes the time points collected in blockStore_ to the time series at the current time point.
+ * The caller guarantees that the block does not extend past the end of the time series.
+ * \param[in] numPoints The number of time points in the block
+ * \param[in] timeStamp The time stamp of the array the time points came from
+ */
+void NDPluginTimeSeries::flushBlock(int numPoints, double timeStamp)
+{
+  int i;
+
+  transposeBlock(blockStore_, numPoints, numSignals_, signalData_ + currentTimePoint_, numTimePoints_);
+  // Without averaging the minimum and maximum are the same as the average
+  transposeBlock((numAverage_ == 1) ? blockStore_ : blockMin_, numPoints, numSignals_,
+                 signalMin_ + currentTimePoint_, numTimePoints_);
+  transposeBlock((numAverage_ == 1) ? blockStore_ : blockMax_, numPoints, numSignals_,
+                 signalMax_ + currentTimePoint_, numTimePoints_);
+  for (i=0; i<numPoints; i++) {
+    timeStamp_[currentTimePoint_ + i] = timeStamp;
+  }
+  if (numLevels_ > 1) addToLevel1(currentTimePoint_, numPoints);
+  currentTimePoint_ += numPoints;
+}
+
+/**
+ * Adds points of level 0 to level 1, adding a point to level 1 each time levelDecimation_ points
+ * have been added.  The points are contiguous in each signal of level 0, so they are reduced in runs.
+ * \param[in] first The first point of level 0 to add
+ * \param[in] numPoints The number of points of level 0 to add
+ */
+void NDPluginTimeSeries::addToLevel1(int first, int numPoints)
+{
+  TSLevel_t *pLevel = &levels_[1];
+  const double *pMean, *pMin, *pMax;
+  double sum, minValue, maxValue;
+  int signal;
+  int i;
+  int numRun;
+
+  while (numPoints > 0) {
+    numRun = levelDecimation_ - pLevel->numAveraged;
+    if (numRun > numPoints) numRun = numPoints;
+    for (signal=0; signal<numSignals_; signal++) {
+      pMean = signalData_ + signal*numTimePoints_ + first;
+      pMin  = signalMin_  + signal*numTimePoints_ + first;
+      pMax  = signalMax_  + signal*numTimePoints_ + first;
+      sum = 0;
+      minValue = pMin[0];
+      maxValue = pMax[0];
+      for (i=0; i<numRun; i++) {
+        sum += pMean[i];
+        if (pMin[i] < minValue) minValue = pMin[i];
+        if (pMax[i] > maxValue) maxValue = pMax[i];
+      }
+      if (pLevel->numAveraged == 0) {
+        pLevel->sumStore[signal] = sum;
+        pLevel->minStore[signal] = minValue;
+        pLevel->maxStore[signal] = maxValue;
+      } else {
+        pLevel->sumStore[signal] += sum;
+        if (minValue < pLevel->minStore[signal]) pLevel->minStore[signal] = minValue;
+        if (maxValue > pLevel->maxStore[signal]) pLevel->maxStore[signal] = maxValue;
+      }
+    }
+    pLevel->numAveraged += numRun;
+    first += numRun;
+    numPoints -= numRun;
+    if (pLevel->numAveraged == levelDecimation_) addLevelPoint(1);
+  }
+}
+
+/**
+ * Writes the point collected in a level to its time series and adds it to the next level.
+ * In fixed mode points after the end of the time series are discarded.
+ * \param[in] level The level, 1 to numLevels_-1
+ */
+void NDPluginTimeSeries::addLevelPoint(int level)
+{
+  TSLevel_t *pLevel = &levels_[level];
+  TSLevel_t *pNext = (level+1 < numLevels_) ? &levels_[level+1] : NULL;
+  int point = pLevel->currentPoint;
+  int signal;
+  double mean;
+
+  for (signal=0; signal<numSignals_; signal++) {
+    mean = pLevel->sumStore[signal] / pLevel->numAveraged;
+    if (point < numTimePoints_) {
+      pLevel->mean[signal*numTimePoints_ + point] = mean;
+      pLevel->min[signal*numTimePoints_ + point]  = pLevel->minStore[signal];
+      pLevel->max[signal*numTimePoints_ + point]  = pLevel->maxStore[signal];
+    }
+    if (!pNext) continue;
+    if (pNext->numAveraged == 0) {
+      pNext->sumStore[signal] = mean;
+      pNext->minStore[signal] = pLevel->minStore[signal];
+      pNext->maxStore[signal] = pLevel->maxStore[signal];
     } else {
-      timeAxis_[i] = -(numTimePoints_-1-i)*averagingTimeActual_;
+      pNext->sumStore[signal] += mean;
+      if (pLevel->minStore[signal] < pNext->minStore[signal]) pNext->minStore[signal] = pLevel->minStore[signal];
+      if (pLevel->maxStore[signal] > pNext->maxStore[signal]) pNext->maxStore[signal] = pLevel->maxStore[signal];
     }
   }
-  doCallbacksFloat64Array(timeAxis_, numTimePoints_, P_TSTimeAxis, 0);
+  pLevel->numAveraged = 0;
+  if (point < numTimePoints_) {
+    point++;
+    if ((point >= numTimePoints_) && (acquireMode_ == TSAcquireModeCircular)) point = 0;
+    pLevel->currentPoint = point;
+  }
+  if (pNext) {
+    pNext->numAveraged++;
+    if (pNext->numAveraged == levelDecimation_) addLevelPoint(level+1);
+  }
 }
 
 /**
  * Templated function to append to time series on different NDArray data types.
+ * Averaged time points are collected with the signals of each point adjacent, which is the layout
+ * of the input array, in a block of up to blockPoints_ points.  Each full block is then transposed
+ * into the time series, which stores each signal contiguously, so the time series is not written
+ * with a stride of numTimePoints_ for every point.
  * \param[in] NDArray The pointer to the NDArray object
  * \return asynStatus
  */
@@ -180,10 +422,12 @@ asynStatus NDPluginTimeSeries::doAddToTimeSeriesT(NDArray *pArray)
 {
   epicsType *pData         = (epicsType *)pArray->pData;
   epicsType *pIn; 
-  epicsType *pTimeCircular = (epicsType *)pTimeCircular_->pData;
+  double *pOut, *pMin, *pMax;
+  double value;
   int signal;
   int i;
   int numTimes = 1;
+  int numBlock = 0;
   epicsTimeStamp timeNow;
   double elapsedTime;
   
@@ -191,19 +435,45 @@ asynStatus NDPluginTimeSeries::doAddToTimeSeriesT(NDArray *pArray)
   
   for (i=0; i<numTimes; i++) {
     pIn = pData + i*numSignalsIn_;
-    for (signal=0; signal<numSignals_; signal++) {
-      averageStore_[signal] += (epicsFloat64)*pIn++;
+    pOut = blockStore_ + numBlock*numSignals_;
+    if (numAverage_ == 1) {
+      for (signal=0; signal<numSignals_; signal++) {
+        pOut[signal] = (epicsFloat64)pIn[signal];
+      }
     }
-    numAveraged_++;
-    if (numAveraged_ < numAverage_) continue;
-    /* We have now collected the desired number of points to average */
-    for (signal=0; signal<numSignals_; signal++) {
-      pTimeCircular[signal * numTimePoints_ + currentTimePoint_] = (epicsType)averageStore_[signal]/numAveraged_;
-      averageStore_[signal] = 0;
+    else {
+      if (numAveraged_ == 0) {
+        for (signal=0; signal<numSignals_; signal++) {
+          value = (epicsFloat64)pIn[signal];
+          averageStore_[signal] = value;
+          minStore_[signal] = value;
+          maxStore_[signal] = value;
+        }
+      } else {
+        for (signal=0; signal<numSignals_; signal++) {
+          value = (epicsFloat64)pIn[signal];
+          averageStore_[signal] += value;
+          if (value < minStore_[signal]) minStore_[signal] = value;
+          if (value > maxStore_[signal]) maxStore_[signal] = value;
+        }
+      }
+      numAveraged_++;
+      if (numAveraged_ < numAverage_) continue;
+      /* We have now collected the desired number of points to average.
+       * The average is converted to the data type so the time series and the output arrays agree. */
+      pMin = blockMin_ + numBlock*numSignals_;
+      pMax = blockMax_ + numBlock*numSignals_;
+      for (signal=0; signal<numSignals_; signal++) {
+        pOut[signal] = (epicsFloat64)(epicsType)(averageStore_[signal]/numAveraged_);
+        pMin[signal] = minStore_[signal];
+        pMax[signal] = maxStore_[signal];
+      }
+      numAveraged_ = 0;
     }
-    numAveraged_ = 0;
-    timeStamp_[currentTimePoint_] = pArray->timeStamp;
-    currentTimePoint_++;
+    numBlock++;
+    if ((numBlock < blockPoints_) && (currentTimePoint_ + numBlock < numTimePoints_)) continue;
+    flushBlock(numBlock, pArray->timeStamp);
+    numBlock = 0;
     if (currentTimePoint_ >= numTimePoints_) {
       if (acquireMode_ == TSAcquireModeFixed) {
         setIntegerParam(P_TSAcquire, 0);
@@ -215,6 +485,7 @@ asynStatus NDPluginTimeSeries::doAddToTimeSeriesT(NDArray *pArray)
       }
     }
   }  // for (i=0; ...)
+  if (numBlock > 0) flushBlock(numBlock, pArray->timeStamp);
   setIntegerParam(P_TSCurrentPoint, currentTimePoint_);     
   epicsTimeGetCurrent(&timeNow);
   elapsedTime = epicsTimeDiffInSeconds(&timeNow, &startTime_);
@@ -264,37 +535,70 @@ asynStatus NDPluginTimeSeries::addToTimeSeries(NDArray *pArray)
   return status;
 }
 
-template <typename epicsType>
-void NDPluginTimeSeries::doTimeSeriesCallbacksT()
+/**
+ * Copies the time series of a signal to pOut with the oldest time point first.
+ * In circular mode this is the part of the time series after the current time point
+ * followed by the part before it.
+ * \param[in] pSeries The time series of the signal
+ * \param[in] currentPoint The next point to be written in the time series
+ * \param[out] pOut The numTimePoints_ points of the time series
+ */
+void NDPluginTimeSeries::unwrapSignal(const double *pSeries, int currentPoint, double *pOut)
 {
-  int signal;
-  int timeOut;
-  int timeIn=0;
-  epicsType *timeCircular = (epicsType *)pTimeCircular_->pData;
+  int first = (acquireMode_ == TSAcquireModeFixed) ? 0 : currentPoint;
 
+  memcpy(pOut, pSeries + first, (numTimePoints_ - first)*sizeof(double));
+  memcpy(pOut + numTimePoints_ - first, pSeries, first*sizeof(double));
+}
 
+/**
+ * Does the callbacks for the time series of a signal.
+ * In fixed mode these are the points acquired so far, in circular mode all the points with
+ * the oldest first.
+ * \param[in] pSeries The time series of the signal
+ * \param[in] currentPoint The next point to be written in the time series
+ * \param[in] reason The parameter of the time series
+ * \param[in] signal The signal
+ */
+void NDPluginTimeSeries::doSeriesCallbacks(double *pSeries, int currentPoint, int reason, int signal)
+{
   if (acquireMode_ == TSAcquireModeFixed) {
-    for (signal=0; signal<numSignals_; signal++) {
-      for (timeOut=0; timeOut<currentTimePoint_; timeOut++) {
-        signalData_[timeOut] = timeCircular[signal*numTimePoints_ + timeOut];
-      }
-      doCallbacksFloat64Array(signalData_, currentTimePoint_, P_TSTimeSeries, signal);
-    }
+    // The time series is already contiguous with the oldest time point first
+    doCallbacksFloat64Array(pSeries, currentPoint, reason, signal);
   }
   else {
-    timeIn = currentTimePoint_;
-    for (signal=0; signal<numSignals_; signal++) {
-      for (timeOut=0; timeOut<numTimePoints_; timeOut++) {
-        signalData_[timeOut] = timeCircular[signal*numTimePoints_ + timeIn];
-        if (++timeIn >= numTimePoints_) timeIn = 0;
-      }
-      doCallbacksFloat64Array(signalData_, numTimePoints_, P_TSTimeSeries, signal);
+    unwrapSignal(pSeries, currentPoint, callbackData_);
+    doCallbacksFloat64Array(callbackData_, numTimePoints_, reason, signal);
+  }
+}
+
+/**
+ * Templated function to copy the time series to the 2-D output array with the oldest time point first.
+ * \param[in] pArrayOut The output array, with dimensions [numTimePoints_, numSignals_]
+ */
+template <typename epicsType>
+void NDPluginTimeSeries::convertTimeSeriesT(NDArray *pArrayOut)
+{
+  int signal;
+  int i;
+  int first = (acquireMode_ == TSAcquireModeFixed) ? 0 : currentTimePoint_;
+  double *pSignal;
+  epicsType *pOut = (epicsType *)pArrayOut->pData;
+
+  for (signal=0; signal<numSignals_; signal++) {
+    pSignal = signalData_ + signal*numTimePoints_;
+    for (i=first; i<numTimePoints_; i++) {
+      *pOut++ = (epicsType)pSignal[i];
+    }
+    for (i=0; i<first; i++) {
+      *pOut++ = (epicsType)pSignal[i];
     }
   }
 }
 
 /**
- * Call the templated doTimeSeriesCallbacks so we can cast correctly. 
+ * Does the callbacks for the time series of each signal and, if NDArrayCallbacks is enabled,
+ * the callbacks for the 2-D array of all signals and the 1-D array of each signal.
  * \return asynStatus
  */
 asynStatus NDPluginTimeSeries::doTimeSeriesCallbacks()
@@ -304,59 +608,72 @@ asynStatus NDPluginTimeSeries::doTimeSeriesCallbacks()
   asynStatus status = asynSuccess;
   char *src, *dst;
   int signal;
-  size_t dims[1]; 
+  size_t dims[2]; 
   int numCopy;
+  int level;
+  size_t offset;
+  TSLevel_t *pLevel;
+  static const char *functionName = "NDPluginTimeSeries::doTimeSeriesCallbacks";
   
-  switch(dataType_) {
-  case NDInt8:
-    doTimeSeriesCallbacksT<epicsInt8>();
-    break;
-  case NDUInt8:
-    doTimeSeriesCallbacksT<epicsUInt8>();
-    break;
-  case NDInt16:
-    doTimeSeriesCallbacksT<epicsInt16>();
-    break;
-  case NDUInt16:
-    doTimeSeriesCallbacksT<epicsUInt16>();
-    break;
-  case NDInt32:
-    doTimeSeriesCallbacksT<epicsInt32>();
-    break;
-  case NDUInt32:
-    doTimeSeriesCallbacksT<epicsUInt32>();
-    break;
-  case NDFloat32:
-    doTimeSeriesCallbacksT<epicsFloat32>();
-    break;
-  case NDFloat64:
-    doTimeSeriesCallbacksT<epicsFloat64>();
-    break;
-  default:
-    return asynError;
-    break;
+  for (signal=0; signal<numSignals_; signal++) {
+    offset = (size_t)signal * numTimePoints_;
+    doSeriesCallbacks(signalData_ + offset, currentTimePoint_, P_TSTimeSeries,  signal);
+    doSeriesCallbacks(signalMin_  + offset, currentTimePoint_, P_TSLevelMin[0], signal);
+    doSeriesCallbacks(signalMax_  + offset, currentTimePoint_, P_TSLevelMax[0], signal);
+    for (level=1; level<numLevels_; level++) {
+      pLevel = &levels_[level];
+      doSeriesCallbacks(pLevel->mean + offset, pLevel->currentPoint, P_TSLevelMean[level], signal);
+      doSeriesCallbacks(pLevel->min  + offset, pLevel->currentPoint, P_TSLevelMin[level],  signal);
+      doSeriesCallbacks(pLevel->max  + offset, pLevel->currentPoint, P_TSLevelMax[level],  signal);
+    }
   }
 
   getIntegerParam(NDArrayCallbacks, &arrayCallbacks);
   if (arrayCallbacks) {
     NDArray *pArrayOut = this->pArrays[0];
     if (pArrayOut) pArrayOut->release();
-    if (acquireMode_ == TSAcquireModeFixed) {
-      pArrayOut = pNDArrayPool->copy(pTimeCircular_, NULL, 1);    
+    this->pArrays[0] = NULL;
+    dims[0] = numTimePoints_;
+    dims[1] = numSignals_;
+    pArrayOut = pNDArrayPool->alloc(2, dims, dataType_, 0, 0);
+    if (!pArrayOut) {
+      asynPrint(pasynUserSelf, ASYN_TRACE_ERROR,
+        "%s: error allocating output array\n",
+        functionName);
+      return asynError;
     }
-    else {
-      // Shift the data so the oldest time point is the first point in the array
-      pArrayOut = pNDArrayPool->copy(pTimeCircular_, NULL, 0);
+    switch(dataType_) {
+    case NDInt8:
+      convertTimeSeriesT<epicsInt8>(pArrayOut);
+      break;
+    case NDUInt8:
+      convertTimeSeriesT<epicsUInt8>(pArrayOut);
+      break;
+    case NDInt16:
+      convertTimeSeriesT<epicsInt16>(pArrayOut);
+      break;
+    case NDUInt16:
+      convertTimeSeriesT<epicsUInt16>(pArrayOut);
+      break;
+    case NDInt32:
+      convertTimeSeriesT<epicsInt32>(pArrayOut);
+      break;
+    case NDUInt32:
+      convertTimeSeriesT<epicsUInt32>(pArrayOut);
+      break;
+    case NDFloat32:
+      convertTimeSeriesT<epicsFloat32>(pArrayOut);
+      break;
+    case NDFloat64:
       for (signal=0; signal<numSignals_; signal++) {
-        numCopy = numTimePoints_ - currentTimePoint_;
-        src = (char *)pTimeCircular_->pData + ((signal * numTimePoints_) + currentTimePoint_)*dataSize_;
-        dst = (char *)pArrayOut->pData      +  (signal * numTimePoints_)*dataSize_;
-        memcpy(dst, src, numCopy*dataSize_);
-        numCopy = currentTimePoint_;
-        src = (char *)pTimeCircular_->pData +  (signal * numTimePoints_)*dataSize_;
-        dst = (char *)pArrayOut->pData      + ((signal * numTimePoints_) + numTimePoints_ - currentTimePoint_)*dataSize_;
-        memcpy(dst, src, numCopy*dataSize_);
+        unwrapSignal(signalData_ + signal*numTimePoints_, currentTimePoint_,
+                     (epicsFloat64 *)pArrayOut->pData + signal*numTimePoints_);
       }
+      break;
+    default:
+      pArrayOut->release();
+      return asynError;
+      break;
     }
     this->getAttributes(pArrayOut->pAttributeList);
     getTimeStamp(&pArrayOut->epicsTS);
@@ -454,6 +771,18 @@ asynStatus NDPluginTimeSeries::writeInt32(asynUser *pasynUser, epicsInt32 value)
 
   if (function == P_TSNumPoints) {
     allocateArrays();
+  } else if (function == P_TSNumLevels) {
+    if (value < 1) value = 1;
+    if (value > TS_MAX_LEVELS) value = TS_MAX_LEVELS;
+    numLevels_ = value;
+    setIntegerParam(P_TSNumLevels, numLevels_);
+    allocateArrays();
+  } else if (function == P_TSLevelDecimation) {
+    if (value < 2) value = 2;
+    levelDecimation_ = value;
+    setIntegerParam(P_TSLevelDecimation, levelDecimation_);
+    acquireReset();
+    createAxisArray();
   } else if (function == P_TSAcquireMode) {
     acquireMode_ = value;
     acquireReset();
@@ -28,10 +28,43 @@
 #define TSAcquireModeString     "TS_ACQUIRE_MODE"     /* (asynInt32,        r/w) Acquire mode */
 #define TSTimeAxisString        "TS_TIME_AXIS"        /* (asynFloat64Array, r/o) Time axis array */
 #define TSTimestampString       "TS_TIMESTAMP"        /* (asynFloat64Array, r/o) Series of timestamps */
+#define TSNumLevelsString       "TS_NUM_LEVELS"       /* (asynInt32,        r/w) Number of resolution levels */
+#define TSLevelDecimationString "TS_LEVEL_DECIMATION" /* (asynInt32,        r/w) Points of each level averaged for the next level */
+#define TSLevel1TimeAxisString  "TS_LEVEL1_TIME_AXIS" /* (asynFloat64Array, r/o) Time axis array of level 1 */
+#define TSLevel2TimeAxisString  "TS_LEVEL2_TIME_AXIS" /* (asynFloat64Array, r/o) Time axis array of level 2 */
+#define TSLevel3TimeAxisString  "TS_LEVEL3_TIME_AXIS" /* (asynFloat64Array, r/o) Time axis array of level 3 */
 
 /* Per-signal parameters */
 #define TSTimeSeriesString      "TS_TIME_SERIES"      /* (asynFloat64Array, r/o) Time series array */
+#define TSLevel0MinString       "TS_LEVEL0_MIN"       /* (asynFloat64Array, r/o) Minimum of the points averaged for each time point */
+#define TSLevel0MaxString       "TS_LEVEL0_MAX"       /* (asynFloat64Array, r/o) Maximum of the points averaged for each time point */
+#define TSLevel1MeanString      "TS_LEVEL1_MEAN"      /* (asynFloat64Array, r/o) Time series of level 1 */
+#define TSLevel1MinString       "TS_LEVEL1_MIN"       /* (asynFloat64Array, r/o) Minimum envelope of level 1 */
+#define TSLevel1MaxString       "TS_LEVEL1_MAX"       /* (asynFloat64Array, r/o) Maximum envelope of level 1 */
+#define TSLevel2MeanString      "TS_LEVEL2_MEAN"      /* (asynFloat64Array, r/o) Time series of level 2 */
+#define TSLevel2MinString       "TS_LEVEL2_MIN"       /* (asynFloat64Array, r/o) Minimum envelope of level 2 */
+#define TSLevel2MaxString       "TS_LEVEL2_MAX"       /* (asynFloat64Array, r/o) Maximum envelope of level 2 */
+#define TSLevel3MeanString      "TS_LEVEL3_MEAN"      /* (asynFloat64Array, r/o) Time series of level 3 */
+#define TSLevel3MinString       "TS_LEVEL3_MIN"       /* (asynFloat64Array, r/o) Minimum envelope of level 3 */
+#define TSLevel3MaxString       "TS_LEVEL3_MAX"       /* (asynFloat64Array, r/o) Maximum envelope of level 3 */
 
+/** Maximum number of resolution levels.  Level 0 is the time series with NumAverage input points averaged
+  * for each time point, level n has LevelDecimation points of level n-1 averaged for each time point. */
+#define TS_MAX_LEVELS 4
+
+
+/** A resolution level above level 0 of the time series.
+  * Each series holds numTimePoints_ points for each signal, with each signal contiguous. */
+typedef struct {
+  double *mean;         /* Average of the level below */
+  double *min;          /* Minimum envelope of the level below */
+  double *max;          /* Maximum envelope of the level below */
+  double *sumStore;     /* Sums of the points of the level below for the current point, one per signal */
+  double *minStore;     /* Minimum of those points */
+  double *maxStore;     /* Maximum of those points */
+  int numAveraged;      /* Number of points of the level below in sumStore */
+  int currentPoint;     /* Next point to write */
+} TSLevel_t;
 
 /** Compute time series on signals */
 class epicsShareClass NDPluginTimeSeries : public NDPluginDriver {
@@ -61,15 +94,26 @@ protected:
   int P_TSAcquireMode;
   int P_TSTimeAxis;
   int P_TSTimestamp;
+  int P_TSNumLevels;
+  int P_TSLevelDecimation;
+  int P_TSLevelTimeAxis[TS_MAX_LEVELS];
 
   // Per-signal parameters
   int P_TSTimeSeries;
+  int P_TSLevelMean[TS_MAX_LEVELS];
+  int P_TSLevelMin[TS_MAX_LEVELS];
+  int P_TSLevelMax[TS_MAX_LEVELS];
                                 
 private:
   template <typename epicsType> asynStatus doAddToTimeSeriesT(NDArray *pArray);
   asynStatus addToTimeSeries(NDArray *pArray);
   asynStatus clear(epicsUInt32 roi);
-  template <typename epicsType> void doTimeSeriesCallbacksT();
+  void flushBlock(int numPoints, double timeStamp);
+  void addToLevel1(int first, int numPoints);
+  void addLevelPoint(int level);
+  void unwrapSignal(const double *pSeries, int currentPoint, double *pOut);
+  void doSeriesCallbacks(double *pSeries, int currentPoint, int reason, int signal);
+  template <typename epicsType> void convertTimeSeriesT(NDArray *pArrayOut);
   asynStatus doTimeSeriesCallbacks();
   void allocateArrays();
   void acquireReset();
@@ -92,10 +136,21 @@ private:
   double timePerPoint_; /* Actual time between points in input arrays */
   epicsTimeStamp startTime_;
   double *averageStore_;
-  double *signalData_;
+  double *minStore_;
+  double *maxStore_;
+  double *signalData_;   /* Time series, numTimePoints_ for each signal */
+  double *callbackData_; /* One time series in time order for callbacks */
+  double *signalMin_;    /* Minimum of the points averaged for each time point */
+  double *signalMax_;    /* Maximum of the points averaged for each time point */
+  double *blockStore_;   /* Block of averaged time points to add to the time series */
+  double *blockMin_;     /* Minimum of the points averaged for the time points in blockStore_ */
+  double *blockMax_;     /* Maximum of the points averaged for the time points in blockStore_ */
+  int blockPoints_;      /* Number of time points in blockStore_ */
+  int numLevels_;
+  int levelDecimation_;
+  TSLevel_t levels_[TS_MAX_LEVELS]; /* Levels 1 to numLevels_-1, levels_[0] is not used */
   double *timeAxis_;
   double *timeStamp_;
-  NDArray *pTimeCircular_;
 };
     
 #endif //NDPluginTimeSeries_H
@@ -14,7 +14,11 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <stddef.h>
 #include <math.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #include <epicsTypes.h>
 #include <epicsMessageQueue.h>
@@ -41,445 +45,271 @@ typedef enum {
   TransformRotate270Mirror,
 } NDPluginTransformType_t;
 
-/** Perform the move of the pixels to the new orientation. */
-template <typename epicsType>
-void transformNDArray(NDArray *inArray, NDArray *outArray, int transformType, int colorMode, NDArrayInfo_t *arrayInfo)
-{
-  epicsType *inData = (epicsType *)inArray->pData;
-  epicsType *outData = (epicsType *)outArray->pData;
-  int x, y, color;
-  int xSize, ySize, colorSize;
-  int xStride, yStride, colorStride;
-  int elementSize;
-
-  xSize = (int)arrayInfo->xSize;
-  ySize = (int)arrayInfo->ySize;
-  if (arrayInfo->colorSize > 0)
-    colorSize = (int)arrayInfo->colorSize;
-  else
-    colorSize = 1;
-
-  xStride = (int)arrayInfo->xStride;
-  yStride = (int)arrayInfo->yStride;
-  colorStride = (int)arrayInfo->colorStride;
-  elementSize = arrayInfo->bytesPerElement;
-
-  // Assume output array is same dimensions as input.  Handle rotation cases below.
-  outArray->dims[arrayInfo->xDim].size = inArray->dims[arrayInfo->xDim].size;
-  outArray->dims[arrayInfo->yDim].size = inArray->dims[arrayInfo->yDim].size;
-  if (inArray->ndims > 2) outArray->dims[arrayInfo->colorDim].size = inArray->dims[arrayInfo->colorDim].size;
-
-  switch (transformType)
-  {
-    case (TransformNone):
-
-      // Nothing to do, since the input array has already been copied to the output array
-      break;
-
-    case (TransformRotate90):
-
-      outArray->dims[arrayInfo->xDim].size = inArray->dims[arrayInfo->yDim].size;
-      outArray->dims[arrayInfo->yDim].size = inArray->dims[arrayInfo->xDim].size;
-
-      if (colorMode == NDColorModeMono)
-      {      
-        for (x = 0; x < xSize; x++)
-        {
-          for (y = (ySize - 1); y >= 0; y--)
-          {
-            outData[(((ySize-1) - y) * xStride) + (x * ySize)] = inData[(y * yStride) + (x * xStride)];
-          }
-        }          
-      }
-
-      if (colorMode == NDColorModeRGB3)
-      {      
-        for (x = 0; x < xSize; x++)
-        {
-          for (y = (ySize - 1); y >= 0; y--)
-          {
-            /** Copy three values for each iteration of the inner loop.  This moves the red, green, and blue information. */
-            outData[(((ySize-1) - y) * xStride) + (x * ySize)] = inData[(y * yStride) + (x * xStride)];
-            outData[(((ySize-1) - y) * xStride) + (x * ySize) + colorStride] = inData[(y * yStride) + (x * xStride) + colorStride];
-            outData[(((ySize-1) - y) * xStride) + (x * ySize) + (2 * colorStride)] = inData[(y * yStride) + (x * xStride) + (2 * colorStride)];
-          }
-        }          
-      }
-
-      if (colorMode == NDColorModeRGB2)
-      {
-        /** The values of colorStride and yStride need to change
-          because the dimensions of the image may have changed.
-        */
-        int newColorStride = ySize;
-        int newYStride = newColorStride * colorSize;
-
-        for (y = (ySize - 1); y >= 0; y--)
-        {
-          for (x = (xSize - 1); x >= 0; x--)
-          {
-            /** Copy three values for each iteration of the inner loop.  This moves the red, green, and blue information. */
-            outData[(((ySize - 1) - y) * xStride) + (x * newYStride)] = inData[(y * yStride) + (x * xStride)];
-            outData[(((ySize - 1) - y) * xStride) + (x * newYStride) + newColorStride] = inData[(y * yStride) + (x * xStride) + colorStride];
-            outData[(((ySize - 1) - y) * xStride) + (x * newYStride) + (2 * newColorStride)] = inData[(y * yStride) + (x * xStride) + (2 * colorStride)];
-          }
-        }
-      }
-
-      if (colorMode == NDColorModeRGB1)
-      {
-        int source_offset;
-        int target_offset;
-
-        /** Calculate a new value for the Y stride. */
-        int newStride = colorSize * ySize;
-
-        for (y = (ySize - 1); y >= 0; y--)
-        {
-          for (x = (xSize - 1); x >= 0; x--)
-          {
-            source_offset = (x * xStride) + (y * yStride);
-            target_offset = (((ySize - 1) - y) * xStride) + (x * (newStride));
-            outData[target_offset + 0] = inData[source_offset + 0];;
-            outData[target_offset + 1] = inData[source_offset + 1];;
-            outData[target_offset + 2] = inData[source_offset + 2];;
-          }
-        }
-      }
-
-      break;
-
-    case (TransformRotate180):
-
-      if (colorMode == NDColorModeMono)
-      {
-        for (y = (ySize - 1); y >= 0; y--)
-        {
-          for (x = (xSize - 1); x >= 0; x--)
-          {
-            outData[(((xSize - 1) - x) * xStride) + (((ySize - 1) - y) * yStride)] = inData[(y * yStride) + (x * xStride)];
-          }
-        }
-      }
-      else
-      {
-        for (y = (ySize - 1); y >= 0; y--)
-        {
-          for (x = (xSize - 1); x >= 0; x--)
-          {
-            /** Copy three values for each iteration of the inner loop.  This moves the red, green, and blue information. */
-            outData[(((xSize - 1) - x) * xStride) + (((ySize - 1) - y) * yStride)] = inData[(y * yStride) + (x * xStride)];
-            outData[(((xSize - 1) - x) * xStride) + (((ySize - 1) - y) * yStride) + colorStride] = inData[(y * yStride) + (x * xStride) + colorStride];
-            outData[(((xSize - 1) - x) * xStride) + (((ySize - 1) - y) * yStride) + (2 * colorStride)] = inData[(y * yStride) + (x * xStride) + (2 * colorStride)];
-          }
-        }
-      }  
-      break;
-
-    case (TransformRotate270):
+/** Width in bytes of the square tiles used for the transforms that exchange the X and Y axes.
+  * The input and output rows of a tile stay in the cache while the tile is transformed. */
+#define TRANSFORM_TILE_BYTES 256
 
-      outArray->dims[arrayInfo->xDim].size = inArray->dims[arrayInfo->yDim].size;
-      outArray->dims[arrayInfo->yDim].size = inArray->dims[arrayInfo->xDim].size;
+/** Size of the blocks that are transposed in registers inside a tile */
+#define TRANSFORM_BLOCK_SIZE 8
 
-      if (colorMode == NDColorModeMono)
-      {
-        for (x = (xSize - 1); x >= 0; x--)
-        {
-          for (y = 0; y < ySize; y++)
-          {
-            outData[(y * xStride) + (((xSize - 1) - x) * ySize)] = inData[(y * yStride) + (x * xStride)];
-          }
-        }
-      }
-
-      if (colorMode == NDColorModeRGB3)
-      {
-        for (x = (xSize - 1); x >= 0; x--)
-        {
-          for (y = 0; y < ySize; y++)
-          {
-            /** Copy three values for each iteration of the inner loop.  This moves the red, green, and blue information. */
-            outData[(y * xStride) + (((xSize - 1) - x) * ySize)]           = inData[(y * yStride) + (x * xStride)];
-            outData[(y * xStride) + (((xSize - 1) - x) * ySize) + colorStride]     = inData[(y * yStride) + (x * xStride) + colorStride];
-            outData[(y * xStride) + (((xSize - 1) - x) * ySize) + (2 * colorStride)] = inData[(y * yStride) + (x * xStride) + (2 * colorStride)];
-          }
-        }
-      }
-
-      if (colorMode == NDColorModeRGB2)
-      {
-        /** The values of colorStride and yStride need to change
-          because the dimensions of the image may have changed.
-        */
-        int newColorStride = ySize;
-        int newYStride = newColorStride * colorSize;
-
-        for (y = 0; y < ySize; y++)
-        {
-          for (x = (xSize - 1); x >= 0; x--)
-          {
-            /** Copy three values for each iteration of the inner loop.  This moves the red, green, and blue information. */
-            outData[(y * xStride) + (((xSize - 1) - x) * newYStride)]            = inData[(y * yStride) + (x * xStride)];
-            outData[(y * xStride) + (((xSize - 1) - x) * newYStride) + newColorStride]     = inData[(y * yStride) + (x * xStride) + colorStride];
-            outData[(y * xStride) + (((xSize - 1) - x) * newYStride) + (2 * newColorStride)] = inData[(y * yStride) + (x * xStride) + (2 * colorStride)];
-          }
-        }
-      }
-
-      if (colorMode == NDColorModeRGB1)
-      {
-        int source_offset;
-        int target_offset;
-
-        /** Calculate a new value for the Y stride. */
-        int newStride = colorSize * ySize;
-
-        for (y = 0; y < ySize; y++)
-        {
-          for (x = (xSize - 1); x >= 0; x--)
-          {
-            source_offset = (x * xStride) + (y * yStride);
-            target_offset = (y * xStride) + (((xSize-1) - x) * (newStride));
-            outData[target_offset + 0] = inData[source_offset + 0];;
-            outData[target_offset + 1] = inData[source_offset + 1];;
-            outData[target_offset + 2] = inData[source_offset + 2];;
-          }
-        }
-      }
-
-      break;
-
-    case (TransformRotate90Mirror):
-
-      outArray->dims[arrayInfo->xDim].size = inArray->dims[arrayInfo->yDim].size;
-      outArray->dims[arrayInfo->yDim].size = inArray->dims[arrayInfo->xDim].size;
-
-      if (colorMode == NDColorModeMono)
-      {
-        for (x = 0; x < xSize; x++)
-        {
-          for (y = 0; y < ySize; y++)
-          {
-            outData[(y * xStride) + (x * ySize)] = inData[(y * yStride) + (x * xStride)];
-          }
-        }
-      }
-
-      if (colorMode == NDColorModeRGB3)
-      {
-        for (x = 0; x < xSize; x++)
-        {
-          for (y = 0; y < ySize; y++)
-          {
-            /** Copy three values for each iteration of the inner loop.  This moves the red, green, and blue information. */
-            outData[(y * xStride) + (x * ySize)] = inData[(y * yStride) + (x * xStride)];
-            outData[(y * xStride) + (x * ySize) + colorStride] = inData[(y * yStride) + (x * xStride) + colorStride];
-            outData[(y * xStride) + (x * ySize) + (2 * colorStride)] = inData[(y * yStride) + (x * xStride) + (2 * colorStride)];
-          }
-        }
-      }
-
-      if (colorMode == NDColorModeRGB2)
-      {
-        /** The values of colorStride and yStride need to change
-          because the dimensions of the image may have changed.
-        */
-        int newColorStride = ySize;
-        int newYStride = newColorStride * colorSize;
-
-        for (y = 0; y < ySize; y++)
-        {
-          for (x = 0; x < xSize; x++)
-          {
-            /** Copy three values for each iteration of the inner loop.  This moves the red, green, and blue information. */
-            outData[(y * xStride) + (x * newYStride)] = inData[(y * yStride) + (x * xStride)];
-            outData[(y * xStride) + (x * newYStride) + newColorStride] = inData[(y * yStride) + (x * xStride) + colorStride];
-            outData[(y * xStride) + (x * newYStride) + (2 * newColorStride)] = inData[(y * yStride) + (x * xStride) + (2 * colorStride)];
-          }
-        }
-      }
-
-      if (colorMode == NDColorModeRGB1)
-      {
-        int source_offset;
-        int target_offset;
-
-        /** Calculate a new value for the Y stride. */
-        int newStride = colorSize * ySize;
-
-        for (y = 0; y < ySize; y++)
-        {
-          for (x = (xSize - 1); x >= 0; x--)
-          {
-            source_offset = (x * xStride) + (y * yStride);
-            target_offset = (y * xStride) + (x * (newStride));
-            outData[target_offset + 0] = inData[source_offset + 0];;
-            outData[target_offset + 1] = inData[source_offset + 1];;
-            outData[target_offset + 2] = inData[source_offset + 2];;
-          }
-        }
-      }
-
-      break;
+#if defined(__SSE2__)
+/** Transposes an 8x8 block of 8-bit elements with SSE2 unpack instructions.
+  * Row i of the block is read from pIn + i*inStep, row i of the transposed block is written to pOut + i*outStep. */
+static inline void transposeBlock8(const epicsUInt8 *pIn, ptrdiff_t inStep, epicsUInt8 *pOut, ptrdiff_t outStep)
+{
+  __m128i t0 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(pIn + 0*inStep)), _mm_loadl_epi64((const __m128i *)(pIn + 1*inStep)));
+  __m128i t1 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(pIn + 2*inStep)), _mm_loadl_epi64((const __m128i *)(pIn + 3*inStep)));
+  __m128i t2 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(pIn + 4*inStep)), _mm_loadl_epi64((const __m128i *)(pIn + 5*inStep)));
+  __m128i t3 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(pIn + 6*inStep)), _mm_loadl_epi64((const __m128i *)(pIn + 7*inStep)));
+  __m128i u0 = _mm_unpacklo_epi16(t0, t1);
+  __m128i u1 = _mm_unpackhi_epi16(t0, t1);
+  __m128i u2 = _mm_unpacklo_epi16(t2, t3);
+  __m128i u3 = _mm_unpackhi_epi16(t2, t3);
+  __m128i v0 = _mm_unpacklo_epi32(u0, u2);
+  __m128i v1 = _mm_unpackhi_epi32(u0, u2);
+  __m128i v2 = _mm_unpacklo_epi32(u1, u3);
+  __m128i v3 = _mm_unpackhi_epi32(u1, u3);
+  _mm_storel_epi64((__m128i *)(pOut + 0*outStep), v0);
+  _mm_storel_epi64((__m128i *)(pOut + 1*outStep), _mm_unpackhi_epi64(v0, v0));
+  _mm_storel_epi64((__m128i *)(pOut + 2*outStep), v1);
+  _mm_storel_epi64((__m128i *)(pOut + 3*outStep), _mm_unpackhi_epi64(v1, v1));
+  _mm_storel_epi64((__m128i *)(pOut + 4*outStep), v2);
+  _mm_storel_epi64((__m128i *)(pOut + 5*outStep), _mm_unpackhi_epi64(v2, v2));
+  _mm_storel_epi64((__m128i *)(pOut + 6*outStep), v3);
+  _mm_storel_epi64((__m128i *)(pOut + 7*outStep), _mm_unpackhi_epi64(v3, v3));
+}
 
-    case (TransformRotate270Mirror):
+/** Transposes an 8x8 block of 16-bit elements with SSE2 unpack instructions.
+  * Row i of the block is read from pIn + i*inStep, row i of the transposed block is written to pOut + i*outStep. */
+static inline void transposeBlock16(const epicsUInt16 *pIn, ptrdiff_t inStep, epicsUInt16 *pOut, ptrdiff_t outStep)
+{
+  __m128i r0 = _mm_loadu_si128((const __m128i *)(pIn + 0*inStep));
+  __m128i r1 = _mm_loadu_si128((const __m128i *)(pIn + 1*inStep));
+  __m128i r2 = _mm_loadu_si128((const __m128i *)(pIn + 2*inStep));
+  __m128i r3 = _mm_loadu_si128((const __m128i *)(pIn + 3*inStep));
+  __m128i r4 = _mm_loadu_si128((const __m128i *)(pIn + 4*inStep));
+  __m128i r5 = _mm_loadu_si128((const __m128i *)(pIn + 5*inStep));
+  __m128i r6 = _mm_loadu_si128((const __m128i *)(pIn + 6*inStep));
+  __m128i r7 = _mm_loadu_si128((const __m128i *)(pIn + 7*inStep));
+  __m128i t0 = _mm_unpacklo_epi16(r0, r1);
+  __m128i t1 = _mm_unpackhi_epi16(r0, r1);
+  __m128i t2 = _mm_unpacklo_epi16(r2, r3);
+  __m128i t3 = _mm_unpackhi_epi16(r2, r3);
+  __m128i t4 = _mm_unpacklo_epi16(r4, r5);
+  __m128i t5 = _mm_unpackhi_epi16(r4, r5);
+  __m128i t6 = _mm_unpacklo_epi16(r6, r7);
+  __m128i t7 = _mm_unpackhi_epi16(r6, r7);
+  __m128i u0 = _mm_unpacklo_epi32(t0, t2);
+  __m128i u1 = _mm_unpackhi_epi32(t0, t2);
+  __m128i u2 = _mm_unpacklo_epi32(t1, t3);
+  __m128i u3 = _mm_unpackhi_epi32(t1, t3);
+  __m128i u4 = _mm_unpacklo_epi32(t4, t6);
+  __m128i u5 = _mm_unpackhi_epi32(t4, t6);
+  __m128i u6 = _mm_unpacklo_epi32(t5, t7);
+  __m128i u7 = _mm_unpackhi_epi32(t5, t7);
+  _mm_storeu_si128((__m128i *)(pOut + 0*outStep), _mm_unpacklo_epi64(u0, u4));
+  _mm_storeu_si128((__m128i *)(pOut + 1*outStep), _mm_unpackhi_epi64(u0, u4));
+  _mm_storeu_si128((__m128i *)(pOut + 2*outStep), _mm_unpacklo_epi64(u1, u5));
+  _mm_storeu_si128((__m128i *)(pOut + 3*outStep), _mm_unpackhi_epi64(u1, u5));
+  _mm_storeu_si128((__m128i *)(pOut + 4*outStep), _mm_unpacklo_epi64(u2, u6));
+  _mm_storeu_si128((__m128i *)(pOut + 5*outStep), _mm_unpackhi_epi64(u2, u6));
+  _mm_storeu_si128((__m128i *)(pOut + 6*outStep), _mm_unpacklo_epi64(u3, u7));
+  _mm_storeu_si128((__m128i *)(pOut + 7*outStep), _mm_unpackhi_epi64(u3, u7));
+}
+#endif
 
-      outArray->dims[arrayInfo->xDim].size = inArray->dims[arrayInfo->yDim].size;
-      outArray->dims[arrayInfo->yDim].size = inArray->dims[arrayInfo->xDim].size;
+/** Transposes a TRANSFORM_BLOCK_SIZE x TRANSFORM_BLOCK_SIZE block of elements.
+  * Row i of the block is read from pIn + i*inStep, row i of the transposed block is written to pOut + i*outStep.
+  * The steps can be negative, which reverses the order of the rows.
+  * 8-bit and 16-bit data use SSE2 shuffles when they are available. */
+template <typename epicsType>
+static inline void transposeBlock(const epicsType *pIn, ptrdiff_t inStep, epicsType *pOut, ptrdiff_t outStep)
+{
+  int i, j;
 
-      if (colorMode == NDColorModeMono)
-      {
-        for (x = (xSize - 1); x >= 0; x--)
-        {
-          for (y = (ySize - 1); y >= 0; y--)
-          {
-            outData[(((ySize - 1) - y) * xStride) + (((xSize - 1) - x) * ySize)] = inData[(y * yStride) + (x * xStride)];
-          }
-        }
-      }
+#if defined(__SSE2__)
+  if (sizeof(epicsType) == 1) {
+    transposeBlock8((const epicsUInt8 *)pIn, inStep, (epicsUInt8 *)pOut, outStep);
+    return;
+  }
+  if (sizeof(epicsType) == 2) {
+    transposeBlock16((const epicsUInt16 *)pIn, inStep, (epicsUInt16 *)pOut, outStep);
+    return;
+  }
+#endif
+  for (i = 0; i < TRANSFORM_BLOCK_SIZE; i++) {
+    for (j = 0; j < TRANSFORM_BLOCK_SIZE; j++) {
+      pOut[i*outStep + j] = pIn[j*inStep + i];
+    }
+  }
+}
 
-      if (colorMode == NDColorModeRGB3)
-      {
-        for (x = (xSize - 1); x >= 0; x--)
-        {
-          for (y = (ySize - 1); y >= 0; y--)
-          {
-            /** Copy three values for each iteration of the inner loop.  This moves the red, green, and blue information. */
-            outData[(((ySize - 1) - y) * xStride) + (((xSize - 1) - x) * ySize)] = inData[(y * yStride) + (x * xStride)];
-            outData[(((ySize - 1) - y) * xStride) + (((xSize - 1) - x) * ySize) + colorStride] = inData[(y * yStride) + (x * xStride) + colorStride];
-            outData[(((ySize - 1) - y) * xStride) + (((xSize - 1) - x) * ySize) + (2 * colorStride)] = inData[(y * yStride) + (x * xStride) + (2 * colorStride)];
-          }
-        }
-      }
+/** Copies the pixels of the input region [x0,x1) x [y0,y1) to their position in the output plane
+  * for the transforms that exchange the X and Y axes. */
+template <typename epicsType>
+static void swapRegion(const epicsType *inData, epicsType *outData, size_t xSize, size_t ySize,
+                       size_t pixelSize, size_t inYStride, size_t outYStride, bool flipX, bool flipY,
+                       size_t x0, size_t x1, size_t y0, size_t y1)
+{
+  size_t x, y, ox, oy, i;
+  const epicsType *pIn;
+  epicsType *pOut;
+
+  for (y = y0; y < y1; y++) {
+    ox = flipY ? (ySize - 1 - y) : y;
+    pIn = inData + y*inYStride + x0*pixelSize;
+    for (x = x0; x < x1; x++) {
+      oy = flipX ? (xSize - 1 - x) : x;
+      pOut = outData + oy*outYStride + ox*pixelSize;
+      for (i = 0; i < pixelSize; i++) *pOut++ = *pIn++;
+    }
+  }
+}
 
-      if (colorMode == NDColorModeRGB2)
-      {
-        /** The values of colorStride and yStride need to change
-          because the dimensions of the image may have changed.
-        */
-        int newColorStride = ySize;
-        int newYStride = newColorStride * colorSize;
-
-        for (y = (ySize - 1); y >= 0; y--)
-        {
-          for (x = (xSize - 1); x >= 0; x--)
-          {
-            /** Copy three values for each iteration of the inner loop.  This moves the red, green, and blue information. */
-            outData[(((ySize - 1) - y) * xStride) + (((xSize - 1) - x) * newYStride)] = inData[(y * yStride) + (x * xStride)];
-            outData[(((ySize - 1) - y) * xStride) + (((xSize - 1) - x) * newYStride) + newColorStride] = inData[(y * yStride) + (x * xStride) + colorStride];
-            outData[(((ySize - 1) - y) * xStride) + (((xSize - 1) - x) * newYStride) + (2 * newColorStride)] = inData[(y * yStride) + (x * xStride) + (2 * colorStride)];
-          }
-        }
-      }
+/** Transforms one plane of an image.
+  * \param[in] inData Pointer to the first element of the input plane.
+  * \param[out] outData Pointer to the first element of the output plane.
+  * \param[in] xSize Number of pixels in X in the input plane.
+  * \param[in] ySize Number of pixels in Y in the input plane.
+  * \param[in] pixelSize Number of contiguous elements in each pixel; 3 for RGB1, 1 otherwise.
+  * \param[in] inYStride Number of elements between rows in the input plane.
+  * \param[in] outYStride Number of elements between rows in the output plane.
+  * \param[in] transformType The transform to perform.
+  *
+  * Transforms that keep the X and Y axes copy whole rows, either with memcpy or reversed.
+  * Transforms that exchange the X and Y axes are done in square tiles that fit in the cache,
+  * with the tiles transposed in TRANSFORM_BLOCK_SIZE blocks for single element pixels. */
+template <typename epicsType>
+static void transformPlane(const epicsType *inData, epicsType *outData, size_t xSize, size_t ySize,
+                           size_t pixelSize, size_t inYStride, size_t outYStride, int transformType)
+{
+  bool swapXY=false, flipX=false, flipY=false;
+  size_t x, y, i, oy;
+  const epicsType *pIn;
+  epicsType *pOut;
+
+  switch (transformType) {
+    case TransformRotate90:        swapXY = true;  flipY = true;  break;
+    case TransformRotate180:       flipX = true;   flipY = true;  break;
+    case TransformRotate270:       swapXY = true;  flipX = true;  break;
+    case TransformMirror:          flipX = true;                  break;
+    case TransformRotate90Mirror:  swapXY = true;                 break;
+    case TransformRotate180Mirror: flipY = true;                  break;
+    case TransformRotate270Mirror: swapXY = true;  flipX = true;  flipY = true; break;
+    default:                                                      break;
+  }
 
-      if (colorMode == NDColorModeRGB1)
-      {
-        int source_offset;
-        int target_offset;
-
-        /** Calculate a new value for the Y stride. */
-        int newStride = colorSize * ySize;
-
-        for (y = (ySize - 1); y >= 0; y--)
-        {
-          for (x = (xSize - 1); x >= 0; x--)
-          {
-            source_offset = (((xSize - 1) - x) * xStride) + (((ySize - 1) - y) * yStride);
-            target_offset = (y * xStride) + (x * (newStride));
-            outData[target_offset + 0] = inData[source_offset + 0];;
-            outData[target_offset + 1] = inData[source_offset + 1];;
-            outData[target_offset + 2] = inData[source_offset + 2];;
-          }
+  if (!swapXY) {
+    for (y = 0; y < ySize; y++) {
+      oy = flipY ? (ySize - 1 - y) : y;
+      pIn = inData + y*inYStride;
+      pOut = outData + oy*outYStride;
+      if (!flipX) {
+        memcpy(pOut, pIn, xSize*pixelSize*sizeof(epicsType));
+      } else {
+        pOut += (xSize - 1)*pixelSize;
+        for (x = 0; x < xSize; x++) {
+          for (i = 0; i < pixelSize; i++) pOut[i] = *pIn++;
+          pOut -= pixelSize;
         }
       }
+    }
+    return;
+  }
 
-      break;
-
-    case (TransformMirror):
-
-      if (colorMode == NDColorModeMono)
-      {
-        for (y = 0; y < ySize; y++)
-        {
-          for (x = (xSize - 1); x >= 0; x--)
-          {
-            outData[(((xSize - 1) - x) * xStride) + (y * yStride)] = inData[(y * yStride) + (x * xStride)];
-          }
-        }
+  size_t tileSize = TRANSFORM_TILE_BYTES / sizeof(epicsType);
+  if (tileSize < TRANSFORM_BLOCK_SIZE) tileSize = TRANSFORM_BLOCK_SIZE;
+  size_t x0, y0, x1, y1, xb, yb, xBlockEnd, yBlockEnd;
+  /* The input rows of a block are ordered so that the output X increases along each transposed row */
+  ptrdiff_t inStep = flipY ? -(ptrdiff_t)inYStride : (ptrdiff_t)inYStride;
+  ptrdiff_t outStep = flipX ? -(ptrdiff_t)outYStride : (ptrdiff_t)outYStride;
+
+  for (y0 = 0; y0 < ySize; y0 += tileSize) {
+    y1 = y0 + tileSize;
+    if (y1 > ySize) y1 = ySize;
+    for (x0 = 0; x0 < xSize; x0 += tileSize) {
+      x1 = x0 + tileSize;
+      if (x1 > xSize) x1 = xSize;
+      if (pixelSize != 1) {
+        swapRegion(inData, outData, xSize, ySize, pixelSize, inYStride, outYStride, flipX, flipY, x0, x1, y0, y1);
+        continue;
       }
-      else
-      {
-        for (y = 0; y < ySize; y++)
-        {
-          for (x = (xSize - 1); x >= 0; x--)
-          {
-            /** Copy three values for each iteration of the inner loop.  This moves the red, green, and blue information. */
-            outData[(((xSize - 1) - x) * xStride) + (y * yStride)] = inData[(y * yStride) + (x * xStride)];
-            outData[(((xSize - 1) - x) * xStride) + (y * yStride) + colorStride] = inData[(y * yStride) + (x * xStride) + colorStride];
-            outData[(((xSize - 1) - x) * xStride) + (y * yStride) + (2 * colorStride)] = inData[(y * yStride) + (x * xStride) + (2 * colorStride)];
-          }
+      /* Transpose the full blocks of the tile, then copy the partial blocks at the right and bottom edges */
+      xBlockEnd = x0 + ((x1 - x0) / TRANSFORM_BLOCK_SIZE) * TRANSFORM_BLOCK_SIZE;
+      yBlockEnd = y0 + ((y1 - y0) / TRANSFORM_BLOCK_SIZE) * TRANSFORM_BLOCK_SIZE;
+      for (yb = y0; yb < yBlockEnd; yb += TRANSFORM_BLOCK_SIZE) {
+        y = flipY ? (yb + TRANSFORM_BLOCK_SIZE - 1) : yb;
+        size_t oxStart = flipY ? (ySize - 1 - y) : y;
+        for (xb = x0; xb < xBlockEnd; xb += TRANSFORM_BLOCK_SIZE) {
+          oy = flipX ? (xSize - 1 - xb) : xb;
+          transposeBlock(inData + y*inYStride + xb, inStep, outData + oy*outYStride + oxStart, outStep);
         }
       }
-      break;
-
-    case (TransformRotate180Mirror):
-
-      int source_offset;
-      int target_offset;
-
-      /** In this mode, we are moving an entire row at once.  First all of the red rows are moved.
-        Next, all of the green rows are moved.  Lastly, all of the blue rows are moved.  In mono
-        mode, the outer loop only executes once.*/
-      if (colorMode == NDColorModeMono || colorMode == NDColorModeRGB3)
-      {
-        for (color = 0; color < colorSize; color++)
-        {          
-          for (y = 0; y < ySize; y++)
-          {
-            source_offset = (y * yStride) + (color * colorStride);
-            target_offset = (((ySize-1) - y) * yStride) + (color * colorStride);
-
-            memcpy(outData + target_offset, inData + source_offset, (yStride * elementSize));
-          }
-
-        }
-      }
-
-      /** In this mode, we are moving three rows at a time. All the red, green, and blue
-        information for each for are moved at once. */
-      if (colorMode == NDColorModeRGB2)
-      {
-        for (y = 0; y < ySize; y++)
-        {
-          source_offset = (y * yStride);
-          target_offset = (((ySize-1) - y) * yStride);
+      if (xBlockEnd < x1)
+        swapRegion(inData, outData, xSize, ySize, 1, inYStride, outYStride, flipX, flipY, xBlockEnd, x1, y0, yBlockEnd);
+      if (yBlockEnd < y1)
+        swapRegion(inData, outData, xSize, ySize, 1, inYStride, outYStride, flipX, flipY, x0, x1, yBlockEnd, y1);
+    }
+  }
+}
 
-          memcpy(outData + target_offset, inData + source_offset, (yStride * elementSize));
-        }
-      }
+/** Perform the move of the pixels to the new orientation. */
+template <typename epicsType>
+void transformNDArray(NDArray *inArray, NDArray *outArray, int transformType, int colorMode, NDArrayInfo_t *arrayInfo)
+{
+  epicsType *inData = (epicsType *)inArray->pData;
+  epicsType *outData = (epicsType *)outArray->pData;
+  size_t xSize, ySize, outXSize;
+  size_t pixelSize=1, numPlanes=1, inYStride, outYStride, inPlaneStride=0, outPlaneStride=0;
+  size_t plane;
+  bool swapXY;
 
-      if (colorMode == NDColorModeRGB1)
-      {
-        for (y = 0; y < ySize; y++)
-        {
-          for (x = 0; x < xSize; x++)
-          {
-            source_offset = (x * xStride) + (y * yStride);
-            target_offset = (x * xStride) + (((ySize-1) - y) * yStride);
-            outData[target_offset + 0] = inData[source_offset + 0];;
-            outData[target_offset + 1] = inData[source_offset + 1];;
-            outData[target_offset + 2] = inData[source_offset + 2];;
-          }
-        }
-      }
+  xSize = arrayInfo->xSize;
+  ySize = arrayInfo->ySize;
 
-      break;
+  // Assume output array is same dimensions as input.  Handle rotation cases below.
+  outArray->dims[arrayInfo->xDim].size = inArray->dims[arrayInfo->xDim].size;
+  outArray->dims[arrayInfo->yDim].size = inArray->dims[arrayInfo->yDim].size;
+  if (inArray->ndims > 2) outArray->dims[arrayInfo->colorDim].size = inArray->dims[arrayInfo->colorDim].size;
 
-    default:
-      break;
+  swapXY = ((transformType == TransformRotate90)       || (transformType == TransformRotate270) ||
+            (transformType == TransformRotate90Mirror) || (transformType == TransformRotate270Mirror));
+  if (swapXY) {
+    outArray->dims[arrayInfo->xDim].size = inArray->dims[arrayInfo->yDim].size;
+    outArray->dims[arrayInfo->yDim].size = inArray->dims[arrayInfo->xDim].size;
+  }
+  outXSize = swapXY ? ySize : xSize;
+
+  /* Each pixel is transformed as a unit of pixelSize contiguous elements.
+   * Color planes (RGB2, RGB3, and 3-D arrays that are not RGB) are transformed one plane at a time. */
+  inYStride = xSize;
+  outYStride = outXSize;
+  if (inArray->ndims == 3) {
+    switch (colorMode) {
+      case NDColorModeRGB1:
+        pixelSize = arrayInfo->colorSize;
+        inYStride = xSize * pixelSize;
+        outYStride = outXSize * pixelSize;
+        break;
+      case NDColorModeRGB2:
+        numPlanes = arrayInfo->colorSize;
+        inPlaneStride = xSize;
+        outPlaneStride = outXSize;
+        inYStride = xSize * numPlanes;
+        outYStride = outXSize * numPlanes;
+        break;
+      default:
+        numPlanes = arrayInfo->colorSize;
+        inPlaneStride = xSize * ySize;
+        outPlaneStride = inPlaneStride;
+        break;
+    }
   }
 
-  return;
+  for (plane = 0; plane < numPlanes; plane++) {
+    transformPlane(inData + plane*inPlaneStride, outData + plane*outPlaneStride, xSize, ySize,
+                   pixelSize, inYStride, outYStride, transformType);
+  }
 }
 
 /** Callback function that is called by the NDArray driver with new NDArray data.
@@ -489,6 +319,8 @@ void transformNDArray(NDArray *inArray, NDArray *outArray, int transformType, in
 void NDPluginTransform::processCallbacks(NDArray *pArray){
   NDArray *transformedArray;
   NDArrayInfo_t arrayInfo;
+  int colorMode;
+  int transformType;
   static const char* functionName = "processCallbacks";
 
   /* Call the base class method */
@@ -503,16 +335,29 @@ void NDPluginTransform::processCallbacks(NDArray *pArray){
   this->userDims_[1] = arrayInfo.yDim;
   this->userDims_[2] = arrayInfo.colorDim;
 
-  /* Copy the information from the current array */
-  transformedArray = this->pNDArrayPool->copy(pArray, NULL, 1);
+  colorMode = NDColorModeMono;
+  getIntegerParam(NDColorMode, &colorMode);
+  getIntegerParam(NDPluginTransformType_, &transformType);
+
+  /* Allocate the output array and copy everything except the data from the current array.
+   * Every output element is written by transformImage, so there is no need to copy the data first. */
+  transformedArray = this->pNDArrayPool->copy(pArray, NULL, 0);
+  if (!transformedArray) {
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, "%s::%s, error allocating output array\n",
+          pluginName, functionName);
+    return;
+  }
 
   /* Release the lock; this is computationally intensive and does not access any shared data */
   this->unlock();
-  if ( pArray->ndims <=3 )
-    this->transformImage(pArray, transformedArray, &arrayInfo);
+  if ((pArray->ndims >= 2) && (pArray->ndims <= 3))
+    this->transformImage(pArray, transformedArray, &arrayInfo, transformType, colorMode);
   else {
-    asynPrint( this->pasynUserSelf, ASYN_TRACE_ERROR, "%s::%s, this method is meant to transform 2Dimages when the number of dimensions is <= 3\n",
-          pluginName, functionName);
+    /* The output array is passed through unchanged */
+    memcpy(transformedArray->pData, pArray->pData, arrayInfo.totalBytes);
+    if (pArray->ndims > 3)
+      asynPrint( this->pasynUserSelf, ASYN_TRACE_ERROR, "%s::%s, this method is meant to transform 2Dimages when the number of dimensions is <= 3\n",
+            pluginName, functionName);
   }
   this->lock();
 
@@ -526,17 +371,14 @@ void NDPluginTransform::processCallbacks(NDArray *pArray){
   callParamCallbacks();
 }
 
-
-/** Transform the image according to the selected choice.*/  
-void NDPluginTransform::transformImage(NDArray *inArray, NDArray *outArray, NDArrayInfo_t *arrayInfo)
+
+/** Transform the image according to the selected choice.
+  * This is called with the lock released, so the transform type and color mode are passed in
+  * rather than read from the parameter library. */  
+void NDPluginTransform::transformImage(NDArray *inArray, NDArray *outArray, NDArrayInfo_t *arrayInfo,
+                                       int transformType, int colorMode)
 {
   //static const char *functionName = "transformNDArray";
-  int colorMode;
-  int transformType;
-
-  colorMode = NDColorModeMono;
-  getIntegerParam(NDColorMode, &colorMode);
-  getIntegerParam(NDPluginTransformType_, &transformType);
 
   switch (inArray->dataType) {
     case NDInt8:
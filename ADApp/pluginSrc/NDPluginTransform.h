@@ -28,7 +28,8 @@ protected:
 
 private:
     size_t userDims_[ND_ARRAY_MAX_DIMS];
-    void transformImage(NDArray *inArray, NDArray *outArray, NDArrayInfo_t *arrayInfo);
+    void transformImage(NDArray *inArray, NDArray *outArray, NDArrayInfo_t *arrayInfo,
+                        int transformType, int colorMode);
 };
 
 #endif
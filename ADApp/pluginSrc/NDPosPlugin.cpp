@@ -6,16 +6,16 @@
  */
 
 #include <string.h>
-#include <sstream>
 #include <iocsh.h>
 #include <sys/stat.h>
 #include <string>
-#include <list>
-#include <map>
 #include <vector>
 
 #include <epicsTypes.h>
 #include <epicsThread.h>
+#include <epicsEvent.h>
+#include <epicsMath.h>
+#include <epicsStdio.h>
 
 #include <asynDriver.h>
 
@@ -31,6 +31,10 @@ static const char *driverName = "NDPosPlugin";
   * If the plugin is running then it attaches position data to the NDArray as NDAttributes
   * and then passes the array on.  If the plugin is not running then NDArrays are not
   * passed through to the next plugin(s) in the chain.
+  * If all the loaded positions have been used while a position file is still being loaded
+  * it waits for the next positions.  If positions are being streamed to NDPos_AppendPositions
+  * in Discard mode an array that arrives when the queue is empty is not passed on and is
+  * counted in NDPos_Underflows, and the plugin keeps running.
   * \param[in] pArray  The NDArray from the callback.
   */ 
 void NDPosPlugin::processCallbacks(NDArray *pArray)
@@ -44,6 +48,8 @@ void NDPosPlugin::processCallbacks(NDArray *pArray)
   int dropped = 0;
   int expectedID = 0;
   int IDDifference = 0;
+  int loading = 0;
+  int underflows = 0;
   epicsInt32 IDValue = 0;
   NDArray *pArrayOut = NULL;
   char IDName[MAX_STRING_SIZE];
@@ -52,17 +58,33 @@ void NDPosPlugin::processCallbacks(NDArray *pArray)
   // Call the base class method
   NDPluginDriver::beginProcessCallbacks(pArray);
   getIntegerParam(NDPos_Running, &running);
-  // We must maintain the size of the list ourselves, as calling
-  // size() on the list has a complexity of O(n) which causes a problem
-  // once we get into tens of thousands of items.
-  getIntegerParam(NDPos_CurrentQty, &size);
+  getIntegerParam(NDPos_CurrentIndex, &index);
+  getIntegerParam(NDPos_Loading, &loading);
+  getIntegerParam(NDPos_Mode, &mode);
+  size = (int)positionStore.size();
+  while ((running == NDPOS_RUNNING) && (index >= size) && loading){
+    // The loader has not caught up yet, wait for it without the lock
+    this->unlock();
+    epicsEventWait(positionsEvent);
+    this->lock();
+    getIntegerParam(NDPos_Running, &running);
+    getIntegerParam(NDPos_CurrentIndex, &index);
+    getIntegerParam(NDPos_Loading, &loading);
+    size = (int)positionStore.size();
+  }
   // Only attach the position data to the array if we are running
   if (running == NDPOS_RUNNING){
-    getIntegerParam(NDPos_CurrentIndex, &index);
     if (index >= size){
-      // We've reached the end of our positions, stop to make sure we don't overflow
-      setIntegerParam(NDPos_Running, NDPOS_IDLE);
-      running = NDPOS_IDLE;
+      getIntegerParam(NDPos_Underflows, &underflows);
+      setIntegerParam(NDPos_Underflows, underflows + 1);
+      if ((mode == MODE_DISCARD) && streaming){
+        // Keep running until more positions are appended, but drop this array
+        skip = 1;
+      } else {
+        // We've reached the end of our positions, stop to make sure we don't overflow
+        setIntegerParam(NDPos_Running, NDPOS_IDLE);
+        running = NDPOS_IDLE;
+      }
     } else {
       // Read the ID parameter from the NDArray.  If it cannot be found then abort
       getStringParam(NDPos_IDName, MAX_STRING_SIZE, IDName);
@@ -103,14 +125,19 @@ void NDPosPlugin::processCallbacks(NDArray *pArray)
           getIntegerParam(NDPos_Mode, &mode);
           if (mode == MODE_DISCARD){
             while ((expectedID < IDValue) && (size > 0)){
-              // The index will stay the same, and we need to pop the value out of the position array
-              positionArray.erase(positionArray.begin());
+              // The index will stay the same, and we need to pop the value out of the position store
+              positionStore.discard(1);
               size--;
               expectedID += IDDifference;
               dropped++;
             }
-            // If the size has dropped to zero then we've run out of positions, abort
-            if (size == 0){
+            // If the size has dropped to zero then we've run out of positions, abort,
+            // unless more positions are being streamed
+            if ((size == 0) && streaming){
+              getIntegerParam(NDPos_Underflows, &underflows);
+              setIntegerParam(NDPos_Underflows, underflows + 1);
+              skip = 1;
+            } else if (size == 0){
               setIntegerParam(NDPos_Running, NDPOS_IDLE);
               running = NDPOS_IDLE;
             }
@@ -146,31 +173,9 @@ void NDPosPlugin::processCallbacks(NDArray *pArray)
       if (skip == 0 && running == NDPOS_RUNNING){
         // We must make a copy of the array as we are going to alter it
         pArrayOut = this->pNDArrayPool->copy(pArray, NULL, 1);
-        this->getAttributes(pArrayOut->pAttributeList);
         if (pArrayOut){
-          std::list<std::map<std::string, double> >::iterator it = positionArray.begin();
-          std::advance(it, index);
-          //std::map<std::string, double> pos = positionArray[index];
-          std::map<std::string, double> pos = *it;
-          std::stringstream sspos;
-          sspos << "[";
-          bool firstTime = true;
-          std::map<std::string, double>::iterator iter;
-          for (iter = pos.begin(); iter != pos.end(); iter++){
-            if (firstTime){
-              firstTime = false;
-            } else {
-              sspos << ",";
-            }
-            sspos << iter->first << "=" << iter->second;
-            // Create the NDAttribute with the position data
-            NDAttribute *pAtt = new NDAttribute(iter->first.c_str(), "Position of NDArray", NDAttrSourceDriver, driverName, NDAttrFloat64, &(iter->second));
-            // Add the NDAttribute to the NDArray
-            pArrayOut->pAttributeList->add(pAtt);
-          }
-          sspos << "]";
-          setStringParam(NDPos_CurrentPos, sspos.str().c_str());
-
+          this->getAttributes(pArrayOut->pAttributeList);
+          attachPosition(pArrayOut, index);
         } else {
           // We were unable to allocate the required buffer (memory or qty exceeded).
           // This results in us dropping a frame, note it and print an error
@@ -187,10 +192,12 @@ void NDPosPlugin::processCallbacks(NDArray *pArray)
         // Check the mode
         getIntegerParam(NDPos_Mode, &mode);
         if (mode == MODE_DISCARD){
-          // The index will stay the same, and we need to pop the value out of the position array
-          positionArray.erase(positionArray.begin());
+          // The index will stay the same, and we need to pop the value out of the position store
+          positionStore.discard(1);
           size--;
           setIntegerParam(NDPos_CurrentQty, size);
+          // Let the loader refill the queue
+          if (loading) epicsEventSignal(loadEvent);
         } else if (mode == MODE_KEEP){
           index++;
           setIntegerParam(NDPos_CurrentIndex, index);
@@ -200,10 +207,12 @@ void NDPosPlugin::processCallbacks(NDArray *pArray)
         setIntegerParam(NDPos_ExpectedID, expectedID);
       }
     }
-    // If the size has dropped to zero then we've run out of positions, abort
-    if (size == 0){
+    // If the size has dropped to zero then we've run out of positions, abort,
+    // unless more positions are being loaded or streamed
+    if ((size == 0) && !loading && !((mode == MODE_DISCARD) && streaming)){
       setIntegerParam(NDPos_Running, NDPOS_IDLE);
     }
+    setQueueDepth();
     callParamCallbacks();
     if (skip == 0 && running == NDPOS_RUNNING) {
       NDPluginDriver::endProcessCallbacks(pArrayOut, false, false);
@@ -211,6 +220,286 @@ void NDPosPlugin::processCallbacks(NDArray *pArray)
   }
 }
 
+/** Adds the values of a position to an array as NDAttributes, in the order of the dimension names,
+  * and sets NDPos_CurrentPos to the position, for example "[n=0,x=1,y=0]".
+  * Dimensions that the position has no value in are left out.
+  * \param[in] pArray The array.
+  * \param[in] index The index of the position in the store.
+  */
+void NDPosPlugin::attachPosition(NDArray *pArray, size_t index)
+{
+  const std::vector<size_t>& dimensions = positionStore.sortedDimensions();
+  std::string currentPos("[");
+  char valueString[64];
+  double value;
+
+  for (size_t i = 0; i < dimensions.size(); i++){
+    value = positionStore.value(index, dimensions[i]);
+    if (isnan(value)) continue;
+    const std::string& name = positionStore.dimensionName(dimensions[i]);
+    // Create the NDAttribute with the position data and add it to the NDArray
+    NDAttribute *pAtt = new NDAttribute(name.c_str(), "Position of NDArray", NDAttrSourceDriver, driverName, NDAttrFloat64, &value);
+    pArray->pAttributeList->add(pAtt);
+    epicsSnprintf(valueString, sizeof(valueString), "%g", value);
+    if (currentPos.size() > 1) currentPos += ",";
+    currentPos += name;
+    currentPos += "=";
+    currentPos += valueString;
+  }
+  currentPos += "]";
+  setStringParam(NDPos_CurrentPos, currentPos.c_str());
+}
+
+/** Starts loading a position file.  The first NDPOS_LOAD_BLOCK_SIZE positions are read
+  * here, so a file that cannot be read is reported to the caller, and loadTask() loads the
+  * rest in the background while the positions already loaded are used.  If another file
+  * is still being loaded the file is queued behind it.
+  * Called with the lock held.
+  * \param[in] filename The file name, or an XML string containing <pos_layout>.
+  */
+asynStatus NDPosPlugin::loadFile(const std::string& filename)
+{
+  NDPosPluginFileReader *pReader = new NDPosPluginFileReader();
+  std::vector<int> columns;
+  std::vector<double> values;
+  int count = 0;
+  asynStatus status = asynSuccess;
+  static const char *functionName = "loadFile";
+
+  status = pReader->openStream(filename);
+  if (status == asynSuccess){
+    status = pReader->readBlock(values, NDPOS_LOAD_BLOCK_SIZE, &count);
+  }
+  if (status != asynSuccess){
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+              "%s::%s ERROR: %s\n",
+              driverName, functionName, pReader->getErrorMsg().c_str());
+    delete pReader;
+    return status;
+  }
+  positionStore.mapDimensions(pReader->readDimensions(), columns);
+  if (pReader->isFinished()){
+    delete pReader;
+    pReader = NULL;
+  }
+  queueLoad(pReader, columns, values.empty() ? NULL : &values[0], count);
+  return asynSuccess;
+}
+
+/** Adds positions to the store, or queues them if a position file is still being loaded.
+  * If there is a reader loadTask() loads the rest of its file.  Called with the lock held.
+  * \param[in] pReader The reader of the rest of the file, or NULL.
+  * \param[in] columns The columns of the dimensions of the positions in the store.
+  * \param[in] values The values of the positions, those of each position together.
+  * \param[in] count The number of positions.
+  */
+void NDPosPlugin::queueLoad(NDPosPluginFileReader *pReader, const std::vector<int>& columns,
+                            const double *values, int count)
+{
+  int loading = 0;
+
+  getIntegerParam(NDPos_Loading, &loading);
+  if (loading){
+    NDPosPendingLoad load;
+    load.pReader = pReader;
+    load.columns = columns;
+    if (count > 0) load.values.assign(values, values + count * columns.size());
+    load.count = count;
+    pendingLoads.push_back(load);
+    return;
+  }
+  appendPositions(columns, values, count);
+  if (pReader != NULL){
+    loadReader = pReader;
+    loadColumns = columns;
+    setIntegerParam(NDPos_Loading, 1);
+    epicsEventSignal(loadEvent);
+  }
+}
+
+/** Adds the queued positions to the store up to the next file that has more to load,
+  * which loadTask() then loads.  Called with the lock held when the current file is loaded.
+  */
+void NDPosPlugin::startPendingLoad()
+{
+  setIntegerParam(NDPos_Loading, 0);
+  while (!pendingLoads.empty()){
+    NDPosPendingLoad& load = pendingLoads.front();
+    appendPositions(load.columns, load.values.empty() ? NULL : &load.values[0], load.count);
+    if (load.pReader != NULL){
+      loadReader = load.pReader;
+      loadColumns = load.columns;
+      setIntegerParam(NDPos_Loading, 1);
+    }
+    pendingLoads.pop_front();
+    if (loadReader != NULL) break;
+  }
+}
+
+/** Appends positions to the store.  Called with the lock held.
+  * \param[in] columns The columns of the dimensions of the positions in the store.
+  * \param[in] values The values of the positions, those of each position together.
+  * \param[in] count The number of positions.
+  */
+void NDPosPlugin::appendPositions(const std::vector<int>& columns, const double *values, int count)
+{
+  positionStore.append(columns, values, count);
+  setIntegerParam(NDPos_CurrentQty, (int)positionStore.size());
+  setQueueDepth();
+}
+
+/** Sets NDPos_QueueDepth to the number of positions that have not been used yet.
+  * Called with the lock held.
+  */
+void NDPosPlugin::setQueueDepth()
+{
+  int index = 0;
+  int size = (int)positionStore.size();
+
+  getIntegerParam(NDPos_CurrentIndex, &index);
+  setIntegerParam(NDPos_QueueDepth, (index < size) ? size - index : 0);
+}
+
+/** Appends positions written to NDPos_AppendPositions.  Called with the lock held.
+  * \param[in] values The values of the positions in the dimensions of NDPos_Dimensions,
+  *            those of each position together.
+  * \param[in] nElements The number of values.
+  */
+asynStatus NDPosPlugin::appendValues(const epicsFloat64 *values, size_t nElements)
+{
+  std::string names;
+  std::vector<std::string> dimensions;
+  std::vector<int> columns;
+  size_t start = 0, end;
+  static const char *functionName = "appendValues";
+
+  // The dimensions are mapped for each block, so they survive NDPos_Delete
+  getStringParam(NDPos_Dimensions, names);
+  while (start < names.size()){
+    end = names.find(',', start);
+    if (end == std::string::npos) end = names.size();
+    size_t first = names.find_first_not_of(" \t", start);
+    size_t last = names.find_last_not_of(" \t", end - 1);
+    if ((first != std::string::npos) && (first < end)){
+      dimensions.push_back(names.substr(first, last - first + 1));
+    }
+    start = end + 1;
+  }
+  if (dimensions.empty() || (nElements % dimensions.size() != 0)){
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+              "%s::%s ERROR: %d values do not make whole positions of dimensions [%s]\n",
+              driverName, functionName, (int)nElements, names.c_str());
+    return asynError;
+  }
+  for (size_t i = 0; i < nElements; i++){
+    // NaN marks a dimension with no value in the store, so it is not a valid value
+    if (isnan(values[i]) || isinf(values[i])){
+      asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                "%s::%s ERROR: value %d is not finite\n",
+                driverName, functionName, (int)i);
+      return asynError;
+    }
+  }
+  positionStore.mapDimensions(dimensions, columns);
+  // The positions are queued behind a position file that is still being loaded
+  queueLoad(NULL, columns, values, (int)(nElements / dimensions.size()));
+  streaming = true;
+  return asynSuccess;
+}
+
+/** Stops loading the current position file and drops the queued positions.
+  * Called with the lock held.
+  */
+void NDPosPlugin::stopLoading()
+{
+  // If loadTask() is reading a block it deletes the reader when it sees loadId has changed
+  loadId++;
+  if (loadReader != NULL){
+    delete loadReader;
+    loadReader = NULL;
+  }
+  while (!pendingLoads.empty()){
+    delete pendingLoads.front().pReader;
+    pendingLoads.pop_front();
+  }
+  setIntegerParam(NDPos_Loading, 0);
+  epicsEventSignal(positionsEvent);
+}
+
+/** Loads the rest of a position file opened by loadFile() a block at a time, and then the
+  * positions queued behind it.  The blocks are read without the lock.  In Discard mode loading pauses while NDPos_QueueLimit
+  * positions are waiting to be used, so the memory used does not depend on the size of the file.
+  */
+void NDPosPlugin::loadTask()
+{
+  NDPosPluginFileReader *pReader;
+  std::vector<int> columns;
+  std::vector<double> values;
+  int id;
+  int count = 0;
+  int mode = 0;
+  int queueLimit = 0;
+  asynStatus status;
+  static const char *functionName = "loadTask";
+
+  this->lock();
+  while (!exiting){
+    getIntegerParam(NDPos_Mode, &mode);
+    getIntegerParam(NDPos_QueueLimit, &queueLimit);
+    if ((loadReader == NULL) ||
+        ((mode == MODE_DISCARD) && (queueLimit > 0) && ((int)positionStore.size() >= queueLimit))){
+      // Nothing to load, or enough positions are waiting to be used
+      this->unlock();
+      epicsEventWait(loadEvent);
+      this->lock();
+      continue;
+    }
+    pReader = loadReader;
+    loadReader = NULL;
+    columns = loadColumns;
+    id = loadId;
+    this->unlock();
+    status = pReader->readBlock(values, NDPOS_LOAD_BLOCK_SIZE, &count);
+    this->lock();
+    if (id != loadId){
+      // The positions were deleted while the block was read
+      delete pReader;
+      continue;
+    }
+    if (status != asynSuccess){
+      // The file is malformed after the first block, so stop the scan rather than
+      // attach positions from a file that is only partly loaded
+      asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                "%s::%s ERROR: %s\n",
+                driverName, functionName, pReader->getErrorMsg().c_str());
+      setIntegerParam(NDPos_FileValid, 0);
+      setIntegerParam(NDPos_Running, NDPOS_IDLE);
+    } else {
+      appendPositions(columns, values.empty() ? NULL : &values[0], count);
+    }
+    if ((status != asynSuccess) || pReader->isFinished()){
+      delete pReader;
+      startPendingLoad();
+      // Stop if the last position was used while this block was read
+      if ((loadReader == NULL) && (mode == MODE_DISCARD) && (positionStore.size() == 0) && !streaming){
+        setIntegerParam(NDPos_Running, NDPOS_IDLE);
+      }
+    } else {
+      loadReader = pReader;
+    }
+    callParamCallbacks();
+    epicsEventSignal(positionsEvent);
+  }
+  this->unlock();
+  epicsEventSignal(loadExitEvent);
+}
+
+static void loadTaskC(void *drvPvt)
+{
+  NDPosPlugin *pPvt = (NDPosPlugin *)drvPvt;
+  pPvt->loadTask();
+}
+
 /** Sets an int32 parameter.
   * \param[in] pasynUser asynUser structure that contains the function code in pasynUser->reason. 
   * \param[in] value The value for this parameter 
@@ -238,9 +527,14 @@ asynStatus NDPosPlugin::writeInt32(asynUser *pasynUser, epicsInt32 value)
       int expected = 0;
       getIntegerParam(NDPos_IDStart, &expected);
       setIntegerParam(NDPos_ExpectedID, expected);
+      // Release an array waiting for positions
+      epicsEventSignal(positionsEvent);
     } else if (function == NDPos_Mode){
       // Reset the position index to 0 if the mode is changed
       setIntegerParam(NDPos_CurrentIndex, 0);
+      epicsEventSignal(loadEvent);
+    } else if (function == NDPos_QueueLimit){
+      epicsEventSignal(loadEvent);
     } else if (function == NDPos_Restart){
       // Reset the position index to 0
       setIntegerParam(NDPos_CurrentIndex, 0);
@@ -251,9 +545,11 @@ asynStatus NDPosPlugin::writeInt32(asynUser *pasynUser, epicsInt32 value)
       setIntegerParam(NDPos_CurrentIndex, 0);
       // Reset the last sent position
       setStringParam(NDPos_CurrentPos, "");
-      // Clear out the position array
-      positionArray.clear();
-      setIntegerParam(NDPos_CurrentQty, (int)positionArray.size());
+      // Stop loading and streaming and clear out the position store
+      stopLoading();
+      streaming = false;
+      positionStore.clear();
+      setIntegerParam(NDPos_CurrentQty, (int)positionStore.size());
     } else {
       // If this parameter belongs to a base class call its method
       if (function < FIRST_NDPOS_PARAM){
@@ -263,6 +559,7 @@ asynStatus NDPosPlugin::writeInt32(asynUser *pasynUser, epicsInt32 value)
   }
 
   // Do callbacks so higher layers see any changes
+  setQueueDepth();
   status = (asynStatus)callParamCallbacks();
 
   if (status){
@@ -278,6 +575,38 @@ asynStatus NDPosPlugin::writeInt32(asynUser *pasynUser, epicsInt32 value)
   return status;
 }
 
+/** Called when asyn clients call pasynFloat64Array->write().
+  * Positions written to NDPos_AppendPositions are appended to the store, so positions can be
+  * streamed to the plugin while it is running.
+  * \param[in] pasynUser pasynUser structure that encodes the reason and address.
+  * \param[in] value Pointer to the array to write.
+  * \param[in] nElements Number of elements to write.
+  */
+asynStatus NDPosPlugin::writeFloat64Array(asynUser *pasynUser, epicsFloat64 *value, size_t nElements)
+{
+  int function = pasynUser->reason;
+  asynStatus status = asynSuccess;
+  static const char *functionName = "writeFloat64Array";
+
+  if (function == NDPos_AppendPositions){
+    status = appendValues(value, nElements);
+  } else if (function < FIRST_NDPOS_PARAM){
+    status = NDPluginDriver::writeFloat64Array(pasynUser, value, nElements);
+  }
+  callParamCallbacks();
+
+  if (status){
+    epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+                  "%s:%s: status=%d, function=%d, nElements=%d",
+                  driverName, functionName, status, function, (int)nElements);
+  } else {
+    asynPrint(pasynUser, ASYN_TRACEIO_DRIVER,
+              "%s:%s: function=%d, nElements=%d\n",
+              driverName, functionName, function, (int)nElements);
+  }
+  return status;
+}
+
 /** Called when asyn clients call pasynOctet->write().
   * This function performs actions for some parameters, including AttributesFile.
   * For all parameters it sets the value in the parameter library and calls any registered callbacks..
@@ -300,21 +629,10 @@ asynStatus NDPosPlugin::writeOctet(asynUser *pasynUser, const char *value, size_
 
   if (function == NDPos_Filename){
     // Read the filename parameter
-    std::string xml;
-    getStringParam(NDPos_Filename, xml);
-    // Now validate the XML
-    NDPosPluginFileReader fr;
-    if (fr.validateXML(xml) == asynSuccess){
+    std::string filename;
+    getStringParam(NDPos_Filename, filename);
+    if (loadFile(filename) == asynSuccess){
       setIntegerParam(NDPos_FileValid, 1);
-      NDPosPluginFileReader fr;
-       /* Read the filename and valid parameters
-       * then the positions are loaded and appended to the position set.
-       */
-      fr.loadXML(xml);
-      std::vector<std::map<std::string, double> > positions = fr.readPositions();
-      positionArray.insert(positionArray.end(), positions.begin(), positions.end());
-      setIntegerParam(NDPos_CurrentQty, (int)positionArray.size());
-      callParamCallbacks();
     } else {
       setIntegerParam(NDPos_FileValid, 0);
       status = asynError;
@@ -403,6 +721,12 @@ NDPosPlugin::NDPosPlugin(const char *portName,
   createParam(str_NDPos_IDName,          asynParamOctet,        &NDPos_IDName);
   createParam(str_NDPos_IDDifference,    asynParamInt32,        &NDPos_IDDifference);
   createParam(str_NDPos_IDStart,         asynParamInt32,        &NDPos_IDStart);
+  createParam(str_NDPos_Loading,         asynParamInt32,        &NDPos_Loading);
+  createParam(str_NDPos_QueueLimit,      asynParamInt32,        &NDPos_QueueLimit);
+  createParam(str_NDPos_QueueDepth,      asynParamInt32,        &NDPos_QueueDepth);
+  createParam(str_NDPos_Underflows,      asynParamInt32,        &NDPos_Underflows);
+  createParam(str_NDPos_Dimensions,      asynParamOctet,        &NDPos_Dimensions);
+  createParam(str_NDPos_AppendPositions, asynParamFloat64Array, &NDPos_AppendPositions);
 
   // Set the plugin type string
   setStringParam(NDPluginDriverPluginType, "NDPositionPlugin");
@@ -430,6 +754,27 @@ NDPosPlugin::NDPosPlugin(const char *portName,
   setIntegerParam(NDPos_MissingFrames,     0);
   // Set the missing frames to 0
   setIntegerParam(NDPos_DuplicateFrames,   0);
+  // Set loading to 0
+  setIntegerParam(NDPos_Loading,           0);
+  // Load up to 100000 positions ahead in Discard mode
+  setIntegerParam(NDPos_QueueLimit,        100000);
+  // Set the queue depth and underflows to 0
+  setIntegerParam(NDPos_QueueDepth,        0);
+  setIntegerParam(NDPos_Underflows,        0);
+  // No dimensions for appended positions
+  setStringParam(NDPos_Dimensions,         "");
+
+  // Start the task that loads position files in the background
+  loadReader = NULL;
+  loadId = 0;
+  exiting = false;
+  streaming = false;
+  loadEvent = epicsEventMustCreate(epicsEventEmpty);
+  positionsEvent = epicsEventMustCreate(epicsEventEmpty);
+  loadExitEvent = epicsEventMustCreate(epicsEventEmpty);
+  epicsThreadCreate("NDPosPluginLoad", epicsThreadPriorityLow,
+                    epicsThreadGetStackSize(epicsThreadStackMedium),
+                    (EPICSTHREADFUNC)loadTaskC, this);
 
   // Try to connect to the array port
   connectToArrayPort();
@@ -438,6 +783,17 @@ NDPosPlugin::NDPosPlugin(const char *portName,
 
 NDPosPlugin::~NDPosPlugin ()
 {
+  this->lock();
+  exiting = true;
+  this->unlock();
+  epicsEventSignal(loadEvent);
+  epicsEventWait(loadExitEvent);
+  this->lock();
+  stopLoading();
+  this->unlock();
+  epicsEventDestroy(loadEvent);
+  epicsEventDestroy(positionsEvent);
+  epicsEventDestroy(loadExitEvent);
 }
 
 // Configuration command
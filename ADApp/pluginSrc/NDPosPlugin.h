@@ -25,17 +25,25 @@
  *  NDPos_CurrentQty         - Number of loaded positions in the store
  *  NDPos_CurrentIndex       - Current index of position in store (0 if Discard mode)
  *  NDPos_CurrentPos         - Value of the next position to attach to the NDArray
+ *  NDPos_Loading            - Positions are being loaded from the file in the background
+ *  NDPos_QueueLimit         - Maximum number of positions loaded ahead in Discard mode (0 - no limit)
+ *  NDPos_QueueDepth         - Number of positions that have not been used yet
+ *  NDPos_Underflows         - Number of arrays that arrived when no position was available
+ *  NDPos_Dimensions         - Comma separated dimension names of the positions written to NDPos_AppendPositions
+ *  NDPos_AppendPositions    - Packed values of positions to append to the store, those of each position together
  */
 
 #ifndef NDPosPluginAPP_SRC_NDPosPlugin_H_
 #define NDPosPluginAPP_SRC_NDPOSPLUGIN_H_
 
 #include <epicsTypes.h>
+#include <epicsEvent.h>
 #include <string>
-#include <list>
-#include <map>
+#include <vector>
+#include <deque>
 
 #include "NDPluginDriver.h"
+#include "NDPosPluginPositions.h"
 
 #define str_NDPos_Filename        "NDPos_Filename"
 #define str_NDPos_FileValid       "NDPos_FileValid"
@@ -54,6 +62,12 @@
 #define str_NDPos_IDName          "NDPos_IDName"
 #define str_NDPos_IDDifference    "NDPos_IDDifference"
 #define str_NDPos_IDStart         "NDPos_IDStart"
+#define str_NDPos_Loading         "NDPos_Loading"
+#define str_NDPos_QueueLimit      "NDPos_QueueLimit"
+#define str_NDPos_QueueDepth      "NDPos_QueueDepth"
+#define str_NDPos_Underflows      "NDPos_Underflows"
+#define str_NDPos_Dimensions      "NDPos_Dimensions"
+#define str_NDPos_AppendPositions "NDPos_AppendPositions"
 
 #define MODE_DISCARD 0
 #define MODE_KEEP    1
@@ -61,6 +75,21 @@
 #define NDPOS_IDLE    0
 #define NDPOS_RUNNING 1
 
+// Number of positions read from a position file at a time
+#define NDPOS_LOAD_BLOCK_SIZE 1000
+
+class NDPosPluginFileReader;
+
+/** Positions that are waiting for an earlier position file to be loaded, so that they are
+  * added to the store in the order they were written.
+  */
+typedef struct NDPosPendingLoad {
+  NDPosPluginFileReader *pReader;  // Reader of the rest of the file, NULL if there is no more
+  std::vector<int> columns;        // Columns of the dimensions of the positions in the store
+  std::vector<double> values;      // Positions read from the file or appended
+  int count;                       // Number of positions in values
+} NDPosPendingLoad;
+
 class NDPosPlugin : public NDPluginDriver
 {
 
@@ -79,6 +108,8 @@ public:
   void processCallbacks(NDArray *pArray);
   asynStatus writeInt32(asynUser *pasynUser, epicsInt32 value);
   asynStatus writeOctet(asynUser *pasynUser, const char *value, size_t nChars, size_t *nActual);
+  asynStatus writeFloat64Array(asynUser *pasynUser, epicsFloat64 *value, size_t nElements);
+  void loadTask();
 
 protected:
   // plugin parameters
@@ -100,10 +131,37 @@ protected:
   int NDPos_IDName;
   int NDPos_IDDifference;
   int NDPos_IDStart;
+  int NDPos_Loading;
+  int NDPos_QueueLimit;
+  int NDPos_QueueDepth;
+  int NDPos_Underflows;
+  int NDPos_Dimensions;
+  int NDPos_AppendPositions;
 
 private:
+  void attachPosition(NDArray *pArray, size_t index);
+  asynStatus loadFile(const std::string& filename);
+  void appendPositions(const std::vector<int>& columns, const double *values, int count);
+  asynStatus appendValues(const epicsFloat64 *values, size_t nElements);
+  void setQueueDepth();
+  void queueLoad(NDPosPluginFileReader *pReader, const std::vector<int>& columns,
+                 const double *values, int count);
+  void startPendingLoad();
+  void stopLoading();
+
   // Plugin member variables
-  std::list<std::map<std::string, double> > positionArray;
+  NDPosPluginPositions positionStore;
+  // Background loading of position files; loadReader is NULL while loadTask() is reading from it
+  NDPosPluginFileReader *loadReader;
+  std::vector<int> loadColumns;
+  std::deque<NDPosPendingLoad> pendingLoads;
+  int loadId;
+  bool exiting;
+  // Positions have been appended to NDPos_AppendPositions since the last NDPos_Delete
+  bool streaming;
+  epicsEventId loadEvent;
+  epicsEventId positionsEvent;
+  epicsEventId loadExitEvent;
 };
 
 #endif /* NDPosPluginAPP_SRC_NDPOSPLUGIN_H_ */
@@ -7,6 +7,11 @@
 
 #include "NDPosPluginFileReader.h"
 #include <sstream>
+#include <stdlib.h>
+#include <string.h>
+
+#include <epicsString.h>
+#include <epicsMath.h>
 
 const std::string NDPosPluginFileReader::ELEMENT_NAME       = "name";
 const std::string NDPosPluginFileReader::ELEMENT_DIMENSIONS = "dimensions";
@@ -17,12 +22,13 @@ const std::string NDPosPluginFileReader::ELEMENT_POSITION   = "position";
 const std::string NDPosPluginFileReader::DIMENSION_NAME     = "name";
 
 NDPosPluginFileReader::NDPosPluginFileReader()
-  : xmlreader(NULL)
+  : xmlreader(NULL), csv(false), finished(true), pendingPosition(false)
 {
 }
 
 NDPosPluginFileReader::~NDPosPluginFileReader()
 {
+  closeStream();
 }
 
 asynStatus NDPosPluginFileReader::validateXML(const std::string& filename)
@@ -167,6 +173,9 @@ asynStatus NDPosPluginFileReader::addDimension()
     // Add the dimension to the vector of dimension names
     dimensions.push_back(str_dim_name);
   }
+  if (dim_name != NULL){
+    xmlFree(dim_name);
+  }
   return status;
 }
 
@@ -201,6 +210,7 @@ asynStatus NDPosPluginFileReader::addPosition()
           // Insert the dimension index into the position map
           pos[*iter] = index;
         }
+        xmlFree(pos_val);
       }
     }
   }
@@ -212,6 +222,225 @@ asynStatus NDPosPluginFileReader::addPosition()
   return status;
 }
 
+/** Opens a position file or XML string to read the positions a block at a time with readBlock(),
+  * so that large files do not have to be held in memory.  The dimensions are read here.
+  * Files with the extension .csv have a line with the comma separated dimension names followed
+  * by a line with the values of each position, and lines starting with # are comments;
+  * other files and strings are XML.
+  * \param[in] filename The file name, or an XML string containing <pos_layout>.
+  */
+asynStatus NDPosPluginFileReader::openStream(const std::string& filename)
+{
+  int ret = 0;
+  size_t len = filename.length();
+
+  closeStream();
+  dimensions.clear();
+  finished = false;
+  if (filename.find("<pos_layout>") != std::string::npos){
+    // The reader uses the string in place so keep a copy of it
+    xmlString = filename;
+    xmlreader = xmlReaderForMemory(xmlString.c_str(), (int)xmlString.length(), NULL, NULL, 0);
+  } else if ((len > 4) && (epicsStrCaseCmp(filename.c_str() + len - 4, ".csv") == 0)){
+    return openCSV(filename);
+  } else {
+    xmlreader = xmlReaderForFile(filename.c_str(), NULL, 0);
+  }
+
+  if (xmlreader == NULL){
+    setErrorMsg("Error creating XML parser, check file");
+    finished = true;
+    return asynError;
+  }
+
+  // Read up to the start of the positions
+  while ((ret = xmlTextReaderRead(xmlreader)) == 1){
+    if (xmlTextReaderNodeType(xmlreader) != XML_READER_TYPE_ELEMENT) continue;
+    const xmlChar *xmlname = xmlTextReaderConstName(xmlreader);
+    if (xmlStrEqual(xmlname, (const xmlChar *)ELEMENT_DIMENSION.c_str())){
+      if (addDimension() != asynSuccess){
+        setErrorMsg("Possible bad XML format, check file");
+      }
+    } else if (xmlStrEqual(xmlname, (const xmlChar *)ELEMENT_POSITIONS.c_str())){
+      break;
+    } else if (xmlStrEqual(xmlname, (const xmlChar *)ELEMENT_POSITION.c_str())){
+      // No positions element, this position is read by the first readBlock()
+      pendingPosition = true;
+      break;
+    }
+  }
+  if (ret < 0){
+    setErrorMsg("XML parsing failed, check file format");
+    closeStream();
+    return asynError;
+  }
+  if (ret == 0){
+    finished = true;
+  }
+  return asynSuccess;
+}
+
+/** Reads the next block of positions from the stream opened with openStream().
+  * Positions without a valid value for each dimension are skipped as they are by loadXML().
+  * \param[out] values The values of the positions, those of each position in the order of readDimensions().
+  * \param[in] maxPositions The maximum number of positions to read.
+  * \param[out] count The number of positions read.
+  * \return asynError if the file is not valid; the positions before the error are returned.
+  */
+asynStatus NDPosPluginFileReader::readBlock(std::vector<double>& values, int maxPositions, int *count)
+{
+  size_t numDims = dimensions.size();
+  int ret = 0;
+
+  *count = 0;
+  if (csv){
+    return readCSVBlock(values, maxPositions, count);
+  }
+  values.resize(maxPositions * numDims);
+  while (!finished && (*count < maxPositions)){
+    if (pendingPosition){
+      pendingPosition = false;
+    } else {
+      ret = xmlTextReaderRead(xmlreader);
+      if (ret <= 0){
+        finished = true;
+        if (ret < 0){
+          setErrorMsg("XML parsing failed, check file format");
+          values.resize(*count * numDims);
+          return asynError;
+        }
+        break;
+      }
+      if ((xmlTextReaderNodeType(xmlreader) != XML_READER_TYPE_ELEMENT) ||
+          !xmlStrEqual(xmlTextReaderConstName(xmlreader), (const xmlChar *)ELEMENT_POSITION.c_str())){
+        continue;
+      }
+    }
+    if (parsePosition(&values[*count * numDims]) == asynSuccess){
+      (*count)++;
+    } else {
+      setErrorMsg("Possible bad XML format, check file");
+    }
+  }
+  values.resize(*count * numDims);
+  return asynSuccess;
+}
+
+/** Returns true when all the positions of the stream have been read */
+bool NDPosPluginFileReader::isFinished()
+{
+  return finished;
+}
+
+/** Closes the stream opened with openStream() */
+void NDPosPluginFileReader::closeStream()
+{
+  if (xmlreader != NULL){
+    xmlFreeTextReader(xmlreader);
+    xmlreader = NULL;
+  }
+  if (csvFile.is_open()){
+    csvFile.close();
+  }
+  xmlString.clear();
+  csv = false;
+  finished = true;
+  pendingPosition = false;
+}
+
+asynStatus NDPosPluginFileReader::openCSV(const std::string& filename)
+{
+  std::string line;
+  size_t start = 0, end;
+
+  csvFile.clear();
+  csvFile.open(filename.c_str());
+  if (!csvFile.is_open() || !std::getline(csvFile, line)){
+    setErrorMsg("Error opening CSV position file, check file");
+    closeStream();
+    return asynError;
+  }
+  // The first line has the dimension names
+  while (start <= line.length()){
+    end = line.find(',', start);
+    if (end == std::string::npos) end = line.length();
+    std::string name = line.substr(start, end - start);
+    size_t first = name.find_first_not_of(" \t\r");
+    size_t last = name.find_last_not_of(" \t\r");
+    if (first == std::string::npos){
+      setErrorMsg("CSV position file has an empty dimension name, check file");
+      closeStream();
+      return asynError;
+    }
+    dimensions.push_back(name.substr(first, last - first + 1));
+    start = end + 1;
+  }
+  csv = true;
+  return asynSuccess;
+}
+
+asynStatus NDPosPluginFileReader::readCSVBlock(std::vector<double>& values, int maxPositions, int *count)
+{
+  size_t numDims = dimensions.size();
+  std::string line;
+  const char *p;
+  char *end;
+  size_t d;
+
+  values.resize(maxPositions * numDims);
+  while (!finished && (*count < maxPositions)){
+    if (!std::getline(csvFile, line)){
+      finished = true;
+      break;
+    }
+    // Skip empty lines and comments
+    size_t first = line.find_first_not_of(" \t\r");
+    if ((first == std::string::npos) || (line[first] == '#')) continue;
+    p = line.c_str();
+    double *pos = &values[*count * numDims];
+    for (d = 0; d < numDims; d++){
+      pos[d] = strtod(p, &end);
+      // NaN marks a dimension with no value in the store, so it is not a valid value
+      if ((end == p) || isnan(pos[d]) || isinf(pos[d])) break;
+      while ((*end == ' ') || (*end == '\t')) end++;
+      if (d + 1 < numDims){
+        if (*end != ',') break;
+        end++;
+      }
+      p = end;
+    }
+    if ((d == numDims) && ((*end == 0) || (*end == '\r'))){
+      (*count)++;
+    } else {
+      setErrorMsg("Possible bad CSV line, check file");
+    }
+  }
+  values.resize(*count * numDims);
+  return asynSuccess;
+}
+
+asynStatus NDPosPluginFileReader::parsePosition(double *values)
+{
+  asynStatus status = asynSuccess;
+  xmlChar *pos_val = NULL;
+  char *end;
+
+  for (size_t d = 0; (d < dimensions.size()) && (status == asynSuccess); d++){
+    pos_val = xmlTextReaderGetAttribute(this->xmlreader, (const xmlChar *)dimensions[d].c_str());
+    if (pos_val == NULL){
+      status = asynError;
+    } else {
+      values[d] = strtod((const char *)pos_val, &end);
+      // NaN marks a dimension with no value in the store, so it is not a valid value
+      if ((end == (char *)pos_val) || isnan(values[d]) || isinf(values[d])){
+        status = asynError;
+      }
+      xmlFree(pos_val);
+    }
+  }
+  return status;
+}
+
 std::string NDPosPluginFileReader::getErrorMsg()
 {
   return errorMessage;
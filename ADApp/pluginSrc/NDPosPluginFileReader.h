@@ -13,6 +13,7 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <fstream>
 
 class NDPosPluginFileReader
 {
@@ -37,14 +38,29 @@ public:
   asynStatus addPosition();
   std::string getErrorMsg();
 
+  // Streaming interface, reads the positions a block at a time
+  asynStatus openStream(const std::string& filename);
+  asynStatus readBlock(std::vector<double>& values, int maxPositions, int *count);
+  bool isFinished();
+  void closeStream();
+
 protected:
   void setErrorMsg(const std::string& msg);
 
 private:
+  asynStatus openCSV(const std::string& filename);
+  asynStatus readCSVBlock(std::vector<double>& values, int maxPositions, int *count);
+  asynStatus parsePosition(double *values);
+
   xmlTextReaderPtr xmlreader;
   std::vector<std::string> dimensions;
   std::vector<std::map<std::string, double> > positions;
   std::string errorMessage;
+  std::string xmlString;
+  std::ifstream csvFile;
+  bool csv;
+  bool finished;
+  bool pendingPosition;
 };
 
 #endif /* POSPLUGINAPP_SRC_NDPOSPLUGINFILEREADER_H_ */
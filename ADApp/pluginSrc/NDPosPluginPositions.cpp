@@ -0,0 +1,160 @@
+/*
+ * NDPosPluginPositions.cpp
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#include <algorithm>
+
+#include <epicsMath.h>
+
+#include "NDPosPluginPositions.h"
+
+// Discarded positions are erased from the arrays when there are at least this many
+// and they are at least half of the arrays
+static const size_t MIN_ERASE = 4096;
+
+/** Orders dimensions by name */
+class dimensionNameLess
+{
+public:
+  dimensionNameLess(const std::vector<std::string>& names) : names(names) {}
+  bool operator()(size_t a, size_t b) const { return names[a] < names[b]; }
+private:
+  const std::vector<std::string>& names;
+};
+
+NDPosPluginPositions::NDPosPluginPositions()
+  : first(0), end(0)
+{
+}
+
+NDPosPluginPositions::~NDPosPluginPositions()
+{
+}
+
+/** Finds the columns for the dimensions of a set of positions, adding the ones that
+  * are not yet in the store.  This is done once for each set of positions loaded.
+  * \param[in] dimensionNames The names of the dimensions.
+  * \param[out] columns The column of each dimension, for append().
+  */
+void NDPosPluginPositions::mapDimensions(const std::vector<std::string>& dimensionNames, std::vector<int>& columns)
+{
+  columns.resize(dimensionNames.size());
+  for (size_t i = 0; i < dimensionNames.size(); i++){
+    std::vector<std::string>::iterator it = std::find(names.begin(), names.end(), dimensionNames[i]);
+    if (it != names.end()){
+      columns[i] = (int)(it - names.begin());
+    } else {
+      // Positions already in the store have no value in the new dimension
+      columns[i] = (int)names.size();
+      names.push_back(dimensionNames[i]);
+      sorted.push_back(sorted.size());
+      values.push_back(std::vector<double>(end, epicsNAN));
+    }
+  }
+  std::sort(sorted.begin(), sorted.end(), dimensionNameLess(names));
+  row.resize(names.size());
+}
+
+/** Adds a position to the end of the store.
+  * \param[in] columns The columns of the values, from mapDimensions().
+  * \param[in] pValues The values of the position.
+  */
+void NDPosPluginPositions::append(const std::vector<int>& columns, const double *pValues)
+{
+  std::fill(row.begin(), row.end(), epicsNAN);
+  for (size_t i = 0; i < columns.size(); i++){
+    row[columns[i]] = pValues[i];
+  }
+  for (size_t d = 0; d < values.size(); d++){
+    values[d].push_back(row[d]);
+  }
+  end++;
+}
+
+/** Adds several positions to the end of the store, a column at a time.
+  * \param[in] columns The columns of the values, from mapDimensions().
+  * \param[in] pValues The values of the positions, those of each position together.
+  * \param[in] count The number of positions.
+  */
+void NDPosPluginPositions::append(const std::vector<int>& columns, const double *pValues, size_t count)
+{
+  size_t numValues = columns.size();
+  std::vector<bool> filled(values.size(), false);
+
+  for (size_t i = 0; i < numValues; i++){
+    std::vector<double>& column = values[columns[i]];
+    column.resize(end + count);
+    for (size_t n = 0; n < count; n++){
+      column[end + n] = pValues[n * numValues + i];
+    }
+    filled[columns[i]] = true;
+  }
+  // The other dimensions have no value
+  for (size_t d = 0; d < values.size(); d++){
+    if (!filled[d]) values[d].resize(end + count, epicsNAN);
+  }
+  end += count;
+}
+
+/** Returns the number of positions in the store */
+size_t NDPosPluginPositions::size() const
+{
+  return end - first;
+}
+
+/** Returns the number of dimensions of the positions in the store */
+size_t NDPosPluginPositions::numDimensions() const
+{
+  return names.size();
+}
+
+/** Returns the name of a dimension */
+const std::string& NDPosPluginPositions::dimensionName(size_t dimension) const
+{
+  return names[dimension];
+}
+
+/** Returns the dimensions in the order of their names */
+const std::vector<size_t>& NDPosPluginPositions::sortedDimensions() const
+{
+  return sorted;
+}
+
+/** Returns the value of a position in one dimension, NaN if the position has no value in it.
+  * \param[in] index The index of the position, 0 is the first position in the store.
+  * \param[in] dimension The dimension.
+  */
+double NDPosPluginPositions::value(size_t index, size_t dimension) const
+{
+  return values[dimension][first + index];
+}
+
+/** Removes positions from the start of the store.
+  * \param[in] count The number of positions to remove.
+  */
+void NDPosPluginPositions::discard(size_t count)
+{
+  first += std::min(count, size());
+  if (first == end){
+    for (size_t d = 0; d < values.size(); d++) values[d].clear();
+    first = end = 0;
+  } else if ((first >= MIN_ERASE) && (first * 2 >= end)){
+    for (size_t d = 0; d < values.size(); d++){
+      values[d].erase(values[d].begin(), values[d].begin() + first);
+    }
+    end -= first;
+    first = 0;
+  }
+}
+
+/** Removes all the positions and dimensions from the store */
+void NDPosPluginPositions::clear()
+{
+  names.clear();
+  sorted.clear();
+  values.clear();
+  row.clear();
+  first = end = 0;
+}
@@ -0,0 +1,46 @@
+/*
+ * NDPosPluginPositions.h
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#ifndef NDPOSPLUGINPOSITIONS_H_
+#define NDPOSPLUGINPOSITIONS_H_
+
+#include <string>
+#include <vector>
+
+/** Store of the positions used by NDPosPlugin.
+  * The names of the dimensions are stored once and the values of each dimension in a contiguous
+  * array, so a position is found by index in constant time.  Positions loaded with different
+  * dimensions share the columns of the dimensions with the same name; a position has no value
+  * (NaN) in the dimensions it was not loaded with.  Positions discarded from the start of the
+  * store are only erased from the arrays once they are a large part of them.
+  * The store is not thread safe, the caller must lock it.
+  */
+class NDPosPluginPositions
+{
+public:
+  NDPosPluginPositions();
+  virtual ~NDPosPluginPositions();
+  void mapDimensions(const std::vector<std::string>& dimensionNames, std::vector<int>& columns);
+  void append(const std::vector<int>& columns, const double *pValues);
+  void append(const std::vector<int>& columns, const double *pValues, size_t count);
+  size_t size() const;
+  size_t numDimensions() const;
+  const std::string& dimensionName(size_t dimension) const;
+  const std::vector<size_t>& sortedDimensions() const;
+  double value(size_t index, size_t dimension) const;
+  void discard(size_t count);
+  void clear();
+
+private:
+  std::vector<std::string> names;
+  std::vector<size_t> sorted;
+  std::vector<std::vector<double> > values;
+  std::vector<double> row;
+  size_t first;
+  size_t end;
+};
+
+#endif /* NDPOSPLUGINPOSITIONS_H_ */
@@ -0,0 +1,182 @@
+/** NDRingBuffer.h
+ *
+ * Ring buffer holding the history of a value, written by one thread and read by
+ * other threads without a lock.
+ *
+ */
+
+#ifndef NDRingBuffer_H
+#define NDRingBuffer_H
+
+#include <stddef.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "NDAtomic.h"
+
+/** Ring buffer holding the most recent maxSize values of a series, used by plugins that keep
+  * histories of values and export them from another thread.
+  *
+  * There is a single producer, which calls push(), clear() and last(); if more than one thread
+  * pushes they must be serialized, for example by the plugin lock.  Any number of consumers can
+  * call size(), getView() and copyLatest() at the same time without a lock.  A consumer reads
+  * the values in place and then asks which of them the producer may have overwritten meanwhile,
+  * so the producer never waits for a consumer.
+  *
+  * The storage is a power of two, so slots are found by masking rather than division.  When
+  * maxSize is not a power of two the extra storage gives consumers time to read the oldest values
+  * before they are overwritten.  clear() starts the history at the first slot, so a history that
+  * has not yet wrapped is a single contiguous segment that can be exported without a copy.
+  */
+template <class T>
+class NDRingBuffer {
+public:
+    /** A contiguous part of the history */
+    struct Segment {
+        const T *data;
+        size_t size;
+    };
+
+    /** Constructor.
+      * \param[in] maxSize The number of values in the history. */
+    explicit NDRingBuffer(size_t maxSize = 1)
+        : maxSize_(maxSize < 1 ? 1 : maxSize), capacity_(1),
+          head_(0), first_(0), writing_(0)
+    {
+        while (capacity_ < maxSize_) capacity_ <<= 1;
+        mask_ = capacity_ - 1;
+        buffer_.resize(capacity_);
+    }
+
+    /** Returns the number of values in the history when it is full */
+    size_t maxSize() const { return maxSize_; }
+
+    /** Returns the number of values in the history; can be called from any thread */
+    size_t size() const
+    {
+        unsigned first = (unsigned)ndAtomicGet(&first_);
+        unsigned head = (unsigned)ndAtomicGet(&head_);
+        size_t count = head - first;
+        return std::min(count, maxSize_);
+    }
+
+    /** Adds a value to the history, replacing the oldest value if it is full.  Producer only.
+      * \param[in] value The value. */
+    void push(const T& value)
+    {
+        unsigned head = (unsigned)head_;
+
+        ndAtomicSet(&writing_, (int)(head + 1));
+        ndWriteBarrier();
+        buffer_[head & mask_] = value;
+        ndAtomicSet(&head_, (int)(head + 1));
+    }
+
+    /** Adds several values to the history.  Producer only.
+      * The values are copied in at most two blocks and published together.
+      * \param[in] pValues The values, oldest first.
+      * \param[in] count The number of values. */
+    void push(const T *pValues, size_t count)
+    {
+        unsigned end = (unsigned)head_ + (unsigned)count;
+        size_t numCopy = std::min(count, capacity_);
+        size_t slot = (end - numCopy) & mask_;
+        size_t numFirst = std::min(numCopy, capacity_ - slot);
+
+        if (count == 0) return;
+        // Only the last capacity_ values can be kept
+        pValues += count - numCopy;
+        ndAtomicSet(&writing_, (int)end);
+        ndWriteBarrier();
+        std::copy(pValues, pValues + numFirst, buffer_.begin() + slot);
+        std::copy(pValues + numFirst, pValues + numCopy, buffer_.begin());
+        ndAtomicSet(&head_, (int)end);
+    }
+
+    /** Returns the most recent value.  Producer only, and the history must not be empty. */
+    const T& last() const
+    {
+        return buffer_[((unsigned)head_ - 1) & mask_];
+    }
+
+    /** Empties the history.  Producer only. */
+    void clear()
+    {
+        // Start the history at the first slot
+        unsigned start = ((unsigned)head_ + (unsigned)mask_) & ~(unsigned)mask_;
+
+        ndAtomicSet(&writing_, (int)start);
+        ndAtomicSet(&head_, (int)start);
+        ndAtomicSet(&first_, (int)start);
+    }
+
+    /** Gets the most recent values in place, oldest first; can be called from any thread.
+      * The values are in one segment, or two if they wrap around the end of the storage.
+      * The producer can overwrite them while they are read; numOverwritten() tells how many
+      * of them could have been overwritten by the time they were read.
+      * \param[in] maxCount The maximum number of values.
+      * \param[out] segments The segments; the second one is empty if the values do not wrap.
+      * \return A token for numOverwritten(). */
+    unsigned getView(size_t maxCount, Segment segments[2]) const
+    {
+        unsigned first = (unsigned)ndAtomicGet(&first_);
+        unsigned head = (unsigned)ndAtomicGet(&head_);
+        size_t count = std::min(std::min((size_t)(head - first), maxSize_), maxCount);
+        unsigned start = head - (unsigned)count;
+        size_t slot = start & mask_;
+        size_t numFirst = std::min(count, capacity_ - slot);
+
+        segments[0].data = &buffer_[slot];
+        segments[0].size = numFirst;
+        segments[1].data = &buffer_[0];
+        segments[1].size = count - numFirst;
+        return start;
+    }
+
+    /** Returns how many of the values of a view, counted from the oldest, the producer may have
+      * overwritten since getView() was called.  Call this after reading the values.
+      * \param[in] token The token returned by getView(). */
+    size_t numOverwritten(unsigned token) const
+    {
+        ndReadBarrier();
+        // The values before writing_ - capacity_ have been or are being overwritten
+        unsigned validStart = (unsigned)ndAtomicGet(&writing_) - (unsigned)capacity_;
+        int numLost = (int)(validStart - token);
+        return (numLost > 0) ? (size_t)numLost : 0;
+    }
+
+    /** Copies the most recent values, oldest first; can be called from any thread.
+      * Values that were overwritten while they were copied are left out.
+      * \param[out] pOut The output array.
+      * \param[in] maxCount The size of the output array.
+      * \return The number of values copied. */
+    size_t copyLatest(T *pOut, size_t maxCount) const
+    {
+        Segment segments[2];
+        unsigned token = getView(maxCount, segments);
+        size_t count = segments[0].size + segments[1].size;
+        size_t numLost;
+
+        std::copy(segments[0].data, segments[0].data + segments[0].size, pOut);
+        std::copy(segments[1].data, segments[1].data + segments[1].size, pOut + segments[0].size);
+        numLost = numOverwritten(token);
+        if (numLost >= count) return 0;
+        if (numLost > 0) {
+            std::copy(pOut + numLost, pOut + count, pOut);
+            count -= numLost;
+        }
+        return count;
+    }
+
+private:
+    size_t maxSize_;
+    size_t capacity_;
+    size_t mask_;
+    int head_;      /**< Number of values pushed, published after the values are written */
+    int first_;     /**< Value of head_ when the history was last cleared */
+    int writing_;   /**< End of the values being written, set before they are written */
+    std::vector<T> buffer_;
+};
+
+#endif
@@ -0,0 +1,25 @@
+/*
+ * AttributePluginWrapper.cpp
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#include "AttributePluginWrapper.h"
+
+AttributePluginWrapper::AttributePluginWrapper(const std::string& port,
+                                               int queueSize,
+                                               int blocking,
+                                               const std::string& detectorPort,
+                                               int address,
+                                               int maxAttributes)
+  :  NDPluginAttribute(port.c_str(), queueSize, blocking,
+                       detectorPort.c_str(), address,
+                       maxAttributes, 0, 0, 0, 0),
+     AsynPortClientContainer(port)
+{
+}
+
+AttributePluginWrapper::~AttributePluginWrapper ()
+{
+  cleanup();
+}
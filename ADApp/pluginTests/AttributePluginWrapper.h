@@ -0,0 +1,25 @@
+/*
+ * AttributePluginWrapper.h
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#ifndef ADAPP_PLUGINTESTS_ATTRIBUTEPLUGINWRAPPER_H_
+#define ADAPP_PLUGINTESTS_ATTRIBUTEPLUGINWRAPPER_H_
+
+#include <NDPluginAttribute.h>
+#include "AsynPortClientContainer.h"
+
+class AttributePluginWrapper : public NDPluginAttribute, public AsynPortClientContainer
+{
+public:
+  AttributePluginWrapper(const std::string& port,
+                         int queueSize,
+                         int blocking,
+                         const std::string& detectorPort,
+                         int address,
+                         int maxAttributes);
+  virtual ~AttributePluginWrapper ();
+};
+
+#endif /* ADAPP_PLUGINTESTS_ATTRIBUTEPLUGINWRAPPER_H_ */
@@ -0,0 +1,34 @@
+/*
+ * StdArraysPluginWrapper.cpp
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#include "StdArraysPluginWrapper.h"
+
+StdArraysPluginWrapper::StdArraysPluginWrapper(const std::string& port, const std::string& detectorPort)
+  :  NDPluginStdArrays(port.c_str(), 50, 0, detectorPort.c_str(), 0, 0, 0, 0, 0, 1),
+     AsynPortClientContainer(port)
+{
+}
+
+StdArraysPluginWrapper::StdArraysPluginWrapper(const std::string& port,
+                                               int queueSize,
+                                               int blocking,
+                                               const std::string& detectorPort,
+                                               int address,
+                                               size_t maxMemory,
+                                               int priority,
+                                               int stackSize,
+                                               int maxThreads)
+  :  NDPluginStdArrays(port.c_str(), queueSize, blocking,
+                       detectorPort.c_str(), address,
+                       0, maxMemory, priority, stackSize, maxThreads),
+     AsynPortClientContainer(port)
+{
+}
+
+StdArraysPluginWrapper::~StdArraysPluginWrapper ()
+{
+  cleanup();
+}
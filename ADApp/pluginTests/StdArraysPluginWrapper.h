@@ -0,0 +1,29 @@
+/*
+ * StdArraysPluginWrapper.h
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#ifndef ADAPP_PLUGINTESTS_STDARRAYSPLUGINWRAPPER_H_
+#define ADAPP_PLUGINTESTS_STDARRAYSPLUGINWRAPPER_H_
+
+#include <NDPluginStdArrays.h>
+#include "AsynPortClientContainer.h"
+
+class StdArraysPluginWrapper : public NDPluginStdArrays, public AsynPortClientContainer
+{
+public:
+  StdArraysPluginWrapper(const std::string& port, const std::string& detectorPort);
+  StdArraysPluginWrapper(const std::string& port,
+                         int queueSize,
+                         int blocking,
+                         const std::string& detectorPort,
+                         int address,
+                         size_t maxMemory,
+                         int priority,
+                         int stackSize,
+                         int maxThreads);
+  virtual ~StdArraysPluginWrapper ();
+};
+
+#endif /* ADAPP_PLUGINTESTS_STDARRAYSPLUGINWRAPPER_H_ */
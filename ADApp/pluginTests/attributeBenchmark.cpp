@@ -0,0 +1,136 @@
+/*
+ * attributeBenchmark.cpp
+ *
+ * Measures the time asynNDArrayDriver::getAttributes() takes to update the attributes of
+ * a driver and copy them to an NDArray, with 500 parameter and driver attributes, and the
+ * time of the parts of that.
+ *
+ * Usage: attributeBenchmark [number of attributes] [minimum seconds per measurement]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <epicsTime.h>
+
+#include <asynNDArrayDriver.h>
+#include <paramAttribute.h>
+
+static double minSeconds = 0.5;
+
+static double now()
+{
+  epicsTimeStamp ts;
+  epicsTimeGetCurrent(&ts);
+  return ts.secPastEpoch + ts.nsec / 1.e9;
+}
+
+/* A driver with numAttributes attributes: 60% integer parameters, 30% double parameters,
+ * 5% string parameters and 5% attributes with constant values */
+class BenchmarkDriver : public asynNDArrayDriver {
+public:
+  BenchmarkDriver(const char *portName, int numAttributes)
+    : asynNDArrayDriver(portName, 1, 0, 0,
+                        asynInt32Mask | asynFloat64Mask | asynOctetMask | asynDrvUserMask, 0,
+                        0, 1, 0, 0)
+  {
+    char name[64];
+    int param;
+    epicsFloat64 value = 1.0;
+
+    for (int i=0; i<numAttributes; i++) {
+      int kind = i % 20;
+      sprintf(name, "BENCH_%d", i);
+      if (kind < 12) {
+        createParam(name, asynParamInt32, &param);
+        setIntegerParam(param, i);
+        pAttributeList->add(new paramAttribute(name, "Integer parameter", name, 0, this, "INT"));
+      } else if (kind < 18) {
+        createParam(name, asynParamFloat64, &param);
+        setDoubleParam(param, i * 0.5);
+        pAttributeList->add(new paramAttribute(name, "Double parameter", name, 0, this, "DOUBLE"));
+      } else if (kind < 19) {
+        createParam(name, asynParamOctet, &param);
+        setStringParam(param, "A string parameter value");
+        pAttributeList->add(new paramAttribute(name, "String parameter", name, 0, this, "STRING"));
+      } else {
+        pAttributeList->add(name, "Constant", NDAttrFloat64, &value);
+      }
+    }
+  }
+
+  NDAttributeList *attributeList() { return pAttributeList; }
+  NDArrayPool *arrayPool() { return pNDArrayPool; }
+};
+
+static void report(const char *what, double seconds, int count, int numAttributes)
+{
+  printf("%-40s %10.2f us  %8.1f ns/attribute\n", what, seconds/count*1e6, seconds/count/numAttributes*1e9);
+}
+
+int main(int argc, char *argv[])
+{
+  int numAttributes = 500;
+  double start, elapsed;
+  int count;
+
+  if (argc > 1) numAttributes = atoi(argv[1]);
+  if (argc > 2) minSeconds = atof(argv[2]);
+
+  BenchmarkDriver *pDriver = new BenchmarkDriver("ATTR_BENCHMARK", numAttributes);
+  NDAttributeList *pDriverList = pDriver->attributeList();
+  NDArray *pArray = pDriver->arrayPool()->alloc(0, NULL, NDUInt8, 0, NULL);
+  NDArray *pCopy;
+
+  printf("%d attributes\n", pDriverList->count());
+  pDriver->lock();
+
+  for (count=0, start=now(); (elapsed = now() - start) < minSeconds; count++) {
+    pDriverList->updateValues();
+  }
+  report("NDAttributeList::updateValues", elapsed, count, numAttributes);
+
+  for (count=0, start=now(); (elapsed = now() - start) < minSeconds; count++) {
+    pDriverList->snapshotValues();
+  }
+  report("NDAttributeList::snapshotValues (locked)", elapsed, count, numAttributes);
+
+  // A list that is not compact is copied attribute by attribute
+  NDAttributeList plainList, plainOut;
+  for (NDAttribute *pAttr = pDriverList->next(NULL); pAttr; pAttr = pDriverList->next(pAttr)) {
+    plainList.add(pAttr->copy(NULL));
+  }
+  plainList.copy(&plainOut);
+  for (count=0, start=now(); (elapsed = now() - start) < minSeconds; count++) {
+    plainList.copy(&plainOut);
+  }
+  report("NDAttributeList::copy, not compact", elapsed, count, numAttributes);
+
+  pDriverList->compact();
+  pDriverList->copy(pArray->pAttributeList);
+  for (count=0, start=now(); (elapsed = now() - start) < minSeconds; count++) {
+    pDriverList->copy(pArray->pAttributeList);
+  }
+  report("NDAttributeList::copy, compact", elapsed, count, numAttributes);
+
+  for (count=0, start=now(); (elapsed = now() - start) < minSeconds; count++) {
+    pDriver->getAttributes(pArray->pAttributeList);
+  }
+  report("asynNDArrayDriver::getAttributes", elapsed, count, numAttributes);
+
+  for (count=0, start=now(); (elapsed = now() - start) < minSeconds; count++) {
+    NDAttributeList emptyList(true);
+    pDriver->getAttributes(&emptyList);
+  }
+  report("getAttributes to a new list", elapsed, count, numAttributes);
+
+  for (count=0, start=now(); (elapsed = now() - start) < minSeconds; count++) {
+    pCopy = pDriver->arrayPool()->copy(pArray, NULL, 0);
+    pCopy->release();
+  }
+  report("NDArrayPool::copy of the attributes", elapsed, count, numAttributes);
+
+  pDriver->unlock();
+  pArray->release();
+  return 0;
+}
@@ -0,0 +1,120 @@
+/*
+ * fftBenchmark.cpp
+ *
+ * Compares the speed of the NDFFTPlan transforms used by NDPluginFFT with the
+ * Numerical Recipes code in fft.c that it replaced, for the 1-D and 2-D real
+ * transforms done by the plugin.
+ *
+ * Usage: fftBenchmark [minimum seconds per measurement]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <vector>
+
+#include <epicsTime.h>
+
+#include <NDFFTPlan.h>
+#include <fft.h>
+
+static double minSeconds = 0.5;
+
+static double now()
+{
+  epicsTimeStamp ts;
+  epicsTimeGetCurrent(&ts);
+  return ts.secPastEpoch + ts.nsec / 1.e9;
+}
+
+/* Old plugin code: copy the real data into a complex array and call fft_1D or fft_ND */
+static void oldFFT(const std::vector<double> &in, std::vector<double> &complex, int nx, int ny)
+{
+  unsigned long dims[2];
+
+  for (size_t i=0; i<in.size(); i++) {
+    complex[2*i] = in[i];
+    complex[2*i+1] = 0.;
+  }
+  if (ny == 1) {
+    fft_1D(&complex[0], nx, 1);
+  } else {
+    dims[0] = nx;
+    dims[1] = ny;
+    fft_ND(&complex[0], dims, 2, 1);
+  }
+}
+
+/* New plugin code: a batch of real row transforms followed by interleaved column transforms */
+static void newFFT(const std::vector<double> &in, std::vector<double> &complex, std::vector<double> &work,
+                   const NDFFTRealPlan *pRowPlan, const NDFFTPlan *pColumnPlan, int ny)
+{
+  pRowPlan->execute(&in[0], &complex[0], ny, &work[0]);
+  if (ny > 1) pColumnPlan->execute(&complex[0], pRowPlan->outputSize(), &work[0]);
+}
+
+static void benchmark(int nx, int ny)
+{
+  std::vector<double> in((size_t)nx * ny), oldComplex(2*in.size()), newComplex;
+  const NDFFTRealPlan *pRowPlan;
+  const NDFFTPlan *pColumnPlan;
+  std::vector<double> work;
+  double start, oldTime, newTime, planTime;
+  int i, count;
+  bool pow2 = ((nx & (nx-1)) == 0) && ((ny & (ny-1)) == 0);
+
+  for (size_t j=0; j<in.size(); j++) in[j] = rand() / (double)RAND_MAX;
+
+  start = now();
+  pRowPlan = NDFFTRealPlan::get(nx, 1);
+  pColumnPlan = NDFFTPlan::get(ny, 1);
+  planTime = now() - start;
+  newComplex.resize(2 * (size_t)pRowPlan->outputSize() * ny);
+  work.resize(pRowPlan->workSize() > pColumnPlan->workSize(pRowPlan->outputSize()) ?
+              pRowPlan->workSize() : pColumnPlan->workSize(pRowPlan->outputSize()));
+
+  for (count=0, start=now(); (oldTime = now() - start) < minSeconds; count++) {
+    newFFT(in, newComplex, work, pRowPlan, pColumnPlan, ny);
+  }
+  newTime = oldTime / count;
+
+  if (pow2) {
+    for (count=0, start=now(); (oldTime = now() - start) < minSeconds; count++) {
+      oldFFT(in, oldComplex, nx, ny);
+    }
+    oldTime /= count;
+    printf("%6d x %-6d  fft.c %10.1f us  NDFFTPlan %10.1f us  speedup %5.1f  (plan %.1f us)\n",
+           nx, ny, oldTime*1e6, newTime*1e6, oldTime/newTime, planTime*1e6);
+  } else {
+    // fft.c only does powers of 2, the old plugin zero padded to the next one
+    int px = 1, py = 1;
+    while (px < nx) px *= 2;
+    while (py < ny) py *= 2;
+    std::vector<double> padded((size_t)px * py, 0.), paddedComplex(2*padded.size());
+    for (i=0; i<ny; i++) memcpy(&padded[(size_t)i*px], &in[(size_t)i*nx], nx * sizeof(double));
+    for (count=0, start=now(); (oldTime = now() - start) < minSeconds; count++) {
+      oldFFT(padded, paddedComplex, px, py);
+    }
+    oldTime /= count;
+    printf("%6d x %-6d  fft.c %10.1f us  NDFFTPlan %10.1f us  speedup %5.1f  (plan %.1f us, fft.c padded to %dx%d)\n",
+           nx, ny, oldTime*1e6, newTime*1e6, oldTime/newTime, planTime*1e6, px, py);
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  static const int sizes[][2] = {
+    {256, 1}, {1024, 1}, {4096, 1}, {65536, 1}, {1048576, 1},
+    {1000, 1}, {6000, 1}, {10007, 1},
+    {64, 64}, {256, 256}, {1024, 1024}, {2048, 2048},
+    {640, 480}, {1000, 1000}
+  };
+
+  if (argc > 1) minSeconds = atof(argv[1]);
+  for (size_t i=0; i<sizeof(sizes)/sizeof(sizes[0]); i++) {
+    benchmark(sizes[i][0], sizes[i][1]);
+  }
+  return 0;
+}
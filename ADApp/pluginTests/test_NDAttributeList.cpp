@@ -0,0 +1,343 @@
+/*
+ * test_NDAttributeList.cpp
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#include <stdio.h>
+
+#include "boost/test/unit_test.hpp"
+
+// AD dependencies
+#include <NDAttribute.h>
+#include <NDAttributeList.h>
+
+#include <map>
+#include <string>
+using namespace std;
+
+static string attributeName(int i)
+{
+  char name[32];
+  sprintf(name, "Attribute%d", i);
+  return name;
+}
+
+static int attributeValue(NDAttribute *pAttribute)
+{
+  epicsInt32 value = -1;
+  pAttribute->getValue(NDAttrInt32, &value);
+  return value;
+}
+
+BOOST_AUTO_TEST_SUITE(NDAttributeListTests)
+
+BOOST_AUTO_TEST_CASE(find_add_remove)
+{
+  NDAttributeList list;
+  map<string, int> expected;
+
+  // Enough attributes that the index is resized several times, and enough
+  // removals that entries are shifted back in the index
+  for (int i=0; i<20000; i++) {
+    int n = (i * 7919) % 300;
+    string name = attributeName(n);
+    epicsInt32 value = i;
+    if ((i % 5) == 4) {
+      BOOST_CHECK_EQUAL(list.remove(name.c_str()) == ND_SUCCESS, expected.erase(name) == 1);
+    } else if ((i % 5) == 3) {
+      list.add(new NDAttribute(name.c_str(), "", NDAttrSourceDriver, "", NDAttrInt32, &value));
+      expected[name] = value;
+    } else {
+      list.add(name.c_str(), "", NDAttrInt32, &value);
+      expected[name] = value;
+    }
+  }
+  BOOST_REQUIRE_EQUAL(list.count(), (int)expected.size());
+  for (int n=0; n<300; n++) {
+    string name = attributeName(n);
+    NDAttribute *pAttribute = list.find(name.c_str());
+    BOOST_REQUIRE_EQUAL(pAttribute != NULL, expected.count(name) == 1);
+    if (pAttribute) {
+      BOOST_CHECK_EQUAL(pAttribute->getName(), name);
+      BOOST_CHECK_EQUAL(attributeValue(pAttribute), expected[name]);
+    }
+  }
+  BOOST_CHECK(list.find("") == NULL);
+  BOOST_CHECK(list.find("attribute1") == NULL);
+
+  list.clear();
+  BOOST_CHECK_EQUAL(list.count(), 0);
+  BOOST_CHECK(list.find(attributeName(1).c_str()) == NULL);
+  epicsInt32 value = 5;
+  list.add("Attribute1", "", NDAttrInt32, &value);
+  BOOST_REQUIRE(list.find("Attribute1") != NULL);
+  BOOST_CHECK_EQUAL(attributeValue(list.find("Attribute1")), 5);
+}
+
+BOOST_AUTO_TEST_CASE(copy_same_schema)
+{
+  NDAttributeList in, out;
+  epicsInt32 value;
+
+  for (int i=0; i<300; i++) {
+    value = i;
+    in.add(attributeName(i).c_str(), "", NDAttrInt32, &value);
+  }
+  in.copy(&out);
+  BOOST_REQUIRE_EQUAL(out.count(), 300);
+
+  // The second copy reuses the attributes of the output list
+  NDAttribute *pFirst = out.next(NULL);
+  for (int i=0; i<300; i++) {
+    value = 1000 + i;
+    in.find(attributeName(i).c_str())->setValue(&value);
+  }
+  in.copy(&out);
+  BOOST_REQUIRE_EQUAL(out.count(), 300);
+  BOOST_CHECK(out.next(NULL) == pFirst);
+  int i = 0;
+  for (NDAttribute *pAttribute = out.next(NULL); pAttribute; pAttribute = out.next(pAttribute), i++) {
+    BOOST_CHECK_EQUAL(pAttribute->getName(), attributeName(i));
+    BOOST_CHECK_EQUAL(attributeValue(pAttribute), 1000 + i);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(copy_different_schema)
+{
+  NDAttributeList in, out;
+  epicsInt32 value;
+
+  // The output list has some of the attributes, in a different order, and some others
+  for (int i=0; i<100; i++) {
+    value = i;
+    in.add(attributeName(i).c_str(), "", NDAttrInt32, &value);
+  }
+  for (int i=150; i>=0; i-=3) {
+    value = -1;
+    out.add(attributeName(i).c_str(), "", NDAttrInt32, &value);
+  }
+  int outOnly = 0;
+  for (int i=100; i<=150; i++) {
+    if ((i % 3) == 0) outOnly++;
+  }
+  in.copy(&out);
+  BOOST_CHECK_EQUAL(out.count(), 100 + outOnly);
+  for (int i=0; i<=150; i++) {
+    NDAttribute *pAttribute = out.find(attributeName(i).c_str());
+    if (i < 100) {
+      BOOST_REQUIRE(pAttribute != NULL);
+      BOOST_CHECK_EQUAL(attributeValue(pAttribute), i);
+    } else {
+      BOOST_CHECK_EQUAL(pAttribute != NULL, (i % 3) == 0);
+    }
+  }
+
+  // Copying a list to itself does nothing
+  in.copy(&in);
+  BOOST_CHECK_EQUAL(in.count(), 100);
+}
+
+BOOST_AUTO_TEST_CASE(copy_shared)
+{
+  NDAttributeList in(true), out1(true), out2(true);
+  epicsInt32 value;
+
+  for (int i=0; i<10; i++) {
+    value = i;
+    in.add(attributeName(i).c_str(), "", NDAttrInt32, &value);
+  }
+
+  // Copying a shareable list to empty lists shares its attributes
+  in.copy(&out1);
+  out1.copy(&out2);
+  BOOST_REQUIRE_EQUAL(out1.count(), 10);
+  BOOST_REQUIRE_EQUAL(out2.count(), 10);
+  BOOST_CHECK(out1.find("Attribute3") == in.find("Attribute3"));
+  BOOST_CHECK(out2.find("Attribute3") == in.find("Attribute3"));
+
+  // Changing one list gives it its own copy of the attributes and leaves the others alone
+  value = 100;
+  out1.add("Attribute3", "", NDAttrInt32, &value);
+  BOOST_CHECK(out1.find("Attribute3") != in.find("Attribute3"));
+  BOOST_CHECK_EQUAL(attributeValue(out1.find("Attribute3")), 100);
+  BOOST_CHECK_EQUAL(attributeValue(in.find("Attribute3")), 3);
+  BOOST_CHECK_EQUAL(attributeValue(out2.find("Attribute3")), 3);
+
+  out2.remove("Attribute4");
+  BOOST_CHECK_EQUAL(out2.count(), 9);
+  BOOST_CHECK_EQUAL(in.count(), 10);
+  BOOST_CHECK(in.find("Attribute4") != NULL);
+
+  in.clear();
+  BOOST_CHECK_EQUAL(in.count(), 0);
+  BOOST_CHECK_EQUAL(out1.count(), 10);
+  BOOST_CHECK_EQUAL(out2.count(), 9);
+  BOOST_CHECK_EQUAL(attributeValue(out2.find("Attribute5")), 5);
+}
+
+BOOST_AUTO_TEST_CASE(drop_shared)
+{
+  NDAttributeList driver, array(true), copy(true), other(true);
+  epicsInt32 value;
+
+  for (int i=0; i<10; i++) {
+    value = i;
+    driver.add(attributeName(i).c_str(), "", NDAttrInt32, &value);
+  }
+  driver.copy(&array);
+  array.copy(&copy);
+  BOOST_CHECK(copy.find("Attribute3") == array.find("Attribute3"));
+
+  // Dropping shared attributes, as NDArrayPool::release() does, leaves them to the other list
+  array.dropShared();
+  BOOST_CHECK_EQUAL(array.count(), 0);
+  BOOST_CHECK_EQUAL(copy.count(), 10);
+
+  // Attributes that are not shared are kept for reuse
+  NDAttribute *pAttribute = copy.find("Attribute3");
+  copy.dropShared();
+  BOOST_CHECK(copy.find("Attribute3") == pAttribute);
+
+  // A copy into a list with the same attributes reuses them, with or without exact
+  driver.copy(&array);
+  value = 30;
+  driver.find("Attribute3")->setValue(&value);
+  array.copy(&copy, true);
+  BOOST_CHECK(copy.find("Attribute3") == pAttribute);
+  BOOST_CHECK_EQUAL(attributeValue(pAttribute), 30);
+
+  // A shared output list with the same attributes is replaced rather than copied first
+  copy.copy(&other);
+  BOOST_CHECK(other.find("Attribute3") == pAttribute);
+  array.copy(&other);
+  BOOST_CHECK(other.find("Attribute3") == array.find("Attribute3"));
+  BOOST_CHECK(copy.find("Attribute3") == pAttribute);
+
+  // An exact copy removes the attributes that are not in the input list
+  value = 1;
+  copy.add("Extra", "", NDAttrInt32, &value);
+  array.copy(&copy);
+  BOOST_CHECK(copy.find("Extra") != NULL);
+  array.copy(&copy, true);
+  BOOST_CHECK(copy.find("Extra") == NULL);
+  BOOST_CHECK_EQUAL(copy.count(), 10);
+}
+
+BOOST_AUTO_TEST_CASE(copy_not_shareable)
+{
+  NDAttributeList in, out(true);
+  epicsInt32 value = 1;
+
+  // Lists that are not shareable, such as driver lists, are always copied
+  in.add("Attribute1", "", NDAttrInt32, &value);
+  in.copy(&out);
+  BOOST_REQUIRE(out.find("Attribute1") != NULL);
+  BOOST_CHECK(out.find("Attribute1") != in.find("Attribute1"));
+  value = 2;
+  in.find("Attribute1")->setValue(&value);
+  BOOST_CHECK_EQUAL(attributeValue(out.find("Attribute1")), 1);
+}
+
+BOOST_AUTO_TEST_CASE(copy_compact)
+{
+  NDAttributeList in, out(true);
+  epicsInt32 value;
+  epicsFloat64 dvalue = 1.5;
+
+  for (int i=0; i<100; i++) {
+    value = i;
+    in.add(attributeName(i).c_str(), "", NDAttrInt32, &value);
+  }
+  in.add("Double", "A double", NDAttrFloat64, &dvalue);
+  in.add("String", "A string", NDAttrString, (void *)"first");
+  // Data type not known yet, like a PVAttribute that is not connected
+  in.add(new NDAttribute("Later", "", NDAttrSourceEPICSPV, "PV", NDAttrUndefined, NULL));
+  in.compact();
+  BOOST_REQUIRE(in.getSchema() != NULL);
+  BOOST_CHECK_EQUAL(in.getSchema()->numSlots(), 103);
+
+  // Copying to an empty list makes it compact with the same schema
+  in.copy(&out);
+  BOOST_CHECK(out.getSchema() == in.getSchema());
+  BOOST_REQUIRE_EQUAL(out.count(), 103);
+  NDAttribute *pFirst = out.find("Attribute0");
+  NDAttribute *pString = out.find("String");
+  BOOST_REQUIRE(pString != NULL);
+  std::string svalue;
+  pString->getValue(svalue);
+  BOOST_CHECK_EQUAL(svalue, "first");
+  NDAttrSource_t sourceType;
+  out.find("Later")->getSourceInfo(&sourceType);
+  BOOST_CHECK_EQUAL(sourceType, NDAttrSourceEPICSPV);
+  BOOST_CHECK_EQUAL(out.find("Later")->getDataType(), NDAttrUndefined);
+
+  // The next copy only copies the values
+  for (int i=0; i<100; i++) {
+    value = 1000 + i;
+    in.add(attributeName(i).c_str(), "", NDAttrInt32, &value);
+  }
+  in.add("String", "", NDAttrString, (void *)"second");
+  in.find("Later")->setDataType(NDAttrInt32);
+  value = 7;
+  in.find("Later")->setValue(&value);
+  in.copy(&out);
+  BOOST_CHECK(out.find("Attribute0") == pFirst);
+  for (int i=0; i<100; i++) {
+    BOOST_CHECK_EQUAL(attributeValue(out.find(attributeName(i).c_str())), 1000 + i);
+  }
+  out.find("String")->getValue(svalue);
+  BOOST_CHECK_EQUAL(svalue, "second");
+  BOOST_CHECK_EQUAL(out.find("Later")->getDataType(), NDAttrInt32);
+  BOOST_CHECK_EQUAL(attributeValue(out.find("Later")), 7);
+  out.find("Double")->getValue(NDAttrFloat64, &dvalue);
+  BOOST_CHECK_EQUAL(dvalue, 1.5);
+
+  // The values of schema attributes can be read by slot
+  double slotValue;
+  int slot = in.getSchema()->findSlot("Attribute3");
+  BOOST_CHECK_EQUAL(slot, 3);
+  BOOST_CHECK_EQUAL(out.getSlotValue(slot, &slotValue), ND_SUCCESS);
+  BOOST_CHECK_EQUAL(slotValue, 1003);
+  BOOST_CHECK_EQUAL(out.getSlotValue(in.getSchema()->findSlot("Double"), &slotValue), ND_SUCCESS);
+  BOOST_CHECK_EQUAL(slotValue, 1.5);
+  BOOST_CHECK_EQUAL(out.getSlotValue(in.getSchema()->findSlot("String"), &slotValue), ND_ERROR);
+  BOOST_CHECK_EQUAL(out.getSlotValue(103, &slotValue), ND_ERROR);
+  int slots[4] = {slot, in.getSchema()->findSlot("String"), 103, 99};
+  double slotValues[4] = {0, -1, -1, 0};
+  BOOST_CHECK_EQUAL(out.getSlotValues(4, slots, slotValues), 2);
+  BOOST_CHECK_EQUAL(slotValues[0], 1003);
+  BOOST_CHECK_EQUAL(slotValues[1], -1);
+  BOOST_CHECK_EQUAL(slotValues[2], -1);
+  BOOST_CHECK_EQUAL(slotValues[3], 1099);
+
+  // Attributes added after the list was made compact are copied too
+  value = 42;
+  in.add("Extra", "", NDAttrInt32, &value);
+  in.copy(&out);
+  BOOST_REQUIRE(out.find("Extra") != NULL);
+  BOOST_CHECK_EQUAL(attributeValue(out.find("Extra")), 42);
+  BOOST_CHECK(out.getSchema() == in.getSchema());
+
+  // Removing a schema attribute keeps the values of the others
+  BOOST_CHECK_EQUAL(out.remove("Attribute5"), ND_SUCCESS);
+  BOOST_CHECK(out.getSchema() == NULL);
+  BOOST_CHECK_EQUAL(out.getSlotValue(slot, &slotValue), ND_ERROR);
+  BOOST_CHECK_EQUAL(out.getSlotValues(1, &slot, &slotValue), 0);
+  BOOST_CHECK_EQUAL(out.count(), 103);
+  BOOST_CHECK_EQUAL(attributeValue(out.find("Attribute6")), 1006);
+  out.find("String")->getValue(svalue);
+  BOOST_CHECK_EQUAL(svalue, "second");
+
+  // Making the list compact again creates a new schema
+  in.compact();
+  BOOST_CHECK_EQUAL(in.getSchema()->numSlots(), 104);
+  value = -1;
+  in.add("Attribute5", "", NDAttrInt32, &value);
+  in.copy(&out);
+  BOOST_CHECK_EQUAL(out.count(), 104);
+  BOOST_CHECK_EQUAL(attributeValue(out.find("Attribute5")), -1);
+  BOOST_CHECK_EQUAL(attributeValue(out.find("Extra")), 42);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
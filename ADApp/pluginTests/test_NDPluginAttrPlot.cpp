@@ -423,4 +423,65 @@ BOOST_AUTO_TEST_CASE(attrplot_multiple_attributes)
             ND_ATTRPLOT_NONE_INDEX);
 }
 
+BOOST_AUTO_TEST_CASE(attrplot_compact_attributes)
+{
+    asynFloat64ArrayClient client = asynFloat64ArrayClient(port.c_str(), 0, NDAttrPlotDataString);
+    client.registerInterruptUser(addr0DataInterrupt);
+    BOOST_CHECK_NO_THROW(attrPlot->write(NDArrayCallbacksString, 1));
+
+    // A compact list like the attribute list of a driver, with attributes
+    // added after it was made compact that are not in its schema
+    NDAttributeList source;
+    double value = 0;
+    source.add("a0", "", NDAttrFloat64, &value);
+    source.add("a1", "", NDAttrFloat64, &value);
+    source.compact();
+    source.add("b", "", NDAttrFloat64, &value);
+    source.add("c", "", NDAttrFloat64, &value);
+
+    for (int i = 0; i < 3; ++i) {
+        value = i;
+        source.add("a0", "", NDAttrFloat64, &value);
+        value = 10*i;
+        source.add("a1", "", NDAttrFloat64, &value);
+        value = 100*i;
+        source.add("b", "", NDAttrFloat64, &value);
+        value = 1000*i;
+        source.add("c", "", NDAttrFloat64, &value);
+        NDArrayWrapper wrap(arrPool);
+        wrap.set_uid(i);
+        source.copy(wrap.get()->pAttributeList);
+        BOOST_REQUIRE(wrap.get()->pAttributeList->getSchema() == source.getSchema());
+
+        attrPlot->lock();
+        BOOST_CHECK_NO_THROW(attrPlot->processCallbacks(wrap.get()));
+        attrPlot->unlock();
+    }
+    BOOST_CHECK_EQUAL(attrPlot->readInt(NDAttrPlotNPtsString), 3);
+
+    // Only the first n_attributes attributes are saved
+    BOOST_CHECK_EQUAL(attrPlot->readString(NDAttrPlotAttributeString, 0), "a0");
+    BOOST_CHECK_EQUAL(attrPlot->readString(NDAttrPlotAttributeString, 1), "a1");
+    BOOST_CHECK_EQUAL(attrPlot->readString(NDAttrPlotAttributeString, 2), "b");
+
+    // Attributes in the schema are read by slot, the others by name
+    const int columns[2] = {1, 2};
+    const double scales[2] = {10, 100};
+    for (int c = 0; c < 2; ++c) {
+        addr0Data.reset();
+        BOOST_CHECK_NO_THROW(attrPlot->write(NDAttrPlotDataSelectString, columns[c], 0));
+        try {
+            std::vector<double> data = addr0Data.get_data();
+            BOOST_REQUIRE_EQUAL(data.size(), static_cast<size_t>(cache_size));
+            for (int i = 0; i < 3; ++i) {
+                BOOST_CHECK_EQUAL(data[i], scales[c]*i);
+            }
+            // The rest of the array is filled with the last point
+            BOOST_CHECK_EQUAL(data[cache_size - 1], scales[c]*2);
+        } catch (const AsynException& e) {
+            BOOST_FAIL("Exception thrown while trying to get data");
+        }
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,190 @@
+/*
+ * test_NDPluginAttribute.cpp
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#include <stdio.h>
+
+
+#include "boost/test/unit_test.hpp"
+
+// AD dependencies
+#include <NDPluginDriver.h>
+#include <NDArray.h>
+#include <NDAttribute.h>
+#include <asynDriver.h>
+#include <asynPortClient.h>
+
+#include <vector>
+#include <boost/shared_ptr.hpp>
+using namespace std;
+
+#include "testingutilities.h"
+#include "AttributePluginWrapper.h"
+
+/** asynFloat64Array client that keeps the time series of the last interrupt callback */
+class TSArrayClient : public asynFloat64ArrayClient {
+public:
+  TSArrayClient(const char *portName, int addr)
+    : asynFloat64ArrayClient(portName, addr, NDPluginAttributeTSArrayValueString), callbacks(0)
+  {
+    registerInterruptUser(float64Callback);
+  }
+  static void float64Callback(void *userPvt, asynUser *pasynUser, epicsFloat64 *value, size_t nElements)
+  {
+    TSArrayClient *pClient = (TSArrayClient *)userPvt;
+    pClient->callbacks++;
+    pClient->data.assign(value, value + nElements);
+  }
+  int callbacks;
+  std::vector<epicsFloat64> data;
+};
+
+struct AttributePluginTestFixture
+{
+  NDArrayPool *arrayPool;
+  boost::shared_ptr<AttributePluginWrapper> attr;
+  std::string testport;
+  NDAttributeList source;
+
+  AttributePluginTestFixture()
+  {
+    arrayPool = new NDArrayPool(100, 0);
+
+    // Asyn manager doesn't like it if we try to reuse the same port name for multiple drivers
+    // (even if only one is ever instantiated at once), so we change it slightly for each test case.
+    testport = "ATTR";
+    uniqueAsynPortName(testport);
+
+    // This is the plugin under test, with 3 attribute addresses
+    attr = boost::shared_ptr<AttributePluginWrapper>(new AttributePluginWrapper(testport, 50, 1, "", 0, 3));
+
+    // Enable the plugin
+    attr->start();
+    attr->write(NDPluginDriverEnableCallbacksString, 1);
+    attr->write(NDPluginDriverBlockingCallbacksString, 1);
+
+    attr->write(NDPluginAttributeAttrNameString, std::string("Counts"), 0);
+    attr->write(NDPluginAttributeAttrNameString, std::string("NDArrayUniqueId"), 1);
+    attr->write(NDPluginAttributeAttrNameString, std::string("Missing"), 2);
+  }
+
+  ~AttributePluginTestFixture()
+  {
+    attr.reset();
+    delete arrayPool;
+  }
+
+  /** Sends an array with attributes Counts and Other set to counts and 10*counts */
+  void process(int uniqueId, double counts)
+  {
+    double other = 10*counts;
+    size_t dims[2] = {4, 4};
+    NDArray *pArray = arrayPool->alloc(2, dims, NDUInt8, 0, NULL);
+    pArray->uniqueId = uniqueId;
+    source.add("Counts", "", NDAttrFloat64, &counts);
+    source.add("Other", "", NDAttrFloat64, &other);
+    source.copy(pArray->pAttributeList);
+    attr->lock();
+    BOOST_CHECK_NO_THROW(attr->processCallbacks(pArray));
+    attr->unlock();
+    pArray->release();
+  }
+};
+
+BOOST_FIXTURE_TEST_SUITE(AttributePluginTests, AttributePluginTestFixture)
+
+BOOST_AUTO_TEST_CASE(values_and_sums)
+{
+  for (int i=1; i<=3; i++) process(100 + i, i);
+  BOOST_CHECK_EQUAL(attr->readDouble(NDPluginAttributeValString, 0), 3.0);
+  BOOST_CHECK_EQUAL(attr->readDouble(NDPluginAttributeValSumString, 0), 6.0);
+  BOOST_CHECK_EQUAL(attr->readDouble(NDPluginAttributeValString, 1), 103.0);
+  BOOST_CHECK_EQUAL(attr->readDouble(NDPluginAttributeValSumString, 2), 0.0);
+
+  // Renaming an address reads the new attribute from the next array
+  attr->write(NDPluginAttributeAttrNameString, std::string("Other"), 0);
+  process(104, 4);
+  BOOST_CHECK_EQUAL(attr->readDouble(NDPluginAttributeValString, 0), 40.0);
+  BOOST_CHECK_EQUAL(attr->readDouble(NDPluginAttributeValSumString, 0), 46.0);
+
+  attr->write(NDPluginAttributeResetString, 1);
+  BOOST_CHECK_EQUAL(attr->readDouble(NDPluginAttributeValSumString, 0), 0.0);
+  process(105, 5);
+  BOOST_CHECK_EQUAL(attr->readDouble(NDPluginAttributeValSumString, 0), 50.0);
+}
+
+BOOST_AUTO_TEST_CASE(compact_attributes)
+{
+  // Attributes of compact lists are read by slot, and found again when the schema changes
+  double value = 0;
+  source.add("Counts", "", NDAttrFloat64, &value);
+  source.compact();
+  for (int i=1; i<=2; i++) process(i, i);
+  BOOST_CHECK_EQUAL(attr->readDouble(NDPluginAttributeValString, 0), 2.0);
+  BOOST_CHECK_EQUAL(attr->readDouble(NDPluginAttributeValSumString, 0), 3.0);
+
+  NDAttributeList other;
+  other.add("Spare", "", NDAttrFloat64, &value);
+  other.add("Counts", "", NDAttrFloat64, &value);
+  other.compact();
+  source.clear();
+  other.copy(&source);
+  process(3, 3);
+  BOOST_CHECK_EQUAL(attr->readDouble(NDPluginAttributeValString, 0), 3.0);
+  BOOST_CHECK_EQUAL(attr->readDouble(NDPluginAttributeValSumString, 0), 6.0);
+}
+
+BOOST_AUTO_TEST_CASE(time_series)
+{
+  TSArrayClient counts(testport.c_str(), 0);
+  TSArrayClient missing(testport.c_str(), 2);
+
+  attr->write(NDPluginAttributeTSNumPointsString, 4);
+  attr->write(NDPluginAttributeTSControlString, 0);
+  for (int i=1; i<=3; i++) process(i, i);
+  BOOST_CHECK_EQUAL(attr->readInt(NDPluginAttributeTSCurrentPointString), 3);
+  attr->write(NDPluginAttributeTSControlString, 3);
+  BOOST_REQUIRE_EQUAL(counts.data.size(), (size_t)3);
+  for (int i=0; i<3; i++) BOOST_CHECK_EQUAL(counts.data[i], i + 1);
+  // Missing attributes are 0 so all the series have the same length
+  BOOST_REQUIRE_EQUAL(missing.data.size(), (size_t)3);
+  BOOST_CHECK_EQUAL(missing.data[2], 0.0);
+
+  // The series stops when it is full
+  for (int i=4; i<=6; i++) process(i, i);
+  BOOST_CHECK_EQUAL(attr->readInt(NDPluginAttributeTSAcquiringString), 0);
+  BOOST_REQUIRE_EQUAL(counts.data.size(), (size_t)4);
+  BOOST_CHECK_EQUAL(counts.data[3], 4.0);
+
+  // Erase/Start starts a new series
+  attr->write(NDPluginAttributeTSControlString, 0);
+  BOOST_CHECK_EQUAL(counts.data.size(), (size_t)0);
+  process(7, 7);
+  attr->write(NDPluginAttributeTSControlString, 3);
+  BOOST_REQUIRE_EQUAL(counts.data.size(), (size_t)1);
+  BOOST_CHECK_EQUAL(counts.data[0], 7.0);
+}
+
+BOOST_AUTO_TEST_CASE(publish_rate)
+{
+  // At most one callback in 100 seconds, the first array was published when the plugin was created
+  attr->write(NDPluginAttributePublishRateString, 0.01);
+  for (int i=1; i<=3; i++) process(i, i);
+  BOOST_CHECK_EQUAL(attr->readDouble(NDPluginAttributeValString, 0), 0.0);
+  BOOST_CHECK_EQUAL(attr->readDouble(NDPluginAttributeValSumString, 0), 0.0);
+
+  // The held back values are published by Stop, and the sums include all the arrays
+  attr->write(NDPluginAttributeTSControlString, 2);
+  BOOST_CHECK_EQUAL(attr->readDouble(NDPluginAttributeValString, 0), 3.0);
+  BOOST_CHECK_EQUAL(attr->readDouble(NDPluginAttributeValSumString, 0), 6.0);
+
+  // With no limit every array is published
+  attr->write(NDPluginAttributePublishRateString, 0.0);
+  process(4, 4);
+  BOOST_CHECK_EQUAL(attr->readDouble(NDPluginAttributeValString, 0), 4.0);
+  BOOST_CHECK_EQUAL(attr->readDouble(NDPluginAttributeValSumString, 0), 10.0);
+}
+
+BOOST_AUTO_TEST_SUITE_END() // Done!
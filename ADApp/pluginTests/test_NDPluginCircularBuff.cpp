@@ -14,10 +14,37 @@
 #include <string.h>
 #include <stdint.h>
 
+#include <vector>
+
 #include "testingutilities.h"
 
 using namespace std;
 
+/** Records the uniqueId, first data value and Index attribute of the arrays it receives,
+  * since the arrays read from the spill file are released after the callbacks. */
+class SpillTestClient : public asynGenericPointerClient {
+public:
+    SpillTestClient(const char *portName)
+    : asynGenericPointerClient(portName, 0, NDArrayDataString)
+    {
+        registerInterruptUser(callback);
+    }
+    static void callback(void *userPvt, asynUser *pasynUser, void *pointer)
+    {
+        SpillTestClient *pClient = (SpillTestClient *)userPvt;
+        NDArray *pArray = (NDArray *)pointer;
+        NDAttribute *pAttr = pArray->pAttributeList->find("Index");
+        int index = -1;
+        if (pAttr) pAttr->getValue(NDAttrInt32, &index);
+        pClient->uniqueIds.push_back(pArray->uniqueId);
+        pClient->values.push_back(((uint8_t *)pArray->pData)[0]);
+        pClient->indices.push_back(index);
+    }
+    vector<int> uniqueIds;
+    vector<int> values;
+    vector<int> indices;
+};
+
 
 struct PluginFixture
 {
@@ -185,4 +212,211 @@ BOOST_AUTO_TEST_CASE(test_PreBufferOrder)
     BOOST_CHECK_EQUAL(3, ((uint8_t *)ds->arrays[3]->pData)[0]);
 }
 
+BOOST_AUTO_TEST_CASE(test_StoreReferences)
+{
+    size_t gotbytes;
+    int referenced, copied;
+    asynInt32Client storeReferences(cb->portName, 0, NDCircBuffStoreReferencesString);
+    asynInt32Client minFreeBuffers(cb->portName, 0, NDCircBuffMinFreeBuffersString);
+    asynInt32Client numReferenced(cb->portName, 0, NDCircBuffNumReferencedString);
+    asynInt32Client numCopied(cb->portName, 0, NDCircBuffNumCopiedString);
+    cbCalc->write("0", 2, &gotbytes);
+
+    storeReferences.write(1);
+    cbPreTrigger->write(3);
+    cbControl->write(1);
+
+    size_t dims = 3;
+    NDArray *testArrays[6];
+    for (int i = 0; i < 6; i++) {
+        testArrays[i] = arrayPool->alloc(1,&dims,NDUInt8,0,NULL);
+        memset(testArrays[i]->pData, i, 3);
+    }
+
+    // The pool of the arrays has room for 94 more, so these are stored by reference
+    for (int i = 0; i < 3; i++) {
+        cbProcess(testArrays[i]);
+    }
+    numReferenced.read(&referenced);
+    numCopied.read(&copied);
+    BOOST_CHECK_EQUAL(referenced, 3);
+    BOOST_CHECK_EQUAL(copied, 0);
+
+    // Copy the arrays when holding them would leave the pool with too few buffers
+    minFreeBuffers.write(95);
+    cbProcess(testArrays[3]);
+    numReferenced.read(&referenced);
+    numCopied.read(&copied);
+    BOOST_CHECK_EQUAL(referenced, 3);
+    BOOST_CHECK_EQUAL(copied, 1);
+
+    // Trigger the buffer flush; the arrays are output in order whether referenced or copied
+    cbSoftTrigger->write(1);
+    cbProcess(testArrays[4]);
+    BOOST_REQUIRE_GE(ds->arrays.size(), (size_t)4);
+    BOOST_CHECK_EQUAL(1, ((uint8_t *)ds->arrays[0]->pData)[0]);
+    BOOST_CHECK_EQUAL(2, ((uint8_t *)ds->arrays[1]->pData)[0]);
+    BOOST_CHECK_EQUAL(3, ((uint8_t *)ds->arrays[2]->pData)[0]);
+    BOOST_CHECK_EQUAL(4, ((uint8_t *)ds->arrays[3]->pData)[0]);
+    // The referenced arrays are output themselves, the copied one is not
+    BOOST_CHECK(ds->arrays[0] == testArrays[1]);
+    BOOST_CHECK(ds->arrays[1] == testArrays[2]);
+    BOOST_CHECK(ds->arrays[2] != testArrays[3]);
+
+    // Starting capture again resets the counters
+    cbControl->write(0);
+    cbControl->write(1);
+    numReferenced.read(&referenced);
+    numCopied.read(&copied);
+    BOOST_CHECK_EQUAL(referenced, 0);
+    BOOST_CHECK_EQUAL(copied, 0);
+
+    for (int i = 0; i < 6; i++) {
+        testArrays[i]->release();
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_SpillToFile)
+{
+    size_t gotbytes;
+    int spillQty, spillWritten, currentImage;
+    const char *fileName = "test_NDPluginCircularBuff_spill.dat";
+    bool compress = NDArrayDiskRing::compressionAvailable();
+    asynInt32Client spillEnable(cb->portName, 0, NDCircBuffSpillEnableString);
+    asynOctetClient spillFile(cb->portName, 0, NDCircBuffSpillFileString);
+    asynInt32Client spillFileSize(cb->portName, 0, NDCircBuffSpillFileSizeString);
+    asynInt32Client memoryDepth(cb->portName, 0, NDCircBuffMemoryDepthString);
+    asynInt32Client spillCompress(cb->portName, 0, NDCircBuffSpillCompressString);
+    asynInt32Client spillQtyClient(cb->portName, 0, NDCircBuffSpillQtyString);
+    asynInt32Client spillWrittenClient(cb->portName, 0, NDCircBuffSpillWrittenString);
+    asynFloat64Client spillRatio(cb->portName, 0, NDCircBuffSpillRatioString);
+    SpillTestClient client(cb->portName);
+    cbCalc->write("0", 2, &gotbytes);
+
+    // Keep the newest 2 of 5 pre-trigger arrays in memory and the others in the file
+    spillEnable.write(1);
+    spillFile.write(fileName, strlen(fileName), &gotbytes);
+    spillFileSize.write(1);
+    memoryDepth.write(2);
+    spillCompress.write(compress ? 1 : 0);
+    cbPreTrigger->write(5);
+    cbControl->write(1);
+
+    size_t dims = 1000;
+    NDArray *testArrays[8];
+    for (int i = 0; i < 8; i++) {
+        testArrays[i] = arrayPool->alloc(1,&dims,NDUInt8,0,NULL);
+        memset(testArrays[i]->pData, i, dims);
+        testArrays[i]->uniqueId = i;
+        testArrays[i]->pAttributeList->add("Index", "Array index", NDAttrInt32, &i);
+    }
+
+    // Arrays 0 and 1 are discarded from the file, 2 to 4 are in the file and 5 and 6 in memory
+    for (int i = 0; i < 7; i++) {
+        cbProcess(testArrays[i]);
+    }
+    spillQtyClient.read(&spillQty);
+    spillWrittenClient.read(&spillWritten);
+    cbCount->read(&currentImage);
+    BOOST_CHECK_EQUAL(spillQty, 3);
+    BOOST_CHECK_EQUAL(spillWritten, 5);
+    BOOST_CHECK_EQUAL(currentImage, 5);
+    if (compress) {
+        double ratio;
+        spillRatio.read(&ratio);
+        BOOST_CHECK_GT(ratio, 1.0);
+    }
+
+    // Trigger the buffer flush; the arrays from the file come first with their attributes
+    cbSoftTrigger->write(1);
+    cbProcess(testArrays[7]);
+    BOOST_REQUIRE_EQUAL(client.uniqueIds.size(), (size_t)6);
+    for (int i = 0; i < 6; i++) {
+        BOOST_CHECK_EQUAL(client.uniqueIds[i], i+2);
+        BOOST_CHECK_EQUAL(client.values[i], i+2);
+        BOOST_CHECK_EQUAL(client.indices[i], i+2);
+    }
+    spillQtyClient.read(&spillQty);
+    BOOST_CHECK_EQUAL(spillQty, 0);
+
+    cbControl->write(0);
+    for (int i = 0; i < 8; i++) {
+        testArrays[i]->release();
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_TriggerModes)
+{
+    size_t gotbytes;
+    int triggered;
+    asynInt32Client triggerMode(cb->portName, 0, NDCircBuffTriggerModeString);
+    asynInt32Client triggerEvents(cb->portName, 0, NDCircBuffTriggerEventsString);
+    asynFloat64Client triggerThreshold(cb->portName, 0, NDCircBuffTriggerThresholdString);
+    asynFloat64Client triggerHysteresis(cb->portName, 0, NDCircBuffTriggerHysteresisString);
+    asynInt32Client cbTriggered(cb->portName, 0, NDCircBuffTriggeredString);
+    cbTrigA->write("Value", 5, &gotbytes);
+    cbCalc->write("A", 2, &gotbytes);
+    cbPreTrigger->write(3);
+
+    // The arrays have compact attribute lists with the same schema, like those of a driver,
+    // so the trigger attribute is read by slot
+    NDAttributeList driverList;
+    double value = 0;
+    driverList.add("Other", "", NDAttrFloat64, &value);
+    driverList.add("Value", "", NDAttrFloat64, &value);
+    driverList.compact();
+    size_t dims = 3;
+    NDArray *pArray = arrayPool->alloc(1,&dims,NDUInt8,0,NULL);
+
+    // Trigger on the second rising edge; the first array only sets the initial state
+    triggerMode.write(NDCircBuffTriggerModeRisingEdge);
+    triggerEvents.write(2);
+    cbControl->write(1);
+    double edgeValues[] = {1, 0, 1, 1, 0, 1};
+    int edgeTriggers[]  = {0, 0, 0, 0, 0, 1};
+    for (int i = 0; i < 6; i++) {
+        driverList.add("Value", "", NDAttrFloat64, &edgeValues[i]);
+        driverList.copy(pArray->pAttributeList);
+        BOOST_REQUIRE(pArray->pAttributeList->getSchema() == driverList.getSchema());
+        cbProcess(pArray);
+        cbTriggered.read(&triggered);
+        BOOST_CHECK_EQUAL(triggered, edgeTriggers[i]);
+    }
+    cbControl->write(0);
+
+    // Trigger when the value reaches 10 after being below 8
+    triggerMode.write(NDCircBuffTriggerModeThreshold);
+    triggerEvents.write(1);
+    triggerThreshold.write(10.0);
+    triggerHysteresis.write(2.0);
+    cbControl->write(1);
+    double thresholdValues[] = {12, 9, 11, 7, 9.5, 10};
+    int thresholdTriggers[]  = { 0, 0,  0, 0,   0,  1};
+    for (int i = 0; i < 6; i++) {
+        driverList.add("Value", "", NDAttrFloat64, &thresholdValues[i]);
+        driverList.copy(pArray->pAttributeList);
+        cbProcess(pArray);
+        cbTriggered.read(&triggered);
+        BOOST_CHECK_EQUAL(triggered, thresholdTriggers[i]);
+    }
+    cbControl->write(0);
+
+    // Attributes are found by name in arrays that do not have compact lists
+    triggerMode.write(NDCircBuffTriggerModeLevel);
+    cbControl->write(1);
+    pArray->pAttributeList->clear();
+    value = 0;
+    pArray->pAttributeList->add("Value", "", NDAttrFloat64, &value);
+    cbProcess(pArray);
+    cbTriggered.read(&triggered);
+    BOOST_CHECK_EQUAL(triggered, 0);
+    value = 1;
+    pArray->pAttributeList->add("Value", "", NDAttrFloat64, &value);
+    cbProcess(pArray);
+    cbTriggered.read(&triggered);
+    BOOST_CHECK_EQUAL(triggered, 1);
+    cbControl->write(0);
+    pArray->release();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
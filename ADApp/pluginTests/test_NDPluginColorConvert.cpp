@@ -0,0 +1,375 @@
+/*
+ * test_NDPluginColorConvert.cpp
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#include <stdio.h>
+
+
+#include "boost/test/unit_test.hpp"
+
+// AD dependencies
+#include <NDPluginDriver.h>
+#include <NDArray.h>
+#include <NDAttribute.h>
+#include <asynDriver.h>
+
+#include <string.h>
+#include <stdint.h>
+
+#include <deque>
+#include <boost/shared_ptr.hpp>
+#include <iostream>
+#include <fstream>
+using namespace std;
+
+#include "testingutilities.h"
+#include "ColorConvertPluginWrapper.h"
+#include "AsynException.h"
+
+/** Returns the index of color c of pixel (x, y) in an array with the given color mode */
+static size_t pixelIndex(NDColorMode_t colorMode, size_t xSize, size_t ySize, size_t x, size_t y, int c)
+{
+  switch (colorMode) {
+    case NDColorModeRGB1: return (y*xSize + x)*3 + c;
+    case NDColorModeRGB2: return (y*3 + c)*xSize + x;
+    case NDColorModeRGB3: return (c*ySize + y)*xSize + x;
+    default:              return y*xSize + x;
+  }
+}
+
+struct ColorConvertPluginTestFixture
+{
+  NDArrayPool *arrayPool;
+  boost::shared_ptr<asynPortDriver> driver;
+  boost::shared_ptr<ColorConvertPluginWrapper> colorConvert;
+  TestingPlugin* downstream_plugin; // TODO: we don't put this in a shared_ptr and purposefully leak memory because asyn ports cannot be deleted
+
+  ColorConvertPluginTestFixture()
+  {
+    arrayPool = new NDArrayPool(100, 0);
+
+    // Asyn manager doesn't like it if we try to reuse the same port name for multiple drivers
+    // (even if only one is ever instantiated at once), so we change it slightly for each test case.
+    std::string simport("simCC"), testport("CC");
+    uniqueAsynPortName(simport);
+    uniqueAsynPortName(testport);
+
+    // We need some upstream driver for our test plugin so that calls to connectArrayPort
+    // don't fail, but we can then ignore it and send arrays by calling processCallbacks directly.
+    driver = boost::shared_ptr<asynPortDriver>(new asynPortDriver(simport.c_str(),
+                                                                  1, 1,
+                                                                  asynGenericPointerMask,
+                                                                  asynGenericPointerMask,
+                                                                  0, 0, 0, 2000000));
+
+    // This is the plugin under test
+    colorConvert = boost::shared_ptr<ColorConvertPluginWrapper>(new ColorConvertPluginWrapper(testport.c_str(),
+                                                                                              50,
+                                                                                              1,
+                                                                                              simport.c_str(),
+                                                                                              0,
+                                                                                              0,
+                                                                                              0,
+                                                                                              2000000,
+                                                                                              1));
+    // This is the mock downstream plugin
+    downstream_plugin = new TestingPlugin(testport.c_str(), 0);
+
+    // Enable the plugin
+    colorConvert->start(); // start the plugin thread although not required for this unittesting
+    colorConvert->write(NDPluginDriverEnableCallbacksString, 1);
+    colorConvert->write(NDPluginDriverBlockingCallbacksString, 1);
+  }
+
+  ~ColorConvertPluginTestFixture()
+  {
+    delete arrayPool;
+    colorConvert.reset();
+    driver.reset();
+    //delete downstream_plugin; // TODO: We can't delete a TestingPlugin because it tries to delete an asyn port which doesnt work
+  }
+
+  /** Allocates an image with the given color mode */
+  NDArray *allocImage(NDDataType_t dataType, NDColorMode_t colorMode, size_t xSize, size_t ySize)
+  {
+    size_t dims[3];
+    int ndims = 0;
+    int colorModeInt = colorMode;
+
+    if (colorMode == NDColorModeRGB1) dims[ndims++] = 3;
+    dims[ndims++] = xSize;
+    if (colorMode == NDColorModeRGB2) dims[ndims++] = 3;
+    dims[ndims++] = ySize;
+    if (colorMode == NDColorModeRGB3) dims[ndims++] = 3;
+    NDArray *pArray = arrayPool->alloc(ndims, dims, dataType, 0, NULL);
+    BOOST_REQUIRE(pArray != NULL);
+    pArray->pAttributeList->add("ColorMode", "Color mode", NDAttrInt32, &colorModeInt);
+    return pArray;
+  }
+
+  /** Converts pArray to colorModeOut and returns the output array */
+  NDArray *convert(NDArray *pArray, NDColorMode_t colorModeOut)
+  {
+    int colorMode = -1;
+    BOOST_CHECK_NO_THROW(colorConvert->write(NDPluginColorConvertColorModeOutString, colorModeOut));
+    size_t numArrays = downstream_plugin->arrays.size();
+    colorConvert->lock();
+    BOOST_CHECK_NO_THROW(colorConvert->processCallbacks(pArray));
+    colorConvert->unlock();
+    BOOST_REQUIRE_EQUAL(downstream_plugin->arrays.size(), numArrays+1);
+    NDArray *pOut = downstream_plugin->arrays.back();
+    BOOST_CHECK_EQUAL(pOut->uniqueId, pArray->uniqueId);
+    NDAttribute *pAttribute = pOut->pAttributeList->find("ColorMode");
+    BOOST_REQUIRE(pAttribute != NULL);
+    pAttribute->getValue(NDAttrInt32, &colorMode);
+    BOOST_CHECK_EQUAL(colorMode, colorModeOut);
+    return pOut;
+  }
+
+  /** Converts RGB images between all color modes, and checks that the pixels are unchanged */
+  template <typename epicsType>
+  void testRGB(NDDataType_t dataType, size_t xSize, size_t ySize)
+  {
+    NDColorMode_t rgbModes[3] = {NDColorModeRGB1, NDColorModeRGB2, NDColorModeRGB3};
+    int errors = 0;
+
+    for (int in=0; in<3; in++) {
+      NDArray *pArray = allocImage(dataType, rgbModes[in], xSize, ySize);
+      pArray->uniqueId = in;
+      epicsType *pIn = (epicsType *)pArray->pData;
+      for (size_t i=0; i<3*xSize*ySize; i++) pIn[i] = (epicsType)((i*7) % 251);
+      for (int out=0; out<3; out++) {
+        if (out == in) continue;
+        BOOST_MESSAGE("Convert " << rgbModes[in] << " to " << rgbModes[out] << " dataType=" << dataType);
+        NDArray *pOut = convert(pArray, rgbModes[out]);
+        BOOST_REQUIRE_EQUAL(pOut->ndims, 3);
+        epicsType *pOutData = (epicsType *)pOut->pData;
+        for (size_t y=0; y<ySize; y++) {
+          for (size_t x=0; x<xSize; x++) {
+            for (int c=0; c<3; c++) {
+              if (pOutData[pixelIndex(rgbModes[out], xSize, ySize, x, y, c)] !=
+                  pIn[pixelIndex(rgbModes[in], xSize, ySize, x, y, c)]) errors++;
+            }
+          }
+        }
+      }
+      NDArray *pMono = convert(pArray, NDColorModeMono);
+      BOOST_REQUIRE_EQUAL(pMono->ndims, 2);
+      BOOST_CHECK_EQUAL(pMono->dims[0].size, xSize);
+      BOOST_CHECK_EQUAL(pMono->dims[1].size, ySize);
+      epicsType *pMonoData = (epicsType *)pMono->pData;
+      for (size_t y=0; y<ySize; y++) {
+        for (size_t x=0; x<xSize; x++) {
+          double sum = 0;
+          for (int c=0; c<3; c++) sum += pIn[pixelIndex(rgbModes[in], xSize, ySize, x, y, c)];
+          if (pMonoData[y*xSize + x] != (epicsType)(sum/3.)) errors++;
+        }
+      }
+      pArray->release();
+    }
+    BOOST_CHECK_EQUAL(errors, 0);
+  }
+
+  /** Converts a mono image to all RGB color modes and checks that every color equals the mono value */
+  template <typename epicsType>
+  void testMono(NDDataType_t dataType, size_t xSize, size_t ySize)
+  {
+    NDColorMode_t rgbModes[3] = {NDColorModeRGB1, NDColorModeRGB2, NDColorModeRGB3};
+    int errors = 0;
+
+    NDArray *pArray = allocImage(dataType, NDColorModeMono, xSize, ySize);
+    epicsType *pIn = (epicsType *)pArray->pData;
+    for (size_t i=0; i<xSize*ySize; i++) pIn[i] = (epicsType)(i % 253);
+    for (int out=0; out<3; out++) {
+      NDArray *pOut = convert(pArray, rgbModes[out]);
+      epicsType *pOutData = (epicsType *)pOut->pData;
+      for (size_t y=0; y<ySize; y++) {
+        for (size_t x=0; x<xSize; x++) {
+          for (int c=0; c<3; c++) {
+            if (pOutData[pixelIndex(rgbModes[out], xSize, ySize, x, y, c)] != pIn[y*xSize + x]) errors++;
+          }
+        }
+      }
+    }
+    pArray->release();
+    BOOST_CHECK_EQUAL(errors, 0);
+  }
+
+  /** Converts a Bayer image in which each color is constant; every output pixel must have those colors */
+  template <typename epicsType>
+  void testBayer(NDDataType_t dataType, int bayerMethod, size_t xSize, size_t ySize)
+  {
+    NDColorMode_t rgbModes[3] = {NDColorModeRGB1, NDColorModeRGB2, NDColorModeRGB3};
+    epicsType colors[3] = {200, 120, 40};
+    int errors = 0;
+
+    BOOST_CHECK_NO_THROW(colorConvert->write(NDPluginColorConvertBayerMethodString, bayerMethod));
+    for (int pattern=NDBayerRGGB; pattern<=NDBayerBGGR; pattern++) {
+      size_t redX = ((pattern == NDBayerGRBG) || (pattern == NDBayerBGGR)) ? 1 : 0;
+      size_t redY = ((pattern == NDBayerGBRG) || (pattern == NDBayerBGGR)) ? 1 : 0;
+      NDArray *pArray = allocImage(dataType, NDColorModeBayer, xSize, ySize);
+      pArray->pAttributeList->add("BayerPattern", "Bayer pattern", NDAttrInt32, &pattern);
+      epicsType *pIn = (epicsType *)pArray->pData;
+      for (size_t y=0; y<ySize; y++) {
+        for (size_t x=0; x<xSize; x++) {
+          int c = 1;
+          if (((x & 1) == redX) && ((y & 1) == redY)) c = 0;
+          if (((x & 1) != redX) && ((y & 1) != redY)) c = 2;
+          pIn[y*xSize + x] = colors[c];
+        }
+      }
+      for (int out=0; out<3; out++) {
+        BOOST_MESSAGE("Bayer pattern " << pattern << " method " << bayerMethod << " to " << rgbModes[out]);
+        NDArray *pOut = convert(pArray, rgbModes[out]);
+        BOOST_REQUIRE_EQUAL(pOut->ndims, 3);
+        epicsType *pOutData = (epicsType *)pOut->pData;
+        for (size_t y=0; y<ySize; y++) {
+          for (size_t x=0; x<xSize; x++) {
+            for (int c=0; c<3; c++) {
+              if (pOutData[pixelIndex(rgbModes[out], xSize, ySize, x, y, c)] != colors[c]) errors++;
+            }
+          }
+        }
+      }
+      pArray->release();
+    }
+    BOOST_CHECK_EQUAL(errors, 0);
+  }
+};
+
+BOOST_FIXTURE_TEST_SUITE(ColorConvertPluginTests, ColorConvertPluginTestFixture)
+
+BOOST_AUTO_TEST_CASE(mono_to_rgb)
+{
+  testMono<epicsUInt8>(NDUInt8, 37, 21);
+  testMono<epicsUInt16>(NDUInt16, 64, 40);
+  testMono<epicsFloat64>(NDFloat64, 19, 7);
+}
+
+BOOST_AUTO_TEST_CASE(false_color)
+{
+  NDArray *pArray = allocImage(NDUInt8, NDColorModeMono, 256, 4);
+  epicsUInt8 *pIn = (epicsUInt8 *)pArray->pData;
+  for (size_t i=0; i<256*4; i++) pIn[i] = (epicsUInt8)i;
+  BOOST_CHECK_NO_THROW(colorConvert->write(NDPluginColorConvertFalseColorString, 1));
+  NDArray *pRGB1 = convert(pArray, NDColorModeRGB1);
+  NDArray *pRGB3 = convert(pArray, NDColorModeRGB3);
+  epicsUInt8 *pRGB1Data = (epicsUInt8 *)pRGB1->pData;
+  epicsUInt8 *pRGB3Data = (epicsUInt8 *)pRGB3->pData;
+  int errors = 0;
+  for (size_t i=0; i<256*4; i++) {
+    for (int c=0; c<3; c++) {
+      if (pRGB1Data[3*i + c] != pRGB3Data[c*256*4 + i]) errors++;
+    }
+  }
+  BOOST_CHECK_EQUAL(errors, 0);
+  // A false color map is not a grey scale
+  BOOST_CHECK(pRGB1Data[3*10] != pRGB1Data[3*10 + 2]);
+  pArray->release();
+}
+
+BOOST_AUTO_TEST_CASE(false_color_16bit)
+{
+  // Pixel i of row 0 is scaled to the same color as the 8-bit value i.
+  // Row 1 has values outside FalseColorMin to FalseColorMax.
+  NDArray *pArray8 = allocImage(NDUInt8, NDColorModeMono, 256, 2);
+  NDArray *pArray16 = allocImage(NDUInt16, NDColorModeMono, 256, 2);
+  epicsUInt8 *pIn8 = (epicsUInt8 *)pArray8->pData;
+  epicsUInt16 *pIn16 = (epicsUInt16 *)pArray16->pData;
+  for (size_t i=0; i<256; i++) {
+    pIn8[i] = (epicsUInt8)i;
+    pIn16[i] = (epicsUInt16)(1000 + 4*i);
+    pIn8[256 + i] = (i < 128) ? 0 : 255;
+    pIn16[256 + i] = (i < 128) ? (epicsUInt16)(7*i) : (epicsUInt16)(65535 - i);
+  }
+  BOOST_CHECK_NO_THROW(colorConvert->write(NDPluginColorConvertFalseColorString, 2));
+  NDArray *pRGB8 = convert(pArray8, NDColorModeRGB1);
+  BOOST_CHECK_NO_THROW(colorConvert->write(NDPluginColorConvertFalseColorMinString, 1000));
+  BOOST_CHECK_NO_THROW(colorConvert->write(NDPluginColorConvertFalseColorMaxString, 1000 + 4*255));
+  NDArray *pRGB16 = convert(pArray16, NDColorModeRGB1);
+  BOOST_CHECK_EQUAL(pRGB16->dataType, NDUInt8);
+  BOOST_CHECK_EQUAL(memcmp(pRGB8->pData, pRGB16->pData, 256*2*3), 0);
+  NDArray *pRGB2 = convert(pArray16, NDColorModeRGB2);
+  epicsUInt8 *pRGB16Data = (epicsUInt8 *)pRGB16->pData;
+  epicsUInt8 *pRGB2Data = (epicsUInt8 *)pRGB2->pData;
+  int errors = 0;
+  for (size_t y=0; y<2; y++) {
+    for (size_t x=0; x<256; x++) {
+      for (int c=0; c<3; c++) {
+        if (pRGB16Data[pixelIndex(NDColorModeRGB1, 256, 2, x, y, c)] !=
+            pRGB2Data[pixelIndex(NDColorModeRGB2, 256, 2, x, y, c)]) errors++;
+      }
+    }
+  }
+  BOOST_CHECK_EQUAL(errors, 0);
+  // Changing the range must rebuild the lookup table
+  BOOST_CHECK_NO_THROW(colorConvert->write(NDPluginColorConvertFalseColorMaxString, 1000 + 2*255));
+  NDArray *pHalf = convert(pArray16, NDColorModeRGB1);
+  BOOST_CHECK_EQUAL(memcmp(pRGB8->pData, pHalf->pData, 3), 0);
+  BOOST_CHECK(memcmp(pRGB8->pData, pHalf->pData, 256*3) != 0);
+  pArray8->release();
+  pArray16->release();
+}
+
+BOOST_AUTO_TEST_CASE(rgb_to_rgb)
+{
+  testRGB<epicsUInt8>(NDUInt8, 37, 21);
+  testRGB<epicsUInt8>(NDUInt8, 64, 48);
+  testRGB<epicsUInt16>(NDUInt16, 33, 17);
+  testRGB<epicsFloat32>(NDFloat32, 20, 9);
+}
+
+BOOST_AUTO_TEST_CASE(band_threads)
+{
+  // The results must not depend on the number of threads
+  BOOST_CHECK_NO_THROW(colorConvert->write(NDPluginColorConvertBandThreadsString, 4));
+  testRGB<epicsUInt8>(NDUInt8, 64, 130);
+  testMono<epicsUInt16>(NDUInt16, 50, 100);
+  testBayer<epicsUInt8>(NDUInt8, NDBayerMethodEdgeAware, 64, 70);
+}
+
+BOOST_AUTO_TEST_CASE(bayer)
+{
+  testBayer<epicsUInt8>(NDUInt8, NDBayerMethodBilinear, 37, 21);
+  testBayer<epicsUInt8>(NDUInt8, NDBayerMethodEdgeAware, 37, 21);
+  testBayer<epicsUInt16>(NDUInt16, NDBayerMethodBilinear, 40, 12);
+  testBayer<epicsUInt16>(NDUInt16, NDBayerMethodEdgeAware, 40, 12);
+  testBayer<epicsFloat32>(NDFloat32, NDBayerMethodEdgeAware, 9, 6);
+}
+
+BOOST_AUTO_TEST_CASE(yuv422)
+{
+  // With U=V=128 the image is grey, so R=G=B=Y
+  size_t xSize = 40, ySize = 5;
+  NDArray *pArray = allocImage(NDUInt8, NDColorModeYUV422, 2*xSize, ySize);
+  epicsUInt8 *pIn = (epicsUInt8 *)pArray->pData;
+  for (size_t i=0; i<2*xSize*ySize; i+=2) {
+    pIn[i] = 128;
+    pIn[i+1] = (epicsUInt8)(i/2);
+  }
+  NDArray *pOut = convert(pArray, NDColorModeRGB1);
+  BOOST_REQUIRE_EQUAL(pOut->ndims, 3);
+  BOOST_CHECK_EQUAL(pOut->dims[1].size, xSize);
+  BOOST_CHECK_EQUAL(pOut->dims[2].size, ySize);
+  epicsUInt8 *pOutData = (epicsUInt8 *)pOut->pData;
+  int errors = 0;
+  for (size_t i=0; i<xSize*ySize; i++) {
+    for (int c=0; c<3; c++) {
+      if (pOutData[3*i + c] != (epicsUInt8)i) errors++;
+    }
+  }
+  BOOST_CHECK_EQUAL(errors, 0);
+  NDArray *pMono = convert(pArray, NDColorModeMono);
+  BOOST_REQUIRE_EQUAL(pMono->ndims, 2);
+  BOOST_CHECK_EQUAL(pMono->dims[0].size, xSize);
+  epicsUInt8 *pMonoData = (epicsUInt8 *)pMono->pData;
+  for (size_t i=0; i<xSize*ySize; i++) {
+    if (pMonoData[i] != (epicsUInt8)i) errors++;
+  }
+  BOOST_CHECK_EQUAL(errors, 0);
+  pArray->release();
+}
+
+BOOST_AUTO_TEST_SUITE_END() // Done!
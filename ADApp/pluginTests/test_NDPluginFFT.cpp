@@ -6,6 +6,7 @@
  */
 
 #include <stdio.h>
+#include <math.h>
 
 
 #include "boost/test/unit_test.hpp"
@@ -198,4 +199,125 @@ BOOST_AUTO_TEST_CASE(basic_1D_operation)
 }
 
 
+/* Reference DFT with the sign convention of the plugin */
+static void referenceDFT(const std::vector<double>& in, size_t nx, size_t ny, size_t kx, size_t ky,
+                         double *re, double *im)
+{
+  *re = 0;
+  *im = 0;
+  for (size_t y=0; y<ny; y++) {
+    for (size_t x=0; x<nx; x++) {
+      double phase = 2 * M_PI * ((double)((kx * x) % nx) / nx + (double)((ky * y) % ny) / ny);
+      *re += in[y*nx + x] * cos(phase);
+      *im += in[y*nx + x] * sin(phase);
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(zero_pad_disabled_1D)
+{
+  size_t dims[] = {20};
+  std::vector<double> data(20);
+  NDArray *pArray = arrayPool->alloc(1, dims, NDFloat64, 0, NULL);
+  double *pData = (double *)pArray->pData;
+  for (size_t i=0; i<data.size(); i++) {
+    data[i] = pData[i] = 10 + 3*sin(2*M_PI*3*i/20.) + cos(2*M_PI*7*i/20.) + (double)(i % 3);
+  }
+
+  fft->write(FFTNumAverageString, 1);
+  fft->write(FFTSuppressDCString, 0);
+  fft->write(FFTZeroPadString, 0);
+  BOOST_CHECK_EQUAL(fft->readInt(FFTZeroPadString), 0);
+  fft->write(NDArrayCallbacksString, 1);
+
+  fft->lock();
+  BOOST_CHECK_NO_THROW(fft->processCallbacks(pArray));
+  fft->unlock();
+
+  // 20 points are transformed without padding to 32
+  BOOST_REQUIRE_EQUAL(downstream_plugin->arrays.size(), (size_t)1);
+  NDArray *pOut = downstream_plugin->arrays.back();
+  BOOST_REQUIRE_EQUAL(pOut->ndims, 1);
+  BOOST_REQUIRE_EQUAL(pOut->dims[0].size, (size_t)10);
+  BOOST_REQUIRE_EQUAL(pOut->dataType, NDFloat64);
+  double *pAbs = (double *)pOut->pData;
+  for (size_t k=0; k<10; k++) {
+    double re, im;
+    referenceDFT(data, 20, 1, k, 0, &re, &im);
+    BOOST_CHECK_SMALL(pAbs[k] - sqrt(re*re + im*im)/20, 1e-10);
+  }
+  pArray->release();
+}
+
+BOOST_AUTO_TEST_CASE(zero_pad_disabled_2D)
+{
+  // Not square, with a size (7*11) that is not a power of 2
+  size_t nx = 20, ny = 77;
+  size_t dims[] = {nx, ny};
+  std::vector<double> data(nx * ny);
+  NDArray *pArray = arrayPool->alloc(2, dims, NDUInt16, 0, NULL);
+  epicsUInt16 *pData = (epicsUInt16 *)pArray->pData;
+  for (size_t i=0; i<data.size(); i++) {
+    data[i] = pData[i] = (epicsUInt16)((i * 7919) % 1000);
+  }
+
+  fft->write(FFTNumAverageString, 1);
+  fft->write(FFTSuppressDCString, 0);
+  fft->write(FFTZeroPadString, 0);
+  fft->write(NDArrayCallbacksString, 1);
+
+  fft->lock();
+  BOOST_CHECK_NO_THROW(fft->processCallbacks(pArray));
+  fft->unlock();
+
+  BOOST_REQUIRE_EQUAL(downstream_plugin->arrays.size(), (size_t)1);
+  NDArray *pOut = downstream_plugin->arrays.back();
+  BOOST_REQUIRE_EQUAL(pOut->ndims, 2);
+  BOOST_REQUIRE_EQUAL(pOut->dims[0].size, nx/2);
+  BOOST_REQUIRE_EQUAL(pOut->dims[1].size, ny/2);
+  double *pAbs = (double *)pOut->pData;
+  for (size_t ky=0; ky<ny/2; ky++) {
+    for (size_t kx=0; kx<nx/2; kx++) {
+      double re, im;
+      referenceDFT(data, nx, ny, kx, ky, &re, &im);
+      BOOST_CHECK_SMALL(pAbs[ky*(nx/2) + kx] - sqrt(re*re + im*im)/(nx*ny), 1e-9);
+    }
+  }
+  pArray->release();
+}
+
+BOOST_AUTO_TEST_CASE(plan_sizes)
+{
+  // Compare the cached plans with the reference DFT for radix 2, 3, 4, 5, generic radix and Bluestein sizes
+  static const int sizes[] = {1, 2, 3, 8, 12, 30, 49, 64, 77, 97, 210};
+  for (size_t s=0; s<sizeof(sizes)/sizeof(sizes[0]); s++) {
+    int n = sizes[s];
+    std::vector<double> in(n), complex(2*n);
+    for (int i=0; i<n; i++) {
+      in[i] = sin(0.3*i*i) + 0.1*i;
+      complex[2*i] = in[i];
+      complex[2*i+1] = 0.;
+    }
+    const NDFFTPlan *pPlan = NDFFTPlan::get(n, 1);
+    const NDFFTRealPlan *pRealPlan = NDFFTRealPlan::get(n, 1);
+    BOOST_REQUIRE(pPlan == NDFFTPlan::get(n, 1));
+    BOOST_REQUIRE(pRealPlan == NDFFTRealPlan::get(n, 1));
+    std::vector<double> work(pPlan->workSize(1) + pRealPlan->workSize());
+    std::vector<double> real(2*pRealPlan->outputSize());
+    pPlan->execute(&complex[0], 1, &work[0]);
+    pRealPlan->execute(&in[0], &real[0], 1, &work[0]);
+    for (int k=0; k<n; k++) {
+      double re, im;
+      referenceDFT(in, n, 1, k, 0, &re, &im);
+      BOOST_CHECK_SMALL(complex[2*k] - re, 1e-9);
+      BOOST_CHECK_SMALL(complex[2*k+1] - im, 1e-9);
+      if (k < pRealPlan->outputSize()) {
+        BOOST_CHECK_SMALL(real[2*k] - re, 1e-9);
+        BOOST_CHECK_SMALL(real[2*k+1] - im, 1e-9);
+      }
+    }
+  }
+}
+
+
 BOOST_AUTO_TEST_SUITE_END() // Done!
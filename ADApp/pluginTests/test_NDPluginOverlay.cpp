@@ -256,5 +256,81 @@ BOOST_AUTO_TEST_CASE(basic_overlay_operation)
   }
 }
 
+BOOST_AUTO_TEST_CASE(rectangle_pixels)
+{
+  // A 10x8 rectangle outline with line width 2 drawn in XOR mode.
+  // Each pixel must be drawn once even where the lines overlap.
+  size_t dims[2] = {32, 24};
+  NDArray *pArray = arrayPool->alloc(2, dims, NDUInt8, 0, NULL);
+  memset(pArray->pData, 0, 32*24);
+  BOOST_CHECK_NO_THROW(Overlay->write(NDPluginOverlayUseString,       1,                  0));
+  BOOST_CHECK_NO_THROW(Overlay->write(NDPluginOverlayPositionXString, 4,                  0));
+  BOOST_CHECK_NO_THROW(Overlay->write(NDPluginOverlayPositionYString, 6,                  0));
+  BOOST_CHECK_NO_THROW(Overlay->write(NDPluginOverlaySizeXString,     9,                  0));
+  BOOST_CHECK_NO_THROW(Overlay->write(NDPluginOverlaySizeYString,     7,                  0));
+  BOOST_CHECK_NO_THROW(Overlay->write(NDPluginOverlayWidthXString,    2,                  0));
+  BOOST_CHECK_NO_THROW(Overlay->write(NDPluginOverlayWidthYString,    2,                  0));
+  BOOST_CHECK_NO_THROW(Overlay->write(NDPluginOverlayShapeString,     NDOverlayRectangle, 0));
+  BOOST_CHECK_NO_THROW(Overlay->write(NDPluginOverlayDrawModeString,  NDOverlayXOR,       0));
+  BOOST_CHECK_NO_THROW(Overlay->write(NDPluginOverlayGreenString,     255,                0));
+
+  for (int pass=0; pass<2; pass++) {
+    // The second pass uses the cached pixels
+    Overlay->lock();
+    BOOST_CHECK_NO_THROW(Overlay->processCallbacks(pArray));
+    Overlay->unlock();
+    BOOST_REQUIRE_EQUAL(downstream_plugin->arrays.size(), (size_t)(pass+1));
+    NDArray *pOut = downstream_plugin->arrays.back();
+    BOOST_REQUIRE(pOut != pArray);
+    epicsUInt8 *pData = (epicsUInt8 *)pOut->pData;
+    int errors = 0;
+    for (int y=0; y<24; y++) {
+      for (int x=0; x<32; x++) {
+        bool inside = (x >= 4) && (x <= 13) && (y >= 6) && (y <= 13);
+        bool border = inside && ((x < 6) || (x > 11) || (y < 8) || (y > 11));
+        if (pData[y*32 + x] != (border ? 255 : 0)) errors++;
+      }
+    }
+    BOOST_CHECK_EQUAL(errors, 0);
+  }
+  pArray->release();
+}
+
+BOOST_AUTO_TEST_CASE(copy_on_write)
+{
+  size_t dims[2] = {32, 24};
+  NDArray *pArray = arrayPool->alloc(2, dims, NDUInt8, 0, NULL);
+  memset(pArray->pData, 0, 32*24);
+  BOOST_CHECK_NO_THROW(Overlay->write(NDPluginOverlayCopyOnWriteString, 1));
+  BOOST_CHECK_EQUAL(Overlay->readInt(NDPluginOverlayCopyOnWriteString), 1);
+
+  // No overlay in use, the input array is passed through
+  Overlay->lock();
+  BOOST_CHECK_NO_THROW(Overlay->processCallbacks(pArray));
+  Overlay->unlock();
+  BOOST_REQUIRE_EQUAL(downstream_plugin->arrays.size(), 1);
+  BOOST_CHECK(downstream_plugin->arrays.back() == pArray);
+
+  // A cross that is visible, the array is copied and the input is unchanged
+  BOOST_CHECK_NO_THROW(Overlay->write(NDPluginOverlayUseString,       1,              0));
+  BOOST_CHECK_NO_THROW(Overlay->write(NDPluginOverlayPositionXString, 10,             0));
+  BOOST_CHECK_NO_THROW(Overlay->write(NDPluginOverlayPositionYString, 10,             0));
+  BOOST_CHECK_NO_THROW(Overlay->write(NDPluginOverlaySizeXString,     6,              0));
+  BOOST_CHECK_NO_THROW(Overlay->write(NDPluginOverlaySizeYString,     6,              0));
+  BOOST_CHECK_NO_THROW(Overlay->write(NDPluginOverlayWidthXString,    1,              0));
+  BOOST_CHECK_NO_THROW(Overlay->write(NDPluginOverlayWidthYString,    1,              0));
+  BOOST_CHECK_NO_THROW(Overlay->write(NDPluginOverlayShapeString,     NDOverlayCross, 0));
+  BOOST_CHECK_NO_THROW(Overlay->write(NDPluginOverlayDrawModeString,  NDOverlaySet,   0));
+  BOOST_CHECK_NO_THROW(Overlay->write(NDPluginOverlayGreenString,     255,            0));
+  Overlay->lock();
+  BOOST_CHECK_NO_THROW(Overlay->processCallbacks(pArray));
+  Overlay->unlock();
+  BOOST_REQUIRE_EQUAL(downstream_plugin->arrays.size(), 2);
+  NDArray *pOut = downstream_plugin->arrays.back();
+  BOOST_CHECK(pOut != pArray);
+  BOOST_CHECK_EQUAL(((epicsUInt8 *)pOut->pData)[13*32 + 13], 255);
+  BOOST_CHECK_EQUAL(((epicsUInt8 *)pArray->pData)[13*32 + 13], 0);
+  pArray->release();
+}
 
 BOOST_AUTO_TEST_SUITE_END() // Done!
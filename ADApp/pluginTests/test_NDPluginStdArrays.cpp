@@ -0,0 +1,201 @@
+/*
+ * test_NDPluginStdArrays.cpp
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#include <stdio.h>
+
+
+#include "boost/test/unit_test.hpp"
+
+// AD dependencies
+#include <NDPluginDriver.h>
+#include <NDArray.h>
+#include <NDAttribute.h>
+#include <asynDriver.h>
+#include <asynPortClient.h>
+
+#include <string.h>
+#include <stdint.h>
+
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include <iostream>
+using namespace std;
+
+#include "testingutilities.h"
+#include "StdArraysPluginWrapper.h"
+#include "AsynException.h"
+
+/** asynInt16Array client that keeps the data of the last interrupt callback */
+class Int16ArrayClient : public asynInt16ArrayClient {
+public:
+  Int16ArrayClient(const char *portName, const char *drvInfo)
+    : asynInt16ArrayClient(portName, 0, drvInfo), callbacks(0)
+  {
+    registerInterruptUser(int16Callback);
+  }
+  static void int16Callback(void *userPvt, asynUser *pasynUser, epicsInt16 *value, size_t nElements)
+  {
+    Int16ArrayClient *pClient = (Int16ArrayClient *)userPvt;
+    pClient->callbacks++;
+    pClient->data.assign(value, value + nElements);
+  }
+  int callbacks;
+  std::vector<epicsInt16> data;
+};
+
+struct StdArraysPluginTestFixture
+{
+  NDArrayPool *arrayPool;
+  boost::shared_ptr<asynPortDriver> driver;
+  boost::shared_ptr<StdArraysPluginWrapper> stdArrays;
+  std::string testport;
+
+  StdArraysPluginTestFixture()
+  {
+    arrayPool = new NDArrayPool(100, 0);
+
+    // Asyn manager doesn't like it if we try to reuse the same port name for multiple drivers
+    // (even if only one is ever instantiated at once), so we change it slightly for each test case.
+    std::string simport("simSTDARRAYS");
+    testport = "STDARRAYS";
+    uniqueAsynPortName(simport);
+    uniqueAsynPortName(testport);
+
+    // We need some upstream driver for our test plugin so that calls to connectArrayPort
+    // don't fail, but we can then ignore it and send arrays by calling processCallbacks directly.
+    driver = boost::shared_ptr<asynPortDriver>(new asynPortDriver(simport.c_str(),
+                                                                  1, 1,
+                                                                  asynGenericPointerMask,
+                                                                  asynGenericPointerMask,
+                                                                  0, 0, 0, 2000000));
+
+    // This is the plugin under test
+    stdArrays = boost::shared_ptr<StdArraysPluginWrapper>(new StdArraysPluginWrapper(testport.c_str(),
+                                                                                     50,
+                                                                                     1,
+                                                                                     simport.c_str(),
+                                                                                     0,
+                                                                                     0,
+                                                                                     0,
+                                                                                     2000000,
+                                                                                     1));
+
+    // Enable the plugin
+    stdArrays->start(); // start the plugin thread although not required for this unittesting
+    stdArrays->write(NDPluginDriverEnableCallbacksString, 1);
+    stdArrays->write(NDPluginDriverBlockingCallbacksString, 1);
+  }
+
+  ~StdArraysPluginTestFixture()
+  {
+    delete arrayPool;
+    stdArrays.reset();
+    driver.reset();
+  }
+
+  /** Allocates a UInt16 image with element (x, y) = x + 10*y */
+  NDArray *createImage(size_t xSize, size_t ySize)
+  {
+    size_t dims[2] = {xSize, ySize};
+    NDArray *pArray = arrayPool->alloc(2, dims, NDUInt16, 0, NULL);
+    epicsUInt16 *pData = (epicsUInt16 *)pArray->pData;
+    for (size_t y=0; y<ySize; y++) {
+      for (size_t x=0; x<xSize; x++) *pData++ = (epicsUInt16)(x + 10*y);
+    }
+    return pArray;
+  }
+
+  void process(NDArray *pArray)
+  {
+    stdArrays->lock();
+    BOOST_CHECK_NO_THROW(stdArrays->processCallbacks(pArray));
+    stdArrays->unlock();
+  }
+};
+
+BOOST_FIXTURE_TEST_SUITE(StdArraysPluginTests, StdArraysPluginTestFixture)
+
+BOOST_AUTO_TEST_CASE(native_type)
+{
+  Int16ArrayClient client(testport.c_str(), NDPluginStdArraysDataString);
+
+  NDArray *pArray = createImage(7, 5);
+  process(pArray);
+  BOOST_REQUIRE_EQUAL(client.callbacks, 1);
+  BOOST_REQUIRE_EQUAL(client.data.size(), (size_t)35);
+  BOOST_CHECK_EQUAL(memcmp(&client.data[0], pArray->pData, 35*sizeof(epicsInt16)), 0);
+
+  // Reads of the native type return the same data
+  std::vector<epicsInt16> value(100);
+  size_t nIn;
+  BOOST_CHECK_EQUAL(client.read(&value[0], value.size(), &nIn), asynSuccess);
+  BOOST_REQUIRE_EQUAL(nIn, (size_t)35);
+  BOOST_CHECK_EQUAL(memcmp(&value[0], pArray->pData, 35*sizeof(epicsInt16)), 0);
+  pArray->release();
+}
+
+BOOST_AUTO_TEST_CASE(binning)
+{
+  Int16ArrayClient client(testport.c_str(), NDPluginStdArraysDataString);
+
+  // A 7x5 image binned to at most 12 elements is binned by 2 to 4x3
+  stdArrays->write(NDPluginStdArraysMaxElementsString, 12);
+  NDArray *pArray = createImage(7, 5);
+  process(pArray);
+  BOOST_CHECK_EQUAL(stdArrays->readInt(NDPluginStdArraysBinningString), 2);
+  BOOST_REQUIRE_EQUAL(client.callbacks, 1);
+  BOOST_REQUIRE_EQUAL(client.data.size(), (size_t)12);
+  // Each element is the average of its block; the last column and row are only 1 element wide
+  epicsInt16 expected[12] = { 5,  7,  9, 11,
+                             25, 27, 29, 31,
+                             40, 42, 44, 46};
+  for (int i=0; i<12; i++) BOOST_CHECK_EQUAL(client.data[i], expected[i]);
+
+  // Arrays that fit are not binned
+  stdArrays->write(NDPluginStdArraysMaxElementsString, 35);
+  process(pArray);
+  BOOST_CHECK_EQUAL(stdArrays->readInt(NDPluginStdArraysBinningString), 1);
+  BOOST_CHECK_EQUAL(client.data.size(), (size_t)35);
+  pArray->release();
+}
+
+BOOST_AUTO_TEST_CASE(binning_rgb)
+{
+  Int16ArrayClient client(testport.c_str(), NDPluginStdArraysDataString);
+
+  // The color dimension of RGB1 arrays is not binned
+  size_t dims[3] = {3, 4, 4};
+  int colorMode = NDColorModeRGB1;
+  NDArray *pArray = arrayPool->alloc(3, dims, NDInt16, 0, NULL);
+  pArray->pAttributeList->add("ColorMode", "Color mode", NDAttrInt32, &colorMode);
+  epicsInt16 *pData = (epicsInt16 *)pArray->pData;
+  for (size_t i=0; i<48; i++) pData[i] = (epicsInt16)(i % 3);
+  stdArrays->write(NDPluginStdArraysMaxElementsString, 12);
+  process(pArray);
+  BOOST_CHECK_EQUAL(stdArrays->readInt(NDPluginStdArraysBinningString), 2);
+  BOOST_REQUIRE_EQUAL(client.data.size(), (size_t)12);
+  for (int i=0; i<12; i++) BOOST_CHECK_EQUAL(client.data[i], i % 3);
+  pArray->release();
+}
+
+BOOST_AUTO_TEST_CASE(max_rate)
+{
+  Int16ArrayClient allClient(testport.c_str(), NDPluginStdArraysDataString);
+  Int16ArrayClient limitedClient(testport.c_str(), "STD_ARRAY_DATA MAX_RATE=0.1");
+
+  NDArray *pArray = createImage(4, 4);
+  for (int i=0; i<5; i++) {
+    pArray->uniqueId = i;
+    process(pArray);
+  }
+  // The rate limited client only gets the first array within 10 seconds
+  BOOST_CHECK_EQUAL(allClient.callbacks, 5);
+  BOOST_CHECK_EQUAL(limitedClient.callbacks, 1);
+  BOOST_CHECK_EQUAL(limitedClient.data.size(), (size_t)16);
+  pArray->release();
+}
+
+BOOST_AUTO_TEST_SUITE_END() // Done!
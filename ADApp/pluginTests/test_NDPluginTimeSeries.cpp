@@ -15,11 +15,13 @@
 #include <NDArray.h>
 #include <NDAttribute.h>
 #include <asynDriver.h>
+#include <asynPortClient.h>
 
 #include <string.h>
 #include <stdint.h>
 
 #include <deque>
+#include <vector>
 #include <boost/shared_ptr.hpp>
 #include <iostream>
 #include <fstream>
@@ -39,6 +41,22 @@ void TS_callback(void *userPvt, asynUser *pasynUser, void *pointer)
   callbackCount++;
 }
 
+/** asynFloat64Array client that keeps the data of the last interrupt callback */
+class Float64ArrayClient : public asynFloat64ArrayClient {
+public:
+  Float64ArrayClient(const char *portName, int addr, const char *drvInfo)
+    : asynFloat64ArrayClient(portName, addr, drvInfo)
+  {
+    registerInterruptUser(float64Callback);
+  }
+  static void float64Callback(void *userPvt, asynUser *pasynUser, epicsFloat64 *value, size_t nElements)
+  {
+    Float64ArrayClient *pClient = (Float64ArrayClient *)userPvt;
+    pClient->data.assign(value, value + nElements);
+  }
+  std::vector<epicsFloat64> data;
+};
+
 struct TimeSeriesPluginTestFixture
 {
   NDArrayPool *arrayPool;
@@ -52,6 +70,7 @@ struct TimeSeriesPluginTestFixture
   std::vector<size_t>dims_2d;
   std::vector<NDArray*>arrays_3d;
   std::vector<size_t>dims_3d;
+  std::string testport;
 
   static int testCase;
 
@@ -61,7 +80,8 @@ struct TimeSeriesPluginTestFixture
 
     // Asyn manager doesn't like it if we try to reuse the same port name for multiple drivers
     // (even if only one is ever instantiated at once), so we change it slightly for each test case.
-    std::string simport("simTS"), testport("TS");
+    std::string simport("simTS");
+    testport = "TS";
     uniqueAsynPortName(simport);
     uniqueAsynPortName(testport);
 
@@ -339,5 +359,104 @@ BOOST_AUTO_TEST_CASE(trigger_output_NDArray_circular_mode)
   BOOST_CHECK_EQUAL(downstream_plugin->arrays[0]->dims[0].size, 20);
 }
 
+BOOST_AUTO_TEST_CASE(output_NDArray_circular_time_order)
+{
+  // The 2-D array of all signals is output on address maxSignals=1
+  TestingPlugin* array_plugin = new TestingPlugin(testport.c_str(), 1);
+
+  // Average pairs of points. Signal 0 of input row g is 3*g, so time point p is 6*p+1.5
+  BOOST_CHECK_NO_THROW(ts->write(TSAveragingTimeString, 0.002));
+  BOOST_REQUIRE_EQUAL(ts->readInt(TSNumAverageString), 2);
+  BOOST_CHECK_NO_THROW(ts->write(NDArrayCallbacksString, 1));
+  BOOST_CHECK_NO_THROW(ts->write(TSAcquireModeString, 1)); // TSAcquireModeCircular=1
+  BOOST_CHECK_NO_THROW(ts->write(TSAcquireString, 1));
+
+  // 60 input rows make 30 time points, so the 20 point time series wraps at point 10
+  size_t dims[2] = {3, 20};
+  for (int i = 0; i < 3; i++)
+  {
+    NDArray *pArray = arrayPool->alloc(2, dims, NDFloat32, 0, NULL);
+    epicsFloat32 *pData = (epicsFloat32 *)pArray->pData;
+    for (int j = 0; j < 60; j++) pData[j] = (epicsFloat32)(i*60 + j);
+    ts->lock();
+    BOOST_CHECK_NO_THROW(ts->processCallbacks(pArray));
+    ts->unlock();
+    pArray->release();
+  }
+  BOOST_CHECK_EQUAL(ts->readInt(TSCurrentPointString), 10);
+
+  BOOST_CHECK_NO_THROW(ts->write(TSReadString, 1));
+  BOOST_REQUIRE_EQUAL(array_plugin->arrays.size(), 1);
+  NDArray *pOut = array_plugin->arrays[0];
+  BOOST_REQUIRE_EQUAL(pOut->ndims, 2);
+  BOOST_REQUIRE_EQUAL(pOut->dims[0].size, 20);
+  BOOST_CHECK_EQUAL(pOut->dims[1].size, 1);
+  BOOST_REQUIRE_EQUAL(pOut->dataType, NDFloat32);
+  // The oldest time point is first
+  epicsFloat32 *pData = (epicsFloat32 *)pOut->pData;
+  for (int k = 0; k < 20; k++)
+  {
+    BOOST_CHECK_EQUAL(pData[k], (epicsFloat32)(6*(k+10) + 1.5));
+  }
+  BOOST_CHECK_EQUAL(downstream_plugin->arrays.size(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(resolution_levels)
+{
+  Float64ArrayClient level0Min(testport.c_str(), 0, TSLevel0MinString);
+  Float64ArrayClient level0Max(testport.c_str(), 0, TSLevel0MaxString);
+  Float64ArrayClient level1Mean(testport.c_str(), 0, TSLevel1MeanString);
+  Float64ArrayClient level1Min(testport.c_str(), 0, TSLevel1MinString);
+  Float64ArrayClient level2Mean(testport.c_str(), 0, TSLevel2MeanString);
+  Float64ArrayClient level2Max(testport.c_str(), 0, TSLevel2MaxString);
+  Float64ArrayClient level2TimeAxis(testport.c_str(), 0, TSLevel2TimeAxisString);
+
+  // Average pairs of input points for level 0 and pairs of points of each level for the next level
+  BOOST_CHECK_NO_THROW(ts->write(TSAveragingTimeString, 0.002));
+  BOOST_REQUIRE_EQUAL(ts->readInt(TSNumAverageString), 2);
+  BOOST_CHECK_NO_THROW(ts->write(TSNumLevelsString, 3));
+  BOOST_CHECK_NO_THROW(ts->write(TSLevelDecimationString, 2));
+  BOOST_CHECK_EQUAL(ts->readInt(TSNumLevelsString), 3);
+
+  // Level 2 points are 8 input points apart
+  BOOST_REQUIRE_EQUAL(level2TimeAxis.data.size(), 20);
+  BOOST_CHECK_CLOSE(level2TimeAxis.data[1], 0.008, 1e-6);
+
+  // Signal 0 of input point g is g.  20 input points make 10 points of level 0, 5 of level 1
+  // and 2 of level 2, with half a point of level 2 not yet complete.
+  BOOST_CHECK_NO_THROW(ts->write(TSAcquireString, 1));
+  size_t dims[2] = {3, 20};
+  NDArray *pArray = arrayPool->alloc(2, dims, NDFloat32, 0, NULL);
+  epicsFloat32 *pData = (epicsFloat32 *)pArray->pData;
+  for (int j = 0; j < 60; j++) pData[j] = (epicsFloat32)(j / 3);
+  ts->lock();
+  BOOST_CHECK_NO_THROW(ts->processCallbacks(pArray));
+  ts->unlock();
+  pArray->release();
+  BOOST_CHECK_NO_THROW(ts->write(TSReadString, 1));
+
+  BOOST_REQUIRE_EQUAL(level0Min.data.size(), 10);
+  BOOST_REQUIRE_EQUAL(level0Max.data.size(), 10);
+  for (int p = 0; p < 10; p++)
+  {
+    BOOST_CHECK_EQUAL(level0Min.data[p], 2*p);
+    BOOST_CHECK_EQUAL(level0Max.data[p], 2*p + 1);
+  }
+  BOOST_REQUIRE_EQUAL(level1Mean.data.size(), 5);
+  BOOST_REQUIRE_EQUAL(level1Min.data.size(), 5);
+  for (int q = 0; q < 5; q++)
+  {
+    BOOST_CHECK_EQUAL(level1Mean.data[q], 4*q + 1.5);
+    BOOST_CHECK_EQUAL(level1Min.data[q], 4*q);
+  }
+  BOOST_REQUIRE_EQUAL(level2Mean.data.size(), 2);
+  BOOST_REQUIRE_EQUAL(level2Max.data.size(), 2);
+  for (int r = 0; r < 2; r++)
+  {
+    BOOST_CHECK_EQUAL(level2Mean.data[r], 8*r + 3.5);
+    BOOST_CHECK_EQUAL(level2Max.data[r], 8*r + 7);
+  }
+}
+
 
 BOOST_AUTO_TEST_SUITE_END() // Done!
@@ -0,0 +1,199 @@
+/*
+ * test_NDPluginTransform.cpp
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#include <stdio.h>
+
+
+#include "boost/test/unit_test.hpp"
+
+// AD dependencies
+#include <NDPluginDriver.h>
+#include <NDArray.h>
+#include <NDAttribute.h>
+#include <asynDriver.h>
+
+#include <string.h>
+#include <stdint.h>
+
+#include <deque>
+#include <boost/shared_ptr.hpp>
+#include <iostream>
+#include <fstream>
+using namespace std;
+
+#include "testingutilities.h"
+#include "TransformPluginWrapper.h"
+#include "AsynException.h"
+
+// These must match the transform types in NDPluginTransform.cpp and NDTransform.template
+static const char *transformNames[] = {"None", "Rot90", "Rot180", "Rot270",
+                                       "Mirror", "Rot90Mirror", "Rot180Mirror", "Rot270Mirror"};
+
+/** Computes the output pixel (ox, oy) of input pixel (x, y) for each transform type */
+static void transformPixel(int transformType, size_t xSize, size_t ySize, size_t x, size_t y,
+                           size_t *ox, size_t *oy)
+{
+  switch (transformType) {
+    case 1: *ox = ySize-1-y; *oy = x;         break;
+    case 2: *ox = xSize-1-x; *oy = ySize-1-y; break;
+    case 3: *ox = y;         *oy = xSize-1-x; break;
+    case 4: *ox = xSize-1-x; *oy = y;         break;
+    case 5: *ox = y;         *oy = x;         break;
+    case 6: *ox = x;         *oy = ySize-1-y; break;
+    case 7: *ox = ySize-1-y; *oy = xSize-1-x; break;
+    default: *ox = x;        *oy = y;         break;
+  }
+}
+
+template <typename epicsType>
+static void fillTestArray(NDArray *pArray)
+{
+  NDArrayInfo_t arrayInfo;
+  epicsType *pData = (epicsType *)pArray->pData;
+
+  pArray->getInfo(&arrayInfo);
+  for (size_t i=0; i<arrayInfo.nElements; i++) pData[i] = (epicsType)(i % 251);
+}
+
+/** Checks every element of pOut against the element of pIn it should have come from.
+  * pixelSize is the number of elements in each pixel (3 for RGB1, 1 for mono) */
+template <typename epicsType>
+static void checkTransform(NDArray *pIn, NDArray *pOut, int transformType, size_t pixelSize)
+{
+  epicsType *pInData = (epicsType *)pIn->pData;
+  epicsType *pOutData = (epicsType *)pOut->pData;
+  int xDim = (pixelSize > 1) ? 1 : 0;
+  size_t xSize = pIn->dims[xDim].size;
+  size_t ySize = pIn->dims[xDim+1].size;
+  bool swapXY = (transformType == 1) || (transformType == 3) || (transformType == 5) || (transformType == 7);
+  size_t outXSize = swapXY ? ySize : xSize;
+  size_t ox, oy;
+  int errors = 0;
+
+  BOOST_REQUIRE_EQUAL(pOut->ndims, pIn->ndims);
+  BOOST_CHECK_EQUAL(pOut->dims[xDim].size,   outXSize);
+  BOOST_CHECK_EQUAL(pOut->dims[xDim+1].size, swapXY ? xSize : ySize);
+  for (size_t y=0; y<ySize; y++) {
+    for (size_t x=0; x<xSize; x++) {
+      transformPixel(transformType, xSize, ySize, x, y, &ox, &oy);
+      for (size_t c=0; c<pixelSize; c++) {
+        if (pOutData[(oy*outXSize + ox)*pixelSize + c] != pInData[(y*xSize + x)*pixelSize + c]) errors++;
+      }
+    }
+  }
+  BOOST_CHECK_EQUAL(errors, 0);
+}
+
+struct TransformPluginTestFixture
+{
+  NDArrayPool *arrayPool;
+  boost::shared_ptr<asynPortDriver> driver;
+  boost::shared_ptr<TransformPluginWrapper> transform;
+  TestingPlugin* downstream_plugin; // TODO: we don't put this in a shared_ptr and purposefully leak memory because asyn ports cannot be deleted
+
+  TransformPluginTestFixture()
+  {
+    arrayPool = new NDArrayPool(100, 0);
+
+    // Asyn manager doesn't like it if we try to reuse the same port name for multiple drivers
+    // (even if only one is ever instantiated at once), so we change it slightly for each test case.
+    std::string simport("simTRANS"), testport("TRANS");
+    uniqueAsynPortName(simport);
+    uniqueAsynPortName(testport);
+
+    // We need some upstream driver for our test plugin so that calls to connectArrayPort
+    // don't fail, but we can then ignore it and send arrays by calling processCallbacks directly.
+    driver = boost::shared_ptr<asynPortDriver>(new asynPortDriver(simport.c_str(),
+                                                                  1, 1,
+                                                                  asynGenericPointerMask,
+                                                                  asynGenericPointerMask,
+                                                                  0, 0, 0, 2000000));
+
+    // This is the plugin under test
+    transform = boost::shared_ptr<TransformPluginWrapper>(new TransformPluginWrapper(testport.c_str(),
+                                                                                     50,
+                                                                                     1,
+                                                                                     simport.c_str(),
+                                                                                     0,
+                                                                                     0,
+                                                                                     0,
+                                                                                     2000000,
+                                                                                     1));
+    // This is the mock downstream plugin
+    downstream_plugin = new TestingPlugin(testport.c_str(), 0);
+
+    // Enable the plugin
+    transform->start(); // start the plugin thread although not required for this unittesting
+    transform->write(NDPluginDriverEnableCallbacksString, 1);
+    transform->write(NDPluginDriverBlockingCallbacksString, 1);
+  }
+
+  ~TransformPluginTestFixture()
+  {
+    delete arrayPool;
+    transform.reset();
+    driver.reset();
+    //delete downstream_plugin; // TODO: We can't delete a TestingPlugin because it tries to delete an asyn port which doesnt work
+  }
+
+  template <typename epicsType>
+  void testAllTransforms(NDDataType_t dataType, NDColorMode_t colorMode, size_t xSize, size_t ySize)
+  {
+    size_t dims[3];
+    int ndims = 0;
+    int colorModeInt = colorMode;
+    size_t pixelSize = (colorMode == NDColorModeRGB1) ? 3 : 1;
+
+    if (pixelSize > 1) dims[ndims++] = pixelSize;
+    dims[ndims++] = xSize;
+    dims[ndims++] = ySize;
+    NDArray *pArray = arrayPool->alloc(ndims, dims, dataType, 0, NULL);
+    BOOST_REQUIRE(pArray != NULL);
+    pArray->pAttributeList->add("ColorMode", "Color mode", NDAttrInt32, &colorModeInt);
+    fillTestArray<epicsType>(pArray);
+
+    for (int transformType=0; transformType<8; transformType++) {
+      BOOST_MESSAGE("Transform " << transformNames[transformType] << " dataType=" << dataType <<
+                    " colorMode=" << colorMode << " size=" << xSize << "x" << ySize);
+      BOOST_CHECK_NO_THROW(transform->write(NDPluginTransformTypeString, transformType));
+      size_t numArrays = downstream_plugin->arrays.size();
+      transform->lock();
+      BOOST_CHECK_NO_THROW(transform->processCallbacks(pArray));
+      transform->unlock();
+      BOOST_REQUIRE_EQUAL(downstream_plugin->arrays.size(), numArrays+1);
+      checkTransform<epicsType>(pArray, downstream_plugin->arrays.back(), transformType, pixelSize);
+    }
+    pArray->release();
+  }
+};
+
+BOOST_FIXTURE_TEST_SUITE(TransformPluginTests, TransformPluginTestFixture)
+
+BOOST_AUTO_TEST_CASE(transform_mono_8bit)
+{
+  // The sizes are not multiples of the block size so the edge handling is tested
+  testAllTransforms<epicsUInt8>(NDUInt8, NDColorModeMono, 37, 21);
+  testAllTransforms<epicsUInt8>(NDUInt8, NDColorModeMono, 300, 270);
+}
+
+BOOST_AUTO_TEST_CASE(transform_mono_16bit)
+{
+  testAllTransforms<epicsUInt16>(NDUInt16, NDColorModeMono, 37, 21);
+  testAllTransforms<epicsUInt16>(NDUInt16, NDColorModeMono, 256, 136);
+}
+
+BOOST_AUTO_TEST_CASE(transform_mono_float64)
+{
+  testAllTransforms<epicsFloat64>(NDFloat64, NDColorModeMono, 45, 19);
+}
+
+BOOST_AUTO_TEST_CASE(transform_rgb1)
+{
+  testAllTransforms<epicsUInt8>(NDUInt8, NDColorModeRGB1, 37, 21);
+  testAllTransforms<epicsUInt16>(NDUInt16, NDColorModeRGB1, 70, 33);
+}
+
+BOOST_AUTO_TEST_SUITE_END() // Done!
@@ -15,6 +15,8 @@
 #include <NDArray.h>
 #include <NDAttribute.h>
 #include <asynDriver.h>
+#include <epicsMath.h>
+#include <epicsThread.h>
 
 #include <string.h>
 #include <stdint.h>
@@ -27,6 +29,7 @@ using namespace std;
 
 #include "testingutilities.h"
 #include "PosPluginWrapper.h"
+#include "NDPosPluginPositions.h"
 #include "HDF5FileReader.h"
 #include "AsynException.h"
 
@@ -302,4 +305,305 @@ BOOST_AUTO_TEST_CASE(test_LoadingDataPoints)
   BOOST_CHECK_EQUAL(pos->readInt(str_NDPos_CurrentQty), 0);
 }
 
+BOOST_AUTO_TEST_CASE(test_PositionStore)
+{
+  NDPosPluginPositions store;
+  std::vector<std::string> names;
+  std::vector<int> columns;
+  double values[2];
+
+  names.push_back("y");
+  names.push_back("x");
+  store.mapDimensions(names, columns);
+  for (int i = 0; i < 10000; i++){
+    values[0] = i;
+    values[1] = 2*i;
+    store.append(columns, values);
+  }
+  BOOST_CHECK_EQUAL(store.size(), (size_t)10000);
+  BOOST_REQUIRE_EQUAL(store.numDimensions(), (size_t)2);
+  // Dimensions are sorted by name
+  BOOST_CHECK_EQUAL(store.dimensionName(store.sortedDimensions()[0]), "x");
+  BOOST_CHECK_EQUAL(store.value(9999, columns[1]), 19998.0);
+
+  // Discarding more than half the positions erases them, the indexes stay relative to the first position
+  store.discard(6000);
+  BOOST_CHECK_EQUAL(store.size(), (size_t)4000);
+  BOOST_CHECK_EQUAL(store.value(0, columns[0]), 6000.0);
+  BOOST_CHECK_EQUAL(store.value(3999, columns[1]), 19998.0);
+
+  // A new dimension has no value for the positions already loaded
+  std::vector<std::string> names2(1, "n");
+  std::vector<int> columns2;
+  store.mapDimensions(names2, columns2);
+  BOOST_CHECK_EQUAL(columns2[0], 2);
+  values[0] = 5;
+  store.append(columns2, values);
+  BOOST_CHECK(isnan(store.value(0, columns2[0])));
+  BOOST_CHECK_EQUAL(store.value(4000, columns2[0]), 5.0);
+  BOOST_CHECK(isnan(store.value(4000, columns[0])));
+  BOOST_CHECK_EQUAL(store.dimensionName(store.sortedDimensions()[0]), "n");
+
+  store.discard(5000);
+  BOOST_CHECK_EQUAL(store.size(), (size_t)0);
+  store.clear();
+  BOOST_CHECK_EQUAL(store.numDimensions(), (size_t)0);
+}
+
+BOOST_AUTO_TEST_CASE(test_MixedDimensions)
+{
+  // Positions loaded with different dimensions only get attributes for their own dimensions
+  pos->write(str_NDPos_Filename, "<pos_layout><dimensions><dimension name=\"x\"></dimension></dimensions>\
+  <positions><position x=\"3\"></position></positions></pos_layout>");
+  pos->write(str_NDPos_Filename, "<pos_layout><dimensions><dimension name=\"y\"></dimension><dimension name=\"x\"></dimension></dimensions>\
+  <positions><position y=\"1.5\" x=\"4\"></position></positions></pos_layout>");
+  BOOST_CHECK_EQUAL(pos->readInt(str_NDPos_CurrentQty), 2);
+  // Positions with values that are not finite are skipped, NaN marks a dimension with no value
+  pos->write(str_NDPos_Filename, "<pos_layout><dimensions><dimension name=\"x\"></dimension></dimensions>\
+  <positions><position x=\"nan\"></position><position x=\"inf\"></position></positions></pos_layout>");
+  BOOST_CHECK_EQUAL(pos->readInt(str_NDPos_CurrentQty), 2);
+
+  size_t tmpdims[] = {10,10};
+  std::vector<size_t>dims(tmpdims, tmpdims + sizeof(tmpdims)/sizeof(tmpdims[0]));
+  std::vector<NDArray*>arrays(2);
+  fillNDArraysFromPool(dims, NDUInt32, arrays, arrayPool);
+  BOOST_CHECK_NO_THROW(pos->write(str_NDPos_Running, 1));
+  BOOST_CHECK_NO_THROW(pos->write(str_NDPos_ExpectedID, 0));
+
+  double val;
+  arrays[0]->uniqueId = 0;
+  pos->lock();
+  BOOST_CHECK_NO_THROW(pos->processCallbacks(arrays[0]));
+  pos->unlock();
+  NDArray *arrayPtr = (NDArray *)cbPtr;
+  BOOST_REQUIRE(arrayPtr->pAttributeList->find("x") != NULL);
+  arrayPtr->pAttributeList->find("x")->getValue(NDAttrFloat64, &val);
+  BOOST_CHECK_EQUAL(val, 3.0);
+  BOOST_CHECK(arrayPtr->pAttributeList->find("y") == NULL);
+  BOOST_CHECK_EQUAL(pos->readString(str_NDPos_CurrentPos), "[x=3]");
+
+  arrays[1]->uniqueId = 1;
+  pos->lock();
+  BOOST_CHECK_NO_THROW(pos->processCallbacks(arrays[1]));
+  pos->unlock();
+  arrayPtr = (NDArray *)cbPtr;
+  BOOST_REQUIRE(arrayPtr->pAttributeList->find("y") != NULL);
+  arrayPtr->pAttributeList->find("y")->getValue(NDAttrFloat64, &val);
+  BOOST_CHECK_EQUAL(val, 1.5);
+  BOOST_CHECK_EQUAL(pos->readString(str_NDPos_CurrentPos), "[x=4,y=1.5]");
+  BOOST_CHECK_EQUAL(pos->readInt(str_NDPos_CurrentQty), 0);
+}
+
+BOOST_AUTO_TEST_CASE(test_StreamedLoading)
+{
+  // Create a position file larger than a load block
+  {
+    std::ofstream out("/tmp/streamed_points.csv");
+    out << "x,y\n# Comment lines are ignored\n";
+    for (int i = 0; i < 5000; i++){
+      out << i << "," << 2*i << "\n";
+    }
+  }
+  {
+    std::ofstream out("/tmp/streamed_tail.csv");
+    out << "x,y\n";
+    for (int i = 5000; i < 5003; i++){
+      out << i << "," << 2*i << "\n";
+    }
+  }
+  BOOST_CHECK_NO_THROW(pos->write(str_NDPos_QueueLimit, 2000));
+  BOOST_CHECK_NO_THROW(pos->write(str_NDPos_Filename, "/tmp/streamed_points.csv"));
+  BOOST_CHECK_EQUAL(pos->readInt(str_NDPos_FileValid), 1);
+  BOOST_CHECK(pos->readInt(str_NDPos_CurrentQty) >= 1000);
+  // Another file is queued behind this one
+  BOOST_CHECK_NO_THROW(pos->write(str_NDPos_Filename, "/tmp/streamed_tail.csv"));
+  BOOST_CHECK_EQUAL(pos->readInt(str_NDPos_FileValid), 1);
+
+  // In Discard mode the loader stops at the queue limit
+  for (int i = 0; i < 100 && pos->readInt(str_NDPos_CurrentQty) < 2000; i++){
+    epicsThreadSleep(0.01);
+  }
+  epicsThreadSleep(0.1);
+  BOOST_CHECK_EQUAL(pos->readInt(str_NDPos_CurrentQty), 2000);
+  BOOST_CHECK_EQUAL(pos->readInt(str_NDPos_Loading), 1);
+
+  // Every array gets its position while the rest of the file is loaded
+  size_t tmpdims[] = {10,10};
+  std::vector<size_t>dims(tmpdims, tmpdims + sizeof(tmpdims)/sizeof(tmpdims[0]));
+  std::vector<NDArray*>arrays(1);
+  fillNDArraysFromPool(dims, NDUInt32, arrays, arrayPool);
+  BOOST_CHECK_NO_THROW(pos->write(str_NDPos_Running, 1));
+  int errors = 0;
+  double val = 0;
+  for (int i = 0; i < 5003; i++){
+    arrays[0]->uniqueId = i + 1;
+    pos->lock();
+    pos->processCallbacks(arrays[0]);
+    pos->unlock();
+    NDAttribute *pAtt = ((NDArray *)cbPtr)->pAttributeList->find("y");
+    if ((pAtt == NULL) || (pAtt->getValue(NDAttrFloat64, &val) != ND_SUCCESS) || (val != 2.0*i)){
+      errors++;
+    }
+  }
+  BOOST_CHECK_EQUAL(errors, 0);
+  // The loader finds the end of the files and stops the plugin
+  for (int i = 0; i < 100 && pos->readInt(str_NDPos_Loading) == 1; i++){
+    epicsThreadSleep(0.01);
+  }
+  BOOST_CHECK_EQUAL(pos->readInt(str_NDPos_CurrentQty), 0);
+  BOOST_CHECK_EQUAL(pos->readInt(str_NDPos_Loading), 0);
+  BOOST_CHECK_EQUAL(pos->readInt(str_NDPos_Running), 0);
+
+  // Deleting the positions stops the loading
+  BOOST_CHECK_NO_THROW(pos->write(str_NDPos_Filename, "/tmp/streamed_points.csv"));
+  BOOST_CHECK_NO_THROW(pos->write(str_NDPos_Delete, 1));
+  BOOST_CHECK_EQUAL(pos->readInt(str_NDPos_Loading), 0);
+  epicsThreadSleep(0.1);
+  BOOST_CHECK_EQUAL(pos->readInt(str_NDPos_CurrentQty), 0);
+
+  // Positions appended while a file is loading are added after it
+  asynFloat64ArrayClient append(pos->asynPortDriver::portName, 0, str_NDPos_AppendPositions);
+  double values[] = {-1, -2};
+  BOOST_CHECK_NO_THROW(pos->write(str_NDPos_QueueLimit, 0));
+  BOOST_CHECK_NO_THROW(pos->write(str_NDPos_Filename, "/tmp/streamed_points.csv"));
+  pos->write(str_NDPos_Dimensions, "x,y");
+  BOOST_CHECK_EQUAL(append.write(values, 2), asynSuccess);
+  for (int i = 0; i < 100 && pos->readInt(str_NDPos_Loading) == 1; i++){
+    epicsThreadSleep(0.01);
+  }
+  BOOST_CHECK_EQUAL(pos->readInt(str_NDPos_Loading), 0);
+  BOOST_CHECK_EQUAL(pos->readInt(str_NDPos_CurrentQty), 5001);
+  BOOST_CHECK_NO_THROW(pos->write(str_NDPos_Running, 1));
+  for (int i = 0; i < 5001; i++){
+    arrays[0]->uniqueId = i + 1;
+    pos->lock();
+    pos->processCallbacks(arrays[0]);
+    pos->unlock();
+  }
+  BOOST_REQUIRE(((NDArray *)cbPtr)->pAttributeList->find("y") != NULL);
+  ((NDArray *)cbPtr)->pAttributeList->find("y")->getValue(NDAttrFloat64, &val);
+  BOOST_CHECK_EQUAL(val, -2.0);
+}
+
+BOOST_AUTO_TEST_CASE(test_AppendPositions)
+{
+  asynFloat64ArrayClient append(pos->asynPortDriver::portName, 0, str_NDPos_AppendPositions);
+  double values[] = {0, 10, 1, 11, 2, 12, 3};
+
+  // The dimensions must be set first, and the values must make whole positions
+  BOOST_CHECK(append.write(values, 6) != asynSuccess);
+  pos->write(str_NDPos_Dimensions, " x, y");
+  BOOST_CHECK(append.write(values, 7) != asynSuccess);
+  double notFinite[] = {0, epicsNAN};
+  BOOST_CHECK(append.write(notFinite, 2) != asynSuccess);
+  BOOST_CHECK_EQUAL(pos->readInt(str_NDPos_CurrentQty), 0);
+  BOOST_CHECK_EQUAL(append.write(values, 4), asynSuccess);
+  BOOST_CHECK_EQUAL(pos->readInt(str_NDPos_CurrentQty), 2);
+  BOOST_CHECK_EQUAL(pos->readInt(str_NDPos_QueueDepth), 2);
+
+  size_t tmpdims[] = {10,10};
+  std::vector<size_t>dims(tmpdims, tmpdims + sizeof(tmpdims)/sizeof(tmpdims[0]));
+  std::vector<NDArray*>arrays(1);
+  fillNDArraysFromPool(dims, NDUInt32, arrays, arrayPool);
+  BOOST_CHECK_NO_THROW(pos->write(str_NDPos_Mode, MODE_KEEP));
+  BOOST_CHECK_NO_THROW(pos->write(str_NDPos_Running, 1));
+
+  // Positions appended while running are used by the next arrays
+  double val;
+  for (int i = 0; i < 3; i++){
+    if (i == 2){
+      BOOST_CHECK_EQUAL(append.write(values + 4, 2), asynSuccess);
+      BOOST_CHECK_EQUAL(pos->readInt(str_NDPos_QueueDepth), 1);
+    }
+    arrays[0]->uniqueId = i + 1;
+    pos->lock();
+    BOOST_CHECK_NO_THROW(pos->processCallbacks(arrays[0]));
+    pos->unlock();
+    NDArray *arrayPtr = (NDArray *)cbPtr;
+    BOOST_REQUIRE(arrayPtr->pAttributeList->find("y") != NULL);
+    arrayPtr->pAttributeList->find("y")->getValue(NDAttrFloat64, &val);
+    BOOST_CHECK_EQUAL(val, 10.0 + i);
+  }
+  BOOST_CHECK_EQUAL(pos->readInt(str_NDPos_QueueDepth), 0);
+  BOOST_CHECK_EQUAL(pos->readInt(str_NDPos_Underflows), 0);
+
+  // An array with no position is counted as an underflow
+  arrays[0]->uniqueId = 4;
+  pos->lock();
+  BOOST_CHECK_NO_THROW(pos->processCallbacks(arrays[0]));
+  pos->unlock();
+  BOOST_CHECK_EQUAL(pos->readInt(str_NDPos_Underflows), 1);
+  BOOST_CHECK_EQUAL(pos->readInt(str_NDPos_Running), 0);
+
+  // The dimensions are kept when the positions are deleted
+  BOOST_CHECK_NO_THROW(pos->write(str_NDPos_Delete, 1));
+  BOOST_CHECK_EQUAL(append.write(values, 2), asynSuccess);
+  BOOST_CHECK_EQUAL(pos->readInt(str_NDPos_CurrentQty), 1);
+}
+
+BOOST_AUTO_TEST_CASE(test_AppendPositionsDiscard)
+{
+  asynFloat64ArrayClient append(pos->asynPortDriver::portName, 0, str_NDPos_AppendPositions);
+  double values[] = {0, 10, 1, 11, 2, 12, 3, 13};
+
+  pos->write(str_NDPos_Dimensions, "x,y");
+  BOOST_CHECK_EQUAL(append.write(values, 4), asynSuccess);
+
+  size_t tmpdims[] = {10,10};
+  std::vector<size_t>dims(tmpdims, tmpdims + sizeof(tmpdims)/sizeof(tmpdims[0]));
+  std::vector<NDArray*>arrays(1);
+  fillNDArraysFromPool(dims, NDUInt32, arrays, arrayPool);
+  BOOST_CHECK_EQUAL(pos->readInt(str_NDPos_Mode), MODE_DISCARD);
+  BOOST_CHECK_NO_THROW(pos->write(str_NDPos_Running, 1));
+
+  double val;
+  for (int i = 0; i < 2; i++){
+    arrays[0]->uniqueId = i + 1;
+    pos->lock();
+    BOOST_CHECK_NO_THROW(pos->processCallbacks(arrays[0]));
+    pos->unlock();
+    NDArray *arrayPtr = (NDArray *)cbPtr;
+    BOOST_REQUIRE(arrayPtr->pAttributeList->find("y") != NULL);
+    arrayPtr->pAttributeList->find("y")->getValue(NDAttrFloat64, &val);
+    BOOST_CHECK_EQUAL(val, 10.0 + i);
+  }
+  // The queue is empty but positions are being streamed, so the plugin keeps running
+  BOOST_CHECK_EQUAL(pos->readInt(str_NDPos_CurrentQty), 0);
+  BOOST_CHECK_EQUAL(pos->readInt(str_NDPos_Running), 1);
+
+  // An array with no position is counted and not passed on
+  int count = callbackCount;
+  arrays[0]->uniqueId = 3;
+  pos->lock();
+  BOOST_CHECK_NO_THROW(pos->processCallbacks(arrays[0]));
+  pos->unlock();
+  BOOST_CHECK_EQUAL(callbackCount, count);
+  BOOST_CHECK_EQUAL(pos->readInt(str_NDPos_Underflows), 1);
+  BOOST_CHECK_EQUAL(pos->readInt(str_NDPos_Running), 1);
+
+  // The position of the underflowed array is discarded when the next array arrives
+  BOOST_CHECK_EQUAL(append.write(values + 4, 4), asynSuccess);
+  arrays[0]->uniqueId = 4;
+  pos->lock();
+  BOOST_CHECK_NO_THROW(pos->processCallbacks(arrays[0]));
+  pos->unlock();
+  BOOST_CHECK_EQUAL(callbackCount, count + 1);
+  NDArray *arrayPtr = (NDArray *)cbPtr;
+  BOOST_REQUIRE(arrayPtr->pAttributeList->find("y") != NULL);
+  arrayPtr->pAttributeList->find("y")->getValue(NDAttrFloat64, &val);
+  BOOST_CHECK_EQUAL(val, 13.0);
+  BOOST_CHECK_EQUAL(pos->readInt(str_NDPos_MissingFrames), 1);
+  BOOST_CHECK_EQUAL(pos->readInt(str_NDPos_Underflows), 1);
+  BOOST_CHECK_EQUAL(pos->readInt(str_NDPos_Running), 1);
+
+  // Deleting the positions ends the stream, so the next array stops the plugin
+  BOOST_CHECK_NO_THROW(pos->write(str_NDPos_Delete, 1));
+  arrays[0]->uniqueId = 5;
+  pos->lock();
+  BOOST_CHECK_NO_THROW(pos->processCallbacks(arrays[0]));
+  pos->unlock();
+  BOOST_CHECK_EQUAL(pos->readInt(str_NDPos_Underflows), 2);
+  BOOST_CHECK_EQUAL(pos->readInt(str_NDPos_Running), 0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
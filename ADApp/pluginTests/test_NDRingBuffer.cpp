@@ -0,0 +1,164 @@
+/*
+ * test_NDRingBuffer.cpp
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#include <stdio.h>
+
+#include "boost/test/unit_test.hpp"
+
+// AD dependencies
+#include <epicsThread.h>
+#include <epicsEvent.h>
+
+#include <NDRingBuffer.h>
+
+#include <vector>
+using namespace std;
+
+typedef NDRingBuffer<double> Ring;
+
+static const int numConcurrentValues = 2000000;
+
+struct ProducerArgs {
+  Ring *pRing;
+  epicsEventId done;
+};
+
+static void producer(void *arg)
+{
+  ProducerArgs *pArgs = (ProducerArgs *)arg;
+  double block[7];
+  int value = 0;
+
+  while (value < numConcurrentValues) {
+    if (value % 3 == 0) {
+      pArgs->pRing->push(value++);
+    } else {
+      for (int i=0; i<7; i++) block[i] = value++;
+      pArgs->pRing->push(block, 7);
+    }
+  }
+  epicsEventSignal(pArgs->done);
+}
+
+BOOST_AUTO_TEST_SUITE(NDRingBufferTests)
+
+BOOST_AUTO_TEST_CASE(push_copy)
+{
+  // 5 values are kept in storage of 8
+  Ring ring(5);
+  vector<double> out(10);
+
+  BOOST_CHECK_EQUAL(ring.maxSize(), (size_t)5);
+  BOOST_CHECK_EQUAL(ring.size(), (size_t)0);
+  BOOST_CHECK_EQUAL(ring.copyLatest(&out[0], out.size()), (size_t)0);
+
+  for (int i=0; i<3; i++) ring.push(i);
+  BOOST_CHECK_EQUAL(ring.size(), (size_t)3);
+  BOOST_CHECK_EQUAL(ring.last(), 2);
+  BOOST_REQUIRE_EQUAL(ring.copyLatest(&out[0], out.size()), (size_t)3);
+  for (int i=0; i<3; i++) BOOST_CHECK_EQUAL(out[i], i);
+
+  // Only the last maxSize values are kept, and the copy is in order across the wrap
+  for (int i=3; i<12; i++) ring.push(i);
+  BOOST_CHECK_EQUAL(ring.size(), (size_t)5);
+  BOOST_CHECK_EQUAL(ring.last(), 11);
+  BOOST_REQUIRE_EQUAL(ring.copyLatest(&out[0], out.size()), (size_t)5);
+  for (int i=0; i<5; i++) BOOST_CHECK_EQUAL(out[i], 7 + i);
+
+  // A smaller output gets the most recent values
+  BOOST_REQUIRE_EQUAL(ring.copyLatest(&out[0], 2), (size_t)2);
+  BOOST_CHECK_EQUAL(out[0], 10);
+  BOOST_CHECK_EQUAL(out[1], 11);
+}
+
+BOOST_AUTO_TEST_CASE(bulk_push)
+{
+  Ring ring(6);
+  vector<double> in(20), out(6);
+  for (int i=0; i<20; i++) in[i] = i;
+
+  // A block that wraps around the end of the storage
+  ring.push(&in[0], 5);
+  ring.push(&in[5], 6);
+  BOOST_CHECK_EQUAL(ring.size(), (size_t)6);
+  BOOST_CHECK_EQUAL(ring.last(), 10);
+  BOOST_REQUIRE_EQUAL(ring.copyLatest(&out[0], out.size()), (size_t)6);
+  for (int i=0; i<6; i++) BOOST_CHECK_EQUAL(out[i], 5 + i);
+
+  // A block larger than the storage only keeps its end
+  ring.push(&in[0], 20);
+  BOOST_CHECK_EQUAL(ring.last(), 19);
+  BOOST_REQUIRE_EQUAL(ring.copyLatest(&out[0], out.size()), (size_t)6);
+  for (int i=0; i<6; i++) BOOST_CHECK_EQUAL(out[i], 14 + i);
+
+  ring.push(&in[0], 0);
+  BOOST_CHECK_EQUAL(ring.last(), 19);
+}
+
+BOOST_AUTO_TEST_CASE(clear_view)
+{
+  Ring ring(4);
+  Ring::Segment segments[2];
+  vector<double> out(4);
+
+  for (int i=0; i<6; i++) ring.push(i);
+  ring.getView(4, segments);
+  BOOST_CHECK_EQUAL(segments[0].size, (size_t)2);
+  BOOST_CHECK_EQUAL(segments[1].size, (size_t)2);
+  BOOST_CHECK_EQUAL(segments[0].data[0], 2);
+  BOOST_CHECK_EQUAL(segments[1].data[1], 5);
+
+  // After a clear the history starts at the first slot, so it is one segment until it wraps
+  ring.clear();
+  BOOST_CHECK_EQUAL(ring.size(), (size_t)0);
+  BOOST_CHECK_EQUAL(ring.copyLatest(&out[0], out.size()), (size_t)0);
+  for (int i=0; i<4; i++) ring.push(10 + i);
+  unsigned token = ring.getView(4, segments);
+  BOOST_REQUIRE_EQUAL(segments[0].size, (size_t)4);
+  BOOST_CHECK_EQUAL(segments[1].size, (size_t)0);
+  for (int i=0; i<4; i++) BOOST_CHECK_EQUAL(segments[0].data[i], 10 + i);
+  BOOST_CHECK_EQUAL(ring.numOverwritten(token), (size_t)0);
+
+  // The producer overwriting the view is detected
+  ring.push(14);
+  BOOST_CHECK_EQUAL(ring.numOverwritten(token), (size_t)1);
+  ring.push(15);
+  BOOST_CHECK_EQUAL(ring.numOverwritten(token), (size_t)2);
+}
+
+BOOST_AUTO_TEST_CASE(concurrent_copy)
+{
+  // The consumer copies while another thread pushes; what it gets must be consecutive values
+  Ring ring(100);
+  vector<double> out(100);
+  ProducerArgs args;
+  int numCopies = 0;
+  bool consecutive = true;
+  double lastValue = -1;
+
+  args.pRing = &ring;
+  args.done = epicsEventMustCreate(epicsEventEmpty);
+  epicsThreadCreate("ringProducer", epicsThreadPriorityMedium,
+                    epicsThreadGetStackSize(epicsThreadStackMedium), producer, &args);
+  while (epicsEventTryWait(args.done) != epicsEventWaitOK) {
+    size_t n = ring.copyLatest(&out[0], out.size());
+    for (size_t i=1; i<n; i++) {
+      if (out[i] != out[i-1] + 1) consecutive = false;
+    }
+    if (n > 0) {
+      if (out[n-1] < lastValue) consecutive = false;
+      lastValue = out[n-1];
+    }
+    numCopies++;
+  }
+  BOOST_CHECK(consecutive);
+  BOOST_CHECK(numCopies > 0);
+  BOOST_REQUIRE_EQUAL(ring.copyLatest(&out[0], out.size()), (size_t)100);
+  BOOST_CHECK_EQUAL(out[99], numConcurrentValues - 1);
+  epicsEventDestroy(args.done);
+}
+
+BOOST_AUTO_TEST_SUITE_END()